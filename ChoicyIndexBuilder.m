@@ -0,0 +1,737 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "ChoicyIndexBuilder.h"
+#import "choicy_index.h"
+#import <sys/stat.h>
+#import <notify.h>
+#import <os/lock.h>
+#import <dlfcn.h>
+#import <ptrauth.h>
+#import <mach/mach.h>
+#import <uuid/uuid.h>
+#import <litehook.h>
+#import <MobileCoreServices/LSBundleProxy.h>
+#import <MobileCoreServices/LSPlugInKitProxy.h>
+
+@interface LSBundleProxy ()
++ (instancetype)bundleProxyForIdentifier:(NSString *)identifier;
+@property (nonatomic,readonly) NSString *bundleExecutable;
+@end
+
+extern bool _dyld_get_shared_cache_uuid(uuid_t uuid);
+extern const void *_dyld_get_shared_cache_range(size_t *length);
+
+// Upper bound for the dyld4::APIs vtable, slots beyond its end are read with vm_read_overwrite so that running past it can't crash
+#define kDyldAPIsMaxSlotCount 160
+
+static uint32_t nextPowerOfTwo(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result < value) result <<= 1;
+	return result;
+}
+
+// The Choicy dylib reads these values with xpc_dictionary_get_bool / xpc_int64_get_value, only real booleans and integers count
+static BOOL snapshotBool(id value)
+{
+	return [value isKindOfClass:[NSNumber class]] && CFGetTypeID((__bridge CFTypeRef)value) == CFBooleanGetTypeID() && ((NSNumber *)value).boolValue;
+}
+
+static int32_t snapshotInteger(id value, int32_t default_)
+{
+	if (![value isKindOfClass:[NSNumber class]] || CFGetTypeID((__bridge CFTypeRef)value) != CFNumberGetTypeID() || CFNumberIsFloatType((__bridge CFNumberRef)value)) return default_;
+	return (int32_t)((NSNumber *)value).integerValue;
+}
+
+static uint32_t processFlagsForPreferences(NSDictionary *processSettings)
+{
+	uint32_t flags = 0;
+	if (snapshotBool(processSettings[kChoicyProcessPrefsKeyTweakInjectionDisabled])) flags |= CHOICY_PROCESS_FLAG_TWEAK_INJECTION_DISABLED;
+	if (snapshotBool(processSettings[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled])) flags |= CHOICY_PROCESS_FLAG_CUSTOM_TWEAK_CONFIGURATION_ENABLED;
+	if (snapshotBool(processSettings[kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration])) flags |= CHOICY_PROCESS_FLAG_OVERWRITE_GLOBAL_TWEAK_CONFIGURATION;
+	return flags;
+}
+
+@interface ChoicyIndexTweak : NSObject
+@property (nonatomic) NSString *dylibName;
+@property (nonatomic) uint32_t flags;
+@property (nonatomic) double cfMin;
+@property (nonatomic) double cfMax;
+@property (nonatomic) NSArray<NSString *> *filterBundles;
+@property (nonatomic) NSArray<NSString *> *filterExecutables;
+@end
+
+@implementation ChoicyIndexTweak
+@end
+
+@implementation ChoicyIndexBuilder
+
++ (NSArray *)possibleInjectionLibrariesPaths
+{
+	// Same as +[CHPTweakList possibleInjectionLibrariesPaths]
+	return @[[@"/" stringByAppendingString:@"Library/MobileSubstrate/DynamicLibraries"], [@"/" stringByAppendingString:@"usr/lib/TweakInject"], @"/var/jb/Library/MobileSubstrate/DynamicLibraries", @"/var/jb/usr/lib/TweakInject"];
+}
+
++ (NSString *)injectionLibrariesPath
+{
+	for (NSString *possibleInjectionLibrariesPath in [self possibleInjectionLibrariesPaths]) {
+		if ([[NSFileManager defaultManager] fileExistsAtPath:possibleInjectionLibrariesPath]) {
+			return possibleInjectionLibrariesPath;
+		}
+	}
+	return nil;
+}
+
++ (BOOL)indexNeedsUpdate
+{
+	choicy_index_t index = {0};
+	if (choicy_index_map(kChoicyIndexPath.fileSystemRepresentation, &index) != 0) return YES;
+
+	NSString *injectionLibrariesPath = [self injectionLibrariesPath];
+	BOOL needsUpdate = !injectionLibrariesPath || strcmp(choicy_index_string(&index, index.header->tweak_dir_off), injectionLibrariesPath.fileSystemRepresentation) != 0 || !choicy_index_tweak_dir_is_current(&index);
+	if (!needsUpdate && [[NSFileManager defaultManager] fileExistsAtPath:kChoicyPrefsPlistPath]) {
+		needsUpdate = !choicy_index_prefs_are_current(&index, kChoicyPrefsPlistPath.fileSystemRepresentation);
+	}
+
+	choicy_index_unmap(&index);
+	return needsUpdate;
+}
+
++ (BOOL)updateIndexIfNeeded
+{
+	@synchronized(self) {
+		if (![self indexNeedsUpdate]) return YES;
+		return [self writeIndexToPath:kChoicyIndexPath];
+	}
+}
+
++ (BOOL)updateIndex
+{
+	@synchronized(self) {
+		return [self writeIndexToPath:kChoicyIndexPath];
+	}
+}
+
+// Builds run on a serial background queue, requests that arrive before a pending build started are merged into it
+static os_unfair_lock gScheduleLock = OS_UNFAIR_LOCK_INIT;
+static BOOL gUpdateScheduled;
+static BOOL gForcedUpdateScheduled;
+
++ (void)scheduleIndexUpdate:(BOOL)force
+{
+	static dispatch_queue_t updateQueue;
+	static dispatch_once_t onceToken;
+	dispatch_once (&onceToken, ^{
+		updateQueue = dispatch_queue_create("com.opa334.choicy.index", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+	});
+
+	os_unfair_lock_lock(&gScheduleLock);
+	gForcedUpdateScheduled |= force;
+	BOOL alreadyScheduled = gUpdateScheduled;
+	gUpdateScheduled = YES;
+	os_unfair_lock_unlock(&gScheduleLock);
+	if (alreadyScheduled) return;
+
+	dispatch_async(updateQueue, ^{
+		os_unfair_lock_lock(&gScheduleLock);
+		BOOL forced = gForcedUpdateScheduled;
+		gUpdateScheduled = NO;
+		gForcedUpdateScheduled = NO;
+		os_unfair_lock_unlock(&gScheduleLock);
+
+		// The index is replaced atomically and its generation published afterwards, so readers never see a partial one
+		if (forced) [self updateIndex];
+		else [self updateIndexIfNeeded];
+	});
+}
+
++ (void)scheduleIndexUpdateIfNeeded
+{
+	[self scheduleIndexUpdate:NO];
+}
+
++ (void)scheduleIndexUpdate
+{
+	[self scheduleIndexUpdate:YES];
+}
+
++ (NSString *)executableNameForBundleIdentifier:(NSString *)bundleIdentifier
+{
+	NSString *executableName = nil;
+	Class LSBundleProxyClass = NSClassFromString(@"LSBundleProxy");
+	if ([LSBundleProxyClass respondsToSelector:@selector(bundleProxyForIdentifier:)]) {
+		LSBundleProxy *bundleProxy = [LSBundleProxyClass bundleProxyForIdentifier:bundleIdentifier];
+		if ([bundleProxy respondsToSelector:@selector(bundleExecutable)]) {
+			executableName = bundleProxy.bundleExecutable;
+		}
+	}
+
+	if (!executableName) {
+		Class LSPlugInKitProxyClass = NSClassFromString(@"LSPlugInKitProxy");
+		if ([LSPlugInKitProxyClass respondsToSelector:@selector(pluginKitProxyForIdentifier:)]) {
+			LSPlugInKitProxy *pluginProxy = [LSPlugInKitProxyClass pluginKitProxyForIdentifier:bundleIdentifier];
+			if ([pluginProxy respondsToSelector:@selector(infoPlist)]) {
+				executableName = pluginProxy.infoPlist[@"CFBundleExecutable"];
+			}
+		}
+	}
+
+	return [executableName isKindOfClass:[NSString class]] ? executableName : nil;
+}
+
++ (void)publishGeneration:(uint64_t)generation
+{
+	static int token = NOTIFY_TOKEN_INVALID;
+	static dispatch_once_t onceToken;
+	dispatch_once (&onceToken, ^{
+		notify_register_check(CHOICY_INDEX_GENERATION_NOTIFICATION, &token);
+	});
+	if (token == NOTIFY_TOKEN_INVALID) return;
+	notify_set_state(token, generation);
+	notify_post(CHOICY_INDEX_GENERATION_NOTIFICATION);
+}
+
++ (ChoicyIndexTweak *)tweakForPlistAtPath:(NSString *)plistPath
+{
+	ChoicyIndexTweak *tweak = [ChoicyIndexTweak new];
+	tweak.dylibName = plistPath.lastPathComponent.stringByDeletingPathExtension;
+
+	NSDictionary *plist = [NSDictionary dictionaryWithContentsOfFile:plistPath];
+	NSDictionary *filter = plist[@"Filter"];
+	if (![filter isKindOfClass:[NSDictionary class]]) return tweak;
+
+	NSMutableArray *filterBundles = [NSMutableArray new];
+	NSMutableArray *filterExecutables = [NSMutableArray new];
+
+	__block uint32_t flags = 0;
+	[filter enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+		if (![value isKindOfClass:[NSArray class]]) return;
+
+		// Mirrors dylib_is_tweak in Tweak.c
+		if (((NSArray *)value).count > 0) flags |= CHOICY_TWEAK_FLAG_IS_TWEAK;
+
+		if ([key isEqualToString:@"Bundles"] || [key isEqualToString:@"Executables"]) {
+			NSMutableArray *target = [key isEqualToString:@"Bundles"] ? filterBundles : filterExecutables;
+			for (NSString *entry in value) {
+				if ([entry isKindOfClass:[NSString class]] && ![target containsObject:entry]) {
+					[target addObject:entry];
+				}
+			}
+		}
+		else if ([key isEqualToString:@"CoreFoundationVersion"]) {
+			NSArray *versions = value;
+			if (versions.count > 0 && [versions[0] isKindOfClass:[NSNumber class]]) {
+				flags |= CHOICY_TWEAK_FLAG_CF_VERSION;
+				tweak.cfMin = ((NSNumber *)versions[0]).doubleValue;
+				if (versions.count > 1 && [versions[1] isKindOfClass:[NSNumber class]]) {
+					tweak.cfMax = ((NSNumber *)versions[1]).doubleValue;
+				}
+			}
+		}
+		else if (((NSArray *)value).count > 0) {
+			// Classes or anything else we can't evaluate without loading the tweak
+			flags |= CHOICY_TWEAK_FLAG_UNKNOWN_FILTER;
+		}
+	}];
+
+	// A CoreFoundationVersion filter alone does not restrict any process
+	if ((flags & CHOICY_TWEAK_FLAG_IS_TWEAK) && !filterBundles.count && !filterExecutables.count) {
+		flags |= CHOICY_TWEAK_FLAG_UNKNOWN_FILTER;
+	}
+
+	tweak.flags = flags;
+	tweak.filterBundles = filterBundles.copy;
+	tweak.filterExecutables = filterExecutables.copy;
+	return tweak;
+}
+
++ (NSArray<ChoicyIndexTweak *> *)tweaksInDirectory:(NSString *)injectionLibrariesPath
+{
+	NSMutableArray *tweaks = [NSMutableArray new];
+	NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:injectionLibrariesPath error:nil];
+	for (NSString *filename in contents) {
+		if (![filename.pathExtension isEqualToString:@"plist"]) continue;
+		NSString *dylibPath = [injectionLibrariesPath stringByAppendingPathComponent:[filename.stringByDeletingPathExtension stringByAppendingPathExtension:@"dylib"]];
+		if (![[NSFileManager defaultManager] fileExistsAtPath:dylibPath]) continue;
+		[tweaks addObject:[self tweakForPlistAtPath:[injectionLibrariesPath stringByAppendingPathComponent:filename]]];
+	}
+	[tweaks sortUsingComparator:^NSComparisonResult(ChoicyIndexTweak *a, ChoicyIndexTweak *b) {
+		return [a.dylibName caseInsensitiveCompare:b.dylibName];
+	}];
+	return tweaks;
+}
+
+// The shared cache is the same for every process until the next reboot, so SpringBoard resolves gDyld once for all of them
++ (void)resolveDyldIntoHeader:(choicy_index_header_t *)header previousHeader:(const choicy_index_header_t *)oldHeader
+{
+	size_t sharedCacheLength = 0;
+	const void *sharedCacheBase = _dyld_get_shared_cache_range(&sharedCacheLength);
+	if (!sharedCacheBase || !_dyld_get_shared_cache_uuid(header->dsc_uuid)) return;
+
+	if (oldHeader && (oldHeader->dyld_flags & CHOICY_INDEX_DYLD_FLAG_RESOLVED) && !memcmp(oldHeader->dsc_uuid, header->dsc_uuid, sizeof(header->dsc_uuid))) {
+		header->dyld_flags = oldHeader->dyld_flags;
+		header->gdyld_offset = oldHeader->gdyld_offset;
+		header->dyld_dlopen_slot = oldHeader->dyld_dlopen_slot;
+		header->dyld_dlopen_from_slot = oldHeader->dyld_dlopen_from_slot;
+		return;
+	}
+
+	header->dyld_flags = CHOICY_INDEX_DYLD_FLAG_RESOLVED;
+
+	void **gDyld = litehook_find_dsc_symbol("/usr/lib/system/libdyld.dylib", "__ZN5dyld45gDyldE");
+	if (!gDyld || !*gDyld) return;
+	header->gdyld_offset = (uintptr_t)gDyld - (uintptr_t)sharedCacheBase;
+
+	// Validate the slots by symbolicating every entry of the vtable, same authentication as dyld_hook_routine in the tweak
+	void **dyld = *gDyld;
+	__unused uint64_t dyldPacDiversifier = ((uint64_t)dyld & ~(0xFFFFull << 48)) | (0x63FAull << 48);
+	void **dyldFuncPtrs = ptrauth_auth_data(*dyld, ptrauth_key_process_independent_data, dyldPacDiversifier);
+	if (!dyldFuncPtrs) return;
+
+	// The vtable can end right before an unmapped page, so read it page by page and stop at the first page that can't be read
+	void *slots[kDyldAPIsMaxSlotCount] = {0};
+	uint32_t slotCount = 0;
+	while (slotCount < kDyldAPIsMaxSlotCount) {
+		vm_address_t address = (vm_address_t)&dyldFuncPtrs[slotCount];
+		vm_size_t chunkSize = MIN(vm_page_size - (address & vm_page_mask), (kDyldAPIsMaxSlotCount - slotCount) * sizeof(void *));
+		vm_size_t readSize = 0;
+		if (vm_read_overwrite(mach_task_self_, address, chunkSize, (vm_address_t)&slots[slotCount], &readSize) != KERN_SUCCESS || readSize != chunkSize) break;
+		slotCount += chunkSize / sizeof(void *);
+	}
+
+	uint32_t dlopenSlot = 0, dlopenFromSlot = 0;
+	for (uint32_t i = 0; i < slotCount; i++) {
+		Dl_info info;
+		void *function = ptrauth_strip(slots[i], ptrauth_key_process_independent_code);
+		if (!function || !dladdr(function, &info) || !info.dli_sname) continue;
+		// dladdr returns the closest symbol before the address, only an exact match is the start of that function
+		if (info.dli_saddr != function) continue;
+		if (!dlopenSlot && !strncmp(info.dli_sname, "_ZN5dyld44APIs6dlopenE", strlen("_ZN5dyld44APIs6dlopenE"))) dlopenSlot = i;
+		else if (!dlopenFromSlot && !strncmp(info.dli_sname, "_ZN5dyld44APIs11dlopen_fromE", strlen("_ZN5dyld44APIs11dlopen_fromE"))) dlopenFromSlot = i;
+	}
+
+	if (dlopenSlot && dlopenFromSlot) {
+		header->dyld_dlopen_slot = dlopenSlot;
+		header->dyld_dlopen_from_slot = dlopenFromSlot;
+	}
+	else {
+		NSLog(@"[Choicy] Failed to validate dyld4::APIs slots, injected processes will use the defaults");
+	}
+}
+
++ (BOOL)readHeaderAtPath:(NSString *)path header:(choicy_index_header_t *)headerOut
+{
+	NSData *oldIndex = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+	if (oldIndex.length < sizeof(choicy_index_header_t)) return NO;
+	const choicy_index_header_t *oldHeader = oldIndex.bytes;
+	if (oldHeader->magic != CHOICY_INDEX_MAGIC) return NO;
+	*headerOut = *oldHeader;
+	return YES;
+}
+
++ (uint64_t)hashForTweaks:(NSArray<ChoicyIndexTweak *> *)tweaks
+{
+	// '/' can't be part of a dylib name, so it is safe as a separator
+	NSMutableString *names = [NSMutableString new];
+	for (ChoicyIndexTweak *tweak in tweaks) {
+		[names appendFormat:@"%@/", tweak.dylibName];
+	}
+	return choicy_hash_string(names.UTF8String);
+}
+
++ (BOOL)writeIndexToPath:(NSString *)path
+{
+	NSString *injectionLibrariesPath = [self injectionLibrariesPath];
+	if (!injectionLibrariesPath) return NO;
+
+	struct stat dirStat;
+	if (stat(injectionLibrariesPath.fileSystemRepresentation, &dirStat) != 0) return NO;
+
+	NSArray<ChoicyIndexTweak *> *tweaks = [self tweaksInDirectory:injectionLibrariesPath];
+	uint32_t tweakCount = (uint32_t)tweaks.count;
+	uint32_t bitsetWords = (uint32_t)choicy_bitset_words(tweakCount);
+
+	// Strings, offset 0 is reserved so that 0 can mark empty buckets
+	NSMutableData *strings = [NSMutableData dataWithLength:1];
+	NSMutableDictionary<NSString *, NSNumber *> *stringOffsets = [NSMutableDictionary new];
+	uint32_t (^addString)(NSString *) = ^uint32_t(NSString *string) {
+		NSNumber *existing = stringOffsets[string];
+		if (existing) return existing.unsignedIntValue;
+		uint32_t off = (uint32_t)strings.length;
+		const char *cString = string.UTF8String;
+		[strings appendBytes:cString length:strlen(cString) + 1];
+		stringOffsets[string] = @(off);
+		return off;
+	};
+
+	// Collect every filter key together with the tweaks filtering it
+	NSMutableArray<NSString *> *filterKeys = [NSMutableArray new];
+	NSMutableArray<NSNumber *> *filterKinds = [NSMutableArray new];
+	NSMutableDictionary<NSString *, NSMutableIndexSet *> *filterTweaks = [NSMutableDictionary new];
+	void (^addFilter)(NSString *, uint32_t, uint32_t) = ^(NSString *key, uint32_t kind, uint32_t tweakIdx) {
+		NSString *mapKey = [NSString stringWithFormat:@"%u:%@", kind, key];
+		NSMutableIndexSet *indexes = filterTweaks[mapKey];
+		if (!indexes) {
+			indexes = [NSMutableIndexSet new];
+			filterTweaks[mapKey] = indexes;
+			[filterKeys addObject:key];
+			[filterKinds addObject:@(kind)];
+		}
+		[indexes addIndex:tweakIdx];
+	};
+
+	choicy_index_tweak_t tweakEntries[tweakCount ?: 1];
+	memset(tweakEntries, 0, sizeof(tweakEntries));
+	for (uint32_t idx = 0; idx < tweakCount; idx++) {
+		ChoicyIndexTweak *tweak = tweaks[idx];
+		tweakEntries[idx].name_hash = choicy_hash_string(tweak.dylibName.UTF8String);
+		tweakEntries[idx].name_off = addString(tweak.dylibName);
+		tweakEntries[idx].flags = tweak.flags;
+		tweakEntries[idx].cf_min = tweak.cfMin;
+		tweakEntries[idx].cf_max = tweak.cfMax;
+		for (NSString *bundle in tweak.filterBundles) addFilter(bundle, CHOICY_FILTER_KIND_BUNDLE, idx);
+		for (NSString *executable in tweak.filterExecutables) addFilter(executable, CHOICY_FILTER_KIND_EXECUTABLE, idx);
+	}
+
+	uint32_t tweakDirOff = addString(injectionLibrariesPath);
+
+	uint32_t tweakBucketCount = tweakCount ? nextPowerOfTwo(tweakCount * 2) : 0;
+	uint32_t tweakBuckets[tweakBucketCount ?: 1];
+	memset(tweakBuckets, 0, sizeof(tweakBuckets));
+	for (uint32_t i = 0; i < tweakCount; i++) {
+		uint64_t hash = tweakEntries[i].name_hash;
+		for (uint32_t p = 0; p < tweakBucketCount; p++) {
+			uint32_t *bucket = &tweakBuckets[(hash + p) & (tweakBucketCount - 1)];
+			if (*bucket == 0) {
+				*bucket = i + 1;
+				break;
+			}
+		}
+	}
+
+	uint32_t filterCount = (uint32_t)filterKeys.count;
+	uint32_t filterBucketCount = filterCount ? nextPowerOfTwo(filterCount * 2) : 0;
+	size_t headerSize = sizeof(choicy_index_header_t);
+	size_t tweaksSize = tweakCount * sizeof(choicy_index_tweak_t);
+	size_t filtersSize = filterBucketCount * sizeof(choicy_index_filter_t);
+	size_t bitsetSize = bitsetWords * sizeof(uint64_t);
+	size_t bitsetsOff = headerSize + tweaksSize + filtersSize;
+
+	choicy_index_filter_t filterEntries[filterBucketCount ?: 1];
+	memset(filterEntries, 0, sizeof(filterEntries));
+	NSMutableData *bitsets = [NSMutableData new];
+	NSMutableData *bundleFilters = [NSMutableData new];
+
+	for (uint32_t i = 0; i < filterCount; i++) {
+		NSString *key = filterKeys[i];
+		uint32_t kind = filterKinds[i].unsignedIntValue;
+
+		uint64_t bits[bitsetWords ?: 1];
+		memset(bits, 0, sizeof(bits));
+		NSIndexSet *tweakIndexes = filterTweaks[[NSString stringWithFormat:@"%u:%@", kind, key]];
+		for (NSUInteger tweakIdx = tweakIndexes.firstIndex; tweakIdx != NSNotFound; tweakIdx = [tweakIndexes indexGreaterThanIndex:tweakIdx]) {
+			choicy_bitset_set(bits, (uint32_t)tweakIdx);
+		}
+		uint32_t bitsOff = (uint32_t)(bitsetsOff + bitsets.length);
+		[bitsets appendBytes:bits length:bitsetSize];
+
+		uint64_t hash = choicy_hash_string(key.UTF8String) ^ kind;
+		for (uint32_t p = 0; p < filterBucketCount; p++) {
+			uint32_t bucketIdx = (hash + p) & (filterBucketCount - 1);
+			if (filterEntries[bucketIdx].key_off == 0) {
+				filterEntries[bucketIdx] = (choicy_index_filter_t){ .key_hash = hash, .key_off = addString(key), .kind = kind, .bits_off = bitsOff };
+				if (kind == CHOICY_FILTER_KIND_BUNDLE) {
+					[bundleFilters appendBytes:&bucketIdx length:sizeof(bucketIdx)];
+				}
+				break;
+			}
+		}
+	}
+
+	// Preferences snapshot, stat before reading so that a concurrent write always makes the snapshot look stale
+	struct stat prefsStat;
+	NSDictionary *preferences = nil;
+	if (stat(kChoicyPrefsPlistPath.fileSystemRepresentation, &prefsStat) == 0) {
+		preferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
+	}
+
+	NSMutableArray<NSString *> *processKeys = [NSMutableArray new];
+	NSMutableArray<NSNumber *> *processKinds = [NSMutableArray new];
+	NSMutableArray<NSDictionary *> *processPreferences = [NSMutableArray new];
+	void (^addProcesses)(NSDictionary *, uint32_t) = ^(NSDictionary *settings, uint32_t kind) {
+		if (![settings isKindOfClass:[NSDictionary class]]) return;
+		[settings enumerateKeysAndObjectsUsingBlock:^(NSString *key, NSDictionary *processSettings, BOOL *stop) {
+			if (![key isKindOfClass:[NSString class]] || ![processSettings isKindOfClass:[NSDictionary class]]) return;
+			[processKeys addObject:key];
+			[processKinds addObject:@(kind)];
+			[processPreferences addObject:processSettings];
+		}];
+	};
+	addProcesses(preferences[kChoicyPrefsKeyAppSettings], CHOICY_PROCESS_KIND_APP);
+	addProcesses(preferences[kChoicyPrefsKeyDaemonSettings], CHOICY_PROCESS_KIND_DAEMON);
+
+	uint32_t processCount = (uint32_t)processKeys.count;
+	uint32_t processBucketCount = processCount ? nextPowerOfTwo(processCount * 2) : 0;
+	size_t processesOff = bitsetsOff + bitsets.length + tweakBucketCount * sizeof(uint32_t) + bundleFilters.length;
+	size_t listsOff = processesOff + processBucketCount * sizeof(choicy_index_process_t);
+
+	NSMutableData *lists = [NSMutableData new];
+	uint32_t (^addList)(NSArray *) = ^uint32_t(NSArray *array) {
+		if (![array isKindOfClass:[NSArray class]]) return 0;
+		uint32_t off = (uint32_t)(listsOff + lists.length);
+		uint32_t count = 0;
+		NSUInteger countLocation = lists.length;
+		[lists appendBytes:&count length:sizeof(count)];
+		for (NSString *string in array) {
+			if (![string isKindOfClass:[NSString class]]) continue;
+			uint32_t stringOff = addString(string);
+			[lists appendBytes:&stringOff length:sizeof(stringOff)];
+			count++;
+		}
+		[lists replaceBytesInRange:NSMakeRange(countLocation, sizeof(count)) withBytes:&count];
+		return off;
+	};
+
+	uint32_t globalDeniedOff = addList(preferences[kChoicyPrefsKeyGlobalDeniedTweaks]);
+
+	choicy_index_process_t processEntries[processBucketCount ?: 1];
+	memset(processEntries, 0, sizeof(processEntries));
+	for (uint32_t i = 0; i < processCount; i++) {
+		NSDictionary *processSettings = processPreferences[i];
+		uint32_t kind = processKinds[i].unsignedIntValue;
+
+		choicy_index_process_t entry = {
+			.key_hash = choicy_hash_string(processKeys[i].UTF8String) ^ kind,
+			.key_off = addString(processKeys[i]),
+			.kind = kind,
+			.flags = processFlagsForPreferences(processSettings),
+			.allow_deny_mode = snapshotInteger(processSettings[kChoicyProcessPrefsKeyAllowDenyMode], 1),
+			.allowed_off = addList(processSettings[kChoicyProcessPrefsKeyAllowedTweaks]),
+			.denied_off = addList(processSettings[kChoicyProcessPrefsKeyDeniedTweaks]),
+		};
+
+		for (uint32_t p = 0; p < processBucketCount; p++) {
+			uint32_t bucketIdx = (entry.key_hash + p) & (processBucketCount - 1);
+			if (processEntries[bucketIdx].key_off == 0) {
+				processEntries[bucketIdx] = entry;
+				break;
+			}
+		}
+	}
+
+	// Rules, the literal prefixes of all their patterns are compiled into one trie so that a process only has to walk its path and bundle identifier once
+	// Node 0 and 1 are the roots for executable paths and bundle identifiers, every node lists the rules whose prefix ends there
+	NSMutableData *rules = [NSMutableData new];
+	NSMutableArray<NSMutableDictionary<NSNumber *, NSNumber *> *> *matcherEdges = [NSMutableArray arrayWithObjects:[NSMutableDictionary new], [NSMutableDictionary new], nil];
+	NSMutableArray<NSMutableArray<NSNumber *> *> *matcherRules = [NSMutableArray arrayWithObjects:[NSMutableArray new], [NSMutableArray new], nil];
+	choicy_index_pattern_t (^addPattern)(id, uint32_t, uint32_t) = ^choicy_index_pattern_t(id pattern, uint32_t root, uint32_t ruleIdx) {
+		choicy_index_pattern_t entry = {0};
+		if (![pattern isKindOfClass:[NSString class]] || !((NSString *)pattern).length) return entry;
+
+		const char *cPattern = ((NSString *)pattern).UTF8String;
+		size_t prefixLength = strcspn(cPattern, "*?[\\");
+		entry.pattern_off = addString(pattern);
+		entry.prefix_length = (uint32_t)prefixLength;
+		if (!cPattern[prefixLength]) entry.kind = CHOICY_RULE_PATTERN_LITERAL;
+		else if (!strcmp(&cPattern[prefixLength], "*")) entry.kind = CHOICY_RULE_PATTERN_PREFIX;
+		else entry.kind = CHOICY_RULE_PATTERN_GLOB;
+
+		uint32_t node = root;
+		for (size_t i = 0; i < prefixLength; i++) {
+			NSNumber *character = @((uint8_t)cPattern[i]);
+			NSNumber *next = matcherEdges[node][character];
+			if (!next) {
+				next = @((uint32_t)matcherEdges.count);
+				matcherEdges[node][character] = next;
+				[matcherEdges addObject:[NSMutableDictionary new]];
+				[matcherRules addObject:[NSMutableArray new]];
+			}
+			node = next.unsignedIntValue;
+		}
+		[matcherRules[node] addObject:@(ruleIdx)];
+		return entry;
+	};
+
+	// Entries that processPreferencesForRules would skip are left out, the order of the remaining ones is the precedence
+	BOOL hasBundleRules = NO;
+	NSArray *rulesArray = preferences[kChoicyPrefsKeyRules];
+	for (NSDictionary *rule in [rulesArray isKindOfClass:[NSArray class]] ? rulesArray : @[]) {
+		if (![rule isKindOfClass:[NSDictionary class]]) continue;
+		NSDictionary *ruleSettings = rule[kChoicyRuleKeyPreferences];
+		if (![ruleSettings isKindOfClass:[NSDictionary class]]) continue;
+
+		uint32_t processTypes = 0;
+		NSArray *processTypeNames = rule[kChoicyRuleKeyProcessTypes];
+		if ([processTypeNames isKindOfClass:[NSArray class]] && processTypeNames.count) {
+			if ([processTypeNames containsObject:kChoicyRuleProcessTypeApp]) processTypes |= CHOICY_RULE_PROCESS_TYPE_APP;
+			if ([processTypeNames containsObject:kChoicyRuleProcessTypePlugin]) processTypes |= CHOICY_RULE_PROCESS_TYPE_PLUGIN;
+			if ([processTypeNames containsObject:kChoicyRuleProcessTypeDaemon]) processTypes |= CHOICY_RULE_PROCESS_TYPE_DAEMON;
+			// 0 would match any type
+			if (!processTypes) continue;
+		}
+
+		uint32_t ruleIdx = (uint32_t)(rules.length / sizeof(choicy_index_rule_t));
+		choicy_index_rule_t entry = {
+			.path = addPattern(rule[kChoicyRuleKeyExecutablePath], CHOICY_MATCHER_ROOT_PATH, ruleIdx),
+			.bundle = addPattern(rule[kChoicyRuleKeyBundleIdentifier], CHOICY_MATCHER_ROOT_BUNDLE, ruleIdx),
+			.process_types = processTypes,
+			.flags = processFlagsForPreferences(ruleSettings),
+			.allow_deny_mode = snapshotInteger(ruleSettings[kChoicyProcessPrefsKeyAllowDenyMode], 1),
+			.allowed_off = addList(ruleSettings[kChoicyProcessPrefsKeyAllowedTweaks]),
+			.denied_off = addList(ruleSettings[kChoicyProcessPrefsKeyDeniedTweaks]),
+		};
+		if (entry.bundle.pattern_off) hasBundleRules = YES;
+		[rules appendBytes:&entry length:sizeof(entry)];
+	}
+	uint32_t ruleCount = (uint32_t)(rules.length / sizeof(choicy_index_rule_t));
+
+	NSMutableData *matcherNodes = [NSMutableData new];
+	NSMutableData *matcherEdgeData = [NSMutableData new];
+	NSMutableData *matcherRuleRefs = [NSMutableData new];
+	if (ruleCount) {
+		for (NSUInteger i = 0; i < matcherEdges.count; i++) {
+			choicy_index_matcher_node_t node = {
+				.edges_first = (uint32_t)(matcherEdgeData.length / sizeof(choicy_index_matcher_edge_t)),
+				.edge_count = (uint32_t)matcherEdges[i].count,
+				.rules_first = (uint32_t)(matcherRuleRefs.length / sizeof(uint32_t)),
+				.rule_count = (uint32_t)matcherRules[i].count,
+			};
+			[matcherNodes appendBytes:&node length:sizeof(node)];
+
+			for (NSNumber *character in [matcherEdges[i].allKeys sortedArrayUsingSelector:@selector(compare:)]) {
+				choicy_index_matcher_edge_t edge = { .character = character.unsignedCharValue, .node = matcherEdges[i][character].unsignedIntValue };
+				[matcherEdgeData appendBytes:&edge length:sizeof(edge)];
+			}
+			for (NSNumber *ruleIdx in matcherRules[i]) {
+				uint32_t ref = ruleIdx.unsignedIntValue;
+				[matcherRuleRefs appendBytes:&ref length:sizeof(ref)];
+			}
+		}
+	}
+
+	// Bloom filter over the executable names of all configured processes, apps and plugins are configured by bundle identifier so resolve them
+	// Bundles whose executable name can't be resolved go in by bundle identifier instead
+	BOOL bloomHasBundleIdentifiers = NO;
+	NSMutableSet<NSString *> *bloomKeys = [NSMutableSet new];
+	for (uint32_t i = 0; i < processCount; i++) {
+		if (processKinds[i].unsignedIntValue == CHOICY_PROCESS_KIND_DAEMON) {
+			[bloomKeys addObject:processKeys[i]];
+		}
+		else {
+			NSString *executableName = [self executableNameForBundleIdentifier:processKeys[i]];
+			if (executableName) {
+				[bloomKeys addObject:executableName];
+			}
+			else {
+				[bloomKeys addObject:processKeys[i]];
+				bloomHasBundleIdentifiers = YES;
+			}
+		}
+	}
+
+	uint32_t bloomBits = bloomKeys.count ? nextPowerOfTwo(MAX(64, (uint32_t)bloomKeys.count * 16)) : 0;
+	NSMutableData *bloom = [NSMutableData dataWithLength:choicy_bitset_words(bloomBits) * sizeof(uint64_t)];
+	for (NSString *bloomKey in bloomKeys) {
+		uint64_t hash = choicy_hash_string(bloomKey.UTF8String);
+		for (uint32_t i = 0; i < CHOICY_BLOOM_HASH_COUNT; i++) {
+			choicy_bitset_set(bloom.mutableBytes, choicy_bloom_position(hash, i, bloomBits));
+		}
+	}
+
+	choicy_index_header_t header = {0};
+	header.magic = CHOICY_INDEX_MAGIC;
+	header.version = CHOICY_INDEX_VERSION;
+	choicy_index_header_t oldHeader = {0};
+	BOOL hasOldHeader = [self readHeaderAtPath:path header:&oldHeader];
+	header.generation = hasOldHeader ? oldHeader.generation + 1 : 1;
+	// Keep the tweak generation as long as the tweak indices don't change, so encoded tweak sets survive preference changes
+	header.tweaks_hash = [self hashForTweaks:tweaks];
+	if (hasOldHeader && oldHeader.version == CHOICY_INDEX_VERSION && oldHeader.tweaks_hash == header.tweaks_hash) {
+		header.tweaks_generation = oldHeader.tweaks_generation;
+	}
+	else {
+		header.tweaks_generation = header.generation;
+	}
+	[self resolveDyldIntoHeader:&header previousHeader:(hasOldHeader && oldHeader.version == CHOICY_INDEX_VERSION) ? &oldHeader : NULL];
+	header.tweak_dir_mtime_sec = dirStat.st_mtimespec.tv_sec;
+	header.tweak_dir_mtime_nsec = dirStat.st_mtimespec.tv_nsec;
+	header.tweak_dir_off = tweakDirOff;
+	header.tweak_count = tweakCount;
+	header.bitset_words = bitsetWords;
+	header.tweaks_off = (uint32_t)headerSize;
+	header.filters_off = (uint32_t)(headerSize + tweaksSize);
+	header.filter_bucket_count = filterBucketCount;
+	header.tweak_buckets_off = (uint32_t)(bitsetsOff + bitsets.length);
+	header.tweak_bucket_count = tweakBucketCount;
+	header.bundle_filters_off = header.tweak_buckets_off + tweakBucketCount * sizeof(uint32_t);
+	header.bundle_filter_count = (uint32_t)(bundleFilters.length / sizeof(uint32_t));
+	if (preferences) {
+		header.prefs_flags = CHOICY_INDEX_PREFS_FLAG_PRESENT;
+		header.prefs_mtime_sec = prefsStat.st_mtimespec.tv_sec;
+		header.prefs_mtime_nsec = prefsStat.st_mtimespec.tv_nsec;
+		header.prefs_size = prefsStat.st_size;
+		header.prefs_ino = prefsStat.st_ino;
+		if (bloomHasBundleIdentifiers) header.prefs_flags |= CHOICY_INDEX_PREFS_FLAG_BLOOM_BUNDLE_IDENTIFIERS;
+		if (hasBundleRules) header.prefs_flags |= CHOICY_INDEX_PREFS_FLAG_BUNDLE_RULES;
+		header.shadow_sample_rate = (uint32_t)MIN(MAX(parseNumberInteger(preferences[kChoicyPrefsKeyShadowSampleRate], 0), 0), 100);
+	}
+	header.global_denied_off = globalDeniedOff;
+	header.processes_off = (uint32_t)processesOff;
+	header.process_bucket_count = processBucketCount;
+	header.lists_off = (uint32_t)listsOff;
+	header.lists_size = (uint32_t)lists.length;
+	header.process_bloom_off = (uint32_t)(listsOff + lists.length);
+	header.process_bloom_bits = bloomBits;
+	header.rules_off = (uint32_t)(header.process_bloom_off + bloom.length);
+	header.rule_count = ruleCount;
+	header.matcher_nodes_off = (uint32_t)(header.rules_off + rules.length);
+	header.matcher_node_count = (uint32_t)(matcherNodes.length / sizeof(choicy_index_matcher_node_t));
+	header.matcher_edges_off = (uint32_t)(header.matcher_nodes_off + matcherNodes.length);
+	header.matcher_edge_count = (uint32_t)(matcherEdgeData.length / sizeof(choicy_index_matcher_edge_t));
+	header.matcher_rules_off = (uint32_t)(header.matcher_edges_off + matcherEdgeData.length);
+	header.matcher_rule_ref_count = (uint32_t)(matcherRuleRefs.length / sizeof(uint32_t));
+	header.strings_off = (uint32_t)(header.matcher_rules_off + matcherRuleRefs.length);
+	header.strings_size = (uint32_t)strings.length;
+	header.size = header.strings_off + header.strings_size;
+
+	NSMutableData *indexData = [NSMutableData dataWithCapacity:header.size];
+	[indexData appendBytes:&header length:headerSize];
+	[indexData appendBytes:tweakEntries length:tweaksSize];
+	[indexData appendBytes:filterEntries length:filtersSize];
+	[indexData appendData:bitsets];
+	[indexData appendBytes:tweakBuckets length:tweakBucketCount * sizeof(uint32_t)];
+	[indexData appendData:bundleFilters];
+	[indexData appendBytes:processEntries length:processBucketCount * sizeof(choicy_index_process_t)];
+	[indexData appendData:lists];
+	[indexData appendData:bloom];
+	[indexData appendData:rules];
+	[indexData appendData:matcherNodes];
+	[indexData appendData:matcherEdgeData];
+	[indexData appendData:matcherRuleRefs];
+	[indexData appendData:strings];
+
+	// Atomic replace, processes that still have the old index mapped keep a consistent view of it
+	if (![indexData writeToFile:path atomically:YES]) return NO;
+	[self publishGeneration:header.generation];
+	return YES;
+}
+
+@end
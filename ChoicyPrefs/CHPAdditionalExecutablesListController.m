@@ -111,7 +111,7 @@
 		return;
 	}
 
-	if ([CHPMachoParser isMachoAtPath:executablePath]) {
+	if (![CHPMachoParser isMachoAtPath:executablePath]) {
 		[self showErrorMessage:localize(@"ERROR_FILE_NO_EXECUTABLE")];
 		return;
 	}
@@ -26,6 +26,9 @@
 @property(nonatomic) NSString *plistIdentifier;
 @property(nonatomic) NSSet *linkedFrameworkIdentifiers;
 
+- (instancetype)initWithSnapshotRepresentation:(NSDictionary *)representation;
+- (NSDictionary *)snapshotRepresentation;
+- (BOOL)isEqualToDaemonInfo:(CHPDaemonInfo *)info;
 - (NSString *)executableName;
 
 @end
\ No newline at end of file
@@ -22,6 +22,44 @@
 
 @implementation CHPDaemonInfo
 
+- (instancetype)initWithSnapshotRepresentation:(NSDictionary *)representation
+{
+	NSString *executablePath = representation[@"executablePath"];
+	if (![executablePath isKindOfClass:[NSString class]]) return nil;
+
+	self = [super init];
+	if (self) {
+		self.executablePath = executablePath;
+
+		NSString *plistIdentifier = representation[@"plistIdentifier"];
+		if ([plistIdentifier isKindOfClass:[NSString class]]) {
+			self.plistIdentifier = plistIdentifier;
+		}
+
+		NSArray *linkedFrameworkIdentifiers = representation[@"linkedFrameworkIdentifiers"];
+		if ([linkedFrameworkIdentifiers isKindOfClass:[NSArray class]]) {
+			self.linkedFrameworkIdentifiers = [NSSet setWithArray:linkedFrameworkIdentifiers];
+		}
+	}
+	return self;
+}
+
+- (NSDictionary *)snapshotRepresentation
+{
+	NSMutableDictionary *representation = [NSMutableDictionary new];
+	representation[@"executablePath"] = self.executablePath;
+	if (self.plistIdentifier) representation[@"plistIdentifier"] = self.plistIdentifier;
+	if (self.linkedFrameworkIdentifiers) representation[@"linkedFrameworkIdentifiers"] = self.linkedFrameworkIdentifiers.allObjects;
+	return representation;
+}
+
+- (BOOL)isEqualToDaemonInfo:(CHPDaemonInfo *)info
+{
+	return [self.executablePath isEqualToString:info.executablePath] &&
+		(self.plistIdentifier == info.plistIdentifier || [self.plistIdentifier isEqualToString:info.plistIdentifier]) &&
+		(self.linkedFrameworkIdentifiers == info.linkedFrameworkIdentifiers || [self.linkedFrameworkIdentifiers isEqualToSet:info.linkedFrameworkIdentifiers]);
+}
+
 - (NSString *)executableName
 {
     return [self.executablePath lastPathComponent];
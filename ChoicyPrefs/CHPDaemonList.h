@@ -23,8 +23,10 @@
 
 @interface CHPDaemonList : NSObject {
 	NSHashTable *_observers;
+	NSDictionary *_snapshotFingerprint;
+	BOOL _revalidated;
 }
-@property(nonatomic,readonly) BOOL loaded;
+@property(nonatomic,readonly) BOOL loaded; // Also YES while the list from the last snapshot is being revalidated
 @property(nonatomic,readonly) BOOL loading;
 @property(nonatomic,readonly) NSArray *daemonList;
 + (instancetype)sharedInstance;
@@ -21,12 +21,23 @@
 #import "CHPDaemonList.h"
 #import "CHPDaemonInfo.h"
 #import "CHPMachoParser.h"
+#import "CHPPathProbeCache.h"
+#import "../service_walker.h"
 #import "CHPTweakList.h"
 #import "../Shared.h"
 #import "../HBLogWeak.h"
 #import <libroot.h>
 
-#import <dirent.h>
+#import <sys/stat.h>
+#import <sys/sysctl.h>
+
+#define kDaemonListSnapshotVersion 1
+
+static void collect_executable_path(const char *executablePath, void *context)
+{
+	NSString *path = [NSString stringWithUTF8String:executablePath];
+	if (path) [(__bridge NSMutableArray *)context addObject:path];
+}
 
 @implementation CHPDaemonList
 
@@ -46,6 +57,7 @@
 	self = [super init];
 
 	_observers = [NSHashTable weakObjectsHashTable];
+	[self loadSnapshot];
 
 	return self;
 }
@@ -61,16 +73,105 @@
 	return NO;
 }
 
+// Everything a scan depends on, if none of it changed, the last snapshot is still accurate
+- (NSDictionary *)currentFingerprint
+{
+	NSMutableDictionary *fingerprint = [NSMutableDictionary new];
+
+	char osBuild[32] = {0};
+	size_t osBuildSize = sizeof(osBuild) - 1;
+	if (sysctlbyname("kern.osversion", osBuild, &osBuildSize, NULL, 0) == 0) {
+		fingerprint[@"osBuild"] = [NSString stringWithUTF8String:osBuild];
+	}
+
+	NSMutableArray *directories = [NSMutableArray arrayWithArray:@[@"/System/Library/LaunchDaemons", @"/System/Library/NanoLaunchDaemons", @"/Library/LaunchDaemons", @"/var/jb/Library/LaunchDaemons", @"/usr/libexec", @"/usr/bin", @"/usr/sbin"]];
+	NSString *injectionLibrariesPath = [CHPTweakList injectionLibrariesPath];
+	if (injectionLibrariesPath) [directories addObject:injectionLibrariesPath];
+
+	NSMutableDictionary *directoryMtimes = [NSMutableDictionary new];
+	for (NSString *directory in directories) {
+		struct stat st;
+		if (stat(directory.fileSystemRepresentation, &st) == 0) {
+			directoryMtimes[directory] = [NSString stringWithFormat:@"%ld.%ld", (long)st.st_mtimespec.tv_sec, (long)st.st_mtimespec.tv_nsec];
+		}
+	}
+	fingerprint[@"directoryMtimes"] = directoryMtimes;
+
+	return fingerprint;
+}
+
+- (void)loadSnapshot
+{
+	NSDictionary *snapshot = [NSDictionary dictionaryWithContentsOfFile:kChoicyDaemonListSnapshotPath];
+	if (![snapshot isKindOfClass:[NSDictionary class]] || ![snapshot[@"version"] isEqual:@(kDaemonListSnapshotVersion)]) return;
+
+	NSDictionary *fingerprint = snapshot[@"fingerprint"];
+	NSArray *daemons = snapshot[@"daemons"];
+	if (![fingerprint isKindOfClass:[NSDictionary class]] || ![daemons isKindOfClass:[NSArray class]]) return;
+
+	NSMutableArray *daemonList = [NSMutableArray arrayWithCapacity:daemons.count];
+	for (NSDictionary *representation in daemons) {
+		if (![representation isKindOfClass:[NSDictionary class]]) return;
+		CHPDaemonInfo *info = [[CHPDaemonInfo alloc] initWithSnapshotRepresentation:representation];
+		if (!info) return;
+		[daemonList addObject:info];
+	}
+
+	_snapshotFingerprint = fingerprint;
+	_daemonList = daemonList.copy;
+	_loaded = YES;
+}
+
+- (void)writeSnapshotWithFingerprint:(NSDictionary *)fingerprint
+{
+	NSMutableArray *daemons = [NSMutableArray arrayWithCapacity:_daemonList.count];
+	for (CHPDaemonInfo *info in _daemonList) {
+		[daemons addObject:[info snapshotRepresentation]];
+	}
+
+	// Binary plists store every distinct string once, which keeps the framework identifiers shared by most daemons small
+	NSDictionary *snapshot = @{ @"version" : @(kDaemonListSnapshotVersion), @"fingerprint" : fingerprint, @"daemons" : daemons };
+	NSData *snapshotData = [NSPropertyListSerialization dataWithPropertyList:snapshot format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+	[snapshotData writeToFile:kChoicyDaemonListSnapshotPath atomically:YES];
+	_snapshotFingerprint = fingerprint;
+}
+
 - (void)updateDaemonListIfNeeded
 {
 	HBLogDebugWeak(@"updateDaemonListIfNeeded");
 
-	if (_loaded || _loading) {
+	if (_revalidated || _loading) {
 		return;
 	}
 
 	_loading = YES;
 
+	// The list from the snapshot is already shown, only rescan if anything it depends on changed
+	NSDictionary *fingerprint = [self currentFingerprint];
+	if (_loaded && [_snapshotFingerprint isEqualToDictionary:fingerprint]) {
+		HBLogDebugWeak(@"updateDaemonListIfNeeded snapshot is current");
+		_revalidated = YES;
+		_loading = NO;
+		return;
+	}
+
+	NSArray *previousDaemonList = _loaded ? _daemonList : nil;
+	NSArray *daemonList = [self scanDaemonList];
+
+	_daemonList = daemonList;
+	_loading = NO;
+	_loaded = YES;
+	_revalidated = YES;
+
+	[self writeSnapshotWithFingerprint:fingerprint];
+
+	HBLogDebugWeak(@"updateDaemonListIfNeeded end");
+
+	[self sendChangesToObserversFromDaemonList:previousDaemonList toDaemonList:daemonList];
+}
+
+- (NSArray *)scanDaemonList
+{
 	NSMutableArray<NSURL*> *daemonPlists = [[[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:@"/System/Library/LaunchDaemons"] includingPropertiesForKeys:nil options:0 error:nil] mutableCopy];
 
 	[daemonPlists addObjectsFromArray:[[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:@"/System/Library/NanoLaunchDaemons"] includingPropertiesForKeys:nil options:0 error:nil]];
@@ -113,110 +214,36 @@
 		}
 	}
 
-	NSDirectoryEnumerator *systemLibraryFrameworksEnumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:@"/System/Library/Frameworks" isDirectory:YES] includingPropertiesForKeys:nil options:0 errorHandler:^(NSURL *url, NSError *error) {
-		return YES;
-	}];
-
-	NSDirectoryEnumerator *cryptexSystemLibraryFrameworksEnumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:@"/private/preboot/Cryptexes/OS/System/Library/Frameworks" isDirectory:YES] includingPropertiesForKeys:nil options:0 errorHandler:^(NSURL *url, NSError *error) {
-		return YES;
-	}];
-
-	NSDirectoryEnumerator *systemLibraryPrivateFrameworksEnumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:@"/System/Library/PrivateFrameworks" isDirectory:YES] includingPropertiesForKeys:nil options:0 errorHandler:^(NSURL *url, NSError *error) {
-		return YES;
-	}];
-
-	NSDirectoryEnumerator *cryptexSystemLibraryPrivateFrameworksEnumerator = [[NSFileManager defaultManager] enumeratorAtURL:[NSURL fileURLWithPath:@"/private/preboot/Cryptexes/OS/System/Library/PrivateFrameworks" isDirectory:YES] includingPropertiesForKeys:nil options:0 errorHandler:^(NSURL *url, NSError *error) {
-		return YES;
-	}];
-
-	NSMutableArray *XPCUrls = [NSMutableArray new];
-
-	for (NSURL *fileURL in systemLibraryFrameworksEnumerator) {
-		if ([fileURL.path hasSuffix:@".xpc"]) {
-			[XPCUrls addObject:fileURL];
-		}
-	}
-
-	for (NSURL *fileURL in cryptexSystemLibraryFrameworksEnumerator) {
-		if ([fileURL.path hasSuffix:@".xpc"]) {
-			[XPCUrls addObject:fileURL];
-		}
-	}
-
-	for (NSURL *fileURL in systemLibraryPrivateFrameworksEnumerator) {
-		if ([fileURL.path hasSuffix:@".xpc"]) {
-			[XPCUrls addObject:fileURL];
-		}
-	}
-
-	for (NSURL *fileURL in cryptexSystemLibraryPrivateFrameworksEnumerator) {
-		if ([fileURL.path hasSuffix:@".xpc"]) {
-			[XPCUrls addObject:fileURL];
-		}
+	// Any .xpc bundle below the Frameworks directories is a service, wherever it is nested
+	NSMutableArray *XPCExecutablePaths = [NSMutableArray new];
+	for (NSString *frameworksPath in @[@"/System/Library/Frameworks", @"/private/preboot/Cryptexes/OS/System/Library/Frameworks", @"/System/Library/PrivateFrameworks", @"/private/preboot/Cryptexes/OS/System/Library/PrivateFrameworks"]) {
+		service_walker_find_xpc_services(frameworksPath.fileSystemRepresentation, collect_executable_path, (__bridge void *)XPCExecutablePaths);
 	}
 
-	for (NSURL *XPCUrl in XPCUrls) {
-		NSString *XPCPath = XPCUrl.path;
-
-		NSString *XPCName = [XPCUrl.lastPathComponent stringByReplacingOccurrencesOfString:@".xpc" withString:@""];
-
-		NSString *XPCExecutablePath = [XPCPath stringByAppendingPathComponent:XPCName];
-
-		if ([[NSFileManager defaultManager] fileExistsAtPath:XPCExecutablePath]) {
-			CHPDaemonInfo *info = [[CHPDaemonInfo alloc] init];
-			info.executablePath = XPCExecutablePath;
+	for (NSString *XPCExecutablePath in XPCExecutablePaths) {
+		CHPDaemonInfo *info = [[CHPDaemonInfo alloc] init];
+		info.executablePath = XPCExecutablePath;
 
-			if (![self daemonList:daemonListM containsExecutableName:info.executableName]) {
-				[daemonListM addObject:info];
-			}
+		if (![self daemonList:daemonListM containsExecutableName:info.executableName]) {
+			[daemonListM addObject:info];
 		}
 	}
 
-	NSMutableArray *additionalPotentialDaemons = [NSMutableArray new];
-
 	// On A12 unc0ver, using contentsOfDirectoryAtURL on /usr/libexec locks the thread and leaves a kernel thread looping
 	// This causes all sorts of issues and heats the device up
 	// This has been fixed in unc0ver 4.0, but we still use the old solution because some people might not be updated to 4.0
-	// The C API is not affected by this issue, so we just use it instead
-	DIR *dir;
-    struct dirent *dp;
-    dir = opendir("/usr/libexec");
-    while ((dp=readdir(dir)) != NULL) {
-        if (!(!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")))
-        {
-            NSString *filename = [NSString stringWithCString:dp->d_name encoding:NSUTF8StringEncoding];
-            if (filename) {
-				NSURL *URL = [NSURL fileURLWithPath:[@"/usr/libexec" stringByAppendingPathComponent:filename]];
-				[additionalPotentialDaemons addObject:URL];
-			}
-        }
-    }
-    closedir(dir);
-
-	/*[additionalPotentialDaemons addObjectsFromArray:[[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:@"/usr/libexec" isDirectory:YES] 
-                    includingPropertiesForKeys:nil 
-                                       options:0 
-                                         error:nil]];*/
-	
-	[additionalPotentialDaemons addObjectsFromArray:[[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:@"/usr/bin" isDirectory:YES] 
-                    includingPropertiesForKeys:nil 
-                                       options:0 
-                                         error:nil]];
-	
-	[additionalPotentialDaemons addObjectsFromArray:[[NSFileManager defaultManager] contentsOfDirectoryAtURL:[NSURL fileURLWithPath:@"/usr/sbin" isDirectory:YES] 
-                    includingPropertiesForKeys:nil 
-                                       options:0 
-                                         error:nil]];
-	
-
-	for (NSURL *URL in additionalPotentialDaemons) {
-		if ([URL.lastPathComponent hasSuffix:@"d"]) {
-			CHPDaemonInfo *info = [[CHPDaemonInfo alloc] init];
-			info.executablePath = [URL path];
+	// The C API is not affected by this issue, so the walker uses it for all of these directories
+	NSMutableArray *additionalDaemonPaths = [NSMutableArray new];
+	for (NSString *binariesPath in @[@"/usr/libexec", @"/usr/bin", @"/usr/sbin"]) {
+		service_walker_find_binaries(binariesPath.fileSystemRepresentation, "d", collect_executable_path, (__bridge void *)additionalDaemonPaths);
+	}
 
-			if (![self daemonList:daemonListM containsExecutableName:info.executableName]) {
-				[daemonListM addObject:info];
-			}
+	for (NSString *daemonPath in additionalDaemonPaths) {
+		CHPDaemonInfo *info = [[CHPDaemonInfo alloc] init];
+		info.executablePath = daemonPath;
+
+		if (![self daemonList:daemonListM containsExecutableName:info.executableName]) {
+			[daemonListM addObject:info];
 		}
 	}
 
@@ -228,20 +255,19 @@
 
 	CHPTweakList *tweakList = [CHPTweakList sharedInstance];
 
+	// Most candidate paths don't exist and the same ones come up for many daemons, the results only live as long as this scan
+	CHPPathProbeCache *probeCache = [CHPPathProbeCache new];
+
 	for (CHPDaemonInfo *daemonInfo in [daemonListM reverseObjectEnumerator]) {
-		daemonInfo.linkedFrameworkIdentifiers = [[CHPMachoParser sharedInstance] frameworkBundleIdentifiersForMachoAtPath:daemonInfo.executablePath];
+		daemonInfo.linkedFrameworkIdentifiers = [[CHPMachoParser sharedInstance] frameworkBundleIdentifiersForMachoAtPath:daemonInfo.executablePath probeCache:probeCache];
 		if (![tweakList oneOrMoreTweaksInjectIntoExecutableAtPath:daemonInfo.executablePath]) {
 			[daemonListM removeObject:daemonInfo];
 		}
 	}
 
-	_daemonList = [daemonListM copy];
-	_loading = NO;
-	_loaded = YES;
-
-	HBLogDebugWeak(@"updateDaemonListIfNeeded end");
+	HBLogDebugWeak(@"updateDaemonListIfNeeded path probes: %@", [probeCache statisticsDescription]);
 
-	[self sendReloadToObservers];
+	return [daemonListM copy];
 }
 
 - (void)addObserver:(id<CHPDaemonListObserver>)observer
@@ -258,6 +284,42 @@
 	}
 }
 
+- (void)sendChangesToObserversFromDaemonList:(NSArray *)previousDaemonList toDaemonList:(NSArray *)daemonList
+{
+	NSMutableDictionary *previousDaemons = [NSMutableDictionary new];
+	for (CHPDaemonInfo *info in previousDaemonList) {
+		previousDaemons[info.executablePath] = info;
+	}
+
+	NSMutableArray *addedDaemons = [NSMutableArray new];
+	NSMutableArray *updatedDaemons = [NSMutableArray new];
+	for (CHPDaemonInfo *info in daemonList) {
+		CHPDaemonInfo *previousInfo = previousDaemons[info.executablePath];
+		if (!previousInfo) {
+			[addedDaemons addObject:info];
+		}
+		else {
+			if (![previousInfo isEqualToDaemonInfo:info]) [updatedDaemons addObject:info];
+			[previousDaemons removeObjectForKey:info.executablePath];
+		}
+	}
+	NSArray *removedDaemons = previousDaemons.allValues;
+
+	// Nothing to tell if the rescan confirmed what was already shown, unless this is the first list at all
+	if (previousDaemonList && !addedDaemons.count && !removedDaemons.count && !updatedDaemons.count) return;
+
+	for (id<CHPDaemonListObserver> observer in _observers) {
+		dispatch_async(dispatch_get_main_queue(), ^ {
+			if ([(NSObject *)observer respondsToSelector:@selector(daemonList:didAddDaemons:removeDaemons:updateDaemons:)]) {
+				[observer daemonList:self didAddDaemons:addedDaemons removeDaemons:removedDaemons updateDaemons:updatedDaemons];
+			}
+			else {
+				[observer daemonListDidUpdate:self];
+			}
+		});
+	}
+}
+
 - (void)sendReloadToObservers
 {
 	for (id<CHPDaemonListObserver> observer in _observers){
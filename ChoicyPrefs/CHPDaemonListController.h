@@ -22,9 +22,15 @@
 
 #import "CHPDaemonListObserver.h"
 
+@class CHPSearchIndex, CHPDaemonInfo;
+
 @interface CHPDaemonListController : CHPListController <CHPDaemonListObserver> {
 	NSSet *_suggestedDaemons;
 	BOOL _showsAllDaemons;
+	CHPSearchIndex *_searchIndex;
+	NSMutableDictionary<NSString *, PSSpecifier *> *_daemonSpecifiers;
+	NSArray<CHPDaemonInfo *> *_pendingDaemonInfos;
+	NSUInteger _specifiersGeneration;
 }
 - (void)updateSuggestedDaemons;
 @end
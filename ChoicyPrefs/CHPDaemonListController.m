@@ -25,6 +25,7 @@
 
 #import "CHPDaemonInfo.h"
 #import "CHPDaemonList.h"
+#import "CHPSearchIndex.h"
 #import "CHPProcessConfigurationListController.h"
 #import "CHPApplicationListSubcontrollerController.h"
 
@@ -32,6 +33,8 @@
 - (id)controllerForSpecifier:(PSSpecifier *)specifier;
 @end
 
+#define kDaemonSpecifierBatchSize 64
+
 @implementation CHPDaemonListController
 
 - (void)viewDidLoad
@@ -39,12 +42,11 @@
 	[self applySearchControllerHideWhileScrolling:NO];
 	[[CHPDaemonList sharedInstance] addObserver:self];
 
-	if (![CHPDaemonList sharedInstance].loaded) {
-		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^ {
-			[[CHPDaemonList sharedInstance] updateDaemonListIfNeeded];
-		});
-	}
-	else {
+	// Also revalidates a list that was loaded from the last snapshot, observers only hear back if it changed
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^ {
+		[[CHPDaemonList sharedInstance] updateDaemonListIfNeeded];
+	});
+	if ([CHPDaemonList sharedInstance].loaded) {
 		[self updateSuggestedDaemons];
 	}
 
@@ -108,26 +110,70 @@
 			[daemonsGroup setProperty:localize(@"DAEMON_LIST_BOTTOM_NOTICE") forKey:@"footerText"];
 			[_specifiers addObject:daemonsGroup];
 
-			NSArray<CHPDaemonInfo*> *daemonList = [CHPDaemonList sharedInstance].daemonList;
+			if (!_searchIndex) {
+				_searchIndex = [[CHPSearchIndex alloc] initWithObjects:[CHPDaemonList sharedInstance].daemonList nameBlock:^NSString *(CHPDaemonInfo *info) {
+					return info.executableName;
+				}];
+			}
+			if (!_daemonSpecifiers) {
+				_daemonSpecifiers = [NSMutableDictionary new];
+			}
 
-			for (CHPDaemonInfo *info in daemonList) {
+			NSMutableArray<CHPDaemonInfo *> *daemonInfos = [NSMutableArray new];
+			for (CHPDaemonInfo *info in [_searchIndex objectsMatchingQuery:_searchKey]) {
 				if (_showsAllDaemons || [_suggestedDaemons containsObject:[info executableName]]) {
-					if (_searchKey && ![_searchKey isEqualToString:@""]) {
-						if (![[info executableName] localizedStandardContainsString:_searchKey]) {
-							continue;
-						}
-					}
-					
-					PSSpecifier *specifier = [CHPListController createSpecifierForExecutable:info.executablePath named:info.executableName];
-					[_specifiers addObject:specifier];
+					[daemonInfos addObject:info];
 				}
 			}
+
+			// Only materialize what fits on the first screens, the rest gets appended in batches afterwards
+			_specifiersGeneration++;
+			NSUInteger firstBatchCount = MIN(daemonInfos.count, kDaemonSpecifierBatchSize);
+			[_specifiers addObjectsFromArray:[self specifiersForDaemonInfos:[daemonInfos subarrayWithRange:NSMakeRange(0, firstBatchCount)]]];
+			_pendingDaemonInfos = [daemonInfos subarrayWithRange:NSMakeRange(firstBatchCount, daemonInfos.count - firstBatchCount)];
+			if (_pendingDaemonInfos.count) {
+				[self scheduleAppendingPendingSpecifiers];
+			}
 		}
 	}
 
 	return _specifiers;
 }
 
+- (NSArray<PSSpecifier *> *)specifiersForDaemonInfos:(NSArray<CHPDaemonInfo *> *)daemonInfos
+{
+	NSMutableArray *specifiers = [NSMutableArray arrayWithCapacity:daemonInfos.count];
+	for (CHPDaemonInfo *info in daemonInfos) {
+		// Specifiers are kept across searches so that nothing about them needs to be resolved twice
+		PSSpecifier *specifier = _daemonSpecifiers[info.executablePath];
+		if (!specifier) {
+			specifier = [CHPListController createSpecifierForExecutable:info.executablePath named:info.executableName];
+			_daemonSpecifiers[info.executablePath] = specifier;
+		}
+		[specifiers addObject:specifier];
+	}
+	[CHPListController prefetchBundleIdentifiersOfSpecifiers:specifiers];
+	return specifiers;
+}
+
+- (void)scheduleAppendingPendingSpecifiers
+{
+	NSUInteger generation = _specifiersGeneration;
+	dispatch_async(dispatch_get_main_queue(), ^ {
+		// Specifiers were reloaded in the meantime
+		if (generation != _specifiersGeneration || !_pendingDaemonInfos.count) return;
+
+		NSUInteger batchCount = MIN(_pendingDaemonInfos.count, kDaemonSpecifierBatchSize * 4);
+		NSArray *batch = [self specifiersForDaemonInfos:[_pendingDaemonInfos subarrayWithRange:NSMakeRange(0, batchCount)]];
+		_pendingDaemonInfos = [_pendingDaemonInfos subarrayWithRange:NSMakeRange(batchCount, _pendingDaemonInfos.count - batchCount)];
+		[self addSpecifiersFromArray:batch animated:NO];
+
+		if (_pendingDaemonInfos.count) {
+			[self scheduleAppendingPendingSpecifiers];
+		}
+	});
+}
+
 - (id)previewStringForSpecifier:(PSSpecifier *)specifier
 {
 	return [CHPListController previewStringForSpecifier:specifier];
@@ -164,6 +210,8 @@
 
 - (void)daemonListDidUpdate:(CHPDaemonList *)list
 {
+	_searchIndex = nil;
+	_daemonSpecifiers = nil;
 	[self updateSuggestedDaemons];
 	[self reloadSpecifiers];
 }
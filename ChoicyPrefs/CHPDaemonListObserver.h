@@ -23,4 +23,7 @@
 @protocol CHPDaemonListObserver
 @required
 - (void)daemonListDidUpdate:(CHPDaemonList *)list;
+@optional
+// Sent instead of daemonListDidUpdate: if implemented, neither is sent when a rescan found nothing new
+- (void)daemonList:(CHPDaemonList *)list didAddDaemons:(NSArray *)addedDaemons removeDaemons:(NSArray *)removedDaemons updateDaemons:(NSArray *)updatedDaemons;
 @end
\ No newline at end of file
@@ -21,6 +21,7 @@
 #import "CHPGlobalTweakConfigurationController.h"
 #import "CHPTweakList.h"
 #import "CHPTweakInfo.h"
+#import "CHPLoadingOrder.h"
 #import "CHPRootListController.h"
 #import "CHPPackageInfo.h"
 #import "../Shared.h"
@@ -61,6 +62,7 @@
 		CHPTweakList *sharedTweakList = [CHPTweakList sharedInstance];
 
 		__block BOOL atLeastOneTweakDisabled = NO;
+		NSArray *dylibsBeforeChoicy = [CHPLoadingOrder sharedInstance].dylibsBeforeChoicy;
 
 		[sharedTweakList.tweakList enumerateObjectsUsingBlock:^(CHPTweakInfo *tweakInfo, NSUInteger idx, BOOL *stop) {
 			if ([sharedTweakList isTweakHiddenForAnyProcess:tweakInfo]) return;
@@ -138,7 +140,7 @@
 {
 	NSString *key = [specifier propertyForKey:@"key"];
 
-	if ([dylibsBeforeChoicy containsObject:key]) {
+	if ([[CHPLoadingOrder sharedInstance].dylibsBeforeChoicy containsObject:key]) {
 		return @1;
 	}
 
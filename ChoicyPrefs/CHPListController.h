@@ -30,6 +30,8 @@
 + (NSString *)previewStringForProcessPreferences:(NSDictionary *)processPreferences;
 + (NSString *)previewStringForSpecifier:(PSSpecifier *)specifier;
 + (PSSpecifier *)createSpecifierForExecutable:(NSString *)executablePath named:(NSString *)name;
++ (void)resolveBundleIdentifierOfSpecifier:(PSSpecifier *)specifier;
++ (void)prefetchBundleIdentifiersOfSpecifiers:(NSArray<PSSpecifier *> *)specifiers;
 - (void)applySearchControllerHideWhileScrolling:(BOOL)hideWhileScrolling;
 - (NSString *)topTitle;
 - (NSString *)plistName;
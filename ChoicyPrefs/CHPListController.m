@@ -62,6 +62,9 @@
 
 + (NSString *)previewStringForSpecifier:(PSSpecifier *)specifier
 {
+	// Only called for rows that are about to be shown, so this is where bundle identifiers get resolved if the prefetch hasn't gotten to them yet
+	[self resolveBundleIdentifierOfSpecifier:specifier];
+
 	NSString *appIdentifier = [specifier propertyForKey:@"applicationIdentifier"];
 	NSString *pluginIdentifier = [specifier propertyForKey:@"pluginIdentifier"];
 	NSString *executablePath = [specifier propertyForKey:@"executablePath"];
@@ -80,6 +83,68 @@
 	}
 }
 
++ (dispatch_queue_t)bundleIdentifierQueue
+{
+	static dispatch_queue_t bundleIdentifierQueue;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^ {
+		bundleIdentifierQueue = dispatch_queue_create("com.opa334.choicyprefs.bundleidentifiers", DISPATCH_QUEUE_SERIAL);
+	});
+	return bundleIdentifierQueue;
+}
+
+// Bundle path -> bundle identifier, only accessed on bundleIdentifierQueue
++ (NSMutableDictionary *)bundleIdentifierCache
+{
+	static NSMutableDictionary *bundleIdentifierCache;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^ {
+		bundleIdentifierCache = [NSMutableDictionary new];
+	});
+	return bundleIdentifierCache;
+}
+
++ (NSString *)bundleIdentifierForBundleAtPath:(NSString *)bundlePath
+{
+	__block NSString *bundleIdentifier;
+	dispatch_sync([self bundleIdentifierQueue], ^ {
+		id cached = [self bundleIdentifierCache][bundlePath];
+		if (!cached) {
+			NSDictionary *bundleInfo = [NSDictionary dictionaryWithContentsOfFile:[bundlePath stringByAppendingPathComponent:@"Info.plist"]];
+			cached = bundleInfo[@"CFBundleIdentifier"] ?: [NSNull null];
+			[self bundleIdentifierCache][bundlePath] = cached;
+		}
+		bundleIdentifier = [cached isKindOfClass:[NSString class]] ? cached : nil;
+	});
+	return bundleIdentifier;
+}
+
++ (void)resolveBundleIdentifierOfSpecifier:(PSSpecifier *)specifier
+{
+	NSString *bundlePath = [specifier propertyForKey:@"bundlePath"];
+	if (!bundlePath) return;
+
+	NSString *bundleIdentifier = [self bundleIdentifierForBundleAtPath:bundlePath];
+	[specifier setProperty:bundleIdentifier forKey:[bundlePath.pathExtension isEqualToString:@"app"] ? @"applicationIdentifier" : @"pluginIdentifier"];
+	[specifier removePropertyForKey:@"bundlePath"];
+}
+
++ (void)prefetchBundleIdentifiersOfSpecifiers:(NSArray<PSSpecifier *> *)specifiers
+{
+	NSMutableArray *bundlePaths = [NSMutableArray new];
+	for (PSSpecifier *specifier in specifiers) {
+		NSString *bundlePath = [specifier propertyForKey:@"bundlePath"];
+		if (bundlePath) [bundlePaths addObject:bundlePath];
+	}
+	if (!bundlePaths.count) return;
+
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^ {
+		for (NSString *bundlePath in bundlePaths) {
+			[self bundleIdentifierForBundleAtPath:bundlePath];
+		}
+	});
+}
+
 + (PSSpecifier *)createSpecifierForExecutable:(NSString *)executablePath named:(NSString *)name
 {
 	PSSpecifier *specifier = [PSSpecifier preferenceSpecifierNamed:name
@@ -90,17 +155,10 @@
 		cell:PSLinkListCell
 		edit:nil];
 
-	if ([executablePath.stringByDeletingLastPathComponent.pathExtension isEqualToString:@"app"]) {
-		NSString *appDirectory = executablePath.stringByDeletingLastPathComponent;
-		NSDictionary *appInfo = [NSDictionary dictionaryWithContentsOfFile:[appDirectory stringByAppendingPathComponent:@"Info.plist"]];
-		NSString *appIdentifier = appInfo[@"CFBundleIdentifier"];
-		[specifier setProperty:appIdentifier forKey:@"applicationIdentifier"];
-	}
-	else if ([executablePath.stringByDeletingLastPathComponent.pathExtension isEqualToString:@"appex"]) {
-		NSString *pluginDirectory = executablePath.stringByDeletingLastPathComponent;
-		NSDictionary *pluginInfo = [NSDictionary dictionaryWithContentsOfFile:[pluginDirectory stringByAppendingPathComponent:@"Info.plist"]];
-		NSString *pluginIdentifier = pluginInfo[@"CFBundleIdentifier"];
-		[specifier setProperty:pluginIdentifier forKey:@"pluginIdentifier"];
+	// The bundle identifier of apps and plugins is resolved lazily, see resolveBundleIdentifierOfSpecifier:
+	NSString *executableDirectory = executablePath.stringByDeletingLastPathComponent;
+	if ([executableDirectory.pathExtension isEqualToString:@"app"] || [executableDirectory.pathExtension isEqualToString:@"appex"]) {
+		[specifier setProperty:executableDirectory forKey:@"bundlePath"];
 	}
 	else {
 		[specifier setProperty:executablePath forKey:@"executablePath"];
@@ -149,8 +207,13 @@
 
 - (void)updateSearchResultsForSearchController:(UISearchController *)searchController
 {
-	_searchKey = searchController.searchBar.text;
-	[self reloadSpecifiers];
+	NSString *searchKey = searchController.searchBar.text ?: @"";
+	if ([searchKey isEqualToString:_searchKey]) return;
+	_searchKey = searchKey;
+
+	// Only reload once the user stops typing for a moment
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(reloadSpecifiers) object:nil];
+	[self performSelector:@selector(reloadSpecifiers) withObject:nil afterDelay:0.1];
 }
 
 - (NSMutableArray *)specifiers
@@ -185,24 +248,25 @@
 	}
 }
 
+- (void)viewWillAppear:(BOOL)animated
+{
+	// Picks up changes to the file that weren't announced through ReloadPrefs
+	choicy_reloadPreferences();
+	[super viewWillAppear:animated];
+}
+
 - (void)setPreferenceValue:(id)value specifier:(PSSpecifier *)specifier
 {
-	NSMutableDictionary *mutableDict = [NSMutableDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
-	if (!mutableDict) {
-		mutableDict = [NSMutableDictionary new];
-		[ChoicyPrefsMigrator updatePreferenceVersion:mutableDict];
-	}
-	[mutableDict setObject:value forKey:[[specifier properties] objectForKey:@"key"]];
-	[mutableDict writeToFile:kChoicyPrefsPlistPath atomically:YES];
+	NSMutableDictionary *mutablePrefs = preferencesForWriting();
+	[mutablePrefs setObject:value forKey:[[specifier properties] objectForKey:@"key"]];
+	if (!storePreferences(mutablePrefs)) return;
 
 	[[self class] sendPostNotificationForSpecifier:specifier];
 }
 
 - (id)readPreferenceValue:(PSSpecifier *)specifier
 {
-	NSDictionary *dict = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
-
-	id obj = [dict objectForKey:[[specifier properties] objectForKey:@"key"]];
+	id obj = [preferences objectForKey:[[specifier properties] objectForKey:@"key"]];
 
 	if (!obj) {
 		obj = [[specifier properties] objectForKey:@"default"];
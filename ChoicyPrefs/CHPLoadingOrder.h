@@ -0,0 +1,42 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSInteger, CHPLoadingOrderModel) {
+	CHPLoadingOrderModelDirectoryOrder, // Raw readdir order of all dylibs
+	CHPLoadingOrderModelAlphabetical, // Case insensitive order of all filter plists
+};
+
+// Models the order in which the tweak loader of the current jailbreak loads dylibs
+// The result is cached until the modification date of the injection directory changes
+@interface CHPLoadingOrder : NSObject {
+	NSString *_injectionLibrariesPath;
+	struct timespec _injectionLibrariesMtime;
+	BOOL _loaded;
+}
+@property (nonatomic, readonly) NSString *loaderName; // nil if no known loader is loaded
+@property (nonatomic, readonly) CHPLoadingOrderModel model;
+@property (nonatomic, readonly) NSArray<NSString *> *dylibsInLoadingOrder;
+@property (nonatomic, readonly) NSArray<NSString *> *dylibsBeforeChoicy; // nil if Choicy loads first
++ (instancetype)sharedInstance;
++ (CHPLoadingOrderModel)modelForLoaderName:(NSString *)loaderName;
+- (void)updateIfNeeded;
+@end
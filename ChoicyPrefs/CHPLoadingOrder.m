@@ -0,0 +1,184 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "CHPLoadingOrder.h"
+#import "CHPTweakList.h"
+#import "../Shared.h"
+#import <mach-o/dyld.h>
+#import <dirent.h>
+#import <sys/stat.h>
+#import <libroot.h>
+
+@implementation CHPLoadingOrder
+
++ (instancetype)sharedInstance
+{
+	static CHPLoadingOrder *sharedInstance = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^ {
+		//Initialise instance
+		sharedInstance = [[CHPLoadingOrder alloc] init];
+	});
+	return sharedInstance;
+}
+
++ (NSString *)detectLoaderName
+{
+	// Same loaders as find_tweak_loader_mach_header in the tweak, in the same order of precedence
+	NSArray *loaderSuffixes = @[
+		@[@"/usr/lib/TweakLoader.dylib", @"ElleKit"],
+		@[@"/usr/lib/substitute-inserter.dylib", @"Substitute"],
+		@[@"/usr/lib/substitute-loader.dylib", @"Substitute"],
+		@[@"/usr/lib/TweakInject.dylib", @"libhooker"],
+		@[@"/usr/lib/substrate/SubstrateInserter.dylib", @"Substrate"],
+		@[@"/usr/lib/substrate/SubstrateLoader.dylib", @"Substrate"],
+		@[@"/Library/Frameworks/CydiaSubstrate.framework/Libraries/SubstrateLoader.dylib", @"Substrate"],
+		@[@"/usr/lib/Sonar/libsonar.dylib", @"Sonar"],
+	];
+
+	NSMutableSet *loadedImages = [NSMutableSet new];
+	for (uint32_t i = 0; i < _dyld_image_count(); i++) {
+		const char *pathC = _dyld_get_image_name(i);
+		if (pathC) [loadedImages addObject:[NSString stringWithUTF8String:pathC]];
+	}
+
+	for (NSArray *loaderSuffix in loaderSuffixes) {
+		for (NSString *path in loadedImages) {
+			if ([path hasSuffix:loaderSuffix[0]]) {
+				return loaderSuffix[1];
+			}
+		}
+	}
+
+	return nil;
+}
+
++ (CHPLoadingOrderModel)modelForLoaderName:(NSString *)loaderName
+{
+	// SubstrateLoader doesn't sort anything and instead processes the raw output of readdir
+	if ([loaderName isEqualToString:@"Substrate"]) {
+		return CHPLoadingOrderModelDirectoryOrder;
+	}
+
+	// Anything but substrate sorts the dylibs alphabetically
+	return CHPLoadingOrderModelAlphabetical;
+}
+
++ (BOOL)choicyLoaderIsInstalled
+{
+	NSString *substrateLoaderPath = JBROOT_PATH_NSSTRING(@"/usr/lib/substrate/SubstrateLoader.dylib");
+	NSDictionary *targetLoaderAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:substrateLoaderPath error:nil];
+
+	if ([[targetLoaderAttributes objectForKey:NSFileType] isEqualToString:NSFileTypeSymbolicLink]) {
+		NSString *destination = [[NSFileManager defaultManager] destinationOfSymbolicLinkAtPath:substrateLoaderPath error:nil];
+		return [destination hasPrefix:@"/usr/lib/ChoicyLoader.dylib"];
+	}
+
+	return NO;
+}
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		_loaderName = [[self class] detectLoaderName];
+		_model = [[self class] modelForLoaderName:_loaderName];
+	}
+	return self;
+}
+
+- (NSArray<NSString *> *)readDylibsInLoadingOrder
+{
+	NSMutableArray *dylibsInOrder = [NSMutableArray new];
+
+	if (_model == CHPLoadingOrderModelDirectoryOrder) {
+		DIR *dir = opendir(_injectionLibrariesPath.fileSystemRepresentation);
+		if (!dir) return @[];
+		struct dirent *dp;
+		while ((dp = readdir(dir)) != NULL) {
+			if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+			NSString *filename = [NSString stringWithCString:dp->d_name encoding:NSUTF8StringEncoding];
+			if ([filename.pathExtension isEqualToString:@"dylib"]) {
+				[dylibsInOrder addObject:[filename stringByDeletingPathExtension]];
+			}
+		}
+		closedir(dir);
+	}
+	else {
+		NSArray *contents = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_injectionLibrariesPath error:nil];
+		for (NSString *filename in contents) {
+			if ([filename.pathExtension isEqualToString:@"plist"]) {
+				[dylibsInOrder addObject:[filename stringByDeletingPathExtension]];
+			}
+		}
+		[dylibsInOrder sortUsingSelector:@selector(caseInsensitiveCompare:)];
+	}
+
+	return dylibsInOrder.copy;
+}
+
+- (void)updateIfNeeded
+{
+	@synchronized (self) {
+		if (!_injectionLibrariesPath) {
+			@try {
+				_injectionLibrariesPath = [CHPTweakList injectionLibrariesPath];
+			}
+			@catch (NSException *exception) {
+				return;
+			}
+		}
+
+		struct stat s;
+		if (stat(_injectionLibrariesPath.fileSystemRepresentation, &s) != 0) return;
+		if (_loaded && s.st_mtimespec.tv_sec == _injectionLibrariesMtime.tv_sec && s.st_mtimespec.tv_nsec == _injectionLibrariesMtime.tv_nsec) return;
+
+		_injectionLibrariesMtime = s.st_mtimespec;
+		_loaded = YES;
+		_dylibsInLoadingOrder = [self readDylibsInLoadingOrder];
+		_dylibsBeforeChoicy = nil;
+
+		NSUInteger choicyIndex = [_dylibsInLoadingOrder indexOfObject:kChoicyDylibName];
+		if (choicyIndex == NSNotFound || choicyIndex == 0) return;
+
+		// If ChoicyLoader is installed on Substrate, Choicy always loads first
+		if ([_loaderName isEqualToString:@"Substrate"] && [[self class] choicyLoaderIsInstalled]) return;
+
+		_dylibsBeforeChoicy = [_dylibsInLoadingOrder subarrayWithRange:NSMakeRange(0, choicyIndex)];
+	}
+}
+
+- (NSArray<NSString *> *)dylibsInLoadingOrder
+{
+	[self updateIfNeeded];
+	@synchronized (self) {
+		return _dylibsInLoadingOrder;
+	}
+}
+
+- (NSArray<NSString *> *)dylibsBeforeChoicy
+{
+	[self updateIfNeeded];
+	@synchronized (self) {
+		return _dylibsBeforeChoicy;
+	}
+}
+
+@end
@@ -22,10 +22,13 @@
 
 #import <DyldSharedCache.h>
 
+@class CHPPathProbeCache;
+
 @interface CHPMachoParser : NSObject
 {
 	NSMutableDictionary<NSString *, NSMutableSet *> *_bundleIdentifierCache;
 	NSMutableDictionary<NSString *, NSMutableSet *> *_dependencyPathCache;
+	NSMutableDictionary<NSString *, NSArray *> *_rpathCache;
 	DyldSharedCache *_sharedCache;
 }
 
@@ -35,4 +38,8 @@
 - (NSSet *)dependencyPathsForMachoAtPath:(NSString *)path;
 - (NSSet *)frameworkBundleIdentifiersForMachoAtPath:(NSString *)path;
 
+// Variants for a scan that owns a probe cache, without one every candidate path is checked on disk
+- (NSSet *)dependencyPathsForMachoAtPath:(NSString *)path probeCache:(CHPPathProbeCache *)probeCache;
+- (NSSet *)frameworkBundleIdentifiersForMachoAtPath:(NSString *)path probeCache:(CHPPathProbeCache *)probeCache;
+
 @end
\ No newline at end of file
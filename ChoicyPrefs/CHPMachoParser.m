@@ -19,59 +19,63 @@
 // SOFTWARE.
 
 #import "CHPMachoParser.h"
+#import "CHPPathProbeCache.h"
 
 #import <litehook.h>
 
 #import <Host.h>
-#import <Fat.h>
 #import <MachO.h>
+#import "../macho_reader.h"
 
 #import <mach-o/dyld_images.h>
 #import <mach-o/dyld.h>
 #import <version.h>
 
-MachO *choicy_fat_find_preferred_slice(Fat *fat)
+// Slice types the kernel would pick on this device, in order of preference, only determined once
+const macho_slice_policy_t *choicy_preferred_slice_policy(void)
 {
-	cpu_type_t cputype;
-	cpu_subtype_t cpusubtype;
-	if (host_get_cpu_information(&cputype, &cpusubtype) != 0) { return NULL; }
-	
-	MachO *candidateSlice = NULL;
-
-	if (cputype == CPU_TYPE_ARM64) {
-		if (!candidateSlice && cpusubtype == CPU_SUBTYPE_ARM64E) {
-			// New arm64e ABI
-			if (kCFCoreFoundationVersionNumber >= kCFCoreFoundationVersionNumber_iOS_14_0) {
-				candidateSlice = fat_find_slice(fat, cputype, CPU_SUBTYPE_ARM64E | CPU_SUBTYPE_ARM64E_ABI_V2);
-				if (!candidateSlice && kCFCoreFoundationVersionNumber < kCFCoreFoundationVersionNumber_iOS_15_0) {
-					// Old ABI slice is also allowed but only before 15.0
-					candidateSlice = fat_find_slice(fat, cputype, CPU_SUBTYPE_ARM64E);
+	static macho_slice_type_t types[4];
+	static macho_slice_policy_t policy = { types, 0 };
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		cpu_type_t cputype;
+		cpu_subtype_t cpusubtype;
+		if (host_get_cpu_information(&cputype, &cpusubtype) != 0) return;
+
+		void (^addType)(cpu_type_t, cpu_subtype_t) = ^(cpu_type_t type, cpu_subtype_t subtype) {
+			types[policy.count++] = (macho_slice_type_t){ type, subtype };
+		};
+
+		if (cputype == CPU_TYPE_ARM64) {
+			if (cpusubtype == CPU_SUBTYPE_ARM64E) {
+				// New arm64e ABI
+				if (kCFCoreFoundationVersionNumber >= kCFCoreFoundationVersionNumber_iOS_14_0) {
+					addType(cputype, CPU_SUBTYPE_ARM64E | CPU_SUBTYPE_ARM64E_ABI_V2);
+					if (kCFCoreFoundationVersionNumber < kCFCoreFoundationVersionNumber_iOS_15_0) {
+						// Old ABI slice is also allowed but only before 15.0
+						addType(cputype, CPU_SUBTYPE_ARM64E);
+					}
+				}
+				// Old arm64e ABI
+				else {
+					addType(cputype, CPU_SUBTYPE_ARM64E);
 				}
 			}
-			// Old arm64e ABI
-			else {
-				candidateSlice = fat_find_slice(fat, cputype, CPU_SUBTYPE_ARM64E);
-			}
-		}
 
-		if (!candidateSlice) {
 			if (kCFCoreFoundationVersionNumber >= kCFCoreFoundationVersionNumber_iOS_15_0) {
 				// On iOS 15+ the kernels prefers ARM64_V8 to ARM64_ALL
-				candidateSlice = fat_find_slice(fat, cputype, CPU_SUBTYPE_ARM64_V8);
-			}
-			if (!candidateSlice) {
-				candidateSlice = fat_find_slice(fat, cputype, CPU_SUBTYPE_ARM64_ALL);
+				addType(cputype, CPU_SUBTYPE_ARM64_V8);
 			}
+			addType(cputype, CPU_SUBTYPE_ARM64_ALL);
 		}
-	}
-	else if (cputype == CPU_TYPE_ARM) {
-		candidateSlice = fat_find_slice(fat, cputype, cpusubtype);
-		if (!candidateSlice && cpusubtype == CPU_SUBTYPE_ARM_V7S) {
-			candidateSlice = fat_find_slice(fat, cputype, CPU_SUBTYPE_ARM_V7);
+		else if (cputype == CPU_TYPE_ARM) {
+			addType(cputype, cpusubtype);
+			if (cpusubtype == CPU_SUBTYPE_ARM_V7S) {
+				addType(cputype, CPU_SUBTYPE_ARM_V7);
+			}
 		}
-	}
-
-	return candidateSlice;
+	});
+	return &policy;
 }
 
 @implementation CHPMachoParser
@@ -89,7 +93,7 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 
 + (BOOL)isMachoAtPath:(NSString *)path
 {
-	return NO;
+	return macho_is_macho_at_path(path.fileSystemRepresentation);
 }
 
 - (instancetype)init
@@ -98,6 +102,7 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 	if (self) {
 		_bundleIdentifierCache = [NSMutableDictionary new];
 		_dependencyPathCache = [NSMutableDictionary new];
+		_rpathCache = [NSMutableDictionary new];
 
 		task_dyld_info_data_t dyldInfo;
 		uint32_t count = TASK_DYLD_INFO_COUNT;
@@ -109,7 +114,58 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 	return self;
 }
 
-- (NSString *)resolvedDependencyPathForDependencyPath:(NSString *)dependencyPath sourceImagePath:(NSString *)sourceImagePath sourceExecutablePath:(NSString *)sourceExecutablePath
+// Dependencies and rpaths in one pass, images in the shared cache are already mapped, anything else only has its load commands read
+- (BOOL)readLoadCommandsOfMachoAtPath:(NSString *)path dependencies:(NSArray **)dependenciesOut rpaths:(NSArray **)rpathsOut
+{
+	NSMutableArray *dependencies = [NSMutableArray new];
+	NSMutableArray *rpaths = [NSMutableArray new];
+
+	MachO *macho = dsc_lookup_macho_by_path(_sharedCache, path.fileSystemRepresentation, NULL);
+	if (macho) {
+		macho_enumerate_dependencies(macho, ^(const char *imagePathC, uint32_t cmd, struct dylib* dylib, bool *stop){
+			NSString *imagePath = imagePathC ? [NSString stringWithUTF8String:imagePathC] : nil;
+			if (imagePath) [dependencies addObject:imagePath];
+		});
+		macho_enumerate_rpaths(macho, ^(const char *rpathC, bool *stop) {
+			NSString *rpath = rpathC ? [NSString stringWithUTF8String:rpathC] : nil;
+			if (rpath) [rpaths addObject:rpath];
+		});
+	}
+	else {
+		macho_info_t info;
+		if (macho_read_info(path.fileSystemRepresentation, choicy_preferred_slice_policy(), &info) != 0) return NO;
+		for (uint32_t i = 0; i < info.dylib_count; i++) {
+			NSString *imagePath = [NSString stringWithUTF8String:info.dylibs[i]];
+			if (imagePath) [dependencies addObject:imagePath];
+		}
+		for (uint32_t i = 0; i < info.rpath_count; i++) {
+			NSString *rpath = [NSString stringWithUTF8String:info.rpaths[i]];
+			if (rpath) [rpaths addObject:rpath];
+		}
+		macho_info_free(&info);
+	}
+
+	// Every image that has its dependencies resolved also gets asked for its rpaths, so remember them right away
+	_rpathCache[path] = rpaths.copy;
+
+	if (dependenciesOut) *dependenciesOut = dependencies.copy;
+	if (rpathsOut) *rpathsOut = rpaths.copy;
+	return YES;
+}
+
+- (NSArray *)rpathsForMachoAtPath:(NSString *)path
+{
+	if (!path) return nil;
+	NSString *standardizedPath = path.stringByStandardizingPath;
+	if (_rpathCache[standardizedPath]) return _rpathCache[standardizedPath];
+
+	NSArray *rpaths = nil;
+	[self readLoadCommandsOfMachoAtPath:standardizedPath dependencies:nil rpaths:&rpaths];
+	_rpathCache[standardizedPath] = rpaths ?: @[];
+	return _rpathCache[standardizedPath];
+}
+
+- (NSString *)resolvedDependencyPathForDependencyPath:(NSString *)dependencyPath sourceImagePath:(NSString *)sourceImagePath sourceExecutablePath:(NSString *)sourceExecutablePath probeCache:(CHPPathProbeCache *)probeCache
 {
 	@autoreleasepool {
 		if (!dependencyPath) return nil;
@@ -118,50 +174,34 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 
 		NSString *resolvedPath = nil;
 
+		// Only a scan that passes in a cache may reuse probe results, anyone else has to see the file system as it is now
+		BOOL (^fileExistsAtPath)(NSString *) = ^BOOL(NSString *path) {
+			if (probeCache) return [probeCache fileExistsAtPath:path];
+			return [[NSFileManager defaultManager] fileExistsAtPath:path];
+		};
+
 		NSString *(^resolveLoaderExecutablePaths)(NSString *) = ^NSString *(NSString *candidatePath) {
 			if (!candidatePath) return nil;
-			if ([[NSFileManager defaultManager] fileExistsAtPath:candidatePath]) return candidatePath;
+			if (fileExistsAtPath(candidatePath)) return candidatePath;
 			if (dsc_lookup_macho_by_path(_sharedCache, candidatePath.fileSystemRepresentation, NULL)) return candidatePath;
 			if ([candidatePath hasPrefix:@"@loader_path"] && loaderPath) {
 				NSString *loaderCandidatePath = [candidatePath stringByReplacingOccurrencesOfString:@"@loader_path" withString:loaderPath];
-				if ([[NSFileManager defaultManager] fileExistsAtPath:loaderCandidatePath]) return loaderCandidatePath;
+				if (fileExistsAtPath(loaderCandidatePath)) return loaderCandidatePath;
 			}
 			if ([candidatePath hasPrefix:@"@executable_path"] && executablePath) {
 				NSString *executableCandidatePath = [candidatePath stringByReplacingOccurrencesOfString:@"@executable_path" withString:executablePath];
-				if ([[NSFileManager defaultManager] fileExistsAtPath:executableCandidatePath]) return executableCandidatePath;
+				if (fileExistsAtPath(executableCandidatePath)) return executableCandidatePath;
 			}
 			return nil;
 		};
 
 		if ([dependencyPath hasPrefix:@"@rpath"]) {
 			NSString *(^resolveRpaths)(NSString *) = ^NSString *(NSString *binaryPath) {
-				if (!binaryPath) return nil;
-				__block NSString *rpathResolvedPath = nil;
-				Fat *fat = NULL;
-				MachO *macho = dsc_lookup_macho_by_path(_sharedCache, binaryPath.fileSystemRepresentation, NULL);
-				if (!macho) {
-					fat = fat_init_from_path(binaryPath.fileSystemRepresentation);
-					if (fat) {
-						macho = choicy_fat_find_preferred_slice(fat);
-					}
+				for (NSString *rpath in [self rpathsForMachoAtPath:binaryPath]) {
+					NSString *rpathResolvedPath = resolveLoaderExecutablePaths([dependencyPath stringByReplacingOccurrencesOfString:@"@rpath" withString:rpath]);
+					if (rpathResolvedPath) return rpathResolvedPath;
 				}
-				if (macho) {
-					macho_enumerate_rpaths(macho, ^(const char *rpathC, bool *stop) {
-						if (rpathC) {
-							NSString *rpath = [NSString stringWithUTF8String:rpathC];
-							if (rpath) {
-								rpathResolvedPath = resolveLoaderExecutablePaths([dependencyPath stringByReplacingOccurrencesOfString:@"@rpath" withString:rpath]);
-								if (rpathResolvedPath) {
-									*stop = true;
-								}
-							}
-						}
-					});
-				}
-				if (fat) {
-					fat_free(fat);
-				}
-				return rpathResolvedPath;
+				return nil;
 			};
 
 			resolvedPath = resolveRpaths(sourceImagePath);
@@ -180,7 +220,7 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 	}
 }
 
-- (NSSet *)_dependencyPathsForMachoAtPath:(NSString *)path sourceImagePath:(NSString *)sourceImagePath sourceExecutablePath:(NSString *)sourceExecutablePath
+- (NSSet *)_dependencyPathsForMachoAtPath:(NSString *)path sourceImagePath:(NSString *)sourceImagePath sourceExecutablePath:(NSString *)sourceExecutablePath probeCache:(CHPPathProbeCache *)probeCache
 {
 	NSString *standardizedPath = path.stringByStandardizingPath;
 
@@ -190,42 +230,37 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 
 	_dependencyPathCache[standardizedPath] = [NSMutableSet new];
 
-	Fat *fat = NULL;
-	MachO *macho = dsc_lookup_macho_by_path(_sharedCache, standardizedPath.fileSystemRepresentation, NULL);
-	if (!macho) {
-		fat = fat_init_from_path(standardizedPath.fileSystemRepresentation);
-		if (fat) {
-			macho = choicy_fat_find_preferred_slice(fat);
+	NSArray *dependencies = nil;
+	[self readLoadCommandsOfMachoAtPath:standardizedPath dependencies:&dependencies rpaths:nil];
+	for (NSString *dependency in dependencies) {
+		NSString *imagePath = [self resolvedDependencyPathForDependencyPath:dependency.stringByStandardizingPath sourceImagePath:sourceImagePath sourceExecutablePath:sourceExecutablePath probeCache:probeCache];
+		if (!imagePath) continue;
+		if (![_dependencyPathCache[standardizedPath] containsObject:imagePath]) {
+			[_dependencyPathCache[standardizedPath] addObject:imagePath];
+			NSSet *nestedPaths = [self _dependencyPathsForMachoAtPath:imagePath sourceImagePath:path sourceExecutablePath:sourceExecutablePath probeCache:probeCache];
+			[_dependencyPathCache[standardizedPath] unionSet:nestedPaths];
 		}
 	}
 
-	if (macho) {
-		macho_enumerate_dependencies(macho, ^(const char *imagePathC, uint32_t cmd, struct dylib* dylib, bool *stop){
-			if (!imagePathC) return;
-			NSString *imagePath = [NSString stringWithUTF8String:imagePathC].stringByStandardizingPath;
-			imagePath = [self resolvedDependencyPathForDependencyPath:imagePath sourceImagePath:sourceImagePath sourceExecutablePath:sourceExecutablePath];
-			if (!imagePath) return;
-			if (![_dependencyPathCache[standardizedPath] containsObject:imagePath]) {
-				[_dependencyPathCache[standardizedPath] addObject:imagePath];
-				NSSet *nestedPaths = [self _dependencyPathsForMachoAtPath:imagePath sourceImagePath:path sourceExecutablePath:sourceExecutablePath];
-				[_dependencyPathCache[standardizedPath] unionSet:nestedPaths];
-			}
-		});
-	}
-
-	if (fat) {
-		fat_free(fat);
-	}
-
 	return _dependencyPathCache[standardizedPath];
 }
 
 - (NSSet *)dependencyPathsForMachoAtPath:(NSString *)path
 {
-	return [self _dependencyPathsForMachoAtPath:path sourceImagePath:nil sourceExecutablePath:path];
+	return [self dependencyPathsForMachoAtPath:path probeCache:nil];
+}
+
+- (NSSet *)dependencyPathsForMachoAtPath:(NSString *)path probeCache:(CHPPathProbeCache *)probeCache
+{
+	return [self _dependencyPathsForMachoAtPath:path sourceImagePath:nil sourceExecutablePath:path probeCache:probeCache];
 }
 
 - (NSSet *)frameworkBundleIdentifiersForMachoAtPath:(NSString *)path
+{
+	return [self frameworkBundleIdentifiersForMachoAtPath:path probeCache:nil];
+}
+
+- (NSSet *)frameworkBundleIdentifiersForMachoAtPath:(NSString *)path probeCache:(CHPPathProbeCache *)probeCache
 {
 	NSString *standardizedPath = path.stringByStandardizingPath;
 
@@ -234,7 +269,7 @@ MachO *choicy_fat_find_preferred_slice(Fat *fat)
 	}
 
 	NSMutableSet *bundleIdentifiers = [NSMutableSet set];
-	NSSet *dependencyPaths = [self dependencyPathsForMachoAtPath:standardizedPath];
+	NSSet *dependencyPaths = [self dependencyPathsForMachoAtPath:standardizedPath probeCache:probeCache];
 
 	void (^processDependencyPaths)(NSString *) = ^(NSString *dependencyPath){
 		NSString *parentPath = [dependencyPath stringByDeletingLastPathComponent];
@@ -0,0 +1,38 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import <os/lock.h>
+
+// Remembers whether paths exist, including paths that don't, so that dependency resolution doesn't stat the same candidates over and over
+// A cache belongs to one scan, results are only valid for one scan generation and starting a new one drops them
+@interface CHPPathProbeCache : NSObject {
+	NSMutableDictionary<NSString *, NSNumber *> *_results;
+	os_unfair_lock _lock;
+}
+@property (nonatomic, readonly) uint64_t generation;
+@property (nonatomic, readonly) uint64_t hitCount; // Probes answered from the cache, each one saved a syscall
+@property (nonatomic, readonly) uint64_t missCount; // Probes that had to stat the path
+@property (nonatomic, readonly) uint64_t negativeEntryCount;
+- (void)beginGeneration;
+- (BOOL)fileExistsAtPath:(NSString *)path;
+- (double)hitRate;
+- (NSString *)statisticsDescription;
+@end
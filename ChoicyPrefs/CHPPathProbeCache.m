@@ -0,0 +1,128 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "CHPPathProbeCache.h"
+#import <sys/stat.h>
+
+@implementation CHPPathProbeCache
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self) {
+		_results = [NSMutableDictionary new];
+		_lock = OS_UNFAIR_LOCK_INIT;
+	}
+	return self;
+}
+
+- (void)beginGeneration
+{
+	os_unfair_lock_lock(&_lock);
+	[_results removeAllObjects];
+	_generation++;
+	_hitCount = 0;
+	_missCount = 0;
+	_negativeEntryCount = 0;
+	os_unfair_lock_unlock(&_lock);
+}
+
+- (BOOL)fileExistsAtPath:(NSString *)path
+{
+	if (!path) return NO;
+	NSString *normalizedPath = path.stringByStandardizingPath;
+
+	os_unfair_lock_lock(&_lock);
+	NSNumber *result = _results[normalizedPath];
+	if (result) _hitCount++;
+	os_unfair_lock_unlock(&_lock);
+	if (result) return result.boolValue;
+
+	// Same semantics as -[NSFileManager fileExistsAtPath:], symlinks are followed
+	struct stat st;
+	BOOL exists = stat(normalizedPath.fileSystemRepresentation, &st) == 0;
+
+	os_unfair_lock_lock(&_lock);
+	_missCount++;
+	if (!_results[normalizedPath]) {
+		_results[normalizedPath] = @(exists);
+		if (!exists) _negativeEntryCount++;
+	}
+	os_unfair_lock_unlock(&_lock);
+	return exists;
+}
+
+- (uint64_t)generation
+{
+	os_unfair_lock_lock(&_lock);
+	uint64_t generation = _generation;
+	os_unfair_lock_unlock(&_lock);
+	return generation;
+}
+
+- (uint64_t)hitCount
+{
+	os_unfair_lock_lock(&_lock);
+	uint64_t hitCount = _hitCount;
+	os_unfair_lock_unlock(&_lock);
+	return hitCount;
+}
+
+- (uint64_t)missCount
+{
+	os_unfair_lock_lock(&_lock);
+	uint64_t missCount = _missCount;
+	os_unfair_lock_unlock(&_lock);
+	return missCount;
+}
+
+- (uint64_t)negativeEntryCount
+{
+	os_unfair_lock_lock(&_lock);
+	uint64_t negativeEntryCount = _negativeEntryCount;
+	os_unfair_lock_unlock(&_lock);
+	return negativeEntryCount;
+}
+
+- (double)hitRate
+{
+	os_unfair_lock_lock(&_lock);
+	uint64_t probeCount = _hitCount + _missCount;
+	double hitRate = probeCount ? (double)_hitCount / probeCount : 0;
+	os_unfair_lock_unlock(&_lock);
+	return hitRate;
+}
+
+- (NSString *)statisticsDescription
+{
+	os_unfair_lock_lock(&_lock);
+	uint64_t hitCount = _hitCount;
+	uint64_t missCount = _missCount;
+	uint64_t entryCount = _results.count;
+	uint64_t negativeEntryCount = _negativeEntryCount;
+	uint64_t generation = _generation;
+	os_unfair_lock_unlock(&_lock);
+
+	uint64_t probeCount = hitCount + missCount;
+	return [NSString stringWithFormat:@"generation %llu: %llu probes, %llu hits (%.1f%%), %llu syscalls saved, %llu entries (%llu negative)",
+		generation, probeCount, hitCount, probeCount ? 100.0 * hitCount / probeCount : 0.0, hitCount, entryCount, negativeEntryCount];
+}
+
+@end
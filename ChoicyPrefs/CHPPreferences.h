@@ -1,5 +1,6 @@
-extern NSArray *dylibsBeforeChoicy;
 extern NSDictionary *preferences;
+extern void choicy_reloadPreferences();
 extern NSMutableDictionary *preferencesForWriting();
-extern void writePreferences(NSMutableDictionary *mutablePrefs);
+extern BOOL storePreferences(NSMutableDictionary *mutablePrefs);
+extern BOOL writePreferences(NSMutableDictionary *mutablePrefs);
 extern void presentNotLoadingFirstWarning(PSListController *plc, BOOL showDontShowAgainOption);
\ No newline at end of file
@@ -0,0 +1,97 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "CHPListController.h"
+#import "CHPPreferences.h"
+#import "../Shared.h"
+#import "../ChoicyPrefsMigrator.h"
+#import <sys/stat.h>
+
+// Process wide, immutable snapshot of the preferences that all controllers read from
+// Writes go through preferencesForWriting() / writePreferences(), which replace the snapshot instead of mutating it
+NSDictionary *preferences;
+
+static struct stat loadedPreferencesStat;
+
+static BOOL preferencesFileChanged(struct stat *stOut)
+{
+	struct stat st = {0};
+	if (stat(kChoicyPrefsPlistPath.fileSystemRepresentation, &st) != 0) {
+		memset(&st, 0, sizeof(st));
+	}
+	if (stOut) *stOut = st;
+
+	return st.st_ino != loadedPreferencesStat.st_ino ||
+		st.st_size != loadedPreferencesStat.st_size ||
+		st.st_mtimespec.tv_sec != loadedPreferencesStat.st_mtimespec.tv_sec ||
+		st.st_mtimespec.tv_nsec != loadedPreferencesStat.st_mtimespec.tv_nsec;
+}
+
+void choicy_reloadPreferences()
+{
+	struct stat st;
+	if (!preferencesFileChanged(&st)) return;
+
+	preferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
+	loadedPreferencesStat = st;
+}
+
+NSMutableDictionary *preferencesForWriting()
+{
+	// Start from what is on disk, so that changes made by someone else (e.g. choicyctl) since our last read aren't overwritten
+	choicy_reloadPreferences();
+
+	if (preferences) {
+		return preferences.mutableCopy;
+	}
+	else {
+		NSMutableDictionary *mutablePrefs = [NSMutableDictionary new];
+		[ChoicyPrefsMigrator updatePreferenceVersion:mutablePrefs];
+		return mutablePrefs;
+	}
+}
+
+BOOL storePreferences(NSMutableDictionary *mutablePrefs)
+{
+	// The old snapshot still matches the file if the write failed
+	if (![mutablePrefs writeToFile:kChoicyPrefsPlistPath atomically:YES]) {
+		NSLog(@"[Choicy] Failed to write %@", kChoicyPrefsPlistPath);
+		return NO;
+	}
+
+	// We already know the contents, so the ReloadPrefs notification caused by this write does not need to parse the file again
+	preferences = mutablePrefs.copy;
+	preferencesFileChanged(&loadedPreferencesStat);
+	return YES;
+}
+
+BOOL writePreferences(NSMutableDictionary *mutablePrefs)
+{
+	if (!storePreferences(mutablePrefs)) return NO;
+	[CHPListController sendChoicyPrefsPostNotification];
+	return YES;
+}
+
+__attribute__((constructor))
+static void init(void)
+{
+	choicy_reloadPreferences();
+	CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), NULL, (CFNotificationCallback)choicy_reloadPreferences, CFSTR("com.opa334.choicyprefs/ReloadPrefs"), NULL, CFNotificationSuspensionBehaviorDeliverImmediately);
+}
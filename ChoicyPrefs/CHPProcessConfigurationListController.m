@@ -25,6 +25,7 @@
 #import "CHPTweakList.h"
 #import "CHPTweakInfo.h"
 #import "CHPMachoParser.h"
+#import "CHPLoadingOrder.h"
 #import "CHPRootListController.h"
 #import "CHPPackageInfo.h"
 #import "CoreServices.h"
@@ -208,6 +209,7 @@
 		[_customConfigurationSpecifiers addObject:groupSpecifier];
 
 		__block BOOL atLeastOneTweakDisabled = NO;
+		NSArray *dylibsBeforeChoicy = [CHPLoadingOrder sharedInstance].dylibsBeforeChoicy;
 
 		[tweakList enumerateObjectsUsingBlock:^(CHPTweakInfo *tweakInfo, NSUInteger idx, BOOL *stop) {
 			BOOL show = [self shouldShowTweak:tweakInfo];
@@ -263,6 +265,7 @@
 - (NSMutableArray *)specifiers
 {
 	if (!_specifiers) {
+		[CHPListController resolveBundleIdentifierOfSpecifier:[self specifier]];
 		_appIdentifier = [[self specifier] propertyForKey:@"applicationIdentifier"];
 		_pluginIdentifier = [[self specifier] propertyForKey:@"pluginIdentifier"];
 		if (_appIdentifier) {
@@ -385,7 +388,7 @@
 	NSString *key = [specifier propertyForKey:@"key"];
 	NSInteger segmentValue = ((NSNumber *)[self readPreferenceValue:_segmentSpecifier]).intValue;
 
-	if ([dylibsBeforeChoicy containsObject:key]) {
+	if ([[CHPLoadingOrder sharedInstance].dylibsBeforeChoicy containsObject:key]) {
 		if (segmentValue == 1) {
 			return @1;
 		}
@@ -0,0 +1,197 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "CHPProfilesListController.h"
+#import <Preferences/PSSpecifier.h>
+#import "CHPListController.h"
+#import "CHPPreferences.h"
+#import "../Shared.h"
+#import "../ChoicyProfiles.h"
+
+@implementation CHPProfilesListController
+
+// iOS 16+
+- (UIBarButtonItem *)editBarButtonItem
+{
+	return [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemAdd target:self action:@selector(addButtonPressed)];
+}
+
+// iOS 11-15
+- (id)_editButtonBarItem
+{
+	return [[UIBarButtonItem alloc] initWithBarButtonSystemItem:UIBarButtonSystemItemAdd target:self action:@selector(addButtonPressed)];
+}
+
+- (NSMutableDictionary *)profileStore
+{
+	if (!_profileStore) {
+		_profileStore = [ChoicyProfiles profileStoreAtPath:kChoicyProfilesPlistPath];
+	}
+	return _profileStore;
+}
+
+// The store goes first, so the preferences never name a profile whose state has not been saved
+// If either write fails, the store on disk is put back and the changes to it are dropped
+- (void)writeProfileStoreAndPreferences:(NSMutableDictionary *)mutablePrefs
+{
+	NSMutableDictionary *previousProfileStore = [ChoicyProfiles profileStoreAtPath:kChoicyProfilesPlistPath];
+	if ([ChoicyProfiles writeProfileStore:_profileStore toPath:kChoicyProfilesPlistPath]) {
+		if (writePreferences(mutablePrefs)) return;
+		[ChoicyProfiles writeProfileStore:previousProfileStore toPath:kChoicyProfilesPlistPath];
+	}
+	_profileStore = nil;
+	[self showErrorMessage:localize(@"ERROR_PROFILE_NOT_SAVED")];
+}
+
+- (void)showErrorMessage:(NSString *)message
+{
+	UIAlertController *errorAlert = [UIAlertController alertControllerWithTitle:localize(@"ERROR") message:message preferredStyle:UIAlertControllerStyleAlert];
+	UIAlertAction *closeAction = [UIAlertAction actionWithTitle:localize(@"CLOSE") style:UIAlertActionStyleDefault handler:nil];
+	[errorAlert addAction:closeAction];
+
+	[self presentViewController:errorAlert animated:YES completion:nil];
+}
+
+- (void)viewWillAppear:(BOOL)animated
+{
+	choicy_reloadPreferences();
+	_profileStore = nil;
+	[self reloadSpecifiers];
+	[super viewWillAppear:animated];
+}
+
+- (void)addButtonPressed
+{
+	UIAlertController *profileAlert = [UIAlertController alertControllerWithTitle:localize(@"SAVE_PROFILE") message:localize(@"SAVE_PROFILE_MESSAGE") preferredStyle:UIAlertControllerStyleAlert];
+
+	[profileAlert addTextFieldWithConfigurationHandler:^(UITextField *textField) {
+		textField.placeholder = localize(@"NAME");
+		if (@available(iOS 13, *)) {
+			textField.textColor = [UIColor labelColor];
+		}
+		else {
+			textField.textColor = [UIColor blackColor];
+		}
+		textField.keyboardType = UIKeyboardTypeDefault;
+		textField.clearButtonMode = UITextFieldViewModeWhileEditing;
+		textField.borderStyle = UITextBorderStyleNone;
+	}];
+
+	UIAlertAction *cancelAction = [UIAlertAction actionWithTitle:localize(@"CANCEL") style:UIAlertActionStyleCancel handler:nil];
+	[profileAlert addAction:cancelAction];
+
+	UIAlertAction *saveAction = [UIAlertAction actionWithTitle:localize(@"SAVE") style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+		NSString *name = [profileAlert.textFields[0].text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+		if (!name.length) return;
+
+		NSMutableDictionary *mutablePrefs = preferencesForWriting();
+		[ChoicyProfiles saveCurrentConfigurationAsProfile:name inPreferences:mutablePrefs store:[self profileStore]];
+		[self writeProfileStoreAndPreferences:mutablePrefs];
+		[self reloadSpecifiers];
+	}];
+	[profileAlert addAction:saveAction];
+
+	[self presentViewController:profileAlert animated:YES completion:nil];
+}
+
+- (void)profileSpecifierPressed:(PSSpecifier *)specifier
+{
+	NSString *name = [specifier propertyForKey:@"profileName"];
+	if ([name isEqual:[ChoicyProfiles activeProfileInPreferences:preferences store:[self profileStore]]]) return;
+
+	// The switch is one write of the preferences and one notification, SpringBoard then only kills apps whose configuration changed
+	NSMutableDictionary *mutablePrefs = preferencesForWriting();
+	if ([ChoicyProfiles activateProfile:name inPreferences:mutablePrefs store:[self profileStore]]) {
+		[self writeProfileStoreAndPreferences:mutablePrefs];
+	}
+	[self reloadSpecifiers];
+}
+
+- (UITableViewCell *)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath
+{
+	UITableViewCell *cell = [super tableView:tableView cellForRowAtIndexPath:indexPath];
+
+	PSSpecifier *specifier = [self specifierAtIndexPath:indexPath];
+	if (specifier.cellType == PSButtonCell) {
+		NSString *activeProfile = [ChoicyProfiles activeProfileInPreferences:preferences store:[self profileStore]];
+		NSString *name = [specifier propertyForKey:@"profileName"];
+		BOOL isActive = (!name && !activeProfile) || [name isEqualToString:activeProfile];
+		cell.accessoryType = isActive ? UITableViewCellAccessoryCheckmark : UITableViewCellAccessoryNone;
+	}
+
+	return cell;
+}
+
+- (UITableViewCellEditingStyle)tableView:(UITableView *)tableView editingStyleForRowAtIndexPath:(NSIndexPath *)indexPath
+{
+	PSSpecifier *specifier = [self specifierAtIndexPath:indexPath];
+	return [specifier propertyForKey:@"profileName"] ? UITableViewCellEditingStyleDelete : UITableViewCellEditingStyleNone;
+}
+
+- (BOOL)performDeletionActionForSpecifier:(PSSpecifier *)specifier
+{
+	BOOL orig = [super performDeletionActionForSpecifier:specifier];
+
+	NSMutableDictionary *mutablePrefs = preferencesForWriting();
+	[ChoicyProfiles deleteProfile:[specifier propertyForKey:@"profileName"] inPreferences:mutablePrefs store:[self profileStore]];
+	[self writeProfileStoreAndPreferences:mutablePrefs];
+	[self reloadSpecifiers];
+
+	return orig;
+}
+
+- (PSSpecifier *)createSpecifierForProfileNamed:(NSString *)name
+{
+	PSSpecifier *specifier = [PSSpecifier preferenceSpecifierNamed:name ?: localize(@"NO_PROFILE")
+		target:self
+		set:nil
+		get:nil
+		detail:nil
+		cell:PSButtonCell
+		edit:nil];
+
+	[specifier setProperty:@1 forKey:@"enabled"];
+	[specifier setProperty:name forKey:@"profileName"];
+	specifier.buttonAction = @selector(profileSpecifierPressed:);
+
+	return specifier;
+}
+
+- (NSMutableArray *)specifiers
+{
+	if (!_specifiers) {
+		_specifiers = [NSMutableArray new];
+
+		PSSpecifier *groupSpecifier = [PSSpecifier emptyGroupSpecifier];
+		[groupSpecifier setProperty:localize(@"PROFILES_FOOTER") forKey:@"footerText"];
+		[_specifiers addObject:groupSpecifier];
+
+		[_specifiers addObject:[self createSpecifierForProfileNamed:nil]];
+		for (NSString *name in [ChoicyProfiles profileNamesInStore:[self profileStore]]) {
+			[_specifiers addObject:[self createSpecifierForProfileNamed:name]];
+		}
+	}
+
+	[(UINavigationItem *)self.navigationItem setTitle:localize(@"PROFILES")];
+
+	return _specifiers;
+}
+
+@end
@@ -24,38 +24,10 @@
 #import "CHPTweakList.h"
 #import <mach-o/dyld.h>
 #import "CHPPreferences.h"
+#import "CHPLoadingOrder.h"
 #import "../ChoicyPrefsMigrator.h"
 #import <libroot.h>
 
-NSArray *dylibsBeforeChoicy;
-
-#import <dirent.h>
-
-NSDictionary *preferences;
-
-void choicy_reloadPreferences()
-{
-	preferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
-}
-
-NSMutableDictionary *preferencesForWriting()
-{
-	if (preferences) {
-		return preferences.mutableCopy;
-	}
-	else {
-		NSMutableDictionary *mutablePrefs = [NSMutableDictionary new];
-		[ChoicyPrefsMigrator updatePreferenceVersion:mutablePrefs];
-		return mutablePrefs;
-	}
-}
-
-void writePreferences(NSMutableDictionary *mutablePrefs)
-{
-	[mutablePrefs writeToFile:kChoicyPrefsPlistPath atomically:YES];
-	[CHPListController sendChoicyPrefsPostNotification];
-}
-
 NSArray *getInjectionLibraries()
 {
 	static NSArray *injectionLibraries = nil;
@@ -91,30 +63,7 @@ NSArray *getInjectionLibraries()
 
 NSString *getInjectionPlatform()
 {
-	static NSString *injectionPlatform = nil;
-
-	if (!injectionPlatform) {
-		for (uint32_t i = 0; i < _dyld_image_count(); i++) {
-			const char *pathC = _dyld_get_image_name(i);
-			NSString *path = [NSString stringWithUTF8String:pathC];
-
-			if ([path hasSuffix:@"/usr/lib/substitute-inserter.dylib"]) {
-				injectionPlatform = @"Substitute";
-			}
-			else if ([path hasSuffix:@"/usr/lib/TweakInject.dylib"]) {
-				injectionPlatform = @"libhooker";
-			}
-			else if ([path hasSuffix:@"/usr/lib/substrate/SubstrateInserter.dylib"]) {
-				injectionPlatform = @"Substrate";
-			}
-		}
-
-		if (!injectionPlatform) {
-			injectionPlatform = localize(@"THE_INJECTION_PLATFORM");
-		}
-	}
-
-	return injectionPlatform;
+	return [CHPLoadingOrder sharedInstance].loaderName ?: localize(@"THE_INJECTION_PLATFORM");
 }
 
 @implementation CHPRootListController
@@ -255,70 +204,9 @@ void presentNotLoadingFirstWarning(PSListController *plc, BOOL showDontShowAgain
 {
 	[super viewDidLoad];
 
-	if (dylibsBeforeChoicy) {
+	if ([CHPLoadingOrder sharedInstance].dylibsBeforeChoicy) {
 		presentNotLoadingFirstWarning(self, YES);
 	}
 }
 
 @end
-
-void determineLoadingOrder()
-{
-	NSMutableArray *dylibsInOrder = [NSMutableArray new];
-	NSString *injectionLibrariesPath = [CHPTweakList injectionLibrariesPath];
-
-	BOOL isSubstrate = [getInjectionPlatform() isEqualToString:@"Substrate"];
-	if (isSubstrate) {
-		//SubstrateLoader doesn't sort anything and instead process the raw output of readdir
-		DIR *dir;
-		struct dirent *dp;
-		dir = opendir(injectionLibrariesPath.UTF8String);
-		dp=readdir(dir); //.
-		dp=readdir(dir); //..
-		while ((dp = readdir(dir)) != NULL) {
-			NSString *filename = [NSString stringWithCString:dp->d_name encoding:NSUTF8StringEncoding];
-
-			if ([filename.pathExtension isEqualToString:@"dylib"]) {
-				[dylibsInOrder addObject:[filename stringByDeletingPathExtension]];
-			}
-		}
-	}
-	else {
-		//Anything but substrate sorts the dylibs alphabetically
-		NSMutableArray *contents = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:injectionLibrariesPath error:nil] mutableCopy];
-		NSArray *plists = [contents filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF ENDSWITH %@", @"plist"]];
-		for (NSString *plist in plists) {
-			NSString *dylibName = [plist stringByDeletingPathExtension];
-			[dylibsInOrder addObject:dylibName];
-		}
-		[dylibsInOrder sortUsingSelector:@selector(caseInsensitiveCompare:)];
-	}
-
-	NSUInteger choicyIndex = [dylibsInOrder indexOfObject:kChoicyDylibName];
-
-	if (choicyIndex == NSNotFound) return;
-
-	if (choicyIndex != 0) {
-		dylibsBeforeChoicy = [dylibsInOrder subarrayWithRange:NSMakeRange(0,choicyIndex)];
-	}
-
-	if (dylibsBeforeChoicy && isSubstrate) {
-		NSDictionary *targetLoaderAttributes = [[NSFileManager defaultManager] attributesOfItemAtPath:JBROOT_PATH_NSSTRING(@"/usr/lib/substrate/SubstrateLoader.dylib") error:nil];
-
-		if ([[targetLoaderAttributes objectForKey:NSFileType] isEqualToString:NSFileTypeSymbolicLink]) {
-			NSString *destination = [[NSFileManager defaultManager] destinationOfSymbolicLinkAtPath:JBROOT_PATH_NSSTRING(@"/usr/lib/substrate/SubstrateLoader.dylib") error:nil];
-			if ([destination hasPrefix:@"/usr/lib/ChoicyLoader.dylib"]) {
-				// If ChoicyLoader is installed on Substrate, Choicy always loads first
-				dylibsBeforeChoicy = nil;
-			}
-		}
-	}
-}
-
-__attribute__((constructor))
-static void init(void)
-{
-	choicy_reloadPreferences();
-	CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), NULL, (CFNotificationCallback)choicy_reloadPreferences, CFSTR("com.opa334.choicyprefs/ReloadPrefs"), NULL, CFNotificationSuspensionBehaviorDeliverImmediately);
-	determineLoadingOrder();
-}
\ No newline at end of file
@@ -0,0 +1,35 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import <Foundation/Foundation.h>
+
+// Matches objects by name, names are normalized once when the index is created
+// Consecutive queries that extend the previous one only search through the previous results
+@interface CHPSearchIndex : NSObject {
+	NSArray *_objects;
+	NSArray<NSString *> *_normalizedNames;
+	NSString *_lastQuery;
+	NSIndexSet *_lastMatches;
+}
+@property (nonatomic,readonly) NSArray *objects;
++ (NSString *)normalizedString:(NSString *)string;
+- (instancetype)initWithObjects:(NSArray *)objects nameBlock:(NSString *(^)(id object))nameBlock;
+- (NSArray *)objectsMatchingQuery:(NSString *)query;
+@end
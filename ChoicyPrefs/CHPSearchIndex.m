@@ -0,0 +1,71 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "CHPSearchIndex.h"
+
+@implementation CHPSearchIndex
+
++ (NSString *)normalizedString:(NSString *)string
+{
+	return [string stringByFoldingWithOptions:NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch | NSWidthInsensitiveSearch locale:nil] ?: @"";
+}
+
+- (instancetype)initWithObjects:(NSArray *)objects nameBlock:(NSString *(^)(id object))nameBlock
+{
+	self = [super init];
+
+	_objects = objects.copy;
+
+	NSMutableArray *normalizedNames = [NSMutableArray arrayWithCapacity:_objects.count];
+	for (id object in _objects) {
+		[normalizedNames addObject:[[self class] normalizedString:nameBlock(object)]];
+	}
+	_normalizedNames = normalizedNames.copy;
+
+	return self;
+}
+
+- (NSArray *)objects
+{
+	return _objects;
+}
+
+- (NSArray *)objectsMatchingQuery:(NSString *)query
+{
+	NSString *normalizedQuery = [[self class] normalizedString:query];
+	if (!normalizedQuery.length) {
+		_lastQuery = nil;
+		_lastMatches = nil;
+		return _objects;
+	}
+
+	// Anything that matches the new query also matched the previous one if it is contained in it
+	NSIndexSet *candidates = (_lastQuery && [normalizedQuery containsString:_lastQuery]) ? _lastMatches : [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, _objects.count)];
+
+	NSIndexSet *matches = [candidates indexesPassingTest:^BOOL(NSUInteger idx, BOOL *stop) {
+		return [_normalizedNames[idx] containsString:normalizedQuery];
+	}];
+
+	_lastQuery = normalizedQuery;
+	_lastMatches = matches;
+	return [_objects objectsAtIndexes:matches];
+}
+
+@end
@@ -0,0 +1,167 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "CHPShadowModeListController.h"
+#import "CHPDestructiveTableCell.h"
+#import "../Shared.h"
+#import "../choicy_shadow_log.h"
+
+#define kShadowKindCount 2
+#define kMaxDisplayedMismatches 20
+
+@implementation CHPShadowModeListController
+
+- (NSString *)topTitle
+{
+	return localize(@"SHADOW_MODE");
+}
+
+- (NSString *)plistName
+{
+	return @"ShadowMode";
+}
+
+- (NSMutableArray *)specifiers
+{
+	if (!_specifiers) {
+		_specifiers = [super specifiers];
+
+		for (PSSpecifier *specifier in _specifiers) {
+			if ([[specifier propertyForKey:@"key"] isEqualToString:kChoicyPrefsKeyShadowSampleRate]) {
+				[specifier setValues:@[@0, @1, @10, @50, @100] titles:@[localize(@"OFF"), @"1 %", @"10 %", @"50 %", @"100 %"]];
+			}
+		}
+
+		[self addLogSpecifiers];
+	}
+
+	return _specifiers;
+}
+
+- (PSSpecifier *)newInfoSpecifierNamed:(NSString *)name value:(NSString *)value
+{
+	PSSpecifier *infoSpecifier = [PSSpecifier preferenceSpecifierNamed:name
+		target:self
+		set:nil
+		get:@selector(readValueOfInfoSpecifier:)
+		detail:nil
+		cell:PSTitleValueCell
+		edit:nil];
+
+	[infoSpecifier setProperty:value forKey:@"value"];
+	return infoSpecifier;
+}
+
+- (id)readValueOfInfoSpecifier:(PSSpecifier *)specifier
+{
+	return [specifier propertyForKey:@"value"];
+}
+
+- (void)addLogSpecifiers
+{
+	NSData *logData = [NSData dataWithContentsOfFile:kChoicyShadowLogPath options:NSDataReadingMappedIfSafe error:nil];
+	const choicy_shadow_record_t *records = logData.bytes;
+	NSUInteger recordCount = logData.length / sizeof(choicy_shadow_record_t);
+
+	NSUInteger sampleCounts[kShadowKindCount] = {0};
+	NSUInteger mismatchCounts[kShadowKindCount] = {0};
+	uint64_t fastNs[kShadowKindCount] = {0};
+	uint64_t referenceNs[kShadowKindCount] = {0};
+	NSMutableArray *mismatchDescriptions = [NSMutableArray new];
+
+	// Newest records are at the end
+	for (NSInteger i = recordCount - 1; i >= 0; i--) {
+		const choicy_shadow_record_t *record = &records[i];
+		if (record->magic != CHOICY_SHADOW_RECORD_MAGIC || record->kind < 1 || record->kind > kShadowKindCount) continue;
+
+		uint8_t kindIdx = record->kind - 1;
+		sampleCounts[kindIdx]++;
+		fastNs[kindIdx] += record->fast_ns;
+		referenceNs[kindIdx] += record->reference_ns;
+		if (!record->mismatch) continue;
+
+		mismatchCounts[kindIdx]++;
+		if (mismatchDescriptions.count >= kMaxDisplayedMismatches) continue;
+
+		NSString *process = [[NSString alloc] initWithBytes:record->process length:strnlen(record->process, sizeof(record->process)) encoding:NSUTF8StringEncoding] ?: @"?";
+		NSString *subject = [[NSString alloc] initWithBytes:record->subject length:strnlen(record->subject, sizeof(record->subject)) encoding:NSUTF8StringEncoding] ?: @"?";
+		if (record->kind == CHOICY_SHADOW_KIND_PREFERENCES) {
+			[mismatchDescriptions addObject:[NSString stringWithFormat:localize(@"SHADOW_MISMATCH_PREFERENCES"), process]];
+		}
+		else {
+			NSString *format = record->fast_result ? localize(@"SHADOW_MISMATCH_TWEAK_DETECTION_INDEX") : localize(@"SHADOW_MISMATCH_TWEAK_DETECTION_PLIST");
+			[mismatchDescriptions addObject:[NSString stringWithFormat:format, process, subject]];
+		}
+	}
+
+	PSSpecifier *resultsGroupSpecifier = [PSSpecifier emptyGroupSpecifier];
+	resultsGroupSpecifier.name = localize(@"RESULTS");
+	[_specifiers addObject:resultsGroupSpecifier];
+
+	NSArray *kindNames = @[localize(@"SHADOW_KIND_PREFERENCES"), localize(@"SHADOW_KIND_TWEAK_DETECTION")];
+	for (NSUInteger k = 0; k < kShadowKindCount; k++) {
+		NSString *summary = localize(@"SHADOW_NO_SAMPLES");
+		if (sampleCounts[k]) {
+			double speedup = fastNs[k] ? (double)referenceNs[k] / (double)fastNs[k] : 0;
+			summary = [NSString stringWithFormat:localize(@"SHADOW_KIND_SUMMARY"), (unsigned long)sampleCounts[k], (unsigned long)mismatchCounts[k], speedup];
+		}
+		[_specifiers addObject:[self newInfoSpecifierNamed:kindNames[k] value:summary]];
+	}
+
+	if (mismatchDescriptions.count) {
+		PSSpecifier *mismatchesGroupSpecifier = [PSSpecifier emptyGroupSpecifier];
+		mismatchesGroupSpecifier.name = localize(@"SHADOW_MISMATCHES");
+		[_specifiers addObject:mismatchesGroupSpecifier];
+
+		for (NSString *mismatchDescription in mismatchDescriptions) {
+			PSSpecifier *mismatchSpecifier = [PSSpecifier preferenceSpecifierNamed:mismatchDescription
+				target:self
+				set:nil
+				get:nil
+				detail:nil
+				cell:PSStaticTextCell
+				edit:nil];
+			[_specifiers addObject:mismatchSpecifier];
+		}
+	}
+
+	if (recordCount) {
+		[_specifiers addObject:[PSSpecifier emptyGroupSpecifier]];
+
+		PSSpecifier *clearSpecifier = [PSSpecifier preferenceSpecifierNamed:localize(@"CLEAR_SHADOW_LOG")
+			target:self
+			set:nil
+			get:nil
+			detail:nil
+			cell:PSButtonCell
+			edit:nil];
+		[clearSpecifier setProperty:[CHPDestructiveTableCell class] forKey:@"cellClass"];
+		clearSpecifier.buttonAction = @selector(clearLog);
+		[_specifiers addObject:clearSpecifier];
+	}
+}
+
+- (void)clearLog
+{
+	[[NSFileManager defaultManager] removeItemAtPath:kChoicyShadowLogPath error:nil];
+	[self reloadSpecifiers];
+}
+
+@end
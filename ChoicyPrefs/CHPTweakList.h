@@ -25,6 +25,7 @@
 
 @interface CHPTweakList : NSObject
 @property (nonatomic) NSArray *tweakList;
++ (void)setRootPath:(NSString *)rootPath;
 + (NSArray *)possibleInjectionLibrariesPaths;
 + (NSString *)injectionLibrariesPath;
 + (BOOL)isTweakLibraryPath:(NSString *)path;
@@ -39,10 +39,25 @@
 	return sharedInstance;
 }
 
+static NSString *gRootPath;
+
+// Makes all lookups relative to another root directory, used by choicyctl to operate on fixtures
++ (void)setRootPath:(NSString *)rootPath
+{
+	gRootPath = rootPath;
+}
+
 + (NSArray *)possibleInjectionLibrariesPaths
 {
 	// /Library and /usr always gets converted to rootless paths on xina, so this workaround is neccessary
-	return @[[@"/" stringByAppendingString:@"Library/MobileSubstrate/DynamicLibraries"], [@"/" stringByAppendingString:@"usr/lib/TweakInject"], @"/var/jb/Library/MobileSubstrate/DynamicLibraries", @"/var/jb/usr/lib/TweakInject"];
+	NSArray *paths = @[[@"/" stringByAppendingString:@"Library/MobileSubstrate/DynamicLibraries"], [@"/" stringByAppendingString:@"usr/lib/TweakInject"], @"/var/jb/Library/MobileSubstrate/DynamicLibraries", @"/var/jb/usr/lib/TweakInject"];
+	if (!gRootPath) return paths;
+
+	NSMutableArray *rootedPaths = [NSMutableArray new];
+	for (NSString *path in paths) {
+		[rootedPaths addObject:[gRootPath stringByAppendingPathComponent:path]];
+	}
+	return rootedPaths.copy;
 }
 
 + (NSString *)injectionLibrariesPath
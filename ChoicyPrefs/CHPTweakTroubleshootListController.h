@@ -26,6 +26,7 @@
 @interface CHPTweakTroubleshootListController : CHPListController <CHPDaemonListObserver> {
 	NSArray *_packageList;
 	CHPPackageInfo *_selectedPackageWhileWaitingOnLoad;
+	BOOL _troubleshootAllWhileWaitingOnLoad;
 	UIAlertController *_loadingAlertController;
 }
 
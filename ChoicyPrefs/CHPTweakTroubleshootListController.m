@@ -35,11 +35,9 @@
 - (void)viewDidLoad
 {
 	[[CHPDaemonList sharedInstance] addObserver:self];
-	if (![CHPDaemonList sharedInstance].loaded) {
-		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^ {
-			[[CHPDaemonList sharedInstance] updateDaemonListIfNeeded];
-		});
-	}
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^ {
+		[[CHPDaemonList sharedInstance] updateDaemonListIfNeeded];
+	});
 
 	[super viewDidLoad];
 }
@@ -68,10 +66,15 @@
 		[self handleTroubleshootingForPackage:_selectedPackageWhileWaitingOnLoad];
 		_selectedPackageWhileWaitingOnLoad = nil;
 	}
+	if (_troubleshootAllWhileWaitingOnLoad) {
+		_troubleshootAllWhileWaitingOnLoad = NO;
+		[self handleTroubleshootingForAllPackages];
+	}
 }
 
-- (BOOL)isTweakDylib:(NSString *)tweakDylib deniedFromInjectingIntoExecutable:(NSString *)executablePath withProcessPreferences:(NSDictionary *)processPrefs
+- (BOOL)isTweakDylib:(NSString *)tweakDylib deniedFromInjectingIntoProcess:(NSDictionary *)process
 {
+	NSDictionary *processPrefs = process[@"preferences"];
 	BOOL tweakInjectionDisabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO);
 	BOOL customTweakConfigurationEnabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO);
 	NSInteger allowDenyMode = parseNumberInteger(processPrefs[kChoicyProcessPrefsKeyAllowDenyMode], 1);
@@ -87,17 +90,8 @@
 		}
 	}
 
-	NSArray *executableTweaks = [[CHPTweakList sharedInstance] tweakListForExecutableAtPath:executablePath];
-	
-	__block BOOL tweakInjectsIntoExecutable = NO;
-	[executableTweaks enumerateObjectsUsingBlock:^(CHPTweakInfo *tweakInfo, NSUInteger idx, BOOL *stop) {
-		if ([tweakInfo.dylibName isEqualToString:tweakDylib]) {
-			tweakInjectsIntoExecutable = YES;
-			*stop = YES;
-		}
-	}];
-
-	if (tweakInjectsIntoExecutable) {
+	NSSet *injectingDylibs = process[@"injectingDylibs"];
+	if ([injectingDylibs containsObject:tweakDylib]) {
 		if (tweakInjectionDisabled) {
 			return YES;
 		}
@@ -110,6 +104,304 @@
 	return NO;
 }
 
+// Read-only snapshot of everything the analysis needs, the tweak lists of all configured processes are only calculated once
+// (CHPMachoParser caches are not thread safe, so this part has to stay serial)
+- (NSDictionary *)createTroubleshootingSnapshot
+{
+	NSDictionary *prefs = preferences;
+	NSArray *globalDeniedTweaks = prefs[kChoicyPrefsKeyGlobalDeniedTweaks];
+	NSDictionary *appSettings = prefs[kChoicyPrefsKeyAppSettings];
+	NSDictionary *daemonSettings = prefs[kChoicyPrefsKeyDaemonSettings];
+
+	NSSet *(^injectingDylibsForExecutable)(NSString *, NSDictionary *) = ^NSSet *(NSString *executablePath, NSDictionary *processPrefs) {
+		// Only needed if injection is disabled or the process is in allow mode
+		BOOL tweakInjectionDisabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO);
+		BOOL customTweakConfigurationEnabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO);
+		NSInteger allowDenyMode = parseNumberInteger(processPrefs[kChoicyProcessPrefsKeyAllowDenyMode], 1);
+		if (!tweakInjectionDisabled && !(customTweakConfigurationEnabled && allowDenyMode == 1)) return [NSSet set];
+
+		NSMutableSet *injectingDylibs = [NSMutableSet new];
+		for (CHPTweakInfo *tweakInfo in [[CHPTweakList sharedInstance] tweakListForExecutableAtPath:executablePath]) {
+			[injectingDylibs addObject:tweakInfo.dylibName];
+		}
+		return injectingDylibs.copy;
+	};
+
+	NSMutableArray *apps = [NSMutableArray new];
+	[appSettings enumerateKeysAndObjectsUsingBlock:^(NSString *applicationID, NSDictionary *processPrefs, BOOL *stop) {
+		LSApplicationProxy *appProxy = [LSApplicationProxy applicationProxyForIdentifier:applicationID];
+		if (appProxy.isInstalled) {
+			NSString *executablePath = [CHPProcessConfigurationListController executablePathForBundleProxy:appProxy];
+			[apps addObject:@{
+				@"appProxy" : appProxy,
+				@"preferences" : processPrefs,
+				@"injectingDylibs" : injectingDylibsForExecutable(executablePath, processPrefs),
+			}];
+		}
+	}];
+
+	NSMutableArray *daemons = [NSMutableArray new];
+	[daemonSettings enumerateKeysAndObjectsUsingBlock:^(NSString *daemonName, NSDictionary *processPrefs, BOOL *stop) {
+		NSString *executablePath = [[CHPDaemonList sharedInstance] executablePathForDaemonName:daemonName];
+		[daemons addObject:@{
+			@"daemonName" : daemonName,
+			@"preferences" : processPrefs,
+			@"injectingDylibs" : injectingDylibsForExecutable(executablePath, processPrefs),
+		}];
+	}];
+
+	return @{
+		@"globalDeniedTweaks" : [NSSet setWithArray:globalDeniedTweaks ?: @[]],
+		@"apps" : apps.copy,
+		@"daemons" : daemons.copy,
+	};
+}
+
+// Only reads from the snapshot, safe to call concurrently
+- (NSDictionary *)troubleshootingResultForPackage:(CHPPackageInfo *)packageInfo snapshot:(NSDictionary *)snapshot
+{
+	NSSet *globalDeniedTweaks = snapshot[@"globalDeniedTweaks"];
+
+	NSMutableArray *globallyDeniedDylibs = [NSMutableArray new];
+	NSMutableDictionary *deniedAppsByTweakDylib = [NSMutableDictionary new];
+	NSMutableDictionary *deniedDaemonsByTweakDylib = [NSMutableDictionary new];
+
+	[packageInfo.tweakDylibs enumerateObjectsUsingBlock:^(NSString *tweakDylib, NSUInteger idx, BOOL *stop) {
+		if ([globalDeniedTweaks containsObject:tweakDylib]) {
+			[globallyDeniedDylibs addObject:tweakDylib];
+		}
+
+		NSMutableArray *deniedAppsList = [NSMutableArray new];
+		NSMutableArray *deniedDaemonsList = [NSMutableArray new];
+
+		for (NSDictionary *app in snapshot[@"apps"]) {
+			if ([self isTweakDylib:tweakDylib deniedFromInjectingIntoProcess:app]) {
+				[deniedAppsList addObject:app[@"appProxy"]];
+			}
+		}
+
+		for (NSDictionary *daemon in snapshot[@"daemons"]) {
+			if ([self isTweakDylib:tweakDylib deniedFromInjectingIntoProcess:daemon]) {
+				[deniedDaemonsList addObject:daemon[@"daemonName"]];
+			}
+		}
+
+		if (deniedAppsList.count) {
+			deniedAppsByTweakDylib[tweakDylib] = deniedAppsList;
+		}
+		if (deniedDaemonsList.count) {
+			deniedDaemonsByTweakDylib[tweakDylib] = deniedDaemonsList;
+		}
+	}];
+
+	return @{
+		@"globallyDeniedDylibs" : globallyDeniedDylibs.copy,
+		@"deniedAppsByTweakDylib" : deniedAppsByTweakDylib.copy,
+		@"deniedDaemonsByTweakDylib" : deniedDaemonsByTweakDylib.copy,
+	};
+}
+
+- (BOOL)troubleshootingResultIsEmpty:(NSDictionary *)result
+{
+	return ![result[@"globallyDeniedDylibs"] count] && ![result[@"deniedAppsByTweakDylib"] count] && ![result[@"deniedDaemonsByTweakDylib"] count];
+}
+
+- (NSString *)messageForTroubleshootingResult:(NSDictionary *)result
+{
+	NSArray *globallyDeniedDylibs = result[@"globallyDeniedDylibs"];
+	NSDictionary *deniedAppsByTweakDylib = result[@"deniedAppsByTweakDylib"];
+	NSDictionary *deniedDaemonsByTweakDylib = result[@"deniedDaemonsByTweakDylib"];
+
+	NSMutableString *messageM = [NSMutableString new];
+	__block BOOL firstLinePrinted = NO;
+
+	if (globallyDeniedDylibs.count) {
+		NSString *globallyDeniedDylibsString = [globallyDeniedDylibs componentsJoinedByString:@"\n"];
+		[messageM appendFormat:@"%@\n%@", localize(@"RESULTS_GLOBAL_DENIED"), globallyDeniedDylibsString];
+		firstLinePrinted = YES;
+	}
+
+	if (deniedAppsByTweakDylib.count) {
+		[deniedAppsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *tweakDylib, NSArray *applicationProxies, BOOL *stop) {
+			NSMutableString *applicationNamesString = [NSMutableString new];
+
+			[applicationProxies enumerateObjectsUsingBlock:^(LSApplicationProxy *appProxy, NSUInteger idx, BOOL *stop) {
+				[applicationNamesString appendString:appProxy.localizedName];
+				if (idx < applicationProxies.count-1) {
+					[applicationNamesString appendString:@"\n"];
+				}
+			}];
+
+			if (firstLinePrinted) {
+				[messageM appendString:@"\n\n"];
+			}
+			[messageM appendFormat:localize(@"RESULTS_APPLICATION"), tweakDylib, applicationNamesString.copy];
+			firstLinePrinted = YES;
+		}];
+	}
+
+	if (deniedDaemonsByTweakDylib.count) {
+		[deniedDaemonsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *tweakDylib, NSArray *daemonNames, BOOL *stop) {
+			NSString *daemonNamesString = [daemonNames componentsJoinedByString:@"\n"];
+			if (firstLinePrinted) {
+				[messageM appendString:@"\n\n"];
+			}
+			[messageM appendFormat:localize(@"RESULTS_PROCESS"), tweakDylib, daemonNamesString];
+			firstLinePrinted = YES;
+		}];
+	}
+
+	return messageM.copy;
+}
+
+- (void)applyFixForTroubleshootingResult:(NSDictionary *)result
+{
+	// globally disabled -> remove tweak from global deny list
+	// tweak injection disabled -> disable disable toggle, turn on custom config, set to allow, put tweak dylib on allow list
+	// custom configuration enabled on allow -> add tweak to allow list
+	// custom configuration enabled on deny -> remove tweak from deny list
+
+	NSArray *globallyDeniedDylibs = result[@"globallyDeniedDylibs"];
+	NSDictionary *deniedAppsByTweakDylib = result[@"deniedAppsByTweakDylib"];
+	NSDictionary *deniedDaemonsByTweakDylib = result[@"deniedDaemonsByTweakDylib"];
+
+	NSMutableString *changelogString = [NSMutableString new];
+	__block BOOL changelogFirstLinePrinted = NO;
+
+	NSMutableDictionary *mutablePrefs = preferences.mutableCopy;
+
+	if (globallyDeniedDylibs.count) {
+		// globally disabled -> remove tweak from global deny list
+		NSArray *prefs_globalDeniedTweaks = mutablePrefs[kChoicyPrefsKeyGlobalDeniedTweaks];
+		NSMutableArray *prefs_globalDeniedTweaks_m = prefs_globalDeniedTweaks.mutableCopy;
+		[globallyDeniedDylibs enumerateObjectsUsingBlock:^(NSString *globalDeniedDylib, NSUInteger idx, BOOL *stop) {
+			[prefs_globalDeniedTweaks_m removeObject:globalDeniedDylib];
+
+			if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
+			[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_ENABLED_IN_GLOBAL"), globalDeniedDylib];
+			changelogFirstLinePrinted = YES;
+		}];
+		
+		mutablePrefs[kChoicyPrefsKeyGlobalDeniedTweaks] = prefs_globalDeniedTweaks_m.copy;	
+	}
+
+	void (^handleProcessPrefs)(NSString*, NSMutableDictionary*, NSString *) = ^(NSString *displayName, NSMutableDictionary *processPrefs, NSString *dylibName) {
+		if (parseNumberBool(processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO)) {
+			// tweak injection disabled -> disable disable toggle, turn on custom config, set to allow, put tweak dylib on allow list
+			processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled] = @NO;
+			processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled] = @YES;
+			processPrefs[kChoicyProcessPrefsKeyAllowDenyMode] = @1; //ALLOW
+			processPrefs[kChoicyProcessPrefsKeyAllowedTweaks] = @[dylibName];
+
+			if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
+			[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_DISABLED_TO_ALLOW"), displayName, dylibName];
+			changelogFirstLinePrinted = YES;
+		}
+		else {
+			if (parseNumberBool(processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO)) {
+				if (parseNumberInteger(processPrefs[kChoicyProcessPrefsKeyAllowDenyMode], 1) == 1) //ALLOW
+				{
+					// custom configuration enabled on allow -> add tweak to allow list
+					NSArray *procPrefs_allowedTweaks = processPrefs[kChoicyProcessPrefsKeyAllowedTweaks];
+					NSMutableArray *procPrefs_allowedTweaks_m = procPrefs_allowedTweaks ? procPrefs_allowedTweaks.mutableCopy : [NSMutableArray new];
+					if (![procPrefs_allowedTweaks_m containsObject:dylibName])
+					{
+						[procPrefs_allowedTweaks_m addObject:dylibName];
+						processPrefs[kChoicyProcessPrefsKeyAllowedTweaks] = procPrefs_allowedTweaks_m.copy;
+
+						if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
+						[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_ADDED_TO_ALLOW"), dylibName, displayName];
+						changelogFirstLinePrinted = YES;
+					}
+				}
+				else //DENY
+				{
+					// custom configuration enabled on deny -> remove tweak from deny list
+					NSArray *procPrefs_deniedTweaks = processPrefs[kChoicyProcessPrefsKeyDeniedTweaks];
+					NSMutableArray *procPrefs_deniedTweaks_m = procPrefs_deniedTweaks.mutableCopy;
+					if ([procPrefs_deniedTweaks_m containsObject:dylibName])
+					{
+						[procPrefs_deniedTweaks_m removeObject:dylibName];
+						processPrefs[kChoicyProcessPrefsKeyDeniedTweaks] = procPrefs_deniedTweaks_m.copy;
+
+						if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
+						[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_REMOVED_FROM_DENY"), dylibName, displayName];
+						changelogFirstLinePrinted = YES;
+					}
+				}
+			}
+		}
+	}; 
+
+	// Call handleProcessPrefs on all denied dylibs for all apps
+	if (deniedAppsByTweakDylib.count) {
+		NSMutableDictionary *appSettings_m = [mutablePrefs[kChoicyPrefsKeyAppSettings] mutableCopy];
+		[deniedAppsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *dylibName, NSArray *applicationProxies, BOOL *stop) {
+			[applicationProxies enumerateObjectsUsingBlock:^(LSApplicationProxy *appProxy, NSUInteger idx, BOOL *stop) {
+				NSString *applicationID = appProxy.bundleIdentifier;
+				NSDictionary *appProcessPrefs = appSettings_m[applicationID];
+				NSMutableDictionary *appProcessPrefs_m = appProcessPrefs.mutableCopy;
+				handleProcessPrefs(appProxy.localizedName, appProcessPrefs_m, dylibName);
+				appSettings_m[applicationID] = appProcessPrefs_m.copy;
+			}];
+		}];
+		mutablePrefs[kChoicyPrefsKeyAppSettings] = appSettings_m.copy;
+	}
+
+	// Call handleProcessPrefs on all denied dylibs for all daemons
+	if (deniedDaemonsByTweakDylib.count) {
+		NSMutableDictionary *daemonSettings_m = [mutablePrefs[kChoicyPrefsKeyDaemonSettings] mutableCopy];
+		[deniedDaemonsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *dylibName, NSArray *daemonNames, BOOL *stop) {
+			[daemonNames enumerateObjectsUsingBlock:^(NSString *daemonName, NSUInteger idx, BOOL *stop) {
+				NSDictionary *daemonProcessPrefs = daemonSettings_m[daemonName];
+				NSMutableDictionary *daemonProcessPrefs_m = daemonProcessPrefs.mutableCopy;
+				handleProcessPrefs(daemonName, daemonProcessPrefs_m, dylibName);
+				daemonSettings_m[daemonName] = daemonProcessPrefs_m.copy;
+			}];
+		}];
+		mutablePrefs[kChoicyPrefsKeyDaemonSettings] = daemonSettings_m.copy;
+	}
+
+	writePreferences(mutablePrefs);
+
+	UIAlertController *changelogAlert = [UIAlertController alertControllerWithTitle:localize(@"APPLIED_CHANGES") message:changelogString.copy preferredStyle:UIAlertControllerStyleAlert];
+	UIAlertAction *closeAction = [UIAlertAction actionWithTitle:localize(@"CLOSE") style:UIAlertActionStyleDefault handler:nil];
+	[changelogAlert addAction:closeAction];
+
+	[self presentViewController:changelogAlert animated:YES completion:nil];
+}
+
+- (void)presentTroubleshootingResult:(NSDictionary *)result title:(NSString *)title message:(NSString *)message nothingFoundMessage:(NSString *)nothingFoundMessage
+{
+	dispatch_async(dispatch_get_main_queue(), ^ {
+		[self hideLoadingAlertControllerWithCompletion:^ {
+			dispatch_async(dispatch_get_main_queue(), ^ {
+				if (![self troubleshootingResultIsEmpty:result]) {
+					UIAlertController *troubleshootController = [UIAlertController alertControllerWithTitle:title message:message preferredStyle:UIAlertControllerStyleAlert];
+
+					UIAlertAction *fixAction = [UIAlertAction actionWithTitle:localize(@"FIX") style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
+						[self applyFixForTroubleshootingResult:result];
+					}];
+
+					UIAlertAction *cancelAction = [UIAlertAction actionWithTitle:localize(@"CANCEL") style:UIAlertActionStyleCancel handler:nil];
+
+					[troubleshootController addAction:fixAction];
+					[troubleshootController addAction:cancelAction];
+
+					[self presentViewController:troubleshootController animated:YES completion:nil];
+				}
+				else {
+					UIAlertController *nothingFoundController = [UIAlertController alertControllerWithTitle:title message:nothingFoundMessage preferredStyle:UIAlertControllerStyleAlert];
+					UIAlertAction *closeAction = [UIAlertAction actionWithTitle:localize(@"CLOSE") style:UIAlertActionStyleDefault handler:nil];
+					[nothingFoundController addAction:closeAction];
+
+					[self presentViewController:nothingFoundController animated:YES completion:nil];
+				}
+			});
+		}];
+	});
+}
+
 - (void)showLoadingAlertController
 {
 	_loadingAlertController = [UIAlertController alertControllerWithTitle:@"" message:@"" preferredStyle:UIAlertControllerStyleAlert];
@@ -146,6 +438,15 @@
 	});
 }
 
+- (void)troubleshootAllPressed:(PSSpecifier *)specifier
+{
+	[self showLoadingAlertController];
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^ {
+		[self handleTroubleshootingForAllPackages];
+	});
+}
+
 - (void)handleTroubleshootingForPackage:(CHPPackageInfo *)packageInfo
 {
 	if (![CHPDaemonList sharedInstance].loaded) {
@@ -153,222 +454,62 @@
 		return;
 	}
 
-	NSArray *globalDeniedTweaks = preferences[kChoicyPrefsKeyGlobalDeniedTweaks];
-	NSDictionary *appSettings = preferences[kChoicyPrefsKeyAppSettings];
-	NSDictionary *daemonSettings = preferences[kChoicyPrefsKeyDaemonSettings];
+	NSDictionary *result = [self troubleshootingResultForPackage:packageInfo snapshot:[self createTroubleshootingSnapshot]];
 
-	NSMutableArray *globallyDeniedDylibs = [NSMutableArray new];
-	NSMutableDictionary *deniedAppsByTweakDylib = [NSMutableDictionary new];
-	NSMutableDictionary *deniedDaemonsByTweakDylib = [NSMutableDictionary new];
-	
-	[packageInfo.tweakDylibs enumerateObjectsUsingBlock:^(NSString *tweakDylib, NSUInteger idx, BOOL *stop) {
-		if ([globalDeniedTweaks containsObject:tweakDylib]) {
-			[globallyDeniedDylibs addObject:tweakDylib];
-		}
+	NSString *title = [NSString stringWithFormat:@"%@ (%@)", localize(@"RESULTS"), packageInfo.name];
+	[self presentTroubleshootingResult:result title:title message:[self messageForTroubleshootingResult:result] nothingFoundMessage:localize(@"NOTHING_FOUND_MESSAGE")];
+}
 
-		NSMutableArray *deniedAppsList = [NSMutableArray new];
-		NSMutableArray *deniedDaemonsList = [NSMutableArray new];
+- (void)handleTroubleshootingForAllPackages
+{
+	if (![CHPDaemonList sharedInstance].loaded) {
+		_troubleshootAllWhileWaitingOnLoad = YES;
+		return;
+	}
 
-		[appSettings enumerateKeysAndObjectsUsingBlock:^(NSString *applicationID, NSDictionary *processPrefs, BOOL *stop) {
-			LSApplicationProxy *appProxy = [LSApplicationProxy applicationProxyForIdentifier:applicationID];
-			if (appProxy.isInstalled) {
-				NSString *executablePath = [CHPProcessConfigurationListController executablePathForBundleProxy:appProxy];
-				if ([self isTweakDylib:tweakDylib deniedFromInjectingIntoExecutable:executablePath withProcessPreferences:processPrefs]) {
-					[deniedAppsList addObject:appProxy];
-				}
-			}
-		}];
+	NSDictionary *snapshot = [self createTroubleshootingSnapshot];
+	NSArray *packageList = _packageList;
 
-		[daemonSettings enumerateKeysAndObjectsUsingBlock:^(NSString *daemonName, NSDictionary *processPrefs, BOOL *stop) {
-			NSString *executablePath = [[CHPDaemonList sharedInstance] executablePathForDaemonName:daemonName];
-			if ([self isTweakDylib:tweakDylib deniedFromInjectingIntoExecutable:executablePath withProcessPreferences:processPrefs]) {
-				[deniedDaemonsList addObject:daemonName];
-			}
-		}];
+	NSMutableArray *results = [NSMutableArray arrayWithCapacity:packageList.count];
+	for (NSUInteger i = 0; i < packageList.count; i++) {
+		[results addObject:[NSNull null]];
+	}
 
-		if (deniedAppsList.count) {
-			deniedAppsByTweakDylib[tweakDylib] = deniedAppsList;
+	dispatch_apply(packageList.count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+		CHPPackageInfo *packageInfo = packageList[i];
+		if ([packageInfo.name isEqualToString:@"Choicy"]) return;
+		NSDictionary *result = [self troubleshootingResultForPackage:packageInfo snapshot:snapshot];
+		@synchronized (results) {
+			results[i] = result;
 		}
-		if (deniedDaemonsList.count) {
-			deniedDaemonsByTweakDylib[tweakDylib] = deniedDaemonsList;
-		}
-	}];
-
-	dispatch_async(dispatch_get_main_queue(), ^ {
-		[self hideLoadingAlertControllerWithCompletion:^ {
-			dispatch_async(dispatch_get_main_queue(), ^ {
-				NSString *title = [NSString stringWithFormat:@"%@ (%@)", localize(@"RESULTS"), packageInfo.name];
-				if (globallyDeniedDylibs.count || deniedAppsByTweakDylib.count || deniedDaemonsByTweakDylib.count) {
-					NSMutableString *messageM = [NSMutableString new];
-					__block BOOL firstLinePrinted = NO;
-
-					if (globallyDeniedDylibs.count) {
-						NSString *globallyDeniedDylibsString = [globallyDeniedDylibs componentsJoinedByString:@"\n"];
-						[messageM appendFormat:@"%@\n%@", localize(@"RESULTS_GLOBAL_DENIED"), globallyDeniedDylibsString];
-						firstLinePrinted = YES;
-					}
-
-					if (deniedAppsByTweakDylib.count) {
-						[deniedAppsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *tweakDylib, NSArray *applicationProxies, BOOL *stop) {
-							NSMutableString *applicationNamesString = [NSMutableString new];
-
-							[applicationProxies enumerateObjectsUsingBlock:^(LSApplicationProxy *appProxy, NSUInteger idx, BOOL *stop) {
-								[applicationNamesString appendString:appProxy.localizedName];
-								if (idx < applicationProxies.count-1) {
-									[applicationNamesString appendString:@"\n"];
-								}
-							}];
-
-							if (firstLinePrinted) {
-								[messageM appendString:@"\n\n"];
-							}
-							[messageM appendFormat:localize(@"RESULTS_APPLICATION"), tweakDylib, applicationNamesString.copy];
-							firstLinePrinted = YES;
-						}];
-					}
-
-					if (deniedDaemonsByTweakDylib.count) {
-						[deniedDaemonsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *tweakDylib, NSArray *daemonNames, BOOL *stop) {
-							NSString *daemonNamesString = [daemonNames componentsJoinedByString:@"\n"];
-							if (firstLinePrinted) {
-								[messageM appendString:@"\n\n"];
-							}
-							[messageM appendFormat:localize(@"RESULTS_PROCESS"), tweakDylib, daemonNamesString];
-							firstLinePrinted = YES;
-						}];
-					}
+	});
 
-					UIAlertController *troubleshootController = [UIAlertController alertControllerWithTitle:title message:messageM.copy preferredStyle:UIAlertControllerStyleAlert];
+	// Merge everything into one report, grouped by package
+	NSMutableArray *globallyDeniedDylibs = [NSMutableArray new];
+	NSMutableDictionary *deniedAppsByTweakDylib = [NSMutableDictionary new];
+	NSMutableDictionary *deniedDaemonsByTweakDylib = [NSMutableDictionary new];
+	NSMutableString *messageM = [NSMutableString new];
 
-					UIAlertAction *fixAction = [UIAlertAction actionWithTitle:localize(@"FIX") style:UIAlertActionStyleDefault handler:^(UIAlertAction *action) {
-						// globally disabled -> remove tweak from global deny list
-						// tweak injection disabled -> disable disable toggle, turn on custom config, set to allow, put tweak dylib on allow list
-						// custom configuration enabled on allow -> add tweak to allow list
-						// custom configuration enabled on deny -> remove tweak from deny list
-
-						NSMutableString *changelogString = [NSMutableString new];
-						__block BOOL changelogFirstLinePrinted = NO;
-
-						NSMutableDictionary *mutablePrefs = preferences.mutableCopy;
-
-						if (globallyDeniedDylibs.count) {
-							// globally disabled -> remove tweak from global deny list
-							NSArray *prefs_globalDeniedTweaks = mutablePrefs[kChoicyPrefsKeyGlobalDeniedTweaks];
-							NSMutableArray *prefs_globalDeniedTweaks_m = prefs_globalDeniedTweaks.mutableCopy;
-							[globallyDeniedDylibs enumerateObjectsUsingBlock:^(NSString *globalDeniedDylib, NSUInteger idx, BOOL *stop) {
-								[prefs_globalDeniedTweaks_m removeObject:globalDeniedDylib];
-
-								if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
-								[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_ENABLED_IN_GLOBAL"), globalDeniedDylib];
-								changelogFirstLinePrinted = YES;
-							}];
-							
-							mutablePrefs[kChoicyPrefsKeyGlobalDeniedTweaks] = prefs_globalDeniedTweaks_m.copy;	
-						}
-
-						void (^handleProcessPrefs)(NSString*, NSMutableDictionary*, NSString *) = ^(NSString *displayName, NSMutableDictionary *processPrefs, NSString *dylibName) {
-							if (parseNumberBool(processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO)) {
-								// tweak injection disabled -> disable disable toggle, turn on custom config, set to allow, put tweak dylib on allow list
-								processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled] = @NO;
-								processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled] = @YES;
-								processPrefs[kChoicyProcessPrefsKeyAllowDenyMode] = @1; //ALLOW
-								processPrefs[kChoicyProcessPrefsKeyAllowedTweaks] = @[dylibName];
-
-								if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
-								[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_DISABLED_TO_ALLOW"), displayName, dylibName];
-								changelogFirstLinePrinted = YES;
-							}
-							else {
-								if (parseNumberBool(processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO)) {
-									if (parseNumberInteger(processPrefs[kChoicyProcessPrefsKeyAllowDenyMode], 1) == 1) //ALLOW
-									{
-										// custom configuration enabled on allow -> add tweak to allow list
-										NSArray *procPrefs_allowedTweaks = processPrefs[kChoicyProcessPrefsKeyAllowedTweaks];
-										NSMutableArray *procPrefs_allowedTweaks_m = procPrefs_allowedTweaks ? procPrefs_allowedTweaks.mutableCopy : [NSMutableArray new];
-										if (![procPrefs_allowedTweaks_m containsObject:dylibName])
-										{
-											[procPrefs_allowedTweaks_m addObject:dylibName];
-											processPrefs[kChoicyProcessPrefsKeyAllowedTweaks] = procPrefs_allowedTweaks_m.copy;
-
-											if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
-											[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_ADDED_TO_ALLOW"), dylibName, displayName];
-											changelogFirstLinePrinted = YES;
-										}
-									}
-									else //DENY
-									{
-										// custom configuration enabled on deny -> remove tweak from deny list
-										NSArray *procPrefs_deniedTweaks = processPrefs[kChoicyProcessPrefsKeyDeniedTweaks];
-										NSMutableArray *procPrefs_deniedTweaks_m = procPrefs_deniedTweaks.mutableCopy;
-										if ([procPrefs_deniedTweaks_m containsObject:dylibName])
-										{
-											[procPrefs_deniedTweaks_m removeObject:dylibName];
-											processPrefs[kChoicyProcessPrefsKeyDeniedTweaks] = procPrefs_deniedTweaks_m.copy;
-
-											if (changelogFirstLinePrinted) [changelogString appendString:@"\n\n"];
-											[changelogString appendFormat:localize(@"TROUBLESHOOT_LOG_REMOVED_FROM_DENY"), dylibName, displayName];
-											changelogFirstLinePrinted = YES;
-										}
-									}
-								}
-							}
-						}; 
-
-						// Call handleProcessPrefs on all denied dylibs for all apps
-						if (deniedAppsByTweakDylib.count) {
-							NSMutableDictionary *appSettings_m = appSettings.mutableCopy;
-							[deniedAppsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *dylibName, NSArray *applicationProxies, BOOL *stop) {
-								[applicationProxies enumerateObjectsUsingBlock:^(LSApplicationProxy *appProxy, NSUInteger idx, BOOL *stop) {
-									NSString *applicationID = appProxy.bundleIdentifier;
-									NSDictionary *appProcessPrefs = appSettings_m[applicationID];
-									NSMutableDictionary *appProcessPrefs_m = appProcessPrefs.mutableCopy;
-									handleProcessPrefs(appProxy.localizedName, appProcessPrefs_m, dylibName);
-									appSettings_m[applicationID] = appProcessPrefs_m.copy;
-								}];
-							}];
-							mutablePrefs[kChoicyPrefsKeyAppSettings] = appSettings_m.copy;
-						}
-
-						// Call handleProcessPrefs on all denied dylibs for all daemons
-						if (deniedDaemonsByTweakDylib.count) {
-							NSMutableDictionary *daemonSettings_m = daemonSettings.mutableCopy;
-							[deniedDaemonsByTweakDylib enumerateKeysAndObjectsUsingBlock:^(NSString *dylibName, NSArray *daemonNames, BOOL *stop) {
-								[daemonNames enumerateObjectsUsingBlock:^(NSString *daemonName, NSUInteger idx, BOOL *stop) {
-									NSDictionary *daemonProcessPrefs = daemonSettings_m[daemonName];
-									NSMutableDictionary *daemonProcessPrefs_m = daemonProcessPrefs.mutableCopy;
-									handleProcessPrefs(daemonName, daemonProcessPrefs_m, dylibName);
-									daemonSettings_m[daemonName] = daemonProcessPrefs_m.copy;
-								}];
-							}];
-							mutablePrefs[kChoicyPrefsKeyDaemonSettings] = daemonSettings_m.copy;
-						}
-
-						writePreferences(mutablePrefs);
-
-						UIAlertController *changelogAlert = [UIAlertController alertControllerWithTitle:localize(@"APPLIED_CHANGES") message:changelogString.copy preferredStyle:UIAlertControllerStyleAlert];
-						UIAlertAction *closeAction = [UIAlertAction actionWithTitle:localize(@"CLOSE") style:UIAlertActionStyleDefault handler:nil];
-						[changelogAlert addAction:closeAction];
-
-						[self presentViewController:changelogAlert animated:YES completion:nil];
-					}];
+	[results enumerateObjectsUsingBlock:^(id result, NSUInteger idx, BOOL *stop) {
+		if (result == [NSNull null] || [self troubleshootingResultIsEmpty:result]) return;
 
-					UIAlertAction *cancelAction = [UIAlertAction actionWithTitle:localize(@"CANCEL") style:UIAlertActionStyleCancel handler:nil];
+		[globallyDeniedDylibs addObjectsFromArray:result[@"globallyDeniedDylibs"]];
+		[deniedAppsByTweakDylib addEntriesFromDictionary:result[@"deniedAppsByTweakDylib"]];
+		[deniedDaemonsByTweakDylib addEntriesFromDictionary:result[@"deniedDaemonsByTweakDylib"]];
 
-					[troubleshootController addAction:fixAction];
-					[troubleshootController addAction:cancelAction];
+		if (messageM.length) [messageM appendString:@"\n\n"];
+		CHPPackageInfo *packageInfo = packageList[idx];
+		[messageM appendFormat:@"[%@]\n%@", packageInfo.name, [self messageForTroubleshootingResult:result]];
+	}];
 
-					[self presentViewController:troubleshootController animated:YES completion:nil];
-				}
-				else {
-					UIAlertController *nothingFoundController = [UIAlertController alertControllerWithTitle:title message:localize(@"NOTHING_FOUND_MESSAGE") preferredStyle:UIAlertControllerStyleAlert];
-					UIAlertAction *closeAction = [UIAlertAction actionWithTitle:localize(@"CLOSE") style:UIAlertActionStyleDefault handler:nil];
-					[nothingFoundController addAction:closeAction];
+	NSDictionary *mergedResult = @{
+		@"globallyDeniedDylibs" : globallyDeniedDylibs.copy,
+		@"deniedAppsByTweakDylib" : deniedAppsByTweakDylib.copy,
+		@"deniedDaemonsByTweakDylib" : deniedDaemonsByTweakDylib.copy,
+	};
 
-					[self presentViewController:nothingFoundController animated:YES completion:nil];
-				}
-			});
-		}];
-	});
+	NSString *title = [NSString stringWithFormat:@"%@ (%@)", localize(@"RESULTS"), localize(@"ALL_PACKAGES")];
+	[self presentTroubleshootingResult:mergedResult title:title message:messageM.copy nothingFoundMessage:localize(@"NOTHING_FOUND_ALL_MESSAGE")];
 }
 
 - (NSMutableArray *)specifiers
@@ -378,6 +519,21 @@
 
 		_specifiers = [NSMutableArray new];
 
+		PSSpecifier *troubleshootAllGroupSpecifier = [PSSpecifier emptyGroupSpecifier];
+		[troubleshootAllGroupSpecifier setProperty:localize(@"TROUBLESHOOT_ALL_FOOTER") forKey:@"footerText"];
+		[_specifiers addObject:troubleshootAllGroupSpecifier];
+
+		PSSpecifier *troubleshootAllSpecifier = [PSSpecifier preferenceSpecifierNamed:localize(@"TROUBLESHOOT_ALL")
+			target:self
+			set:nil
+			get:nil
+			detail:nil
+			cell:PSButtonCell
+			edit:nil];
+		[troubleshootAllSpecifier setProperty:@1 forKey:@"enabled"];
+		troubleshootAllSpecifier.buttonAction = @selector(troubleshootAllPressed:);
+		[_specifiers addObject:troubleshootAllSpecifier];
+
 		PSSpecifier *groupSpecifier = [PSSpecifier emptyGroupSpecifier];
 		groupSpecifier.name = localize(@"PACKAGES");
 		[_specifiers addObject:groupSpecifier];
@@ -0,0 +1,43 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "Shared.h"
+#import <Foundation/Foundation.h>
+
+// Profiles live in their own store (kChoicyProfilesPlistPath) as deltas over a base snapshot of appSettings, daemonSettings,
+// globalDeniedTweaks and rules that is taken when the first profile is saved, so every profile describes a complete configuration
+// The preferences only contain the settings of the active profile and its name, so everything that reads them keeps working
+// unchanged and switching profiles is a single write of the preferences
+@interface ChoicyProfiles : NSObject
+
++ (NSMutableDictionary *)profileStoreAtPath:(NSString *)path;
++ (BOOL)writeProfileStore:(NSDictionary *)store toPath:(NSString *)path;
+
++ (NSArray<NSString *> *)profileNamesInStore:(NSDictionary *)store;
++ (NSString *)activeProfileInPreferences:(NSDictionary *)prefs store:(NSDictionary *)store;
+
++ (NSDictionary *)deltaFromSettings:(NSDictionary *)baseSettings toSettings:(NSDictionary *)settings;
++ (NSDictionary *)settingsByApplyingDelta:(NSDictionary *)delta toSettings:(NSDictionary *)baseSettings;
+
++ (void)saveCurrentConfigurationAsProfile:(NSString *)name inPreferences:(NSMutableDictionary *)prefs store:(NSMutableDictionary *)store;
++ (BOOL)activateProfile:(NSString *)name inPreferences:(NSMutableDictionary *)prefs store:(NSMutableDictionary *)store; // nil deactivates the active profile
++ (void)deleteProfile:(NSString *)name inPreferences:(NSMutableDictionary *)prefs store:(NSMutableDictionary *)store;
+
+@end
@@ -0,0 +1,218 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import "ChoicyProfiles.h"
+
+#define kChoicyProfileSettingsKeys @[kChoicyPrefsKeyAppSettings, kChoicyPrefsKeyDaemonSettings, kChoicyPrefsKeyGlobalDeniedTweaks, kChoicyPrefsKeyRules]
+#define kChoicyProfileDeltaKeyRemovedAppSettings @"removedAppSettings"
+#define kChoicyProfileDeltaKeyRemovedDaemonSettings @"removedDaemonSettings"
+
+static NSString *removedKeyForSettingsKey(NSString *settingsKey)
+{
+	return [settingsKey isEqualToString:kChoicyPrefsKeyAppSettings] ? kChoicyProfileDeltaKeyRemovedAppSettings : kChoicyProfileDeltaKeyRemovedDaemonSettings;
+}
+
+static NSDictionary *settingsFromPreferences(NSDictionary *prefs)
+{
+	NSMutableDictionary *settings = [NSMutableDictionary new];
+	for (NSString *key in kChoicyProfileSettingsKeys) {
+		if (prefs[key]) settings[key] = prefs[key];
+	}
+	return settings.copy;
+}
+
+static void applySettingsToPreferences(NSDictionary *settings, NSMutableDictionary *prefs)
+{
+	for (NSString *key in kChoicyProfileSettingsKeys) {
+		if (settings[key]) {
+			prefs[key] = settings[key];
+		}
+		else {
+			[prefs removeObjectForKey:key];
+		}
+	}
+}
+
+@implementation ChoicyProfiles
+
++ (NSMutableDictionary *)profileStoreAtPath:(NSString *)path
+{
+	NSDictionary *store = [NSDictionary dictionaryWithContentsOfFile:path];
+	return [store isKindOfClass:[NSDictionary class]] ? store.mutableCopy : [NSMutableDictionary new];
+}
+
++ (BOOL)writeProfileStore:(NSDictionary *)store toPath:(NSString *)path
+{
+	return [store writeToFile:path atomically:YES];
+}
+
++ (NSArray<NSString *> *)profileNamesInStore:(NSDictionary *)store
+{
+	NSDictionary *profiles = store[kChoicyProfilesKeyProfiles];
+	return [profiles.allKeys sortedArrayUsingSelector:@selector(localizedCaseInsensitiveCompare:)] ?: @[];
+}
+
++ (NSString *)activeProfileInPreferences:(NSDictionary *)prefs store:(NSDictionary *)store
+{
+	NSString *activeProfile = prefs[kChoicyPrefsKeyActiveProfile];
+	if (![activeProfile isKindOfClass:[NSString class]] || !store[kChoicyProfilesKeyProfiles][activeProfile]) return nil;
+	return activeProfile;
+}
+
++ (NSDictionary *)deltaFromSettings:(NSDictionary *)baseSettings toSettings:(NSDictionary *)settings
+{
+	NSMutableDictionary *delta = [NSMutableDictionary new];
+
+	for (NSString *settingsKey in @[kChoicyPrefsKeyAppSettings, kChoicyPrefsKeyDaemonSettings]) {
+		NSDictionary *baseProcessSettings = baseSettings[settingsKey];
+		NSDictionary *processSettings = settings[settingsKey];
+
+		NSMutableDictionary *changed = [NSMutableDictionary new];
+		[processSettings enumerateKeysAndObjectsUsingBlock:^(NSString *process, NSDictionary *processPrefs, BOOL *stop) {
+			if (![processPrefs isEqual:baseProcessSettings[process]]) {
+				changed[process] = processPrefs;
+			}
+		}];
+
+		NSMutableArray *removed = [NSMutableArray new];
+		for (NSString *process in baseProcessSettings) {
+			if (!processSettings[process]) [removed addObject:process];
+		}
+
+		if (changed.count) delta[settingsKey] = changed.copy;
+		if (removed.count) delta[removedKeyForSettingsKey(settingsKey)] = removed.copy;
+	}
+
+	NSArray *baseGlobalDeniedTweaks = baseSettings[kChoicyPrefsKeyGlobalDeniedTweaks] ?: @[];
+	NSArray *globalDeniedTweaks = settings[kChoicyPrefsKeyGlobalDeniedTweaks] ?: @[];
+	if (![baseGlobalDeniedTweaks isEqualToArray:globalDeniedTweaks]) {
+		delta[kChoicyPrefsKeyGlobalDeniedTweaks] = globalDeniedTweaks;
+	}
+
+	// Rules only make sense as a whole because of their order
+	NSArray *baseRules = baseSettings[kChoicyPrefsKeyRules] ?: @[];
+	NSArray *rules = settings[kChoicyPrefsKeyRules] ?: @[];
+	if (![baseRules isEqualToArray:rules]) {
+		delta[kChoicyPrefsKeyRules] = rules;
+	}
+
+	return delta.copy;
+}
+
++ (NSDictionary *)settingsByApplyingDelta:(NSDictionary *)delta toSettings:(NSDictionary *)baseSettings
+{
+	NSMutableDictionary *settings = [baseSettings mutableCopy] ?: [NSMutableDictionary new];
+
+	for (NSString *settingsKey in @[kChoicyPrefsKeyAppSettings, kChoicyPrefsKeyDaemonSettings]) {
+		NSDictionary *changed = delta[settingsKey];
+		NSArray *removed = delta[removedKeyForSettingsKey(settingsKey)];
+		if (!changed.count && !removed.count) continue;
+
+		NSMutableDictionary *processSettings = [baseSettings[settingsKey] mutableCopy] ?: [NSMutableDictionary new];
+		[processSettings addEntriesFromDictionary:changed];
+		[processSettings removeObjectsForKeys:removed ?: @[]];
+		settings[settingsKey] = processSettings.copy;
+	}
+
+	if (delta[kChoicyPrefsKeyGlobalDeniedTweaks]) {
+		settings[kChoicyPrefsKeyGlobalDeniedTweaks] = delta[kChoicyPrefsKeyGlobalDeniedTweaks];
+	}
+
+	if (delta[kChoicyPrefsKeyRules]) {
+		settings[kChoicyPrefsKeyRules] = delta[kChoicyPrefsKeyRules];
+	}
+
+	return settings.copy;
+}
+
+// Changes made while a profile is active belong to that profile
++ (void)commitActiveProfileInPreferences:(NSDictionary *)prefs store:(NSMutableDictionary *)store
+{
+	NSString *activeProfile = [self activeProfileInPreferences:prefs store:store];
+	if (!activeProfile) return;
+
+	NSMutableDictionary *profiles = [store[kChoicyProfilesKeyProfiles] mutableCopy];
+	profiles[activeProfile] = [self deltaFromSettings:store[kChoicyProfilesKeyBase] toSettings:settingsFromPreferences(prefs)];
+	store[kChoicyProfilesKeyProfiles] = profiles.copy;
+}
+
++ (void)saveCurrentConfigurationAsProfile:(NSString *)name inPreferences:(NSMutableDictionary *)prefs store:(NSMutableDictionary *)store
+{
+	if (!name.length) return;
+
+	[self commitActiveProfileInPreferences:prefs store:store];
+
+	// Deltas are only meaningful against a base that does not change afterwards
+	NSDictionary *settings = settingsFromPreferences(prefs);
+	if (![store[kChoicyProfilesKeyBase] isKindOfClass:[NSDictionary class]]) {
+		store[kChoicyProfilesKeyBase] = settings;
+	}
+
+	NSMutableDictionary *profiles = [store[kChoicyProfilesKeyProfiles] mutableCopy] ?: [NSMutableDictionary new];
+	profiles[name] = [self deltaFromSettings:store[kChoicyProfilesKeyBase] toSettings:settings];
+	store[kChoicyProfilesKeyProfiles] = profiles.copy;
+}
+
++ (BOOL)activateProfile:(NSString *)name inPreferences:(NSMutableDictionary *)prefs store:(NSMutableDictionary *)store
+{
+	NSDictionary *delta = name ? store[kChoicyProfilesKeyProfiles][name] : nil;
+	if (name && !delta) return NO;
+
+	NSString *activeProfile = [self activeProfileInPreferences:prefs store:store];
+	[self commitActiveProfileInPreferences:prefs store:store];
+
+	if (name) {
+		if (!activeProfile) {
+			store[kChoicyProfilesKeyNoProfileSettings] = settingsFromPreferences(prefs);
+		}
+		prefs[kChoicyPrefsKeyActiveProfile] = name;
+		applySettingsToPreferences([self settingsByApplyingDelta:delta toSettings:store[kChoicyProfilesKeyBase]], prefs);
+	}
+	else {
+		[prefs removeObjectForKey:kChoicyPrefsKeyActiveProfile];
+		if (activeProfile && store[kChoicyProfilesKeyNoProfileSettings]) {
+			applySettingsToPreferences(store[kChoicyProfilesKeyNoProfileSettings], prefs);
+		}
+		[store removeObjectForKey:kChoicyProfilesKeyNoProfileSettings];
+	}
+
+	return YES;
+}
+
++ (void)deleteProfile:(NSString *)name inPreferences:(NSMutableDictionary *)prefs store:(NSMutableDictionary *)store
+{
+	if (!name) return;
+
+	if ([[self activeProfileInPreferences:prefs store:store] isEqualToString:name]) {
+		[self activateProfile:nil inPreferences:prefs store:store];
+	}
+
+	NSMutableDictionary *profiles = [store[kChoicyProfilesKeyProfiles] mutableCopy];
+	[profiles removeObjectForKey:name];
+	store[kChoicyProfilesKeyProfiles] = profiles.copy;
+
+	// The next profile that is saved starts over with a new base
+	if (!profiles.count) {
+		[store removeObjectForKey:kChoicyProfilesKeyProfiles];
+		[store removeObjectForKey:kChoicyProfilesKeyBase];
+	}
+}
+
+@end
@@ -20,14 +20,26 @@
 
 #import "ChoicyOverrideProvider.h"
 #import <Foundation/Foundation.h>
+#import <os/lock.h>
 
 @interface ChoicyOverrideManager : NSObject {
 	NSMutableArray *_overrideProviders;
+	NSMapTable *_providerRecords; // V2 provider -> application ID -> record or NSNull
+	NSMutableDictionary *_mergedRecords; // application ID -> merged record of all V2 providers or NSNull
+	NSUInteger _legacyProviderCount;
+	os_unfair_lock _lock;
 }
 
 + (instancetype)sharedManager;
-- (void)registerOverrideProvider:(id<ChoicyOverrideProvider>)provider;
-- (void)unregisterOverrideProvider:(id<ChoicyOverrideProvider>)provider;
+- (void)registerOverrideProvider:(id)provider; // ChoicyOverrideProvider or ChoicyOverrideProviderV2
+- (void)unregisterOverrideProvider:(id)provider;
+
+// Called by V2 providers whenever their overrides change
+- (void)overridesDidChangeForApplications:(NSSet<NSString *> *)applicationIDs ofProvider:(id<ChoicyOverrideProviderV2>)provider;
+- (void)overrideTableDidChangeOfProvider:(id<ChoicyOverrideProviderV2>)provider;
+
+// Merged record of all providers, earlier registered providers take precedence
+- (NSDictionary *)overrideRecordForApplication:(NSString *)applicationID;
 
 - (BOOL)disableTweakInjectionOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists;
 - (BOOL)customTweakConfigurationEnabledOverwriteForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists;
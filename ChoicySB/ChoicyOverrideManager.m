@@ -37,118 +37,268 @@
 	self = [super init];
 
 	_overrideProviders = [NSMutableArray new];
+	_providerRecords = [NSMapTable strongToStrongObjectsMapTable];
+	_mergedRecords = [NSMutableDictionary new];
+	_lock = OS_UNFAIR_LOCK_INIT;
 
 	return self;
 }
 
-- (void)registerOverrideProvider:(NSObject<ChoicyOverrideProvider> *)provider
+- (BOOL)providerIsV2:(id)provider
 {
+	return [provider respondsToSelector:@selector(overrideRecordForApplication:)];
+}
+
+// Providers that publish a table have no records for applications that are not in it
+- (BOOL)providerHasTable:(id)provider
+{
+	return [provider respondsToSelector:@selector(overrideRecordTable)];
+}
+
+- (NSMutableDictionary *)recordsFromTableOfProvider:(id<ChoicyOverrideProviderV2>)provider
+{
+	NSMutableDictionary *records = [NSMutableDictionary new];
+	if ([self providerHasTable:provider]) {
+		[[provider overrideRecordTable] enumerateKeysAndObjectsUsingBlock:^(NSString *applicationID, NSDictionary *record, BOOL *stop) {
+			if ([record isKindOfClass:[NSDictionary class]]) {
+				records[applicationID] = record.copy;
+			}
+		}];
+	}
+	return records;
+}
+
+- (void)registerOverrideProvider:(id)provider
+{
+	// Query the table before taking the lock, the provider might call back into us
+	NSMutableDictionary *records = [self providerIsV2:provider] ? [self recordsFromTableOfProvider:provider] : nil;
+
+	os_unfair_lock_lock(&_lock);
 	[_overrideProviders addObject:provider];
+	if (records) {
+		[_providerRecords setObject:records forKey:provider];
+	}
+	else {
+		_legacyProviderCount++;
+	}
+	[self rebuildMergedRecords];
+	os_unfair_lock_unlock(&_lock);
 }
 
-- (void)unregisterOverrideProvider:(NSObject<ChoicyOverrideProvider> *)provider
+- (void)unregisterOverrideProvider:(id)provider
 {
-	[_overrideProviders removeObject:provider];
+	os_unfair_lock_lock(&_lock);
+	if ([_overrideProviders containsObject:provider]) {
+		[_overrideProviders removeObject:provider];
+		if ([_providerRecords objectForKey:provider]) {
+			[_providerRecords removeObjectForKey:provider];
+		}
+		else {
+			_legacyProviderCount--;
+		}
+		[self rebuildMergedRecords];
+	}
+	os_unfair_lock_unlock(&_lock);
 }
 
-- (BOOL)disableTweakInjectionOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+- (void)overridesDidChangeForApplications:(NSSet<NSString *> *)applicationIDs ofProvider:(id<ChoicyOverrideProviderV2>)provider
 {
-	__block BOOL overrideExists_ = NO;
-	__block BOOL overrideValue = NO;
+	NSMutableDictionary *changedRecords = [NSMutableDictionary new];
+	for (NSString *applicationID in applicationIDs) {
+		NSDictionary *record = [provider overrideRecordForApplication:applicationID];
+		changedRecords[applicationID] = [record isKindOfClass:[NSDictionary class]] ? record.copy : [NSNull null];
+	}
 
-	[_overrideProviders enumerateObjectsUsingBlock:^(NSObject<ChoicyOverrideProvider> *overrideProvider, NSUInteger idx, BOOL *stop) {
-		uint32_t providedOverrides = [overrideProvider providedOverridesForApplication:applicationID];
-		if ((providedOverrides & Choicy_Override_DisableTweakInjection) == Choicy_Override_DisableTweakInjection) {
-			overrideExists_ = YES;
-			if ([overrideProvider respondsToSelector:@selector(disableTweakInjectionOverrideForApplication:)]) {
-				overrideValue = [overrideProvider disableTweakInjectionOverrideForApplication:applicationID];
-				*stop = YES;
+	os_unfair_lock_lock(&_lock);
+	NSMutableDictionary *records = [_providerRecords objectForKey:provider];
+	if (records) {
+		[changedRecords enumerateKeysAndObjectsUsingBlock:^(NSString *applicationID, id record, BOOL *stop) {
+			if (record == [NSNull null] && [self providerHasTable:provider]) {
+				[records removeObjectForKey:applicationID];
 			}
-		}
-	}];
+			else {
+				records[applicationID] = record;
+			}
+			[self rebuildMergedRecordForApplication:applicationID];
+		}];
+	}
+	os_unfair_lock_unlock(&_lock);
+}
+
+- (void)overrideTableDidChangeOfProvider:(id<ChoicyOverrideProviderV2>)provider
+{
+	NSMutableDictionary *records = [self recordsFromTableOfProvider:provider];
 
-	if (overrideExists) *overrideExists = overrideExists_;
-	return overrideValue;
+	os_unfair_lock_lock(&_lock);
+	if ([_providerRecords objectForKey:provider]) {
+		[_providerRecords setObject:records forKey:provider];
+		[self rebuildMergedRecords];
+	}
+	os_unfair_lock_unlock(&_lock);
 }
 
-- (BOOL)customTweakConfigurationEnabledOverwriteForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+// Merges the cached records of all V2 providers, returns nil if a provider without a table has not been asked about this application yet, _lock needs to be held
+- (id)cachedMergedRecordForApplication:(NSString *)applicationID
 {
-	__block BOOL overrideExists_ = NO;
-	__block BOOL overrideValue = NO;
+	NSMutableDictionary *mergedRecord = [NSMutableDictionary new];
+	for (id provider in _overrideProviders) {
+		NSMutableDictionary *records = [_providerRecords objectForKey:provider];
+		if (!records) continue;
 
-	[_overrideProviders enumerateObjectsUsingBlock:^(NSObject<ChoicyOverrideProvider> *overrideProvider, NSUInteger idx, BOOL *stop) {
-		uint32_t providedOverrides = [overrideProvider providedOverridesForApplication:applicationID];
-		if ((providedOverrides & Choicy_Override_CustomTweakConfiguration) == Choicy_Override_CustomTweakConfiguration) {
-			overrideExists_ = YES;
-			if ([overrideProvider respondsToSelector:@selector(customTweakConfigurationEnabledOverrideForApplication:)]) {
-				overrideValue = [overrideProvider customTweakConfigurationEnabledOverrideForApplication:applicationID];
-				*stop = YES;
-			}
+		id record = records[applicationID];
+		if (!record) {
+			if ([self providerHasTable:provider]) continue;
+			return nil;
 		}
-	}];
+		if (record == [NSNull null]) continue;
 
-	if (overrideExists) *overrideExists = overrideExists_;
-	return overrideValue;
+		[record enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+			if (!mergedRecord[key]) mergedRecord[key] = value;
+		}];
+	}
+	return mergedRecord.count ? mergedRecord.copy : [NSNull null];
 }
 
-- (BOOL)customTweakConfigurationAllowDenyModeOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+// _lock needs to be held
+- (void)rebuildMergedRecordForApplication:(NSString *)applicationID
 {
-	__block BOOL overrideExists_ = NO;
-	__block BOOL overrideValue = NO;
+	id mergedRecord = [self cachedMergedRecordForApplication:applicationID];
+	if (mergedRecord) {
+		_mergedRecords[applicationID] = mergedRecord;
+	}
+	else {
+		[_mergedRecords removeObjectForKey:applicationID];
+	}
+}
 
-	[_overrideProviders enumerateObjectsUsingBlock:^(NSObject<ChoicyOverrideProvider> *overrideProvider, NSUInteger idx, BOOL *stop) {
-		uint32_t providedOverrides = [overrideProvider providedOverridesForApplication:applicationID];
-		if ((providedOverrides & Choicy_Override_CustomTweakConfiguration) == Choicy_Override_CustomTweakConfiguration) {
-			overrideExists_ = YES;
-			if ([overrideProvider respondsToSelector:@selector(customTweakConfigurationAllowDenyModeOverrideForApplication:)]) {
-				overrideValue = [overrideProvider customTweakConfigurationAllowDenyModeOverrideForApplication:applicationID];
-				*stop = YES;
-			}
-		}
-	}];
+// _lock needs to be held
+- (void)rebuildMergedRecords
+{
+	NSMutableSet *applicationIDs = [NSMutableSet setWithArray:_mergedRecords.allKeys];
+	for (id provider in _overrideProviders) {
+		NSMutableDictionary *records = [_providerRecords objectForKey:provider];
+		if (records) [applicationIDs addObjectsFromArray:records.allKeys];
+	}
 
-	if (overrideExists) *overrideExists = overrideExists_;
-	return overrideValue;
+	[_mergedRecords removeAllObjects];
+	for (NSString *applicationID in applicationIDs) {
+		[self rebuildMergedRecordForApplication:applicationID];
+	}
 }
 
-- (NSArray *)customTweakConfigurationAllowOrDenyListOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+// Turns the answers of a V1 provider into a record
+- (NSDictionary *)recordOfLegacyProvider:(NSObject<ChoicyOverrideProvider> *)provider forApplication:(NSString *)applicationID
 {
-	__block BOOL overrideExists_ = NO;
-	__block NSArray *overrideValue = nil;
+	NSMutableDictionary *record = [NSMutableDictionary new];
+	uint32_t providedOverrides = [provider providedOverridesForApplication:applicationID];
 
-	[_overrideProviders enumerateObjectsUsingBlock:^(NSObject<ChoicyOverrideProvider> *overrideProvider, NSUInteger idx, BOOL *stop) {
-		uint32_t providedOverrides = [overrideProvider providedOverridesForApplication:applicationID];
-		if ((providedOverrides & Choicy_Override_CustomTweakConfiguration) == Choicy_Override_CustomTweakConfiguration) {
-			overrideExists_ = YES;
-			if ([overrideProvider respondsToSelector:@selector(customTweakConfigurationAllowOrDenyListOverrideForApplication:)]) {
-				overrideValue = [overrideProvider customTweakConfigurationAllowOrDenyListOverrideForApplication:applicationID];
-				*stop = YES;
-			}
+	if ((providedOverrides & Choicy_Override_DisableTweakInjection) == Choicy_Override_DisableTweakInjection) {
+		if ([provider respondsToSelector:@selector(disableTweakInjectionOverrideForApplication:)]) {
+			record[kChoicyOverrideKeyDisableTweakInjection] = @([provider disableTweakInjectionOverrideForApplication:applicationID]);
+		}
+	}
+
+	if ((providedOverrides & Choicy_Override_CustomTweakConfiguration) == Choicy_Override_CustomTweakConfiguration) {
+		if ([provider respondsToSelector:@selector(customTweakConfigurationEnabledOverrideForApplication:)]) {
+			record[kChoicyOverrideKeyCustomTweakConfigurationEnabled] = @([provider customTweakConfigurationEnabledOverrideForApplication:applicationID]);
+		}
+		if ([provider respondsToSelector:@selector(customTweakConfigurationAllowDenyModeOverrideForApplication:)]) {
+			record[kChoicyOverrideKeyAllowDenyMode] = @([provider customTweakConfigurationAllowDenyModeOverrideForApplication:applicationID]);
+		}
+		if ([provider respondsToSelector:@selector(customTweakConfigurationAllowOrDenyListOverrideForApplication:)]) {
+			NSArray *allowOrDenyList = [provider customTweakConfigurationAllowOrDenyListOverrideForApplication:applicationID];
+			if (allowOrDenyList) record[kChoicyOverrideKeyAllowOrDenyList] = allowOrDenyList;
 		}
-	}];
+	}
 
-	if (overrideExists) *overrideExists = overrideExists_;
-	return overrideValue;
+	if ((providedOverrides & Choicy_Override_OverrideGlobalConfiguration) == Choicy_Override_OverrideGlobalConfiguration) {
+		if ([provider respondsToSelector:@selector(overwriteGlobalConfigurationOverrideForApplication:)]) {
+			record[kChoicyOverrideKeyOverwriteGlobalConfiguration] = @([provider overwriteGlobalConfigurationOverrideForApplication:applicationID]);
+		}
+	}
+
+	return record;
 }
 
-- (BOOL)overwriteGlobalConfigurationOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+- (NSDictionary *)overrideRecordForApplication:(NSString *)applicationID
 {
-	__block BOOL overrideExists_ = NO;
-	__block BOOL overrideValue = NO;
+	if (!applicationID) return nil;
+
+	os_unfair_lock_lock(&_lock);
+	id mergedRecord = _legacyProviderCount ? nil : _mergedRecords[applicationID];
+	NSArray *providers = mergedRecord ? nil : _overrideProviders.copy;
+	os_unfair_lock_unlock(&_lock);
 
-	[_overrideProviders enumerateObjectsUsingBlock:^(NSObject<ChoicyOverrideProvider> *overrideProvider, NSUInteger idx, BOOL *stop) {
-		uint32_t providedOverrides = [overrideProvider providedOverridesForApplication:applicationID];
-		if ((providedOverrides & Choicy_Override_OverrideGlobalConfiguration) == Choicy_Override_OverrideGlobalConfiguration) {
-			overrideExists_ = YES;
-			if ([overrideProvider respondsToSelector:@selector(overwriteGlobalConfigurationOverrideForApplication:)]) {
-				overrideValue = [overrideProvider overwriteGlobalConfigurationOverrideForApplication:applicationID];
-				*stop = YES;
+	if (mergedRecord) return mergedRecord == [NSNull null] ? nil : mergedRecord;
+
+	// Not precomputed, either because V1 providers are registered or because a V2 provider without a table has not been asked yet
+	NSMutableDictionary *record = [NSMutableDictionary new];
+	for (id provider in providers) {
+		NSDictionary *providerRecord;
+		if ([self providerIsV2:provider]) {
+			os_unfair_lock_lock(&_lock);
+			NSMutableDictionary *records = [_providerRecords objectForKey:provider];
+			id cachedRecord = records[applicationID];
+			os_unfair_lock_unlock(&_lock);
+
+			if (!cachedRecord && ![self providerHasTable:provider]) {
+				NSDictionary *fetchedRecord = [provider overrideRecordForApplication:applicationID];
+				cachedRecord = [fetchedRecord isKindOfClass:[NSDictionary class]] ? fetchedRecord.copy : [NSNull null];
+
+				os_unfair_lock_lock(&_lock);
+				if (records && !records[applicationID]) {
+					records[applicationID] = cachedRecord;
+					[self rebuildMergedRecordForApplication:applicationID];
+				}
+				os_unfair_lock_unlock(&_lock);
 			}
+			providerRecord = cachedRecord == [NSNull null] ? nil : cachedRecord;
+		}
+		else {
+			providerRecord = [self recordOfLegacyProvider:provider forApplication:applicationID];
 		}
-	}];
 
-	if (overrideExists) *overrideExists = overrideExists_;
-	return overrideValue;
+		[providerRecord enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+			if (!record[key]) record[key] = value;
+		}];
+	}
+
+	return record.count ? record.copy : nil;
+}
+
+- (BOOL)boolOverride:(NSString *)key forApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+{
+	NSNumber *value = [self overrideRecordForApplication:applicationID][key];
+	if (overrideExists) *overrideExists = [value isKindOfClass:[NSNumber class]];
+	return [value isKindOfClass:[NSNumber class]] ? value.boolValue : NO;
+}
+
+- (BOOL)disableTweakInjectionOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+{
+	return [self boolOverride:kChoicyOverrideKeyDisableTweakInjection forApplication:applicationID overrideExists:overrideExists];
+}
+
+- (BOOL)customTweakConfigurationEnabledOverwriteForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+{
+	return [self boolOverride:kChoicyOverrideKeyCustomTweakConfigurationEnabled forApplication:applicationID overrideExists:overrideExists];
+}
+
+- (BOOL)customTweakConfigurationAllowDenyModeOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+{
+	return [self boolOverride:kChoicyOverrideKeyAllowDenyMode forApplication:applicationID overrideExists:overrideExists];
+}
+
+- (NSArray *)customTweakConfigurationAllowOrDenyListOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+{
+	NSArray *value = [self overrideRecordForApplication:applicationID][kChoicyOverrideKeyAllowOrDenyList];
+	if (![value isKindOfClass:[NSArray class]]) value = nil;
+	if (overrideExists) *overrideExists = value != nil;
+	return value;
+}
+
+- (BOOL)overwriteGlobalConfigurationOverrideForApplication:(NSString *)applicationID overrideExists:(BOOL *)overrideExists
+{
+	return [self boolOverride:kChoicyOverrideKeyOverwriteGlobalConfiguration forApplication:applicationID overrideExists:overrideExists];
 }
 
-@end
\ No newline at end of file
+@end
@@ -38,4 +38,24 @@ enum {
 - (NSArray *)customTweakConfigurationAllowOrDenyListOverrideForApplication:(NSString *)applicationID;
 - (BOOL)overwriteGlobalConfigurationOverrideForApplication:(NSString *)applicationID;
 
-@end
\ No newline at end of file
+@end
+
+// Keys of an override record, a key being present means that the override exists
+#define kChoicyOverrideKeyDisableTweakInjection @"disableTweakInjection" // NSNumber (BOOL)
+#define kChoicyOverrideKeyCustomTweakConfigurationEnabled @"customTweakConfigurationEnabled" // NSNumber (BOOL)
+#define kChoicyOverrideKeyAllowDenyMode @"allowDenyMode" // NSNumber (BOOL), YES: Deny, NO: Allow
+#define kChoicyOverrideKeyAllowOrDenyList @"allowOrDenyList" // NSArray of dylib names
+#define kChoicyOverrideKeyOverwriteGlobalConfiguration @"overwriteGlobalConfiguration" // NSNumber (BOOL)
+
+// Answers all overrides of an application in one call, the results are cached by ChoicyOverrideManager
+// Whenever they change, the provider has to tell the manager through overridesDidChangeForApplications:ofProvider: or overrideTableDidChangeOfProvider:
+@protocol ChoicyOverrideProviderV2 <NSObject>
+
+@required
+- (NSDictionary *)overrideRecordForApplication:(NSString *)applicationID; // nil: no overrides
+
+@optional
+// Records of all applications that have overrides, if implemented overrideRecordForApplication: is never called for applications not in it
+- (NSDictionary<NSString *, NSDictionary *> *)overrideRecordTable;
+
+@end
@@ -1,9 +1,9 @@
 #import "SpringBoard.h"
 
-extern NSDictionary *preferences;
-
+NSDictionary *choicy_preferences(void);
 void choicy_reloadPreferences(void);
-BOOL choicy_shouldDisableTweakInjectionForApplication(NSString *applicationID);
-NSDictionary *choicy_applyEnvironmentChanges(NSDictionary *originalEnvironment, NSString *bundleIdentifier);
+BOOL choicy_shouldDisableTweakInjectionForApplication(NSString *applicationID, NSString *executablePath); // executablePath may be nil if it is not known
+NSDictionary *choicy_applyEnvironmentChanges(NSDictionary *originalEnvironment, NSString *bundleIdentifier, NSString *executablePath);
 void choicy_applyEnvironmentChangesToLaunchContext(RBSLaunchContext *launchContext);
-void choicy_applyEnvironmentChangesToExecutionContext(FBProcessExecutionContext *executionContext, NSString *bundleIdentifier);
\ No newline at end of file
+void choicy_applyEnvironmentChangesToExecutionContext(FBProcessExecutionContext *executionContext, NSString *bundleIdentifier);
+NSSet<NSString *> *choicy_applicationsToKillForPreferencesChange(NSDictionary *oldPreferences, NSDictionary *newPreferences);
\ No newline at end of file
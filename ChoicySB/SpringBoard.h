@@ -42,9 +42,16 @@
 @end
 
 @interface SBApplication : NSObject
+@property (nonatomic,readonly) NSString *bundleIdentifier;
 - (SBApplicationInfo *)_appInfo;
 @end
 
+@interface SBApplicationController : NSObject
++ (instancetype)sharedInstance;
+- (NSArray<SBApplication *> *)runningApplications;
+- (SBApplication *)applicationWithBundleIdentifier:(NSString *)bundleIdentifier;
+@end
+
 @interface SBSApplicationShortcutIcon : NSObject
 @end
 
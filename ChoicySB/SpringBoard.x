@@ -25,6 +25,10 @@
 #import <UIKit/UIKit.h>
 #import <libroot.h>
 #import "ChoicySB.h"
+#import "../ChoicyIndexBuilder.h"
+#import "../choicy_index.h"
+#import "../choicy_verdict.h"
+#import <MobileCoreServices/LSApplicationProxy.h>
 
 NSBundle *CHBundle;
 NSString *toggleOneTimeApplicationID;
@@ -34,10 +38,10 @@ BOOL choicy_shouldShow3DTouchOptionForDisableTweakInjectionState(BOOL disableTwe
 	BOOL shouldShow = NO;
 
 	if (disableTweakInjectionState) {
-		shouldShow = ((NSNumber *)[preferences objectForKey:@"launchWithTweaksOptionEnabled"]).boolValue;
+		shouldShow = ((NSNumber *)[choicy_preferences() objectForKey:@"launchWithTweaksOptionEnabled"]).boolValue;
 	}
 	else {
-		NSNumber *shouldShowNumber = [preferences objectForKey:@"launchWithoutTweaksOptionEnabled"];
+		NSNumber *shouldShowNumber = [choicy_preferences() objectForKey:@"launchWithoutTweaksOptionEnabled"];
 		if (shouldShowNumber) {
 			shouldShow = shouldShowNumber.boolValue; 
 		}
@@ -58,7 +62,7 @@ BOOL choicy_shouldShow3DTouchOptionForDisableTweakInjectionState(BOOL disableTwe
 	toggleOneTimeApplicationID = nil;
 	if (toggleOnce) {
 		NSMutableDictionary *environmentM = [executionContext.environment mutableCopy];
-		BOOL shouldDisableTweaks = !choicy_shouldDisableTweakInjectionForApplication(bundleIdentifier);
+		BOOL shouldDisableTweaks = !choicy_shouldDisableTweakInjectionForApplication(bundleIdentifier, [executionContext respondsToSelector:@selector(identity)] ? executionContext.identity.executablePath : nil);
 		if (shouldDisableTweaks) {
 			[environmentM setObject:@(shouldDisableTweaks) forKey:@"_MSSafeMode"];
 			[environmentM setObject:@(shouldDisableTweaks) forKey:@"_SafeMode"];
@@ -123,7 +127,7 @@ BOOL choicy_shouldShow3DTouchOptionForDisableTweakInjectionState(BOOL disableTwe
 		return orig;
 	}
 
-	BOOL tweakInjectionDisabled = choicy_shouldDisableTweakInjectionForApplication(applicationID);
+	BOOL tweakInjectionDisabled = choicy_shouldDisableTweakInjectionForApplication(applicationID, nil);
 
 	if (choicy_shouldShow3DTouchOptionForDisableTweakInjectionState(tweakInjectionDisabled)) {
 		SBSApplicationShortcutItem *toggleSafeModeOnceItem = [[%c(SBSApplicationShortcutItem) alloc] init];
@@ -178,7 +182,7 @@ BOOL choicy_shouldShow3DTouchOptionForDisableTweakInjectionState(BOOL disableTwe
 		return orig;
 	}
 
-	BOOL disableTweakInjection = choicy_shouldDisableTweakInjectionForApplication(applicationID);
+	BOOL disableTweakInjection = choicy_shouldDisableTweakInjectionForApplication(applicationID, nil);
 
 	if (choicy_shouldShow3DTouchOptionForDisableTweakInjectionState(disableTweakInjection)) {
 		SBSApplicationShortcutItem *toggleSafeModeOnceItem = [[%c(SBSApplicationShortcutItem) alloc] init];
@@ -245,12 +249,163 @@ void respring(CFNotificationCenterRef center, void *observer, CFStringRef name,
 	[[%c(FBSystemService) sharedInstance] exitAndRelaunch:YES];
 }
 
+void applicationsChanged(CFNotificationCenterRef center, void *observer, CFStringRef name, const void *object, CFDictionaryRef userInfo)
+{
+	// The Choicy index contains the executable names of configured apps, so it needs to be rebuilt when apps are (un)installed
+	[ChoicyIndexBuilder scheduleIndexUpdate];
+}
+
+static NSString *gKillSetApplicationID;
+static NSMutableDictionary<NSString *, NSNumber *> *gBundleIsApplicationCache;
+
+static bool choicy_bundleIsLoadedInApplication(const char *bundleIdentifierC)
+{
+	NSString *bundleIdentifier = [NSString stringWithUTF8String:bundleIdentifierC];
+	if ([bundleIdentifier isEqualToString:gKillSetApplicationID]) return true;
+
+	// Bundles of other apps are never loaded, frameworks might be
+	NSNumber *isApplication = gBundleIsApplicationCache[bundleIdentifier];
+	if (!isApplication) {
+		isApplication = @([LSApplicationProxy applicationProxyForIdentifier:bundleIdentifier].isInstalled);
+		gBundleIsApplicationCache[bundleIdentifier] = isApplication;
+	}
+	return !isApplication.boolValue;
+}
+
+// Same precedence as in the Choicy dylib, an entry of its own wins over the rules
+static NSDictionary *choicy_processPreferencesForApplication(NSDictionary *prefs, NSString *applicationID, NSString *executablePath)
+{
+	return processPreferencesForApplication(prefs, applicationID) ?: processPreferencesForRules(prefs, executablePath, applicationID, kChoicyRuleProcessTypeApp);
+}
+
+// Same decisions as evaluate_dylib in the Choicy dylib
+static NSSet<NSString *> *choicy_loadedTweaksForApplication(NSArray<NSString *> *applicableTweaks, NSDictionary *prefs, NSString *applicationID, NSString *executablePath)
+{
+	NSDictionary *processPrefs = choicy_processPreferencesForApplication(prefs, applicationID, executablePath);
+	if (![processPrefs isKindOfClass:[NSDictionary class]]) processPrefs = nil;
+
+	BOOL customTweakConfigurationEnabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO);
+	BOOL overwriteGlobalTweakConfiguration = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration], NO);
+	NSInteger allowDenyMode = parseNumberInteger(processPrefs[kChoicyProcessPrefsKeyAllowDenyMode], 1);
+	NSArray *globalDeniedTweaks = overwriteGlobalTweakConfiguration ? nil : prefs[kChoicyPrefsKeyGlobalDeniedTweaks];
+	NSArray *allowedTweaks = processPrefs[kChoicyProcessPrefsKeyAllowedTweaks];
+	NSArray *deniedTweaks = processPrefs[kChoicyProcessPrefsKeyDeniedTweaks];
+
+	choicy_verdict_process_t process = {
+		.app_bundle_identifier = applicationID.UTF8String,
+		.tweak_injection_disabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO),
+		.has_allow_list = customTweakConfigurationEnabled && allowDenyMode == 1 && [allowedTweaks isKindOfClass:[NSArray class]],
+		.has_deny_list = customTweakConfigurationEnabled && allowDenyMode == 2 && [deniedTweaks isKindOfClass:[NSArray class]],
+	};
+
+	NSMutableSet *loadedTweaks = [NSMutableSet new];
+	for (NSString *dylibName in applicableTweaks) {
+		// The dylib of Choicy itself is the only one that never goes through the verdict
+		if (![dylibName isEqualToString:kChoicyDylibName]) {
+			choicy_verdict_tweak_t tweak = {
+				.allowed = [allowedTweaks isKindOfClass:[NSArray class]] && [allowedTweaks containsObject:dylibName],
+				.denied = [deniedTweaks isKindOfClass:[NSArray class]] && [deniedTweaks containsObject:dylibName],
+				.globally_denied = [globalDeniedTweaks isKindOfClass:[NSArray class]] && [globalDeniedTweaks containsObject:dylibName],
+			};
+			if (!choicy_verdict_allows_loading(choicy_tweak_verdict(&process, dylibName.UTF8String, &tweak))) continue;
+		}
+		[loadedTweaks addObject:dylibName];
+	}
+	return loadedTweaks;
+}
+
+// Only applications whose set of loaded tweaks actually changes need to be killed
+NSSet<NSString *> *choicy_applicationsToKillForPreferencesChange(NSDictionary *oldPreferences, NSDictionary *newPreferences)
+{
+	NSMutableSet *applicationsToKill = [NSMutableSet new];
+	NSArray *globalDeniedTweaks = newPreferences[kChoicyPrefsKeyGlobalDeniedTweaks] ?: @[];
+	NSArray *oldGlobalDeniedTweaks = oldPreferences[kChoicyPrefsKeyGlobalDeniedTweaks] ?: @[];
+	BOOL globalDeniedTweaksChanged = ![[NSSet setWithArray:globalDeniedTweaks] isEqualToSet:[NSSet setWithArray:oldGlobalDeniedTweaks]];
+
+	SBApplicationController *applicationController = [%c(SBApplicationController) sharedInstance];
+	NSArray *runningApplications = [applicationController respondsToSelector:@selector(runningApplications)] ? [applicationController runningApplications] : nil;
+
+	choicy_index_t index = {0};
+	if (!runningApplications || choicy_index_map(kChoicyIndexPath.fileSystemRepresentation, &index) != 0 || !choicy_index_tweak_dir_is_current(&index)) {
+		choicy_index_unmap(&index);
+
+		// Without the index, fall back to killing every app whose effective configuration changed
+		NSDictionary *appSettings = newPreferences[kChoicyPrefsKeyAppSettings];
+		NSDictionary *oldAppSettings = oldPreferences[kChoicyPrefsKeyAppSettings];
+		NSMutableSet *allApps = [NSMutableSet setWithArray:appSettings.allKeys];
+		[allApps unionSet:[NSSet setWithArray:oldAppSettings.allKeys]];
+		for (NSString *applicationID in allApps) {
+			if (![effectiveProcessPreferences(appSettings[applicationID]) isEqualToDictionary:effectiveProcessPreferences(oldAppSettings[applicationID])]) {
+				[applicationsToKill addObject:applicationID];
+			}
+		}
+
+		// Apps without an entry of their own can still be matched by rules, only running ones matter
+		NSArray *rules = newPreferences[kChoicyPrefsKeyRules];
+		NSArray *oldRules = oldPreferences[kChoicyPrefsKeyRules];
+		if ((rules || oldRules) && ![rules isEqual:oldRules]) {
+			for (SBApplication *application in runningApplications) {
+				NSString *applicationID = application.bundleIdentifier;
+				if (!applicationID || [allApps containsObject:applicationID]) continue;
+				NSString *executablePath = application._appInfo.executableURL.path;
+				if (![effectiveProcessPreferences(processPreferencesForRules(newPreferences, executablePath, applicationID, kChoicyRuleProcessTypeApp)) isEqualToDictionary:effectiveProcessPreferences(processPreferencesForRules(oldPreferences, executablePath, applicationID, kChoicyRuleProcessTypeApp))]) {
+					[applicationsToKill addObject:applicationID];
+				}
+			}
+		}
+		return applicationsToKill;
+	}
+
+	gBundleIsApplicationCache = [NSMutableDictionary new];
+	uint32_t tweakCount = index.header->tweak_count;
+	uint64_t applicableBits[choicy_bitset_words(tweakCount) ?: 1];
+
+	for (SBApplication *application in runningApplications) {
+		NSString *applicationID = application.bundleIdentifier;
+		if (!applicationID) continue;
+
+		// Nothing that influences this app changed
+		NSString *executablePath = application._appInfo.executableURL.path;
+		NSDictionary *processPrefs = choicy_processPreferencesForApplication(newPreferences, applicationID, executablePath);
+		NSDictionary *oldProcessPrefs = choicy_processPreferencesForApplication(oldPreferences, applicationID, executablePath);
+		if (!globalDeniedTweaksChanged && [effectiveProcessPreferences(processPrefs) isEqualToDictionary:effectiveProcessPreferences(oldProcessPrefs)]) continue;
+
+		NSString *executableName = executablePath.lastPathComponent;
+		if (!executableName) {
+			[applicationsToKill addObject:applicationID];
+			continue;
+		}
+
+		gKillSetApplicationID = applicationID;
+		choicy_index_applicable_tweaks(&index, executableName.fileSystemRepresentation, &kCFCoreFoundationVersionNumber, choicy_bundleIsLoadedInApplication, applicableBits);
+
+		NSMutableArray *applicableTweaks = [NSMutableArray new];
+		for (uint32_t idx = 0; idx < tweakCount; idx++) {
+			if (choicy_bitset_test(applicableBits, idx)) {
+				[applicableTweaks addObject:@(choicy_index_string(&index, choicy_index_tweak(&index, idx)->name_off))];
+			}
+		}
+
+		if (![choicy_loadedTweaksForApplication(applicableTweaks, oldPreferences, applicationID, executablePath) isEqualToSet:choicy_loadedTweaksForApplication(applicableTweaks, newPreferences, applicationID, executablePath)]) {
+			[applicationsToKill addObject:applicationID];
+		}
+	}
+
+	gKillSetApplicationID = nil;
+	gBundleIsApplicationCache = nil;
+	choicy_index_unmap(&index);
+
+	return applicationsToKill;
+}
+
 void choicy_initSpringBoard(void)
 {
 	%init();
 
 	CHBundle = [NSBundle bundleWithPath:JBROOT_PATH_NSSTRING(@"/Library/Application Support/Choicy.bundle")];
 	CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), NULL, respring, CFSTR("com.opa334.choicy/respring"), NULL, CFNotificationSuspensionBehaviorDeliverImmediately);
+	CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), NULL, applicationsChanged, CFSTR("com.apple.LaunchServices.applicationRegistered"), NULL, CFNotificationSuspensionBehaviorCoalesce);
+	CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), NULL, applicationsChanged, CFSTR("com.apple.LaunchServices.applicationUnregistered"), NULL, CFNotificationSuspensionBehaviorCoalesce);
 
 	if (kCFCoreFoundationVersionNumber >= kCFCoreFoundationVersionNumber_iOS_13_0) {
 		%init(Shortcut_iOS13Up);
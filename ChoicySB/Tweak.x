@@ -1,11 +1,27 @@
 #import <Foundation/Foundation.h>
 #import "../Shared.h"
 #import "../ChoicyPrefsMigrator.h"
+#import "../ChoicyIndexBuilder.h"
 #import "ChoicyOverrideManager.h"
 #import "ChoicySB.h"
+#import "../choicy_index.h"
+#import <notify.h>
+#import <os/lock.h>
+#import <MobileCoreServices/LSApplicationProxy.h>
 
-NSDictionary *preferences;
+@interface LSBundleProxy ()
+@property (nonatomic,readonly) NSString *bundleExecutable;
+@end
+
+static NSDictionary *preferences;
 BOOL gIsSpringBoard = NO;
+BOOL gIsRunningBoardd = NO;
+BOOL gPreferencesAreStale = NO;
+os_unfair_lock gPreferencesLock = OS_UNFAIR_LOCK_INIT;
+
+choicy_index_t gIndex;
+int gIndexGenerationToken = NOTIFY_TOKEN_INVALID;
+os_unfair_lock gIndexLock = OS_UNFAIR_LOCK_INIT;
 
 extern void choicy_initSpringBoard(void);
 extern void choicy_initRunningBoardd(void);
@@ -17,44 +33,157 @@ NSString *safe_getExecutablePath()
 	return [NSString stringWithUTF8String:executablePathC];
 }
 
-void choicy_reloadPreferences(void)
+// Remaps the Choicy index whenever SpringBoard published a new generation of it, gIndexLock needs to be held
+choicy_index_t *choicy_mappedIndex(void)
 {
-	if (preferences) {
-		NSDictionary *oldPreferences = [preferences copy];
-		preferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
+	if (gIndexGenerationToken == NOTIFY_TOKEN_INVALID) {
+		if (notify_register_check(CHOICY_INDEX_GENERATION_NOTIFICATION, &gIndexGenerationToken) != NOTIFY_STATUS_OK) {
+			gIndexGenerationToken = NOTIFY_TOKEN_INVALID;
+			return NULL;
+		}
+	}
+
+	// The first check after registering always reports a change
+	int changed = 0;
+	notify_check(gIndexGenerationToken, &changed);
+	if (changed) {
+		choicy_index_unmap(&gIndex);
+		choicy_index_map(kChoicyIndexPath.fileSystemRepresentation, &gIndex);
+	}
 
-		if (gIsSpringBoard) {
-			NSDictionary *appSettings = [preferences objectForKey:kChoicyPrefsKeyAppSettings];
-			NSDictionary *oldAppSettings = [oldPreferences objectForKey:kChoicyPrefsKeyAppSettings];
+	return gIndex.header ? &gIndex : NULL;
+}
+
+// Same as choicy_mappedIndex, but only returns the index if its snapshot of the preferences is current
+choicy_index_t *choicy_currentIndex(void)
+{
+	choicy_index_t *index = choicy_mappedIndex();
+	if (!index || !choicy_index_prefs_are_current(index, kChoicyPrefsPlistPath.fileSystemRepresentation)) return NULL;
+	return index;
+}
 
-			NSMutableSet *allApps = [NSMutableSet setWithArray:[appSettings allKeys]];
-			[allApps unionSet:[NSMutableSet setWithArray:[oldAppSettings allKeys]]];
+// Encodes a list of dylib names as a set of tweak indices into the Choicy index, falls back to a ':' separated list of names if any of them is not in it
+NSString *choicy_encodeTweakList(NSArray<NSString *> *tweakList)
+{
+	NSString *encodedList = nil;
 
-			NSMutableSet *changedApps = [NSMutableSet new];
+	os_unfair_lock_lock(&gIndexLock);
+	choicy_index_t *index = choicy_mappedIndex();
+	if (index && tweakList.count && choicy_index_tweak_dir_is_current(index)) {
+		uint32_t words = index->header->bitset_words;
+		uint64_t bits[words ?: 1];
+		memset(bits, 0, sizeof(bits));
 
-			for (NSString *appKey in allApps) {
-				if (![((NSDictionary *)[appSettings objectForKey:appKey]) isEqualToDictionary:((NSDictionary *)[oldAppSettings objectForKey:appKey])]) {
-					[changedApps addObject:appKey];
-				}
+		BOOL allFound = YES;
+		for (NSString *dylibName in tweakList) {
+			int32_t tweakIndex = choicy_index_find_tweak(index, dylibName.UTF8String);
+			if (tweakIndex < 0) {
+				allFound = NO;
+				break;
 			}
+			choicy_bitset_set(bits, tweakIndex);
+		}
 
-			for (NSString *applicationID in changedApps) {
-				if (![applicationID isEqualToString:kSpringboardBundleID] && ![applicationID isEqualToString:kPreferencesBundleID]) {
-					BKSTerminateApplicationForReasonAndReportWithDescription(applicationID, 5, false, @"Choicy - prefs changed, killed");
-				}
+		if (allFound) {
+			// Prefix, 16 digits of generation, separator, 16 digits per word and terminator
+			char encoded[19 + words * 16];
+			if (choicy_tweak_set_encode(index, bits, encoded, sizeof(encoded))) {
+				encodedList = [NSString stringWithUTF8String:encoded];
 			}
 		}
 	}
-	else {
+	os_unfair_lock_unlock(&gIndexLock);
+
+	return encodedList ?: [tweakList componentsJoinedByString:@":"];
+}
+
+// runningboardd only marks the preferences as stale when they change, so everything reading them has to go through here
+NSDictionary *choicy_preferences(void)
+{
+	os_unfair_lock_lock(&gPreferencesLock);
+	if (gPreferencesAreStale) {
+		gPreferencesAreStale = NO;
+		preferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
+	}
+	NSDictionary *currentPreferences = preferences;
+	os_unfair_lock_unlock(&gPreferencesLock);
+	return currentPreferences;
+}
+
+void choicy_reloadPreferences(void)
+{
+	// runningboardd uses the snapshot of the preferences in the Choicy index, only parse the plist when that is not usable
+	if (gIsRunningBoardd) {
+		os_unfair_lock_lock(&gPreferencesLock);
+		gPreferencesAreStale = YES;
+		os_unfair_lock_unlock(&gPreferencesLock);
+		return;
+	}
+
+	NSDictionary *oldPreferences = choicy_preferences();
+	if (!oldPreferences) {
 		NSString *parentDir = [kChoicyPrefsPlistPath stringByDeletingLastPathComponent];
 		if (![[NSFileManager defaultManager] fileExistsAtPath:parentDir]) {
 			[[NSFileManager defaultManager] createDirectoryAtPath:parentDir withIntermediateDirectories:YES attributes:nil error:nil];
 		}
-		preferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
 	}
+
+	NSDictionary *newPreferences = [NSDictionary dictionaryWithContentsOfFile:kChoicyPrefsPlistPath];
+	os_unfair_lock_lock(&gPreferencesLock);
+	preferences = newPreferences;
+	os_unfair_lock_unlock(&gPreferencesLock);
+
+	if (oldPreferences && gIsSpringBoard) {
+		[ChoicyIndexBuilder scheduleIndexUpdateIfNeeded];
+
+		NSSet *changedApps = choicy_applicationsToKillForPreferencesChange(oldPreferences, newPreferences);
+
+		for (NSString *applicationID in changedApps) {
+			if (![applicationID isEqualToString:kSpringboardBundleID] && ![applicationID isEqualToString:kPreferencesBundleID]) {
+				BKSTerminateApplicationForReasonAndReportWithDescription(applicationID, 5, false, @"Choicy - prefs changed, killed");
+			}
+		}
+	}
+}
+
+static NSString *choicy_executablePathForApplication(NSString *applicationID)
+{
+	if (gIsSpringBoard) {
+		SBApplication *application = [[%c(SBApplicationController) sharedInstance] applicationWithBundleIdentifier:applicationID];
+		NSString *executablePath = application._appInfo.executableURL.path;
+		if (executablePath) return executablePath;
+	}
+
+	LSApplicationProxy *appProxy = [LSApplicationProxy applicationProxyForIdentifier:applicationID];
+	NSString *bundleExecutable = appProxy.bundleExecutable;
+	if (!bundleExecutable) return nil;
+	return [appProxy.bundleURL URLByAppendingPathComponent:bundleExecutable].path;
+}
+
+// Returns NO if there is no index, needsExecutablePathOut is set instead of matching if only a rule that selects by path could apply
+static BOOL choicy_indexDisablesTweakInjection(NSString *applicationID, NSString *executablePath, BOOL *needsExecutablePathOut, BOOL *disabledOut)
+{
+	os_unfair_lock_lock(&gIndexLock);
+	choicy_index_t *index = choicy_currentIndex();
+	if (index) {
+		const choicy_index_process_t *process = choicy_index_find_process(index, CHOICY_PROCESS_KIND_APP, applicationID.UTF8String);
+		uint32_t flags = process ? process->flags : 0;
+		if (!process && index->header->rule_count) {
+			if (!executablePath && needsExecutablePathOut) {
+				*needsExecutablePathOut = YES;
+			}
+			else {
+				int32_t ruleIdx = choicy_index_match_rule(index, executablePath.fileSystemRepresentation, applicationID.UTF8String, CHOICY_RULE_PROCESS_TYPE_APP);
+				if (ruleIdx != -1) flags = choicy_index_rule(index, ruleIdx)->flags;
+			}
+		}
+		*disabledOut = (flags & CHOICY_PROCESS_FLAG_TWEAK_INJECTION_DISABLED) && ![applicationID isEqualToString:kPreferencesBundleID];
+	}
+	os_unfair_lock_unlock(&gIndexLock);
+	return index != NULL;
 }
 
-BOOL choicy_shouldDisableTweakInjectionForApplication(NSString *applicationID)
+BOOL choicy_shouldDisableTweakInjectionForApplication(NSString *applicationID, NSString *executablePath)
 {
 	BOOL safeMode = NO;
 
@@ -64,7 +193,23 @@ BOOL choicy_shouldDisableTweakInjectionForApplication(NSString *applicationID)
 		return disableTweakInjectionOverrideValue;
 	}
 
-	NSDictionary *settingsForApp = processPreferencesForApplication(preferences, applicationID);
+	if (gIsRunningBoardd) {
+		BOOL needsExecutablePath = NO;
+		BOOL hasIndex = choicy_indexDisablesTweakInjection(applicationID, executablePath, &needsExecutablePath, &safeMode);
+		if (needsExecutablePath) {
+			// Looked up without holding gIndexLock, LaunchServices may have to ask lsd
+			executablePath = choicy_executablePathForApplication(applicationID);
+			hasIndex = choicy_indexDisablesTweakInjection(applicationID, executablePath, NULL, &safeMode);
+		}
+		if (hasIndex) return safeMode;
+	}
+
+	NSDictionary *currentPreferences = choicy_preferences();
+	NSDictionary *settingsForApp = processPreferencesForApplication(currentPreferences, applicationID);
+	if (!settingsForApp && [currentPreferences[kChoicyPrefsKeyRules] count]) {
+		if (!executablePath) executablePath = choicy_executablePathForApplication(applicationID);
+		settingsForApp = processPreferencesForRules(currentPreferences, executablePath, applicationID, kChoicyRuleProcessTypeApp);
+	}
 
 	if (settingsForApp && [settingsForApp isKindOfClass:[NSDictionary class]]) {
 		if (![applicationID isEqualToString:kPreferencesBundleID]) {
@@ -75,39 +220,46 @@ BOOL choicy_shouldDisableTweakInjectionForApplication(NSString *applicationID)
 	return safeMode;
 }
 
-NSDictionary *choicy_applyEnvironmentChanges(NSDictionary *originalEnvironment, NSString *bundleIdentifier)
+NSDictionary *choicy_applyEnvironmentChanges(NSDictionary *originalEnvironment, NSString *bundleIdentifier, NSString *executablePath)
 {
 	if (originalEnvironment[@"_MSSafeMode"] || originalEnvironment[@"_SafeMode"]) {
 		// "Launch without tweaks" pressed on SpringBoard
 		return originalEnvironment;
 	}
-	else if (originalEnvironment[@"_ChoicyInjectionEnabledFromSpringBoard"]) {
+
+	NSMutableDictionary *newEnvironment = originalEnvironment.mutableCopy ?: [NSMutableDictionary new];
+
+	// Saves the Choicy dylib from having to read the Info.plist of the app
+	if (bundleIdentifier) {
+		[newEnvironment setObject:bundleIdentifier forKey:@kEnvBundleIdentifier];
+	}
+
+	if (originalEnvironment[@"_ChoicyInjectionEnabledFromSpringBoard"]) {
 		// "Launch with tweaks" pressed on SpringBoard
-		return originalEnvironment;
+		return newEnvironment;
 	}
 
-	NSMutableDictionary *newEnvironment = originalEnvironment.mutableCopy ?: [NSMutableDictionary new];
-	if (choicy_shouldDisableTweakInjectionForApplication(bundleIdentifier)) {
+	if (choicy_shouldDisableTweakInjectionForApplication(bundleIdentifier, executablePath)) {
 		[newEnvironment setObject:@(1) forKey:@"_MSSafeMode"];
 		[newEnvironment setObject:@(1) forKey:@"_SafeMode"];
 	}
 	else {
-		ChoicyOverrideManager *overrideManager = [ChoicyOverrideManager sharedManager];
-		BOOL overrideExists = NO;
+		// All overrides of the application in one lookup from the merged table of the override manager
+		NSDictionary *overrideRecord = [[ChoicyOverrideManager sharedManager] overrideRecordForApplication:bundleIdentifier];
 
-		BOOL customTweakConfigurationEnabledOverride = [overrideManager customTweakConfigurationEnabledOverwriteForApplication:bundleIdentifier overrideExists:&overrideExists];
-		if (overrideExists) {
-			if (!customTweakConfigurationEnabledOverride) {
+		NSNumber *customTweakConfigurationEnabledOverride = overrideRecord[kChoicyOverrideKeyCustomTweakConfigurationEnabled];
+		if (customTweakConfigurationEnabledOverride) {
+			if (!customTweakConfigurationEnabledOverride.boolValue) {
 				// if custom tweak configuration has been overwritten with NO
 				// set up an empty deny list
 				[newEnvironment setObject:@"" forKey:@kEnvDeniedTweaksOverride];
 			}
 			else {
-				BOOL customTweakAllowDenyOverride = [overrideManager customTweakConfigurationAllowDenyModeOverrideForApplication:bundleIdentifier overrideExists:&overrideExists];
-				NSArray *allowDenyList = [overrideManager customTweakConfigurationAllowOrDenyListOverrideForApplication:bundleIdentifier overrideExists:&overrideExists];
+				BOOL customTweakAllowDenyOverride = [overrideRecord[kChoicyOverrideKeyAllowDenyMode] boolValue];
+				NSArray *allowDenyList = overrideRecord[kChoicyOverrideKeyAllowOrDenyList];
 
-				if (overrideManager && allowDenyList) {
-					NSString *allowDenyString = [allowDenyList componentsJoinedByString:@":"];
+				if (allowDenyList) {
+					NSString *allowDenyString = choicy_encodeTweakList(allowDenyList);
 
 					NSString *envName;
 					if (customTweakAllowDenyOverride) { // DENY
@@ -124,11 +276,10 @@ NSDictionary *choicy_applyEnvironmentChanges(NSDictionary *originalEnvironment,
 			}
 		}
 
-		BOOL overwriteGlobalConfigurationOverride = [overrideManager overwriteGlobalConfigurationOverrideForApplication:bundleIdentifier overrideExists:&overrideExists];
-		//NSLog(@"overwriteGlobalConfigurationOverride=%i overrideExists=%i", overwriteGlobalConfigurationOverride, overrideExists);
-		if (overrideExists) {
+		NSNumber *overwriteGlobalConfigurationOverride = overrideRecord[kChoicyOverrideKeyOverwriteGlobalConfiguration];
+		if (overwriteGlobalConfigurationOverride) {
 			NSString *envToSet;
-			if (overwriteGlobalConfigurationOverride) {
+			if (overwriteGlobalConfigurationOverride.boolValue) {
 				envToSet = @"1";
 			}
 			else {
@@ -150,12 +301,14 @@ void choicy_applyEnvironmentChangesToLaunchContext(RBSLaunchContext *launchConte
 	else {
 		bundleIdentifier = launchContext.identity.embeddedApplicationIdentifier;
 	}
-	launchContext._additionalEnvironment = choicy_applyEnvironmentChanges(launchContext._additionalEnvironment, bundleIdentifier);
+	NSString *executablePath = [launchContext respondsToSelector:@selector(identity)] ? launchContext.identity.executablePath : nil;
+	launchContext._additionalEnvironment = choicy_applyEnvironmentChanges(launchContext._additionalEnvironment, bundleIdentifier, executablePath);
 }
 
 void choicy_applyEnvironmentChangesToExecutionContext(FBProcessExecutionContext *executionContext, NSString *bundleIdentifier)
 {
-	executionContext.environment = choicy_applyEnvironmentChanges(executionContext.environment, bundleIdentifier);
+	NSString *executablePath = [executionContext respondsToSelector:@selector(identity)] ? executionContext.identity.executablePath : nil;
+	executionContext.environment = choicy_applyEnvironmentChanges(executionContext.environment, bundleIdentifier, executablePath);
 }
 
 %ctor
@@ -163,8 +316,9 @@ void choicy_applyEnvironmentChangesToExecutionContext(FBProcessExecutionContext
 	choicy_reloadPreferences();
 	CFNotificationCenterAddObserver(CFNotificationCenterGetDarwinNotifyCenter(), NULL, (CFNotificationCallback)choicy_reloadPreferences, CFSTR("com.opa334.choicyprefs/ReloadPrefs"), NULL, CFNotificationSuspensionBehaviorDeliverImmediately);
 
-	if (preferences && [ChoicyPrefsMigrator preferencesNeedMigration:preferences]) {
-		NSMutableDictionary *preferencesM = preferences.mutableCopy;
+	NSDictionary *currentPreferences = choicy_preferences();
+	if (currentPreferences && [ChoicyPrefsMigrator preferencesNeedMigration:currentPreferences]) {
+		NSMutableDictionary *preferencesM = currentPreferences.mutableCopy;
 		[ChoicyPrefsMigrator migratePreferences:preferencesM];
 		[ChoicyPrefsMigrator updatePreferenceVersion:preferencesM];
 		[preferencesM writeToFile:kChoicyPrefsPlistPath atomically:NO];
@@ -174,9 +328,11 @@ void choicy_applyEnvironmentChangesToExecutionContext(FBProcessExecutionContext
 	NSString *executablePath = safe_getExecutablePath();
 	if ([executablePath.lastPathComponent isEqualToString:@"SpringBoard"]) {
 		gIsSpringBoard = YES;
+		[ChoicyIndexBuilder scheduleIndexUpdateIfNeeded];
 		choicy_initSpringBoard();
 	}
 	else if ([executablePath.lastPathComponent isEqualToString:@"runningboardd"]) {
+		gIsRunningBoardd = YES;
 		choicy_initRunningBoardd();
 	}
 }
\ No newline at end of file
@@ -27,23 +27,47 @@ extern NSBundle *CHBundle;
 extern NSString *localize(NSString *key);
 extern NSDictionary *processPreferencesForApplication(NSDictionary *preferences, NSString *applicationID);
 extern NSDictionary *processPreferencesForDaemon(NSDictionary *preferences, NSString *daemonDisplayName);
+extern NSDictionary *processPreferencesForRules(NSDictionary *preferences, NSString *executablePath, NSString *bundleIdentifier, NSString *processType);
+extern NSDictionary *effectiveProcessPreferences(NSDictionary *processPreferences);
 
 extern BOOL parseNumberBool(id number, BOOL default_);
 extern NSInteger parseNumberInteger(id number, NSInteger default_);
 
 #define kChoicyPrefsPlistPath JBROOT_PATH(@"/var/mobile/Library/Preferences/com.opa334.choicyprefs.plist")
+#define kChoicyIndexPath JBROOT_PATH(@"/var/mobile/Library/Preferences/com.opa334.choicy.index")
+#define kChoicyDaemonListSnapshotPath JBROOT_PATH(@"/var/mobile/Library/Caches/com.opa334.choicy.daemonlist.plist")
+#define kChoicyProfilesPlistPath JBROOT_PATH(@"/var/mobile/Library/Preferences/com.opa334.choicy.profiles.plist")
+#define kChoicyShadowLogPath JBROOT_PATH(@"/var/mobile/Library/Caches/com.opa334.choicy.shadow.log")
 #define kChoicyDylibName @"   Choicy"
 
 #define kChoicyPrefsKeyGlobalDeniedTweaks @"globalDeniedTweaks"
 #define kChoicyPrefsKeyAppSettings @"appSettings"
 #define kChoicyPrefsKeyDaemonSettings @"daemonSettings"
 #define kChoicyPrefsKeyAdditionalExecutables @"additionalExecutables"
+#define kChoicyPrefsKeyShadowSampleRate @"shadowSampleRate"
+#define kChoicyPrefsKeyRules @"rules"
 #define kChoicyProcessPrefsKeyTweakInjectionDisabled @"tweakInjectionDisabled"
 #define kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled @"customTweakConfigurationEnabled"
 #define kChoicyProcessPrefsKeyAllowDenyMode @"allowDenyMode"
 #define kChoicyProcessPrefsKeyDeniedTweaks @"deniedTweaks"
 #define kChoicyProcessPrefsKeyAllowedTweaks @"allowedTweaks"
 #define kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration @"overwriteGlobalTweakConfiguration"
+#define kChoicyPrefsKeyActiveProfile @"activeProfile"
+
+// Keys of the profile store, which is kept out of the preferences so that the tweak never has to parse it
+#define kChoicyProfilesKeyProfiles @"profiles" // name -> delta over the base
+#define kChoicyProfilesKeyBase @"base" // settings when the first profile was saved
+#define kChoicyProfilesKeyNoProfileSettings @"noProfileSettings" // settings to go back to when deactivating a profile
+
+// Rules apply process preferences to every process matching their selectors, all selectors are optional
+// Processes with an entry in appSettings / daemonSettings ignore rules, otherwise the first matching rule in the array wins
+#define kChoicyRuleKeyExecutablePath @"executablePath" // glob (fnmatch) against the full executable path
+#define kChoicyRuleKeyBundleIdentifier @"bundleIdentifier" // glob against the bundle identifier, never matches daemons
+#define kChoicyRuleKeyProcessTypes @"processTypes" // array of kChoicyRuleProcessType*, empty = any
+#define kChoicyRuleKeyPreferences @"preferences" // same keys as the entries in appSettings / daemonSettings
+#define kChoicyRuleProcessTypeApp @"app"
+#define kChoicyRuleProcessTypePlugin @"plugin"
+#define kChoicyRuleProcessTypeDaemon @"daemon"
 
 // pre 1.4 keys
 #define kChoicyPrefsKeyGlobalDeniedTweaks_LEGACY @"globalTweakBlacklist"
@@ -62,6 +86,7 @@ extern NSInteger parseNumberInteger(id number, NSInteger default_);
 #define kEnvDeniedTweaksOverride "CHOICY_DENIED_TWEAKS_OVERRIDE"
 #define kEnvAllowedTweaksOverride "CHOICY_ALLOWED_TWEAKS_OVERRIDE"
 #define kEnvOverwriteGlobalConfigurationOverride "CHOICY_OVERWRITE_GLOBAL_TWEAK_CONFIGURATION_OVERRIDE"
+#define kEnvBundleIdentifier "CHOICY_BUNDLE_IDENTIFIER"
 
 #define kNoDisableTweakInjectionToggle @[kPreferencesBundleID]
 #define kAlwaysInjectGlobal @[kChoicyDylibName, @"MobileSafety"]
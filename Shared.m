@@ -20,6 +20,7 @@
 
 #import "Shared.h"
 #import "libroot.h"
+#import <fnmatch.h>
 
 BOOL parseNumberBool(id number, BOOL default_)
 {
@@ -84,4 +85,57 @@ NSDictionary *processPreferencesForDaemon(NSDictionary *preferences, NSString *d
 {
 	NSDictionary *daemonSettings = [preferences objectForKey:kChoicyPrefsKeyDaemonSettings];
 	return [daemonSettings objectForKey:daemonDisplayName];
-}
\ No newline at end of file
+}
+
+static BOOL ruleSelectorMatches(NSDictionary *rule, NSString *key, NSString *subject)
+{
+	NSString *pattern = rule[key];
+	if (![pattern isKindOfClass:[NSString class]] || !pattern.length) return YES;
+	return subject && fnmatch(pattern.UTF8String, subject.UTF8String, 0) == 0;
+}
+
+// Same as matching_rule_preferences in the Choicy dylib, subjects that are nil only match rules that don't select by them
+NSDictionary *processPreferencesForRules(NSDictionary *preferences, NSString *executablePath, NSString *bundleIdentifier, NSString *processType)
+{
+	NSArray *rules = preferences[kChoicyPrefsKeyRules];
+	if (![rules isKindOfClass:[NSArray class]]) return nil;
+
+	for (NSDictionary *rule in rules) {
+		if (![rule isKindOfClass:[NSDictionary class]] || ![rule[kChoicyRuleKeyPreferences] isKindOfClass:[NSDictionary class]]) continue;
+
+		NSArray *processTypes = rule[kChoicyRuleKeyProcessTypes];
+		if ([processTypes isKindOfClass:[NSArray class]] && processTypes.count && ![processTypes containsObject:processType]) continue;
+
+		if (ruleSelectorMatches(rule, kChoicyRuleKeyExecutablePath, executablePath) && ruleSelectorMatches(rule, kChoicyRuleKeyBundleIdentifier, bundleIdentifier)) {
+			return rule[kChoicyRuleKeyPreferences];
+		}
+	}
+	return nil;
+}
+
+// Reduces process preferences to the values that actually influence injection, so that equivalent configurations compare as equal
+NSDictionary *effectiveProcessPreferences(NSDictionary *processPreferences)
+{
+	if (![processPreferences isKindOfClass:[NSDictionary class]]) return @{};
+
+	if (parseNumberBool(processPreferences[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO)) {
+		return @{ kChoicyProcessPrefsKeyTweakInjectionDisabled : @YES };
+	}
+
+	NSMutableDictionary *effectivePreferences = [NSMutableDictionary new];
+
+	if (parseNumberBool(processPreferences[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO)) {
+		NSInteger allowDenyMode = parseNumberInteger(processPreferences[kChoicyProcessPrefsKeyAllowDenyMode], 1);
+		NSString *listKey = allowDenyMode == 2 ? kChoicyProcessPrefsKeyDeniedTweaks : kChoicyProcessPrefsKeyAllowedTweaks;
+		NSArray *list = processPreferences[listKey];
+
+		effectivePreferences[kChoicyProcessPrefsKeyAllowDenyMode] = @(allowDenyMode == 2 ? 2 : 1);
+		effectivePreferences[listKey] = [NSSet setWithArray:[list isKindOfClass:[NSArray class]] ? list : @[]];
+	}
+
+	if (parseNumberBool(processPreferences[kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration], NO)) {
+		effectivePreferences[kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration] = @YES;
+	}
+
+	return effectivePreferences.copy;
+}
@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <mach-o/dyld.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <xpc/xpc.h>
 #include <libgen.h>
 #include <os/log.h>
@@ -30,15 +32,37 @@
 #include <mach-o/dyld.h>
 #include <mach-o/getsect.h>
 #include <ptrauth.h>
+#include <stdatomic.h>
+#include <uuid/uuid.h>
+#include <mach/mach_time.h>
+#include <fnmatch.h>
 #include <litehook.h>
+#include <CoreFoundation/CoreFoundation.h>
 #include "dyld_interpose.h"
 #include "nextstep_plist.h"
+#include "plist_scanner.h"
+#include "choicy_index.h"
+#include "choicy_shadow_log.h"
+#include "choicy_verdict.h"
 
+// Hooks are generated from the table in gen.c, see gen_asm.sh
 void *(*dlopen_orig)(const char*, int);
 void *dlopen_hook(const char *path, int mode);
+void *(*dlopen_from_orig)(const char*, int, void *) = NULL;
+void *dlopen_from_hook(const char *path, int mode, void *lr);
+bool (*dlopen_preflight_orig)(const char *) = NULL;
+bool dlopen_preflight_hook(const char *path);
 
 void *(*dyld_dlopen_orig)(const void *, const char*, int);
 void *dyld_dlopen_hook(const void *dyld, const char *path, int mode);
+void *(*dyld_dlopen_from_orig)(const void *, const char*, int, void *) = NULL;
+void *dyld_dlopen_from_hook(const void *dyld, const char *path, int mode, void *lr);
+
+// Once set, all hooks pass straight through to the original without calling should_load_dylib
+_Atomic bool gHooksPassthrough = false;
+
+void pending_tweak_did_pass(int32_t tweakIndex);
+void remove_hooks_if_done(void);
 
 bool gShouldLog = true;
 #define os_log_dbg(args ...) if (gShouldLog) os_log_with_type(OS_LOG_DEFAULT, OS_LOG_TYPE_DEBUG, args)
@@ -48,7 +72,10 @@ extern xpc_object_t xpc_create_from_plist(const void *buf, size_t len);
 #define kEnvDeniedTweaksOverride "CHOICY_DENIED_TWEAKS_OVERRIDE"
 #define kEnvAllowedTweaksOverride "CHOICY_ALLOWED_TWEAKS_OVERRIDE"
 #define kEnvOverwriteGlobalConfigurationOverride "CHOICY_OVERWRITE_GLOBAL_TWEAK_CONFIGURATION_OVERRIDE"
+#define kEnvBundleIdentifier "CHOICY_BUNDLE_IDENTIFIER"
 #define kChoicyPrefsPlistPath JBROOT_PATH("/var/mobile/Library/Preferences/com.opa334.choicyprefs.plist")
+#define kChoicyIndexPath JBROOT_PATH("/var/mobile/Library/Preferences/com.opa334.choicy.index")
+#define kChoicyShadowLogPath JBROOT_PATH("/var/mobile/Library/Caches/com.opa334.choicy.shadow.log")
 #define kChoicyPrefsKeyGlobalDeniedTweaks "globalDeniedTweaks"
 #define kChoicyPrefsKeyAppSettings "appSettings"
 #define kChoicyPrefsKeyDaemonSettings "daemonSettings"
@@ -58,6 +85,14 @@ extern xpc_object_t xpc_create_from_plist(const void *buf, size_t len);
 #define kChoicyProcessPrefsKeyDeniedTweaks "deniedTweaks"
 #define kChoicyProcessPrefsKeyAllowedTweaks "allowedTweaks"
 #define kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration "overwriteGlobalTweakConfiguration"
+#define kChoicyPrefsKeyRules "rules"
+#define kChoicyRuleKeyExecutablePath "executablePath"
+#define kChoicyRuleKeyBundleIdentifier "bundleIdentifier"
+#define kChoicyRuleKeyProcessTypes "processTypes"
+#define kChoicyRuleKeyPreferences "preferences"
+#define kChoicyRuleProcessTypeApp "app"
+#define kChoicyRuleProcessTypePlugin "plugin"
+#define kChoicyRuleProcessTypeDaemon "daemon"
 #define kPreferencesBundleID "com.apple.Preferences"
 #define kSpringboardBundleID "com.apple.springboard"
 
@@ -76,6 +111,34 @@ xpc_object_t gAllowedTweaks = NULL;
 xpc_object_t gDeniedTweaks = NULL;
 xpc_object_t gGlobalDeniedTweaks = NULL;
 
+choicy_index_t gIndex = {0};
+bool gIndexTweaksAreCurrent = false;
+uint64_t *gApplicableTweaks = NULL;
+uint64_t *gRulePathCandidates = NULL;
+
+// Allow / deny list overrides from the environment that were encoded as sets of tweak indices, decoded into static storage
+#define TWEAK_SET_MAX_WORDS 64
+uint64_t gAllowedTweakBitsStorage[TWEAK_SET_MAX_WORDS];
+uint64_t gDeniedTweakBitsStorage[TWEAK_SET_MAX_WORDS];
+const uint64_t *gAllowedTweakBits = NULL;
+const uint64_t *gDeniedTweakBits = NULL;
+
+// Verdicts of should_load_dylib, direct mapped by path hash
+// Each slot holds the upper bits of the hash as a tag, a valid bit and the verdict, so a lookup is a single atomic load
+#define DECISION_CACHE_SIZE 256
+#define DECISION_CACHE_VALID (1ull << 1)
+#define DECISION_CACHE_ALLOW (1ull << 0)
+#define DECISION_CACHE_TAG_MASK ~(DECISION_CACHE_VALID | DECISION_CACHE_ALLOW)
+_Atomic uint64_t gDecisionCache[DECISION_CACHE_SIZE];
+
+// Once every applicable tweak went through the hooks, the tweak loader is done and the hooks in gDyld get removed again
+void **gHookedDyld = NULL;
+uint32_t gHookedDlopenSlot = 0;
+uint32_t gHookedDlopenFromSlot = 0;
+_Atomic uint64_t *gPendingTweaks = NULL;
+_Atomic uint32_t gPendingTweakCount = 0;
+_Atomic uint32_t gHookCallsInFlight = 0;
+
 bool string_has_prefix(const char *str, const char* prefix)
 {
 	if (!str || !prefix) {
@@ -199,6 +262,31 @@ void parse_allow_deny_list(const char *listStr, xpc_object_t *arrOut)
 	*arrOut = xArr;
 }
 
+void parse_allow_deny_override(const char *listStr, xpc_object_t *arrOut, uint64_t *bitsStorage, const uint64_t **bitsOut)
+{
+	if (!listStr) return;
+
+	if (listStr[0] != CHOICY_TWEAK_SET_PREFIX) {
+		parse_allow_deny_list(listStr, arrOut);
+		return;
+	}
+
+	if (gIndex.header && choicy_tweak_set_decode(&gIndex, listStr, bitsStorage, TWEAK_SET_MAX_WORDS)) {
+		*bitsOut = bitsStorage;
+		return;
+	}
+
+	// Only happens if the tweaks changed between the launch and now
+	// Never fall back to the preferences, the override has to win, so an empty allow list blocks everything but the crucial tweaks
+	os_log_err("Choicy failed to decode tweak set from environment: %{public}s", listStr);
+	if (!gAllowedTweaks) gAllowedTweaks = xpc_array_create(NULL, 0);
+}
+
+bool tweak_list_is_overwritten(void)
+{
+	return gDeniedTweaks || gAllowedTweaks || gDeniedTweakBits || gAllowedTweakBits;
+}
+
 void load_global_preferences(xpc_object_t preferencesXdict, xpc_object_t processPreferencesXdict)
 {
 	bool overwriteGlobalConfig = false;
@@ -255,59 +343,261 @@ void load_process_preferences(xpc_object_t preferencesXdict, xpc_object_t proces
 	}
 }
 
-void load_process_info(void)
+void load_index(void)
 {
-	// Load executable path
-	uint32_t executablePathSize = 0;
-	_NSGetExecutablePath(NULL, &executablePathSize);
-	gExecutablePath = malloc(executablePathSize);
-	_NSGetExecutablePath(gExecutablePath, &executablePathSize);
+	if (gIndex.header) return;
+	if (choicy_index_map(kChoicyIndexPath, &gIndex) != 0) {
+		os_log_dbg("Choicy index not available, falling back to parsing plists");
+		return;
+	}
 
-	// Calling os_log from inside logd or notifyd deadlocks the system, prevent that...
-	if (!strcmp(gExecutablePath, "/usr/libexec/logd") || !strcmp(gExecutablePath, "/usr/sbin/notifyd")) gShouldLog = false;
+	gIndexTweaksAreCurrent = choicy_index_tweak_dir_is_current(&gIndex);
+	if (!gIndexTweaksAreCurrent) {
+		os_log_dbg("Tweaks in Choicy index are stale, falling back to parsing tweak plists");
+	}
 
-	// Load process type
-	char *executableDir = path_copy_dirname(gExecutablePath);
-	if (string_has_suffix(executableDir, ".app"))		 gProcessType = PROCESS_TYPE_APP;
-	else if (string_has_suffix(executableDir, ".appex")) gProcessType = PROCESS_TYPE_PLUGIN;
-	else												 gProcessType = PROCESS_TYPE_BINARY;
+	os_log_dbg("Loaded Choicy index (generation %llu, %u tweaks)", gIndex.header->generation, gIndex.header->tweak_count);
+}
 
-	os_log_dbg("Identified process type: %d\n", gProcessType);
+// The executable path never changes, so it is only walked through the matcher once and reused by process_is_unconfigured and load_preferences_from_index
+const uint64_t *rule_path_candidates(choicy_index_t *index)
+{
+	if (gRulePathCandidates) return gRulePathCandidates;
 
-	// Load application identifier
-	size_t infoPlistPathSize = strlen(executableDir) + strlen("/Info.plist") + 1;
-	char infoPlistPath[infoPlistPathSize];
-	strlcpy(infoPlistPath, executableDir, infoPlistPathSize);
-	strlcat(infoPlistPath, "/Info.plist", infoPlistPathSize);
-	free(executableDir);
-	if ((gProcessType == PROCESS_TYPE_APP || gProcessType == PROCESS_TYPE_PLUGIN) && access(infoPlistPath, R_OK) == 0) {
-		xpc_object_t infoXdict = xpc_object_from_plist(infoPlistPath);
-		if (infoXdict && xpc_get_type(infoXdict) == XPC_TYPE_DICTIONARY) {
-			const char *bundleIdentifier = xpc_dictionary_get_string(infoXdict, "CFBundleIdentifier");
-			if (bundleIdentifier) {
-				gBundleIdentifier = strdup(bundleIdentifier);
-				os_log_dbg("Identified bundle identifier: %{PUBLIC}s", gBundleIdentifier);
+	gRulePathCandidates = calloc(choicy_bitset_words(index->header->rule_count) ?: 1, sizeof(uint64_t));
+	if (!gRulePathCandidates) return NULL;
+	if (gExecutablePath) choicy_index_rule_candidates(index, CHOICY_MATCHER_ROOT_PATH, gExecutablePath, gRulePathCandidates);
+	return gRulePathCandidates;
+}
+
+bool process_is_unconfigured(const char *environmentBundleIdentifier)
+{
+	// Overrides from the environment always need the full path
+	if (getenv(kEnvDeniedTweaksOverride) || getenv(kEnvAllowedTweaksOverride)) return false;
+
+	load_index();
+	if (!gIndex.header || !choicy_index_prefs_are_current(&gIndex, kChoicyPrefsPlistPath)) return false;
+
+	// The global configuration applies to all processes
+	uint32_t globalDeniedCount = 0;
+	choicy_index_list(&gIndex, gIndex.header->global_denied_off, &globalDeniedCount);
+	if (globalDeniedCount) return false;
+
+	const char *executableName = strrchr(gExecutablePath, '/');
+	if (!executableName) return false;
+
+	size_t dirLength = executableName - gExecutablePath;
+	bool isApp = dirLength >= 4 && !strncmp(executableName - 4, ".app", 4);
+	bool isPlugin = dirLength >= 6 && !strncmp(executableName - 6, ".appex", 6);
+
+	// Apps and plugins are configured by bundle identifier, rules selecting by it can't be checked this early
+	if ((isApp || isPlugin) && (gIndex.header->prefs_flags & CHOICY_INDEX_PREFS_FLAG_BUNDLE_RULES)) return false;
+
+	// Rules select processes by pattern, so they are not part of the bloom filter
+	uint32_t ruleProcessType = isApp ? CHOICY_RULE_PROCESS_TYPE_APP : (isPlugin ? CHOICY_RULE_PROCESS_TYPE_PLUGIN : CHOICY_RULE_PROCESS_TYPE_DAEMON);
+	if (gIndex.header->rule_count) {
+		const uint64_t *pathCandidates = rule_path_candidates(&gIndex);
+		if (!pathCandidates || choicy_index_match_rule_candidates(&gIndex, gExecutablePath, pathCandidates, NULL, NULL, ruleProcessType) != -1) return false;
+	}
+
+	if (choicy_index_process_may_be_configured(&gIndex, &executableName[1])) return false;
+
+	// Bundles the index couldn't resolve an executable name for are in the bloom filter by bundle identifier
+	if ((isApp || isPlugin) && (gIndex.header->prefs_flags & CHOICY_INDEX_PREFS_FLAG_BLOOM_BUNDLE_IDENTIFIERS)) {
+		char *bundleIdentifier = NULL;
+		if (isApp && environmentBundleIdentifier) {
+			bundleIdentifier = strdup(environmentBundleIdentifier);
+		}
+		else {
+			char infoPlistPath[dirLength + sizeof("/Info.plist")];
+			memcpy(infoPlistPath, gExecutablePath, dirLength);
+			strcpy(&infoPlistPath[dirLength], "/Info.plist");
+			bundleIdentifier = plist_scan_copy_string(infoPlistPath, "CFBundleIdentifier");
+		}
+		if (!bundleIdentifier) return false;
+		bool mayBeConfigured = choicy_index_process_may_be_configured(&gIndex, bundleIdentifier);
+		free(bundleIdentifier);
+		if (mayBeConfigured) return false;
+	}
+
+	return true;
+}
+
+uint32_t rule_process_type(void)
+{
+	switch (gProcessType) {
+		case PROCESS_TYPE_APP:
+			return CHOICY_RULE_PROCESS_TYPE_APP;
+		case PROCESS_TYPE_PLUGIN:
+			return CHOICY_RULE_PROCESS_TYPE_PLUGIN;
+		default:
+			return CHOICY_RULE_PROCESS_TYPE_DAEMON;
+	}
+}
+
+xpc_object_t xpc_array_from_index_list(choicy_index_t *index, uint32_t listOff)
+{
+	uint32_t count = 0;
+	const uint32_t *list = choicy_index_list(index, listOff, &count);
+	xpc_object_t xArr = xpc_array_create(NULL, 0);
+	for (uint32_t i = 0; i < count; i++) {
+		xpc_array_set_string(xArr, XPC_ARRAY_APPEND, choicy_index_string(index, list[i]));
+	}
+	return xArr;
+}
+
+// Same as load_global_preferences and load_process_preferences, but using the snapshot in the Choicy index
+void load_preferences_from_index(choicy_index_t *index)
+{
+	const choicy_index_process_t *process = NULL;
+	if (gBundleIdentifier) {
+		process = choicy_index_find_process(index, CHOICY_PROCESS_KIND_APP, gBundleIdentifier);
+	}
+	else {
+		const char *executableName = strrchr(gExecutablePath, '/');
+		if (executableName) {
+			process = choicy_index_find_process(index, CHOICY_PROCESS_KIND_DAEMON, &executableName[1]);
+		}
+	}
+
+	// Without an entry of its own, the process is configured by the first rule that matches it
+	choicy_index_process_t ruleProcess;
+	if (!process && index->header->rule_count) {
+		const uint64_t *pathCandidates = rule_path_candidates(index);
+		uint64_t bundleCandidates[choicy_bitset_words(index->header->rule_count)];
+		memset(bundleCandidates, 0, sizeof(bundleCandidates));
+		if (gBundleIdentifier) choicy_index_rule_candidates(index, CHOICY_MATCHER_ROOT_BUNDLE, gBundleIdentifier, bundleCandidates);
+		int32_t ruleIdx = pathCandidates ? choicy_index_match_rule_candidates(index, gExecutablePath, pathCandidates, gBundleIdentifier, bundleCandidates, rule_process_type()) : choicy_index_match_rule(index, gExecutablePath, gBundleIdentifier, rule_process_type());
+		if (ruleIdx != -1) {
+			const choicy_index_rule_t *rule = choicy_index_rule(index, ruleIdx);
+			ruleProcess = (choicy_index_process_t){ .flags = rule->flags, .allow_deny_mode = rule->allow_deny_mode, .allowed_off = rule->allowed_off, .denied_off = rule->denied_off };
+			process = &ruleProcess;
+			os_log_dbg("Process matches rule %d", ruleIdx);
+		}
+	}
+
+	bool overwriteGlobalConfig = false;
+	char *overwriteEnvConfigStr = getenv(kEnvOverwriteGlobalConfigurationOverride);
+	if (overwriteEnvConfigStr) {
+		overwriteGlobalConfig = !strcmp(overwriteEnvConfigStr, "1");
+	}
+	else if (process) {
+		overwriteGlobalConfig = process->flags & CHOICY_PROCESS_FLAG_OVERWRITE_GLOBAL_TWEAK_CONFIGURATION;
+	}
+
+	if (!overwriteGlobalConfig && index->header->global_denied_off) {
+		gGlobalDeniedTweaks = xpc_array_from_index_list(index, index->header->global_denied_off);
+	}
+
+	if (!tweak_list_is_overwritten() && process) {
+		if (getenv("_ChoicyInjectionEnabledFromSpringBoard")) {
+			gTweakInjectionDisabled = false;
+		}
+		else {
+			gTweakInjectionDisabled = process->flags & CHOICY_PROCESS_FLAG_TWEAK_INJECTION_DISABLED;
+		}
+
+		if (process->flags & CHOICY_PROCESS_FLAG_CUSTOM_TWEAK_CONFIGURATION_ENABLED) {
+			if (process->allow_deny_mode == 2 && process->denied_off) { // DENY
+				gDeniedTweaks = xpc_array_from_index_list(index, process->denied_off);
+			}
+			else if (process->allow_deny_mode == 1 && process->allowed_off) { // ALLOW
+				gAllowedTweaks = xpc_array_from_index_list(index, process->allowed_off);
 			}
-			xpc_release(infoXdict);
 		}
 	}
+}
 
-	// Load overwrites from environment
-	parse_allow_deny_list(getenv(kEnvDeniedTweaksOverride), &gDeniedTweaks);
-	parse_allow_deny_list(getenv(kEnvAllowedTweaksOverride), &gAllowedTweaks);
+bool decision_cache_lookup(uint64_t pathHash, bool *verdictOut)
+{
+	uint64_t entry = atomic_load_explicit(&gDecisionCache[pathHash % DECISION_CACHE_SIZE], memory_order_relaxed);
+	if (!(entry & DECISION_CACHE_VALID) || (entry & DECISION_CACHE_TAG_MASK) != (pathHash & DECISION_CACHE_TAG_MASK)) return false;
+	*verdictOut = entry & DECISION_CACHE_ALLOW;
+	return true;
+}
 
-	if (gDeniedTweaks && gShouldLog && os_log_debug_enabled(OS_LOG_DEFAULT)) {
-		char *gDeniedTweaksDesc = xpc_copy_description(gDeniedTweaks);
-		os_log_dbg("Loaded denied tweaks from environment: %{PUBLIC}s", gDeniedTweaksDesc ?: "<none>");
-		if (gDeniedTweaksDesc) free(gDeniedTweaksDesc);
+void decision_cache_store(uint64_t pathHash, bool verdict)
+{
+	uint64_t entry = (pathHash & DECISION_CACHE_TAG_MASK) | DECISION_CACHE_VALID | (verdict ? DECISION_CACHE_ALLOW : 0);
+	atomic_store_explicit(&gDecisionCache[pathHash % DECISION_CACHE_SIZE], entry, memory_order_relaxed);
+}
+
+char *copy_bundle_identifier(const char *infoPlistPath, char *environmentBundleIdentifier)
+{
+	// Passed by runningboardd / SpringBoard when launching the app
+	if (gProcessType == PROCESS_TYPE_APP && environmentBundleIdentifier) {
+		os_log_dbg("Bundle identifier from environment");
+		return strdup(environmentBundleIdentifier);
 	}
-	if (gAllowedTweaks && gShouldLog && os_log_debug_enabled(OS_LOG_DEFAULT)) {
-		char *gAllowedTweaksDesc = xpc_copy_description(gAllowedTweaks);
-		os_log_dbg("Loaded allowed tweaks from environment: %{PUBLIC}s", gAllowedTweaksDesc ?: "<none>");
-		if (gAllowedTweaksDesc) free(gAllowedTweaksDesc);
+
+	// launchd service name of apps is "UIKitApplication:<bundle identifier>[<suffix>]"
+	char *serviceName = getenv("XPC_SERVICE_NAME");
+	if (gProcessType == PROCESS_TYPE_APP && serviceName && string_has_prefix(serviceName, "UIKitApplication:")) {
+		char *bundleIdentifierStart = &serviceName[strlen("UIKitApplication:")];
+		size_t bundleIdentifierLength = strcspn(bundleIdentifierStart, "[");
+		if (bundleIdentifierLength > 0) {
+			os_log_dbg("Bundle identifier from XPC service name");
+			return strndup(bundleIdentifierStart, bundleIdentifierLength);
+		}
+	}
+
+	if (access(infoPlistPath, R_OK) != 0) return NULL;
+
+	// Only look at CFBundleIdentifier instead of parsing the whole Info.plist
+	char *bundleIdentifier = plist_scan_copy_string(infoPlistPath, "CFBundleIdentifier");
+	if (bundleIdentifier) return bundleIdentifier;
+
+	xpc_object_t infoXdict = xpc_object_from_plist(infoPlistPath);
+	if (infoXdict && xpc_get_type(infoXdict) == XPC_TYPE_DICTIONARY) {
+		const char *infoBundleIdentifier = xpc_dictionary_get_string(infoXdict, "CFBundleIdentifier");
+		if (infoBundleIdentifier) {
+			bundleIdentifier = strdup(infoBundleIdentifier);
+		}
+	}
+	if (infoXdict) xpc_release(infoXdict);
+	return bundleIdentifier;
+}
+
+bool rule_selector_matches(xpc_object_t ruleXdict, const char *key, const char *subject)
+{
+	const char *pattern = xpc_dictionary_get_string(ruleXdict, key);
+	if (!pattern || !*pattern) return true;
+	return subject && fnmatch(pattern, subject, 0) == 0;
+}
+
+bool rule_process_types_match(xpc_object_t ruleXdict)
+{
+	xpc_object_t processTypesXarr = xpc_dictionary_get_value(ruleXdict, kChoicyRuleKeyProcessTypes);
+	if (!processTypesXarr || xpc_get_type(processTypesXarr) != XPC_TYPE_ARRAY || !xpc_array_get_count(processTypesXarr)) return true;
+
+	const char *processTypeName = gProcessType == PROCESS_TYPE_APP ? kChoicyRuleProcessTypeApp : (gProcessType == PROCESS_TYPE_PLUGIN ? kChoicyRuleProcessTypePlugin : kChoicyRuleProcessTypeDaemon);
+	return xpc_array_contains_string(processTypesXarr, processTypeName);
+}
+
+// Plist counterpart of choicy_index_match_rule, returns the preferences of the first rule that matches this process
+xpc_object_t matching_rule_preferences(xpc_object_t preferencesXdict)
+{
+	xpc_object_t rulesXarr = xpc_dictionary_get_value(preferencesXdict, kChoicyPrefsKeyRules);
+	if (!rulesXarr || xpc_get_type(rulesXarr) != XPC_TYPE_ARRAY) return NULL;
+
+	size_t count = xpc_array_get_count(rulesXarr);
+	for (size_t i = 0; i < count; i++) {
+		xpc_object_t ruleXdict = xpc_array_get_value(rulesXarr, i);
+		if (xpc_get_type(ruleXdict) != XPC_TYPE_DICTIONARY) continue;
+		xpc_object_t rulePreferencesXdict = xpc_dictionary_get_value(ruleXdict, kChoicyRuleKeyPreferences);
+		if (!rulePreferencesXdict || xpc_get_type(rulePreferencesXdict) != XPC_TYPE_DICTIONARY) continue;
+
+		if (rule_process_types_match(ruleXdict) &&
+			rule_selector_matches(ruleXdict, kChoicyRuleKeyExecutablePath, gExecutablePath) &&
+			rule_selector_matches(ruleXdict, kChoicyRuleKeyBundleIdentifier, gBundleIdentifier)) {
+			return rulePreferencesXdict;
+		}
 	}
+	return NULL;
+}
 
-	// Load preferences
+void load_preferences_from_plist(void)
+{
 	xpc_object_t preferencesXdict = xpc_object_from_plist(kChoicyPrefsPlistPath);
 	if (preferencesXdict) {
 		if (xpc_get_type(preferencesXdict) == XPC_TYPE_DICTIONARY) {
@@ -335,6 +625,10 @@ void load_process_info(void)
 				}
 			}
 
+			if (!processPreferencesXdict) {
+				processPreferencesXdict = matching_rule_preferences(preferencesXdict);
+			}
+
 			if (processPreferencesXdict && gShouldLog && os_log_debug_enabled(OS_LOG_DEFAULT)) {
 				char *processPreferencesXdictDesc = xpc_copy_description(processPreferencesXdict);
 				os_log_dbg("Loaded process preferences: %{PUBLIC}s", processPreferencesXdictDesc ?: "<none>");
@@ -350,7 +644,7 @@ void load_process_info(void)
 			}
 
 			// If neither the allow nor the deny list has been overwritten from the environment, load them from preferences
-			if (!gDeniedTweaks && !gAllowedTweaks && processPreferencesXdict) {
+			if (!tweak_list_is_overwritten() && processPreferencesXdict) {
 				load_process_preferences(preferencesXdict, processPreferencesXdict);
 
 				if (gDeniedTweaks && os_log_debug_enabled(OS_LOG_DEFAULT)) {
@@ -372,12 +666,265 @@ void load_process_info(void)
 	}
 }
 
+// Shadow mode, see choicy_shadow_log.h
+uint32_t gShadowSampleRate = 0;
+
+bool shadow_should_sample(void)
+{
+	return gShadowSampleRate && arc4random_uniform(100) < gShadowSampleRate;
+}
+
+uint64_t shadow_now_ns(void)
+{
+	static mach_timebase_info_data_t timebase;
+	if (!timebase.denom) mach_timebase_info(&timebase);
+	return mach_absolute_time() * timebase.numer / timebase.denom;
+}
+
+void shadow_record(uint8_t kind, bool mismatch, bool fastResult, bool referenceResult, uint64_t fastNs, uint64_t referenceNs, const char *subject)
+{
+	choicy_shadow_record_t record = {0};
+	record.magic = CHOICY_SHADOW_RECORD_MAGIC;
+	record.kind = kind;
+	record.mismatch = mismatch;
+	record.fast_result = fastResult;
+	record.reference_result = referenceResult;
+	record.timestamp = time(NULL);
+	record.fast_ns = fastNs;
+	record.reference_ns = referenceNs;
+	const char *executableName = strrchr(gExecutablePath, '/');
+	strlcpy(record.process, executableName ? &executableName[1] : gExecutablePath, sizeof(record.process));
+	if (subject) strlcpy(record.subject, subject, sizeof(record.subject));
+
+	if (mismatch) {
+		os_log_err("Choicy shadow mode mismatch (kind %u, %{public}s): fast path %d, reference %d", kind, subject ?: "<none>", fastResult, referenceResult);
+	}
+
+	// The log lives in a directory owned by mobile, so only processes running as mobile may touch it
+	// For everything else (and sandboxed processes that can't open it) mismatches only end up in the system log
+	if (geteuid() != 501) return;
+
+	int fd = open(kChoicyShadowLogPath, O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_NOCTTY, 0644);
+	if (fd < 0) return;
+
+	struct stat logStat;
+	if (fstat(fd, &logStat) != 0 || !S_ISREG(logStat.st_mode) || logStat.st_uid != geteuid()) {
+		close(fd);
+		return;
+	}
+	if (logStat.st_size >= CHOICY_SHADOW_LOG_MAX_SIZE) ftruncate(fd, 0);
+	write(fd, &record, sizeof(record));
+	close(fd);
+}
+
+// Everything loading the preferences can change
+typedef struct {
+	bool tweakInjectionDisabled;
+	xpc_object_t allowedTweaks;
+	xpc_object_t deniedTweaks;
+	xpc_object_t globalDeniedTweaks;
+} preferences_state_t;
+
+void preferences_state_capture(preferences_state_t *state)
+{
+	state->tweakInjectionDisabled = gTweakInjectionDisabled;
+	state->allowedTweaks = gAllowedTweaks;
+	state->deniedTweaks = gDeniedTweaks;
+	state->globalDeniedTweaks = gGlobalDeniedTweaks;
+}
+
+void preferences_state_restore(const preferences_state_t *state)
+{
+	gTweakInjectionDisabled = state->tweakInjectionDisabled;
+	gAllowedTweaks = state->allowedTweaks;
+	gDeniedTweaks = state->deniedTweaks;
+	gGlobalDeniedTweaks = state->globalDeniedTweaks;
+}
+
+bool xpc_equal_or_null(xpc_object_t a, xpc_object_t b)
+{
+	if (!a || !b) return a == b;
+	return xpc_equal(a, b);
+}
+
+bool preferences_state_equal(const preferences_state_t *a, const preferences_state_t *b)
+{
+	return a->tweakInjectionDisabled == b->tweakInjectionDisabled &&
+		xpc_equal_or_null(a->allowedTweaks, b->allowedTweaks) &&
+		xpc_equal_or_null(a->deniedTweaks, b->deniedTweaks) &&
+		xpc_equal_or_null(a->globalDeniedTweaks, b->globalDeniedTweaks);
+}
+
+// Releases every object of state that was not already part of baseState
+void preferences_state_release(preferences_state_t *state, const preferences_state_t *baseState)
+{
+	if (state->allowedTweaks && state->allowedTweaks != baseState->allowedTweaks) xpc_release(state->allowedTweaks);
+	if (state->deniedTweaks && state->deniedTweaks != baseState->deniedTweaks) xpc_release(state->deniedTweaks);
+	if (state->globalDeniedTweaks && state->globalDeniedTweaks != baseState->globalDeniedTweaks) xpc_release(state->globalDeniedTweaks);
+}
+
+// Loads the preferences from the plist again, starting from the state before they were loaded from the index, and compares the results
+void shadow_verify_preferences(const preferences_state_t *environmentState, uint64_t fastNs)
+{
+	preferences_state_t fastState;
+	preferences_state_capture(&fastState);
+
+	preferences_state_restore(environmentState);
+	uint64_t start = shadow_now_ns();
+	load_preferences_from_plist();
+	uint64_t referenceNs = shadow_now_ns() - start;
+	preferences_state_t referenceState;
+	preferences_state_capture(&referenceState);
+
+	bool mismatch = !preferences_state_equal(&fastState, &referenceState);
+	shadow_record(CHOICY_SHADOW_KIND_PREFERENCES, mismatch, fastState.tweakInjectionDisabled, referenceState.tweakInjectionDisabled, fastNs, referenceNs, NULL);
+
+	// On a mismatch, keep what the plist says
+	if (mismatch) {
+		preferences_state_release(&fastState, environmentState);
+	}
+	else {
+		preferences_state_release(&referenceState, environmentState);
+		preferences_state_restore(&fastState);
+	}
+}
+
+void load_process_info(void)
+{
+	// Load executable path
+	uint32_t executablePathSize = 0;
+	_NSGetExecutablePath(NULL, &executablePathSize);
+	gExecutablePath = malloc(executablePathSize);
+	_NSGetExecutablePath(gExecutablePath, &executablePathSize);
+
+	// The bundle identifier from the environment is only meant for this process and not for anything it spawns
+	char *environmentBundleIdentifier = getenv(kEnvBundleIdentifier);
+	if (environmentBundleIdentifier) {
+		environmentBundleIdentifier = strdup(environmentBundleIdentifier);
+		unsetenv(kEnvBundleIdentifier);
+	}
+
+	// Calling os_log from inside logd or notifyd deadlocks the system, prevent that...
+	if (!strcmp(gExecutablePath, "/usr/libexec/logd") || !strcmp(gExecutablePath, "/usr/sbin/notifyd")) gShouldLog = false;
+
+	// Most processes are not configured at all, if the Choicy index can tell us that, there is nothing else to load
+	if (process_is_unconfigured(environmentBundleIdentifier)) {
+		os_log_dbg("Process is not configured, skipping");
+		choicy_index_unmap(&gIndex);
+		if (environmentBundleIdentifier) free(environmentBundleIdentifier);
+		return;
+	}
+
+	// Load process type
+	char *executableDir = path_copy_dirname(gExecutablePath);
+	if (string_has_suffix(executableDir, ".app"))		 gProcessType = PROCESS_TYPE_APP;
+	else if (string_has_suffix(executableDir, ".appex")) gProcessType = PROCESS_TYPE_PLUGIN;
+	else												 gProcessType = PROCESS_TYPE_BINARY;
+
+	os_log_dbg("Identified process type: %d\n", gProcessType);
+
+	// Load application identifier
+	size_t infoPlistPathSize = strlen(executableDir) + strlen("/Info.plist") + 1;
+	char infoPlistPath[infoPlistPathSize];
+	strlcpy(infoPlistPath, executableDir, infoPlistPathSize);
+	strlcat(infoPlistPath, "/Info.plist", infoPlistPathSize);
+	free(executableDir);
+	if (gProcessType == PROCESS_TYPE_APP || gProcessType == PROCESS_TYPE_PLUGIN) {
+		gBundleIdentifier = copy_bundle_identifier(infoPlistPath, environmentBundleIdentifier);
+		if (gBundleIdentifier) {
+			os_log_dbg("Identified bundle identifier: %{PUBLIC}s", gBundleIdentifier);
+		}
+	}
+	if (environmentBundleIdentifier) free(environmentBundleIdentifier);
+
+	// Load overwrites from environment
+	// SpringBoard passes them as sets of indices into the Choicy index when it can, so the index needs to be loaded first
+	load_index();
+	parse_allow_deny_override(getenv(kEnvDeniedTweaksOverride), &gDeniedTweaks, gDeniedTweakBitsStorage, &gDeniedTweakBits);
+	parse_allow_deny_override(getenv(kEnvAllowedTweaksOverride), &gAllowedTweaks, gAllowedTweakBitsStorage, &gAllowedTweakBits);
+
+	if (gDeniedTweaks && gShouldLog && os_log_debug_enabled(OS_LOG_DEFAULT)) {
+		char *gDeniedTweaksDesc = xpc_copy_description(gDeniedTweaks);
+		os_log_dbg("Loaded denied tweaks from environment: %{PUBLIC}s", gDeniedTweaksDesc ?: "<none>");
+		if (gDeniedTweaksDesc) free(gDeniedTweaksDesc);
+	}
+	if (gAllowedTweaks && gShouldLog && os_log_debug_enabled(OS_LOG_DEFAULT)) {
+		char *gAllowedTweaksDesc = xpc_copy_description(gAllowedTweaks);
+		os_log_dbg("Loaded allowed tweaks from environment: %{PUBLIC}s", gAllowedTweaksDesc ?: "<none>");
+		if (gAllowedTweaksDesc) free(gAllowedTweaksDesc);
+	}
+	if (gDeniedTweakBits || gAllowedTweakBits) {
+		os_log_dbg("Loaded %{public}s tweaks from environment as a set of tweak indices", gDeniedTweakBits ? "denied" : "allowed");
+	}
+
+	// Load preferences, preferably from the snapshot in the Choicy index
+	if (gIndex.header && choicy_index_prefs_are_current(&gIndex, kChoicyPrefsPlistPath)) {
+		os_log_dbg("Loading preferences from Choicy index");
+		gShadowSampleRate = gIndex.header->shadow_sample_rate;
+
+		preferences_state_t environmentState;
+		preferences_state_capture(&environmentState);
+		uint64_t start = gShadowSampleRate ? shadow_now_ns() : 0;
+		load_preferences_from_index(&gIndex);
+		if (shadow_should_sample()) {
+			shadow_verify_preferences(&environmentState, shadow_now_ns() - start);
+		}
+		return;
+	}
+
+	load_preferences_from_plist();
+}
+
+CFBundleRef (*CFBundleGetBundleWithIdentifier_ptr)(CFStringRef) = NULL;
+CFStringRef (*CFStringCreateWithCString_ptr)(CFAllocatorRef, const char *, CFStringEncoding) = NULL;
+void (*CFRelease_ptr)(CFTypeRef) = NULL;
+
+bool bundle_is_loaded(const char *bundleIdentifier)
+{
+	CFStringRef bundleIdentifierString = CFStringCreateWithCString_ptr(NULL, bundleIdentifier, kCFStringEncodingUTF8);
+	if (!bundleIdentifierString) return true;
+	bool isLoaded = CFBundleGetBundleWithIdentifier_ptr(bundleIdentifierString) != NULL;
+	CFRelease_ptr(bundleIdentifierString);
+	return isLoaded;
+}
+
+void load_applicable_tweaks(void)
+{
+	if (!gIndexTweaksAreCurrent || gApplicableTweaks) return;
+
+	// CoreFoundation is not linked by us, but if the process has it, the tweak loader will use it to evaluate bundle filters
+	CFBundleGetBundleWithIdentifier_ptr = dlsym(RTLD_DEFAULT, "CFBundleGetBundleWithIdentifier");
+	CFStringCreateWithCString_ptr = dlsym(RTLD_DEFAULT, "CFStringCreateWithCString");
+	CFRelease_ptr = dlsym(RTLD_DEFAULT, "CFRelease");
+	bool hasCoreFoundation = CFBundleGetBundleWithIdentifier_ptr && CFStringCreateWithCString_ptr && CFRelease_ptr;
+	const double *cfVersion = dlsym(RTLD_DEFAULT, "kCFCoreFoundationVersionNumber");
+
+	const char *executableName = strrchr(gExecutablePath, '/');
+	executableName = executableName ? &executableName[1] : gExecutablePath;
+
+	gApplicableTweaks = calloc(gIndex.header->bitset_words ?: 1, sizeof(uint64_t));
+	choicy_index_applicable_tweaks(&gIndex, executableName, cfVersion, hasCoreFoundation ? bundle_is_loaded : NULL, gApplicableTweaks);
+
+	if (gShouldLog && os_log_debug_enabled(OS_LOG_DEFAULT)) {
+		uint32_t applicableCount = 0;
+		for (uint32_t i = 0; i < gIndex.header->tweak_count; i++) {
+			if (choicy_bitset_test(gApplicableTweaks, i)) applicableCount++;
+		}
+		os_log_dbg("%u/%u tweak(s) apply to this process according to the tweak index", applicableCount, gIndex.header->tweak_count);
+	}
+}
+
+bool dylib_is_in_tweak_directory(const char *dylibPath)
+{
+	return strstr(dylibPath, "/TweakInject/") || strstr(dylibPath, "/MobileSubstrate/DynamicLibraries/");
+}
+
 bool dylib_is_tweak(const char *dylibPath)
 {
 	if (!dylibPath) return false;
 
 	__block bool isTweak = false;
-	if (strstr(dylibPath, "/TweakInject/") || strstr(dylibPath, "/MobileSubstrate/DynamicLibraries/")) {
+	if (dylib_is_in_tweak_directory(dylibPath)) {
 		char dylibPathLength = strlen(dylibPath)+1;
 		char plistPath[dylibPathLength];
 		strcpy(plistPath, dylibPath);
@@ -405,10 +952,28 @@ bool dylib_is_tweak(const char *dylibPath)
 	return isTweak;
 }
 
-bool should_load_dylib(const char *dylibPath)
+// tweakIndex is the index of the tweak in the Choicy index or -1 if it is not in it
+int tweak_verdict(const char *dylibName, int32_t tweakIndex)
 {
-	if (!string_has_suffix(dylibPath, ".dylib")) return true;
+	choicy_verdict_process_t process = {
+		.app_bundle_identifier = gProcessType == PROCESS_TYPE_APP ? gBundleIdentifier : NULL,
+		.tweak_injection_disabled = gTweakInjectionDisabled,
+		.has_allow_list = gAllowedTweaks || gAllowedTweakBits,
+		.has_deny_list = gDeniedTweaks || gDeniedTweakBits,
+	};
+
+	// Overrides encoded as tweak sets only contain tweaks from the index, so a tweak that is not in it is in neither of them
+	choicy_verdict_tweak_t tweak = {
+		.allowed = gAllowedTweakBits ? (tweakIndex >= 0 && choicy_bitset_test(gAllowedTweakBits, tweakIndex)) : xpc_array_contains_string(gAllowedTweaks, dylibName),
+		.denied = gDeniedTweakBits ? (tweakIndex >= 0 && choicy_bitset_test(gDeniedTweakBits, tweakIndex)) : xpc_array_contains_string(gDeniedTweaks, dylibName),
+		.globally_denied = xpc_array_contains_string(gGlobalDeniedTweaks, dylibName),
+	};
+
+	return choicy_tweak_verdict(&process, dylibName, &tweak);
+}
 
+bool evaluate_dylib(const char *dylibPath)
+{
 	char *dylibNameHeap = path_copy_basename(dylibPath);
 	char dylibName[strlen(dylibNameHeap)+1];
 	strcpy(dylibName, dylibNameHeap);
@@ -420,76 +985,112 @@ bool should_load_dylib(const char *dylibPath)
 
 	os_log_dbg("Checking whether %{public}s.dylib should be loaded...", dylibName);
 
-	if (dylib_is_tweak(dylibPath)) {
-		// dylibs crucial for Choicy itself to work
-		if (gProcessType == PROCESS_TYPE_APP) {
-			if (!strcmp(gBundleIdentifier, kPreferencesBundleID)) {
-				if (!strcmp(dylibName, "PreferenceLoader") || !strcmp(dylibName, "preferred")) {
-					os_log_dbg("%{public}s.dylib ✅ (crucial)", dylibName);
-					return true;
-				}
-			}
-			else if (!strcmp(gBundleIdentifier, kSpringboardBundleID)) {
-				if (!strcmp(dylibName, "ChoicySB")) {
-					os_log_dbg("%{public}s.dylib ✅ (crucial)", dylibName);
-					return true;
-				}
-			}
+	// If the tweak index is available, we don't need to parse the plist of the tweak to know whether it is one
+	bool isTweak;
+	uint64_t start = gShadowSampleRate ? shadow_now_ns() : 0;
+	bool needsTweakIndex = gIndexTweaksAreCurrent || gAllowedTweakBits || gDeniedTweakBits;
+	int32_t tweakIndex = (gIndex.header && needsTweakIndex) ? choicy_index_find_tweak(&gIndex, dylibName) : -1;
+	if (gIndexTweaksAreCurrent && tweakIndex >= 0 && dylib_is_in_tweak_directory(dylibPath)) {
+		isTweak = choicy_index_tweak(&gIndex, tweakIndex)->flags & CHOICY_TWEAK_FLAG_IS_TWEAK;
+		pending_tweak_did_pass(tweakIndex);
+		if (shadow_should_sample()) {
+			uint64_t fastNs = shadow_now_ns() - start;
+			start = shadow_now_ns();
+			bool referenceIsTweak = dylib_is_tweak(dylibPath);
+			shadow_record(CHOICY_SHADOW_KIND_TWEAK_DETECTION, isTweak != referenceIsTweak, isTweak, referenceIsTweak, fastNs, shadow_now_ns() - start, dylibName);
+			isTweak = referenceIsTweak;
 		}
+		if (isTweak && gApplicableTweaks && !choicy_bitset_test(gApplicableTweaks, tweakIndex)) {
+			os_log_dbg("%{public}s.dylib is being loaded even though its filter does not match according to the tweak index", dylibName);
+		}
+	}
+	else {
+		isTweak = dylib_is_tweak(dylibPath);
+	}
 
-		if (gTweakInjectionDisabled) {
+	if (!isTweak) {
+		os_log_dbg("%{public}s.dylib ✅ (not a tweak)", dylibName);
+		return true;
+	}
+
+	switch (tweak_verdict(dylibName, tweakIndex)) {
+		case CHOICY_VERDICT_CRUCIAL:
+			os_log_dbg("%{public}s.dylib ✅ (crucial)", dylibName);
+			return true;
+
+		case CHOICY_VERDICT_INJECTION_DISABLED:
 			os_log_dbg("%{public}s.dylib ❌ (tweak injection disabled)", dylibName);
 			return false;
-		}
-
-		bool tweakIsAllowed = xpc_array_contains_string(gAllowedTweaks, dylibName);
-		bool tweakIsDenied = xpc_array_contains_string(gDeniedTweaks, dylibName);
-		bool tweakIsGloballyDenied = xpc_array_contains_string(gGlobalDeniedTweaks, dylibName);
 
-		if (tweakIsGloballyDenied) {
+		case CHOICY_VERDICT_GLOBALLY_DENIED:
 			os_log_dbg("%{public}s.dylib ❌ (disabled in global tweak configuration)", dylibName);
 			return false;
-		}
 
-		if (gAllowedTweaks && !tweakIsAllowed) {
+		case CHOICY_VERDICT_NOT_ALLOWED:
 			os_log_dbg("%{public}s.dylib ❌ (custom tweak configuration on allow and tweak not allowed)", dylibName);
 			return false;
-		}
 
-		if (gDeniedTweaks && tweakIsDenied) {
+		case CHOICY_VERDICT_DENIED:
 			os_log_dbg("%{public}s.dylib ❌ (custom tweak configuration on deny and tweak denied)", dylibName);
 			return false;
-		}
-	}
-	else {
-		os_log_dbg("%{public}s.dylib ✅ (not a tweak)", dylibName);
-		return true;
 	}
 
 	os_log_dbg("%{public}s.dylib ✅ (allowed)", dylibName);
 	return true;
 }
 
-void *(*dlopen_from_orig)(const char*, int, void *) = NULL;
-void *dlopen_from_hook(const char *path, int mode, void *lr)
+// Whether any tweak that the tweak loader is going to load into this process would be blocked, if not, the dlopen hooks are not needed
+// Tweaks with bundle filters count as well, the tweak loader may still load them once their bundle gets loaded
+bool applicable_tweaks_need_filtering(void)
 {
-	if (path) {
-		if (!should_load_dylib(path)) {
-			return NULL;
+	if (!gApplicableTweaks) return true;
+
+	uint32_t words = gIndex.header->bitset_words;
+	uint64_t candidateTweaks[words ?: 1];
+	choicy_index_bundle_filtered_tweaks(&gIndex, candidateTweaks);
+	for (uint32_t w = 0; w < words; w++) candidateTweaks[w] |= gApplicableTweaks[w];
+
+	for (uint32_t i = 0; i < gIndex.header->tweak_count; i++) {
+		if (!choicy_bitset_test(candidateTweaks, i)) continue;
+		const char *dylibName = choicy_index_string(&gIndex, choicy_index_tweak(&gIndex, i)->name_off);
+		if (!dylibName) return true;
+		int verdict = tweak_verdict(dylibName, i);
+		if (!choicy_verdict_allows_loading(verdict)) {
+			os_log_dbg("%{public}s.dylib applies to this process and will be blocked", dylibName);
+			return true;
 		}
 	}
-	return dlopen_from_orig(path, mode, lr);
+
+	return false;
 }
 
-void *(*dyld_dlopen_from_orig)(const void *, const char*, int, void *) = NULL;
-void *dyld_dlopen_from_hook(const void *dyld, const char *path, int mode, void *lr)
+bool evaluate_dylib_cached(const char *dylibPath)
 {
-	if (path) {
-		if (!should_load_dylib(path)) {
-			return NULL;
-		}
+	uint64_t pathHash = choicy_hash_string(dylibPath);
+	bool verdict;
+	if (decision_cache_lookup(pathHash, &verdict)) {
+		os_log_dbg("%{public}s %{public}s (cached)", dylibPath, verdict ? "✅" : "❌");
+		return verdict;
+	}
+
+	verdict = evaluate_dylib(dylibPath);
+	decision_cache_store(pathHash, verdict);
+	return verdict;
+}
+
+bool should_load_dylib(const char *dylibPath)
+{
+	if (!string_has_suffix(dylibPath, ".dylib")) return true;
+
+	// Calls that read the slot before the hooks were removed can still end up here, the state they need is only freed if there are none
+	atomic_fetch_add(&gHookCallsInFlight, 1);
+	bool verdict = true;
+	if (!atomic_load(&gHooksPassthrough)) {
+		verdict = evaluate_dylib_cached(dylibPath);
+		remove_hooks_if_done();
 	}
-	return dyld_dlopen_from_orig(dyld, path, mode, lr);
+	atomic_fetch_sub(&gHookCallsInFlight, 1);
+	return verdict;
 }
 
 const struct mach_header *find_tweak_loader_mach_header(const char **pathOut)
@@ -530,12 +1131,17 @@ const struct mach_header *find_tweak_loader_mach_header(const char **pathOut)
 	return NULL;
 }
 
-int dyld_hook_routine(void **dyld, int idx, void *hook, void **orig, uint16_t pacSalt)
+void **dyld_func_ptrs(void **dyld)
 {
-	if (!dyld) return -1;
+	if (!dyld) return NULL;
 
 	__unused uint64_t dyldPacDiversifier = ((uint64_t)dyld & ~(0xFFFFull << 48)) | (0x63FAull << 48);
-	void **dyldFuncPtrs = ptrauth_auth_data(*dyld, ptrauth_key_process_independent_data, dyldPacDiversifier);
+	return ptrauth_auth_data(*dyld, ptrauth_key_process_independent_data, dyldPacDiversifier);
+}
+
+int dyld_hook_routine(void **dyld, int idx, void *hook, void **orig, uint16_t pacSalt)
+{
+	void **dyldFuncPtrs = dyld_func_ptrs(dyld);
 	if (!dyldFuncPtrs) return -1;
 
 	if (vm_protect(mach_task_self_, (mach_vm_address_t)&dyldFuncPtrs[idx], sizeof(void *), false, VM_PROT_READ | VM_PROT_WRITE) == 0) {
@@ -551,6 +1157,149 @@ int dyld_hook_routine(void **dyld, int idx, void *hook, void **orig, uint16_t pa
 	return -1;
 }
 
+// Puts orig (as returned by dyld_hook_routine) back into the slot, signed the same way dyld signed it
+int dyld_unhook_routine(void **dyld, int idx, void *orig, uint16_t pacSalt)
+{
+	void **dyldFuncPtrs = dyld_func_ptrs(dyld);
+	if (!dyldFuncPtrs || !orig) return -1;
+
+	if (vm_protect(mach_task_self_, (mach_vm_address_t)&dyldFuncPtrs[idx], sizeof(void *), false, VM_PROT_READ | VM_PROT_WRITE) == 0) {
+		uint64_t location = (uint64_t)&dyldFuncPtrs[idx];
+		__unused uint64_t pacDiversifier = (location & ~(0xFFFFull << 48)) | ((uint64_t)pacSalt << 48);
+
+		dyldFuncPtrs[idx] = ptrauth_auth_and_resign(orig, ptrauth_key_function_pointer, 0, ptrauth_key_process_independent_code, pacDiversifier);
+		vm_protect(mach_task_self_, (mach_vm_address_t)&dyldFuncPtrs[idx], sizeof(void *), false, VM_PROT_READ);
+		return 0;
+	}
+
+	return -1;
+}
+
+void free_tweak_state(void)
+{
+	if (gAllowedTweaks) xpc_release(gAllowedTweaks);
+	if (gDeniedTweaks) xpc_release(gDeniedTweaks);
+	if (gGlobalDeniedTweaks) xpc_release(gGlobalDeniedTweaks);
+	gAllowedTweaks = gDeniedTweaks = gGlobalDeniedTweaks = NULL;
+	gAllowedTweakBits = gDeniedTweakBits = NULL;
+
+	free(gApplicableTweaks);
+	gApplicableTweaks = NULL;
+	free(gRulePathCandidates);
+	gRulePathCandidates = NULL;
+	free((void *)gPendingTweaks);
+	gPendingTweaks = NULL;
+	choicy_index_unmap(&gIndex);
+	gIndexTweaksAreCurrent = false;
+}
+
+void pending_tweak_did_pass(int32_t tweakIndex)
+{
+	if (!gPendingTweaks || tweakIndex < 0) return;
+
+	uint64_t bit = 1ull << (tweakIndex % 64);
+	if (atomic_fetch_and(&gPendingTweaks[tweakIndex / 64], ~bit) & bit) {
+		atomic_fetch_sub(&gPendingTweakCount, 1);
+	}
+}
+
+void remove_hooks_if_done(void)
+{
+	if (!gPendingTweaks || atomic_load(&gPendingTweakCount) != 0) return;
+	if (atomic_exchange(&gHooksPassthrough, true)) return;
+
+	// dyld_dlopen_hook tail calls dyld_dlopen_orig, so the dlopen of the last tweak still completes normally
+	// Interposed hooks (iOS <= 14) can't be removed again, these just stay in passthrough mode
+	if (gHookedDyld) {
+		dyld_unhook_routine(*gHookedDyld, gHookedDlopenSlot, (void *)dyld_dlopen_orig, 0xBF31);
+		dyld_unhook_routine(*gHookedDyld, gHookedDlopenFromSlot, (void *)dyld_dlopen_from_orig, 0xD48C);
+	}
+
+	if (atomic_load(&gHookCallsInFlight) == 1) {
+		free_tweak_state();
+		os_log_dbg("Tweak loader is done, removed hooks and freed tweak configuration");
+	}
+	else {
+		os_log_dbg("Tweak loader is done, removed hooks");
+	}
+}
+
+// Sets up removing the hooks once the tweak loader is done if that is safe, dyld is NULL if they were not installed into gDyld
+void prepare_hook_removal(void **dyld, uint32_t dlopenSlot, uint32_t dlopenFromSlot)
+{
+	if (!gApplicableTweaks) return;
+
+	// Some tweak loaders inject tweaks with bundle filters once the bundle is loaded, so any of those that is blocked requires the hooks to stay
+	uint32_t words = gIndex.header->bitset_words;
+	uint64_t lazyTweaks[words ?: 1];
+	choicy_index_bundle_filtered_tweaks(&gIndex, lazyTweaks);
+
+	uint32_t pendingCount = 0;
+	for (uint32_t i = 0; i < gIndex.header->tweak_count; i++) {
+		if (choicy_bitset_test(gApplicableTweaks, i)) {
+			pendingCount++;
+			continue;
+		}
+		if (!choicy_bitset_test(lazyTweaks, i)) continue;
+
+		const char *dylibName = choicy_index_string(&gIndex, choicy_index_tweak(&gIndex, i)->name_off);
+		int verdict = dylibName ? tweak_verdict(dylibName, i) : CHOICY_VERDICT_DENIED;
+		if (!choicy_verdict_allows_loading(verdict)) {
+			os_log_dbg("%{public}s.dylib may still be injected later on, keeping hooks", dylibName);
+			return;
+		}
+	}
+
+	_Atomic uint64_t *pendingTweaks = calloc(words ?: 1, sizeof(uint64_t));
+	for (uint32_t w = 0; w < words; w++) atomic_store(&pendingTweaks[w], gApplicableTweaks[w]);
+
+	// We are already loaded, so we won't pass through our own hooks
+	int32_t choicyIndex = choicy_index_find_tweak(&gIndex, "   Choicy");
+	if (choicyIndex >= 0 && choicy_bitset_test(gApplicableTweaks, choicyIndex)) {
+		atomic_fetch_and(&pendingTweaks[choicyIndex / 64], ~(1ull << (choicyIndex % 64)));
+		pendingCount--;
+	}
+	if (!pendingCount) {
+		free((void *)pendingTweaks);
+		return;
+	}
+
+	gHookedDyld = dyld;
+	gHookedDlopenSlot = dlopenSlot;
+	gHookedDlopenFromSlot = dlopenFromSlot;
+	atomic_store(&gPendingTweakCount, pendingCount);
+	gPendingTweaks = pendingTweaks;
+	os_log_dbg("Removing hooks after %u tweak(s) have been loaded", pendingCount);
+}
+
+extern bool _dyld_get_shared_cache_uuid(uuid_t uuid);
+extern const void *_dyld_get_shared_cache_range(size_t *length);
+
+void **find_gdyld(uint32_t *dlopenSlotOut, uint32_t *dlopenFromSlotOut)
+{
+	*dlopenSlotOut = CHOICY_DYLD_DLOPEN_SLOT_DEFAULT;
+	*dlopenFromSlotOut = CHOICY_DYLD_DLOPEN_FROM_SLOT_DEFAULT;
+
+	// If SpringBoard already resolved gDyld for the shared cache we are running with, skip walking the symbol tables of libdyld
+	load_index();
+	if (gIndex.header && (gIndex.header->dyld_flags & CHOICY_INDEX_DYLD_FLAG_RESOLVED)) {
+		uuid_t uuid;
+		size_t sharedCacheLength = 0;
+		const void *sharedCacheBase = _dyld_get_shared_cache_range(&sharedCacheLength);
+		if (sharedCacheBase && _dyld_get_shared_cache_uuid(uuid) && !memcmp(uuid, gIndex.header->dsc_uuid, sizeof(uuid_t)) && gIndex.header->gdyld_offset < sharedCacheLength) {
+			if (!gIndex.header->gdyld_offset) return NULL;
+			if (gIndex.header->dyld_dlopen_slot && gIndex.header->dyld_dlopen_from_slot) {
+				*dlopenSlotOut = gIndex.header->dyld_dlopen_slot;
+				*dlopenFromSlotOut = gIndex.header->dyld_dlopen_from_slot;
+			}
+			os_log_dbg("Using gDyld resolved by the Choicy index");
+			return (void **)((uintptr_t)sharedCacheBase + gIndex.header->gdyld_offset);
+		}
+	}
+
+	return litehook_find_dsc_symbol("/usr/lib/system/libdyld.dylib", "__ZN5dyld45gDyldE");
+}
+
 int replace_bss_pointers(const struct mach_header *mh, void *pointersToReplace[], void *replacementPointers[], uint32_t pointerCount)
 {
 	unsigned long bssSectionSize = 0;
@@ -577,17 +1326,29 @@ __attribute__((constructor)) static void initializer(void)
 	load_process_info();
 	os_log_dbg("Choicy loaded");
 
-	if (gTweakInjectionDisabled || gAllowedTweaks || gDeniedTweaks || gGlobalDeniedTweaks) {
+	if (gTweakInjectionDisabled || tweak_list_is_overwritten() || gGlobalDeniedTweaks) {
 		os_log_dbg("Initializing Choicy...");
 
-		void **dyld4Struct = litehook_find_dsc_symbol("/usr/lib/system/libdyld.dylib", "__ZN5dyld45gDyldE");
+		load_applicable_tweaks();
+
+		// Most configurations only affect a few processes, if none of the tweaks that will be loaded are blocked, there is nothing to hook
+		if (!applicable_tweaks_need_filtering()) {
+			os_log_dbg("No tweak that applies to this process is blocked, skipping hooks");
+			return;
+		}
+
+		uint32_t dlopenSlot, dlopenFromSlot;
+		void **dyld4Struct = find_gdyld(&dlopenSlot, &dlopenFromSlot);
 		if (dyld4Struct) {
 			// iOS 15+
 			// dyld_dynamic_interpose is a stub, so apply the hooks by overwriting function pointers in gDyld
 			// This will catch *all* dlopen calls
 
-			dyld_hook_routine(*dyld4Struct, 14, (void *)&dyld_dlopen_hook, (void **)&dyld_dlopen_orig, 0xBF31);
-			dyld_hook_routine(*dyld4Struct, 97, (void *)&dyld_dlopen_from_hook, (void **)&dyld_dlopen_from_orig, 0xD48C);
+			int dlopenHooked = dyld_hook_routine(*dyld4Struct, dlopenSlot, (void *)&dyld_dlopen_hook, (void **)&dyld_dlopen_orig, 0xBF31);
+			int dlopenFromHooked = dyld_hook_routine(*dyld4Struct, dlopenFromSlot, (void *)&dyld_dlopen_from_hook, (void **)&dyld_dlopen_from_orig, 0xD48C);
+			if (dlopenHooked == 0 && dlopenFromHooked == 0) {
+				prepare_hook_removal(dyld4Struct, dlopenSlot, dlopenFromSlot);
+			}
 		}
 		else {
 			// iOS <=14
@@ -598,11 +1359,15 @@ __attribute__((constructor)) static void initializer(void)
 			void *dlopen_from = dlsym(libdyldHandle, "dlopen_from");
 
 			dlopen_orig = dlopen;
+			dlopen_preflight_orig = dlopen_preflight;
 			if (dlopen_from) dlopen_from_orig = dlopen_from;
 
 			const char *tweakLoaderPath = NULL;
 			const struct mach_header *tweakLoaderHeader = find_tweak_loader_mach_header(&tweakLoaderPath);
 			if (tweakLoaderHeader) {
+				// The interposed hooks only see the tweak loader, so once it is done they can pass everything through
+				prepare_hook_removal(NULL, 0, 0);
+
 				// On rootful / iOS <=14, there are multiple different special cases we need to take care of
 				// First: substitute-loader.dylib is heavily obfuscated and gets the dlopen pointer via dlsym before Choicy runs
 				// So in order to support substitute, we have to find the dlopen pointer in it's BSS section and replace it
@@ -628,19 +1393,22 @@ __attribute__((constructor)) static void initializer(void)
 				// Second: dyld_dynamic_interpose seems to cause a nullptr deref in arm64e processes
 				// So, we have to use a litehook rebind instead
 				litehook_rebind_symbol((const mach_header *)tweakLoaderHeader, dlopen, dlopen_hook);
+				litehook_rebind_symbol((const mach_header *)tweakLoaderHeader, dlopen_preflight, dlopen_preflight_hook);
 				if (dlopen_from) {
 					litehook_rebind_symbol((const mach_header *)tweakLoaderHeader, dlopen_from, dlopen_from_hook);
 				}
 				return;
 #endif
 				// If not arm64e, we can just use dyld_dynamic_interpose, which (unlike litehook) supports armv7 aswell
-				static struct dyld_interpose_tuple interposes[2];
-				interposes[0] = (struct dyld_interpose_tuple){ .replacement = dlopen_hook, .replacee = dlopen };
+				static struct dyld_interpose_tuple interposes[3];
+				size_t interposeCount = 0;
+				interposes[interposeCount++] = (struct dyld_interpose_tuple){ .replacement = dlopen_hook, .replacee = dlopen };
+				interposes[interposeCount++] = (struct dyld_interpose_tuple){ .replacement = dlopen_preflight_hook, .replacee = dlopen_preflight };
 				if (dlopen_from) {
-					interposes[1] = (struct dyld_interpose_tuple){ .replacement = dlopen_from_hook, .replacee = dlopen_from };
+					interposes[interposeCount++] = (struct dyld_interpose_tuple){ .replacement = dlopen_from_hook, .replacee = dlopen_from };
 				}
-				dyld_dynamic_interpose(tweakLoaderHeader, interposes, dlopen_from ? 2 : 1);
-				os_log_dbg("Initialized %u interpose(s) in tweak loader", dlopen_from ? 2 : 1);
+				dyld_dynamic_interpose(tweakLoaderHeader, interposes, interposeCount);
+				os_log_dbg("Initialized %zu interpose(s) in tweak loader", interposeCount);
 			}
 			else {
 				os_log_dbg("Unable to find tweak loader");
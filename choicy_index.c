@@ -0,0 +1,497 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "choicy_index.h"
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define stat_mtime(st) ((st).st_mtimespec)
+#else
+#define stat_mtime(st) ((st).st_mtim)
+#endif
+
+static bool choicy_index_range_is_valid(size_t size, uint32_t off, size_t len)
+{
+	if (off > size) return false;
+	if (len > size - off) return false;
+	return true;
+}
+
+int choicy_index_map(const char *path, choicy_index_t *indexOut)
+{
+	if (!path || !indexOut) return -1;
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+
+	struct stat st = {0};
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(choicy_index_header_t)) {
+		close(fd);
+		return -1;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return -1;
+
+	const choicy_index_header_t *header = data;
+	size_t size = st.st_size;
+	size_t bitsetSize = header->bitset_words * sizeof(uint64_t);
+
+	bool valid = header->magic == CHOICY_INDEX_MAGIC &&
+		header->version == CHOICY_INDEX_VERSION &&
+		header->size == size &&
+		header->bitset_words == choicy_bitset_words(header->tweak_count) &&
+		choicy_index_range_is_valid(size, header->strings_off, header->strings_size) &&
+		header->strings_size > 0 && ((const char *)data)[header->strings_off + header->strings_size - 1] == '\0' &&
+		choicy_index_range_is_valid(size, header->tweaks_off, (size_t)header->tweak_count * sizeof(choicy_index_tweak_t)) &&
+		choicy_index_range_is_valid(size, header->tweak_buckets_off, (size_t)header->tweak_bucket_count * sizeof(uint32_t)) &&
+		choicy_index_range_is_valid(size, header->filters_off, (size_t)header->filter_bucket_count * sizeof(choicy_index_filter_t)) &&
+		choicy_index_range_is_valid(size, header->bundle_filters_off, (size_t)header->bundle_filter_count * sizeof(uint32_t)) &&
+		(header->tweak_bucket_count & (header->tweak_bucket_count - 1)) == 0 &&
+		(header->filter_bucket_count & (header->filter_bucket_count - 1)) == 0 &&
+		header->tweak_dir_off < header->strings_size;
+
+	if (valid) {
+		// Make sure every offset stored in the tables points into the file, so lookups don't need to check them again
+		const choicy_index_filter_t *filters = (const void *)((const uint8_t *)data + header->filters_off);
+		for (uint32_t i = 0; i < header->filter_bucket_count && valid; i++) {
+			if (!filters[i].key_off) continue;
+			valid = filters[i].key_off < header->strings_size && choicy_index_range_is_valid(size, filters[i].bits_off, bitsetSize);
+		}
+		const choicy_index_tweak_t *tweaks = (const void *)((const uint8_t *)data + header->tweaks_off);
+		for (uint32_t i = 0; i < header->tweak_count && valid; i++) {
+			valid = tweaks[i].name_off < header->strings_size;
+		}
+		const uint32_t *bundleFilters = (const void *)((const uint8_t *)data + header->bundle_filters_off);
+		for (uint32_t i = 0; i < header->bundle_filter_count && valid; i++) {
+			valid = bundleFilters[i] < header->filter_bucket_count;
+		}
+		const uint32_t *tweakBuckets = (const void *)((const uint8_t *)data + header->tweak_buckets_off);
+		for (uint32_t i = 0; i < header->tweak_bucket_count && valid; i++) {
+			valid = tweakBuckets[i] <= header->tweak_count;
+		}
+	}
+
+	if (valid) {
+		valid = choicy_index_range_is_valid(size, header->lists_off, header->lists_size) &&
+			choicy_index_range_is_valid(size, header->processes_off, (size_t)header->process_bucket_count * sizeof(choicy_index_process_t)) &&
+			(header->process_bucket_count & (header->process_bucket_count - 1)) == 0;
+
+		// Lists are packed back to back, walk all of them once
+		uint32_t listOff = header->lists_off;
+		while (valid && listOff < header->lists_off + header->lists_size) {
+			uint32_t count = *(const uint32_t *)((const uint8_t *)data + listOff);
+			valid = choicy_index_range_is_valid(header->lists_off + header->lists_size, listOff, sizeof(uint32_t) * ((size_t)count + 1));
+			const uint32_t *strings = (const void *)((const uint8_t *)data + listOff + sizeof(uint32_t));
+			for (uint32_t i = 0; i < count && valid; i++) {
+				valid = strings[i] < header->strings_size;
+			}
+			listOff += sizeof(uint32_t) * (count + 1);
+		}
+
+		#define list_off_is_valid(off) ((off) == 0 || ((off) >= header->lists_off && (off) < header->lists_off + header->lists_size && ((off) - header->lists_off) % sizeof(uint32_t) == 0))
+		valid = valid && list_off_is_valid(header->global_denied_off);
+		const choicy_index_process_t *processes = (const void *)((const uint8_t *)data + header->processes_off);
+		for (uint32_t i = 0; i < header->process_bucket_count && valid; i++) {
+			if (!processes[i].key_off) continue;
+			valid = processes[i].key_off < header->strings_size && list_off_is_valid(processes[i].allowed_off) && list_off_is_valid(processes[i].denied_off);
+		}
+
+		valid = valid && choicy_index_range_is_valid(size, header->rules_off, (size_t)header->rule_count * sizeof(choicy_index_rule_t));
+		const choicy_index_rule_t *rules = (const void *)((const uint8_t *)data + header->rules_off);
+		for (uint32_t i = 0; i < header->rule_count && valid; i++) {
+			valid = rules[i].path.pattern_off < header->strings_size && rules[i].bundle.pattern_off < header->strings_size &&
+				list_off_is_valid(rules[i].allowed_off) && list_off_is_valid(rules[i].denied_off);
+		}
+		#undef list_off_is_valid
+
+		// Both roots always exist as soon as there is a rule
+		valid = valid && (header->rule_count == 0 || header->matcher_node_count >= 2) &&
+			choicy_index_range_is_valid(size, header->matcher_nodes_off, (size_t)header->matcher_node_count * sizeof(choicy_index_matcher_node_t)) &&
+			choicy_index_range_is_valid(size, header->matcher_edges_off, (size_t)header->matcher_edge_count * sizeof(choicy_index_matcher_edge_t)) &&
+			choicy_index_range_is_valid(size, header->matcher_rules_off, (size_t)header->matcher_rule_ref_count * sizeof(uint32_t));
+		const choicy_index_matcher_node_t *nodes = (const void *)((const uint8_t *)data + header->matcher_nodes_off);
+		for (uint32_t i = 0; i < header->matcher_node_count && valid; i++) {
+			valid = nodes[i].edges_first <= header->matcher_edge_count && nodes[i].edge_count <= header->matcher_edge_count - nodes[i].edges_first &&
+				nodes[i].rules_first <= header->matcher_rule_ref_count && nodes[i].rule_count <= header->matcher_rule_ref_count - nodes[i].rules_first;
+		}
+		const choicy_index_matcher_edge_t *edges = (const void *)((const uint8_t *)data + header->matcher_edges_off);
+		for (uint32_t i = 0; i < header->matcher_edge_count && valid; i++) {
+			valid = edges[i].node < header->matcher_node_count;
+		}
+		const uint32_t *ruleRefs = (const void *)((const uint8_t *)data + header->matcher_rules_off);
+		for (uint32_t i = 0; i < header->matcher_rule_ref_count && valid; i++) {
+			valid = ruleRefs[i] < header->rule_count;
+		}
+
+		valid = valid && (header->process_bloom_bits & (header->process_bloom_bits - 1)) == 0 &&
+			choicy_index_range_is_valid(size, header->process_bloom_off, choicy_bitset_words(header->process_bloom_bits) * sizeof(uint64_t));
+	}
+
+	if (!valid) {
+		munmap(data, size);
+		return -1;
+	}
+
+	indexOut->header = header;
+	indexOut->size = size;
+	return 0;
+}
+
+void choicy_index_unmap(choicy_index_t *index)
+{
+	if (!index || !index->header) return;
+	munmap((void *)index->header, index->size);
+	index->header = NULL;
+	index->size = 0;
+}
+
+const char *choicy_index_string(choicy_index_t *index, uint32_t off)
+{
+	return (const char *)index->header + index->header->strings_off + off;
+}
+
+bool choicy_index_tweak_dir_is_current(choicy_index_t *index)
+{
+	struct stat st = {0};
+	if (stat(choicy_index_string(index, index->header->tweak_dir_off), &st) != 0) return false;
+	return stat_mtime(st).tv_sec == index->header->tweak_dir_mtime_sec && stat_mtime(st).tv_nsec == index->header->tweak_dir_mtime_nsec;
+}
+
+bool choicy_index_prefs_are_current(choicy_index_t *index, const char *prefsPath)
+{
+	if (!(index->header->prefs_flags & CHOICY_INDEX_PREFS_FLAG_PRESENT)) return false;
+
+	struct stat st = {0};
+	if (stat(prefsPath, &st) != 0) return false;
+	return (uint64_t)stat_mtime(st).tv_sec == index->header->prefs_mtime_sec &&
+		(uint64_t)stat_mtime(st).tv_nsec == index->header->prefs_mtime_nsec &&
+		(uint64_t)st.st_size == index->header->prefs_size &&
+		(uint64_t)st.st_ino == index->header->prefs_ino;
+}
+
+const choicy_index_tweak_t *choicy_index_tweak(choicy_index_t *index, uint32_t idx)
+{
+	if (idx >= index->header->tweak_count) return NULL;
+	const choicy_index_tweak_t *tweaks = (const void *)((const uint8_t *)index->header + index->header->tweaks_off);
+	return &tweaks[idx];
+}
+
+int32_t choicy_index_find_tweak(choicy_index_t *index, const char *dylibName)
+{
+	uint32_t bucketCount = index->header->tweak_bucket_count;
+	if (!bucketCount || !dylibName) return -1;
+
+	const uint32_t *buckets = (const void *)((const uint8_t *)index->header + index->header->tweak_buckets_off);
+	uint64_t hash = choicy_hash_string(dylibName);
+
+	for (uint32_t i = 0; i < bucketCount; i++) {
+		uint32_t entry = buckets[(hash + i) & (bucketCount - 1)];
+		if (entry == 0) break;
+		const choicy_index_tweak_t *tweak = choicy_index_tweak(index, entry - 1);
+		if (tweak->name_hash == hash && !strcmp(choicy_index_string(index, tweak->name_off), dylibName)) {
+			return entry - 1;
+		}
+	}
+	return -1;
+}
+
+const uint64_t *choicy_index_filter_bits(choicy_index_t *index, uint32_t kind, const char *key)
+{
+	uint32_t bucketCount = index->header->filter_bucket_count;
+	if (!bucketCount || !key) return NULL;
+
+	const choicy_index_filter_t *filters = (const void *)((const uint8_t *)index->header + index->header->filters_off);
+	uint64_t hash = choicy_hash_string(key) ^ kind;
+
+	for (uint32_t i = 0; i < bucketCount; i++) {
+		const choicy_index_filter_t *filter = &filters[(hash + i) & (bucketCount - 1)];
+		if (filter->key_off == 0) break;
+		if (filter->key_hash == hash && filter->kind == kind && !strcmp(choicy_index_string(index, filter->key_off), key)) {
+			return (const void *)((const uint8_t *)index->header + filter->bits_off);
+		}
+	}
+	return NULL;
+}
+
+const choicy_index_process_t *choicy_index_find_process(choicy_index_t *index, uint32_t kind, const char *key)
+{
+	uint32_t bucketCount = index->header->process_bucket_count;
+	if (!bucketCount || !key) return NULL;
+
+	const choicy_index_process_t *processes = (const void *)((const uint8_t *)index->header + index->header->processes_off);
+	uint64_t hash = choicy_hash_string(key) ^ kind;
+
+	for (uint32_t i = 0; i < bucketCount; i++) {
+		const choicy_index_process_t *process = &processes[(hash + i) & (bucketCount - 1)];
+		if (process->key_off == 0) break;
+		if (process->key_hash == hash && process->kind == kind && !strcmp(choicy_index_string(index, process->key_off), key)) {
+			return process;
+		}
+	}
+	return NULL;
+}
+
+const uint32_t *choicy_index_list(choicy_index_t *index, uint32_t listOff, uint32_t *countOut)
+{
+	if (!listOff) {
+		*countOut = 0;
+		return NULL;
+	}
+	const uint32_t *list = (const void *)((const uint8_t *)index->header + listOff);
+
+	// choicy_index_map only verified that listOff is inside the list area, don't trust the count beyond it
+	uint32_t maxCount = (index->header->lists_off + index->header->lists_size - listOff) / sizeof(uint32_t) - 1;
+	*countOut = list[0] < maxCount ? list[0] : maxCount;
+	return &list[1];
+}
+
+bool choicy_index_process_may_be_configured(choicy_index_t *index, const char *key)
+{
+	uint32_t bitCount = index->header->process_bloom_bits;
+	if (!bitCount) return false;
+
+	const uint64_t *bloom = (const void *)((const uint8_t *)index->header + index->header->process_bloom_off);
+	uint64_t hash = choicy_hash_string(key);
+	for (uint32_t i = 0; i < CHOICY_BLOOM_HASH_COUNT; i++) {
+		if (!choicy_bitset_test(bloom, choicy_bloom_position(hash, i, bitCount))) return false;
+	}
+	return true;
+}
+
+const choicy_index_rule_t *choicy_index_rule(choicy_index_t *index, uint32_t idx)
+{
+	const choicy_index_rule_t *rules = (const void *)((const uint8_t *)index->header + index->header->rules_off);
+	return &rules[idx];
+}
+
+// Runs subject through the matcher from root and marks every rule whose pattern prefix is a prefix of subject
+void choicy_index_rule_candidates(choicy_index_t *index, uint32_t root, const char *subject, uint64_t *candidates)
+{
+	const choicy_index_matcher_node_t *nodes = (const void *)((const uint8_t *)index->header + index->header->matcher_nodes_off);
+	const choicy_index_matcher_edge_t *edges = (const void *)((const uint8_t *)index->header + index->header->matcher_edges_off);
+	const uint32_t *ruleRefs = (const void *)((const uint8_t *)index->header + index->header->matcher_rules_off);
+
+	const choicy_index_matcher_node_t *node = &nodes[root];
+	for (const uint8_t *c = (const uint8_t *)subject; ; c++) {
+		for (uint32_t i = 0; i < node->rule_count; i++) {
+			choicy_bitset_set(candidates, ruleRefs[node->rules_first + i]);
+		}
+		if (!*c) break;
+
+		// Edges are sorted by character
+		const choicy_index_matcher_edge_t *nodeEdges = &edges[node->edges_first];
+		uint32_t lo = 0, hi = node->edge_count;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			if (nodeEdges[mid].character < *c) lo = mid + 1;
+			else hi = mid;
+		}
+		if (lo == node->edge_count || nodeEdges[lo].character != *c) break;
+		node = &nodes[nodeEdges[lo].node];
+	}
+}
+
+// Only called for rules whose prefix the matcher already reached in subject
+static bool choicy_index_pattern_matches(choicy_index_t *index, const choicy_index_pattern_t *pattern, const char *subject)
+{
+	switch (pattern->kind) {
+		case CHOICY_RULE_PATTERN_LITERAL:
+			return subject[pattern->prefix_length] == '\0';
+		case CHOICY_RULE_PATTERN_PREFIX:
+			return true;
+		default:
+			return fnmatch(choicy_index_string(index, pattern->pattern_off), subject, 0) == 0;
+	}
+}
+
+int32_t choicy_index_match_rule(choicy_index_t *index, const char *executablePath, const char *bundleIdentifier, uint32_t processType)
+{
+	uint32_t ruleCount = index->header->rule_count;
+	if (!ruleCount) return -1;
+
+	// Each subject goes through the matcher once, the candidates of both are then checked in order of precedence
+	size_t words = choicy_bitset_words(ruleCount);
+	uint64_t pathCandidates[words];
+	uint64_t bundleCandidates[words];
+	memset(pathCandidates, 0, sizeof(pathCandidates));
+	memset(bundleCandidates, 0, sizeof(bundleCandidates));
+	if (executablePath) choicy_index_rule_candidates(index, CHOICY_MATCHER_ROOT_PATH, executablePath, pathCandidates);
+	if (bundleIdentifier) choicy_index_rule_candidates(index, CHOICY_MATCHER_ROOT_BUNDLE, bundleIdentifier, bundleCandidates);
+
+	return choicy_index_match_rule_candidates(index, executablePath, pathCandidates, bundleIdentifier, bundleCandidates, processType);
+}
+
+int32_t choicy_index_match_rule_candidates(choicy_index_t *index, const char *executablePath, const uint64_t *pathCandidates, const char *bundleIdentifier, const uint64_t *bundleCandidates, uint32_t processType)
+{
+	uint32_t ruleCount = index->header->rule_count;
+	for (uint32_t idx = 0; idx < ruleCount; idx++) {
+		const choicy_index_rule_t *rule = choicy_index_rule(index, idx);
+		if (rule->process_types && !(rule->process_types & processType)) continue;
+		if (rule->path.pattern_off && !(executablePath && choicy_bitset_test(pathCandidates, idx) && choicy_index_pattern_matches(index, &rule->path, executablePath))) continue;
+		if (rule->bundle.pattern_off && !(bundleIdentifier && choicy_bitset_test(bundleCandidates, idx) && choicy_index_pattern_matches(index, &rule->bundle, bundleIdentifier))) continue;
+		return idx;
+	}
+	return -1;
+}
+
+static const char kHexDigits[] = "0123456789abcdef";
+
+static int hex_digit_value(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+size_t choicy_tweak_set_encode(choicy_index_t *index, const uint64_t *bits, char *buf, size_t bufSize)
+{
+	size_t len = 0;
+	if (len >= bufSize) return 0;
+	buf[len++] = CHOICY_TWEAK_SET_PREFIX;
+
+	// Generation, most significant digit first
+	uint64_t generation = index->header->tweaks_generation;
+	int shift = 60;
+	while (shift > 0 && !((generation >> shift) & 0xf)) shift -= 4;
+	for (; shift >= 0; shift -= 4) {
+		if (len >= bufSize) return 0;
+		buf[len++] = kHexDigits[(generation >> shift) & 0xf];
+	}
+
+	if (len >= bufSize) return 0;
+	buf[len++] = ':';
+
+	// Bits, four per digit, trailing zeros omitted
+	uint32_t digitCount = 0;
+	for (uint32_t d = 0; d < index->header->bitset_words * 16; d++) {
+		if ((bits[d / 16] >> ((d % 16) * 4)) & 0xf) digitCount = d + 1;
+	}
+	for (uint32_t d = 0; d < digitCount; d++) {
+		if (len >= bufSize) return 0;
+		buf[len++] = kHexDigits[(bits[d / 16] >> ((d % 16) * 4)) & 0xf];
+	}
+
+	if (len >= bufSize) return 0;
+	buf[len] = '\0';
+	return len;
+}
+
+bool choicy_tweak_set_decode(choicy_index_t *index, const char *str, uint64_t *bitsOut, size_t bitsWords)
+{
+	if (!str || str[0] != CHOICY_TWEAK_SET_PREFIX) return false;
+	if (bitsWords < index->header->bitset_words) return false;
+
+	const char *cur = &str[1];
+	uint64_t generation = 0;
+	int generationDigits = 0;
+	for (; *cur && *cur != ':'; cur++) {
+		int value = hex_digit_value(*cur);
+		if (value < 0 || ++generationDigits > 16) return false;
+		generation = (generation << 4) | value;
+	}
+	if (*cur != ':' || !generationDigits) return false;
+	if (generation != index->header->tweaks_generation) return false;
+	cur++;
+
+	memset(bitsOut, 0, bitsWords * sizeof(uint64_t));
+	for (uint32_t d = 0; cur[d]; d++) {
+		int value = hex_digit_value(cur[d]);
+		if (value < 0 || d / 16 >= index->header->bitset_words) return false;
+		bitsOut[d / 16] |= (uint64_t)value << ((d % 16) * 4);
+	}
+
+	// Bits beyond the tweak table mean the set was not encoded for this index
+	for (uint32_t idx = index->header->tweak_count; idx < index->header->bitset_words * 64; idx++) {
+		if (choicy_bitset_test(bitsOut, idx)) return false;
+	}
+	return true;
+}
+
+void choicy_index_applicable_tweaks(choicy_index_t *index, const char *executableName, const double *cfVersion, bool (*bundleIsLoaded)(const char *bundleIdentifier), uint64_t *bitsOut)
+{
+	uint32_t words = index->header->bitset_words;
+	uint64_t matched[words ?: 1];
+	memset(matched, 0, sizeof(matched));
+
+	// Executable filters
+	const uint64_t *executableBits = choicy_index_filter_bits(index, CHOICY_FILTER_KIND_EXECUTABLE, executableName);
+	if (executableBits) {
+		for (uint32_t w = 0; w < words; w++) matched[w] |= executableBits[w];
+	}
+
+	// Bundle filters, every unique bundle identifier only gets checked once
+	const choicy_index_filter_t *filters = (const void *)((const uint8_t *)index->header + index->header->filters_off);
+	const uint32_t *bundleFilters = (const void *)((const uint8_t *)index->header + index->header->bundle_filters_off);
+	for (uint32_t i = 0; i < index->header->bundle_filter_count; i++) {
+		const choicy_index_filter_t *filter = &filters[bundleFilters[i]];
+		const uint64_t *bits = (const void *)((const uint8_t *)index->header + filter->bits_off);
+
+		// Skip the lookup if every tweak filtering this bundle already matched
+		bool needsCheck = false;
+		for (uint32_t w = 0; w < words; w++) {
+			if (bits[w] & ~matched[w]) {
+				needsCheck = true;
+				break;
+			}
+		}
+		if (!needsCheck) continue;
+
+		// Without CoreFoundation we can't tell, so be conservative
+		if (!bundleIsLoaded || bundleIsLoaded(choicy_index_string(index, filter->key_off))) {
+			for (uint32_t w = 0; w < words; w++) matched[w] |= bits[w];
+		}
+	}
+
+	memset(bitsOut, 0, words * sizeof(uint64_t));
+	for (uint32_t idx = 0; idx < index->header->tweak_count; idx++) {
+		const choicy_index_tweak_t *tweak = choicy_index_tweak(index, idx);
+		if (!(tweak->flags & CHOICY_TWEAK_FLAG_IS_TWEAK)) continue;
+
+		if ((tweak->flags & CHOICY_TWEAK_FLAG_CF_VERSION) && cfVersion) {
+			if (tweak->cf_min > *cfVersion) continue;
+			if (tweak->cf_max != 0 && tweak->cf_max <= *cfVersion) continue;
+		}
+
+		if ((tweak->flags & CHOICY_TWEAK_FLAG_UNKNOWN_FILTER) || choicy_bitset_test(matched, idx)) {
+			choicy_bitset_set(bitsOut, idx);
+		}
+	}
+}
+
+void choicy_index_bundle_filtered_tweaks(choicy_index_t *index, uint64_t *bitsOut)
+{
+	uint32_t words = index->header->bitset_words;
+	memset(bitsOut, 0, words * sizeof(uint64_t));
+
+	const choicy_index_filter_t *filters = (const void *)((const uint8_t *)index->header + index->header->filters_off);
+	const uint32_t *bundleFilters = (const void *)((const uint8_t *)index->header + index->header->bundle_filters_off);
+	for (uint32_t i = 0; i < index->header->bundle_filter_count; i++) {
+		const uint64_t *bits = (const void *)((const uint8_t *)index->header + filters[bundleFilters[i]].bits_off);
+		for (uint32_t w = 0; w < words; w++) bitsOut[w] |= bits[w];
+	}
+}
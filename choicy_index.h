@@ -0,0 +1,294 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The Choicy index is a compiled, mmap-able representation of the filters of all installed tweaks and a snapshot of the preferences
+// It is written by ChoicySB (see ChoicyIndexBuilder) and read by the Choicy dylib in every process
+// All offsets are relative to the start of the file, all strings are NUL terminated and live in the string table
+
+#ifndef CHOICY_INDEX_H
+#define CHOICY_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CHOICY_INDEX_MAGIC 0x58494843 // 'CHIX'
+#define CHOICY_INDEX_VERSION 8
+
+// Posted by SpringBoard whenever a new index has been written, the state of the notification is the generation of the index
+#define CHOICY_INDEX_GENERATION_NOTIFICATION "com.opa334.choicy/IndexGeneration"
+
+enum {
+	CHOICY_FILTER_KIND_BUNDLE = 1,
+	CHOICY_FILTER_KIND_EXECUTABLE = 2,
+};
+
+enum {
+	CHOICY_TWEAK_FLAG_IS_TWEAK = 1 << 0, // Filter dictionary contains at least one non empty array (same check as dylib_is_tweak)
+	CHOICY_TWEAK_FLAG_UNKNOWN_FILTER = 1 << 1, // Filter uses keys we can't evaluate (e.g. Classes), always treat as applicable
+	CHOICY_TWEAK_FLAG_CF_VERSION = 1 << 2, // cf_min / cf_max are valid
+};
+
+enum {
+	CHOICY_PROCESS_KIND_APP = 1, // keyed by bundle identifier
+	CHOICY_PROCESS_KIND_DAEMON = 2, // keyed by executable name
+};
+
+enum {
+	CHOICY_PROCESS_FLAG_TWEAK_INJECTION_DISABLED = 1 << 0,
+	CHOICY_PROCESS_FLAG_CUSTOM_TWEAK_CONFIGURATION_ENABLED = 1 << 1,
+	CHOICY_PROCESS_FLAG_OVERWRITE_GLOBAL_TWEAK_CONFIGURATION = 1 << 2,
+};
+
+enum {
+	CHOICY_INDEX_PREFS_FLAG_PRESENT = 1 << 0,
+	CHOICY_INDEX_PREFS_FLAG_BLOOM_BUNDLE_IDENTIFIERS = 1 << 1, // Executable names of some configured bundles are unknown, the bloom filter has their bundle identifiers instead
+	CHOICY_INDEX_PREFS_FLAG_BUNDLE_RULES = 1 << 2, // Some rules select by bundle identifier, which is not known before the bloom filter is checked
+};
+
+enum {
+	CHOICY_RULE_PROCESS_TYPE_APP = 1 << 0,
+	CHOICY_RULE_PROCESS_TYPE_PLUGIN = 1 << 1,
+	CHOICY_RULE_PROCESS_TYPE_DAEMON = 1 << 2,
+};
+
+enum {
+	CHOICY_RULE_PATTERN_LITERAL = 1, // No wildcards, the whole subject has to be the prefix
+	CHOICY_RULE_PATTERN_PREFIX = 2, // Prefix followed by a single trailing '*', reaching the prefix in the matcher is enough
+	CHOICY_RULE_PATTERN_GLOB = 3, // Anything else, verified with fnmatch once the matcher reached the prefix
+};
+
+enum {
+	CHOICY_MATCHER_ROOT_PATH = 0,
+	CHOICY_MATCHER_ROOT_BUNDLE = 1,
+};
+
+enum {
+	CHOICY_INDEX_DYLD_FLAG_RESOLVED = 1 << 0, // dsc_uuid is valid, gdyld_offset = 0 means gDyld doesn't exist (iOS <= 14)
+};
+
+// dyld4::APIs vtable slots that were used before they were validated per shared cache
+#define CHOICY_DYLD_DLOPEN_SLOT_DEFAULT 14
+#define CHOICY_DYLD_DLOPEN_FROM_SLOT_DEFAULT 97
+
+#define CHOICY_BLOOM_HASH_COUNT 4
+
+// Sets of tweaks (e.g. the allow / deny list overrides passed through the environment) can be encoded as "/<tweaks_generation>:<bits>"
+// Both parts are hex, every digit of <bits> holds four bits of the set, least significant first, trailing zeros are omitted
+// A dylib name can't contain '/', so an encoded set can't be confused with a ':' separated list of names
+#define CHOICY_TWEAK_SET_PREFIX '/'
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t generation;
+
+	// Used to detect whether the index is stale
+	int64_t tweak_dir_mtime_sec;
+	int64_t tweak_dir_mtime_nsec;
+	uint32_t tweak_dir_off;
+
+	uint32_t tweak_count;
+	uint32_t bitset_words;
+	uint32_t tweaks_off; // choicy_index_tweak_t[tweak_count]
+	uint32_t tweak_buckets_off; // uint32_t[tweak_bucket_count], tweak index + 1, 0 = empty
+	uint32_t tweak_bucket_count;
+
+	uint32_t filters_off; // choicy_index_filter_t[filter_bucket_count]
+	uint32_t filter_bucket_count;
+	uint32_t bundle_filters_off; // uint32_t[bundle_filter_count], index into filters of every bundle filter
+	uint32_t bundle_filter_count;
+
+	uint32_t strings_off;
+	uint32_t strings_size;
+	uint32_t size;
+
+	// Snapshot of the preferences, only valid as long as the preferences file is unchanged
+	uint32_t prefs_flags;
+	uint64_t prefs_mtime_sec;
+	uint64_t prefs_mtime_nsec;
+	uint64_t prefs_size;
+	uint64_t prefs_ino;
+	uint32_t global_denied_off; // list, 0 = none
+	uint32_t processes_off; // choicy_index_process_t[process_bucket_count]
+	uint32_t process_bucket_count;
+
+	// Lists are a uint32_t count followed by that many string offsets
+	uint32_t lists_off;
+	uint32_t lists_size;
+
+	// Bloom filter over the executable names of all configured processes (or bundle identifiers, see CHOICY_INDEX_PREFS_FLAG_BLOOM_BUNDLE_IDENTIFIERS), used to skip unconfigured processes early
+	uint32_t process_bloom_off;
+	uint32_t process_bloom_bits; // power of two, 0 = no process is configured
+
+	// Tweak indices stay valid for as long as the tweak table is unchanged, tweaks_generation is the generation that last changed it
+	uint64_t tweaks_hash;
+	uint64_t tweaks_generation;
+
+	// Resolution of dyld4::gDyld for the shared cache with dsc_uuid, so that injected processes don't have to walk its symbol tables
+	uint32_t dyld_flags;
+	uint8_t dsc_uuid[16];
+	uint64_t gdyld_offset; // from the start of the shared cache
+	uint32_t dyld_dlopen_slot; // 0 = could not be validated
+	uint32_t dyld_dlopen_from_slot; // 0 = could not be validated
+
+	// Percentage of decisions that the Choicy dylib verifies against the plist based path (see choicy_shadow_log.h), 0 = off
+	uint32_t shadow_sample_rate;
+
+	// Wildcard rules in order of precedence, they only apply to processes that have no entry of their own
+	uint32_t rules_off; // choicy_index_rule_t[rule_count]
+	uint32_t rule_count;
+	// Trie over the literal prefixes of all rule patterns, see CHOICY_MATCHER_ROOT_*
+	uint32_t matcher_nodes_off; // choicy_index_matcher_node_t[matcher_node_count]
+	uint32_t matcher_node_count;
+	uint32_t matcher_edges_off; // choicy_index_matcher_edge_t[matcher_edge_count]
+	uint32_t matcher_edge_count;
+	uint32_t matcher_rules_off; // uint32_t[matcher_rule_ref_count], rule indices referenced by the nodes
+	uint32_t matcher_rule_ref_count;
+} choicy_index_header_t;
+
+typedef struct {
+	uint64_t name_hash;
+	uint32_t name_off;
+	uint32_t flags;
+	double cf_min;
+	double cf_max; // 0 = unbounded
+} choicy_index_tweak_t;
+
+typedef struct {
+	uint64_t key_hash;
+	uint32_t key_off; // 0 = empty bucket
+	uint32_t kind;
+	uint32_t bits_off; // uint64_t[bitset_words] of all tweaks filtering this key
+	uint32_t reserved;
+} choicy_index_filter_t;
+
+typedef struct {
+	uint64_t key_hash;
+	uint32_t key_off; // 0 = empty bucket
+	uint32_t kind;
+	uint32_t flags;
+	int32_t allow_deny_mode; // 1 = allow, 2 = deny
+	uint32_t allowed_off; // list, 0 = none
+	uint32_t denied_off; // list, 0 = none
+} choicy_index_process_t;
+
+typedef struct {
+	uint32_t pattern_off; // 0 = matches any subject
+	uint32_t kind; // CHOICY_RULE_PATTERN_*
+	uint32_t prefix_length;
+} choicy_index_pattern_t;
+
+typedef struct {
+	choicy_index_pattern_t path; // executable path
+	choicy_index_pattern_t bundle; // bundle identifier
+	uint32_t process_types; // CHOICY_RULE_PROCESS_TYPE_*, 0 = any
+	uint32_t flags; // CHOICY_PROCESS_FLAG_*
+	int32_t allow_deny_mode; // 1 = allow, 2 = deny
+	uint32_t allowed_off; // list, 0 = none
+	uint32_t denied_off; // list, 0 = none
+} choicy_index_rule_t;
+
+typedef struct {
+	uint32_t edges_first; // index of the first edge, edges of a node are sorted by character
+	uint32_t edge_count;
+	uint32_t rules_first; // index of the first rule whose pattern prefix ends at this node
+	uint32_t rule_count;
+} choicy_index_matcher_node_t;
+
+typedef struct {
+	uint8_t character;
+	uint8_t reserved[3];
+	uint32_t node;
+} choicy_index_matcher_edge_t;
+
+typedef struct {
+	const choicy_index_header_t *header;
+	size_t size;
+} choicy_index_t;
+
+static inline uint64_t choicy_hash_string(const char *str)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	while (*str) {
+		hash ^= (uint8_t)*str++;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static inline size_t choicy_bitset_words(uint32_t count)
+{
+	return (count + 63) / 64;
+}
+
+static inline bool choicy_bitset_test(const uint64_t *bits, uint32_t idx)
+{
+	return (bits[idx / 64] & (1ull << (idx % 64))) != 0;
+}
+
+static inline void choicy_bitset_set(uint64_t *bits, uint32_t idx)
+{
+	bits[idx / 64] |= (1ull << (idx % 64));
+}
+
+static inline uint32_t choicy_bloom_position(uint64_t hash, uint32_t i, uint32_t bitCount)
+{
+	uint32_t h1 = (uint32_t)hash;
+	uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+	return (h1 + i * h2) & (bitCount - 1);
+}
+
+int choicy_index_map(const char *path, choicy_index_t *indexOut);
+void choicy_index_unmap(choicy_index_t *index);
+bool choicy_index_tweak_dir_is_current(choicy_index_t *index);
+bool choicy_index_prefs_are_current(choicy_index_t *index, const char *prefsPath);
+
+const char *choicy_index_string(choicy_index_t *index, uint32_t off);
+const choicy_index_tweak_t *choicy_index_tweak(choicy_index_t *index, uint32_t idx);
+int32_t choicy_index_find_tweak(choicy_index_t *index, const char *dylibName);
+const uint64_t *choicy_index_filter_bits(choicy_index_t *index, uint32_t kind, const char *key);
+const choicy_index_process_t *choicy_index_find_process(choicy_index_t *index, uint32_t kind, const char *key);
+const uint32_t *choicy_index_list(choicy_index_t *index, uint32_t listOff, uint32_t *countOut);
+
+// false means that the process with this executable name or bundle identifier is definitely not configured, true means it might be
+bool choicy_index_process_may_be_configured(choicy_index_t *index, const char *key);
+
+// Returns the index of the rule with the highest precedence that matches the process, -1 if there is none
+// Subjects that are NULL only match rules that don't select by them
+int32_t choicy_index_match_rule(choicy_index_t *index, const char *executablePath, const char *bundleIdentifier, uint32_t processType);
+// The two halves of choicy_index_match_rule, so that a process can walk its executable path through the matcher only once
+// candidates has to hold choicy_bitset_words(rule_count) zeroed words, subjects that are NULL are never looked at
+void choicy_index_rule_candidates(choicy_index_t *index, uint32_t root, const char *subject, uint64_t *candidates);
+int32_t choicy_index_match_rule_candidates(choicy_index_t *index, const char *executablePath, const uint64_t *pathCandidates, const char *bundleIdentifier, const uint64_t *bundleCandidates, uint32_t processType);
+const choicy_index_rule_t *choicy_index_rule(choicy_index_t *index, uint32_t idx);
+
+// Encodes a set of tweaks into buf, returns the length of the encoded string or 0 if buf is too small
+size_t choicy_tweak_set_encode(choicy_index_t *index, const uint64_t *bits, char *buf, size_t bufSize);
+// Decodes an encoded set of tweaks into bitsOut (bitsWords long) without allocating, fails if it was encoded for another tweak table
+bool choicy_tweak_set_decode(choicy_index_t *index, const char *str, uint64_t *bitsOut, size_t bitsWords);
+
+// Calculates the set of tweaks whose filters match the current process, bundleIsLoaded may be NULL if CoreFoundation is not available
+void choicy_index_applicable_tweaks(choicy_index_t *index, const char *executableName, const double *cfVersion, bool (*bundleIsLoaded)(const char *bundleIdentifier), uint64_t *bitsOut);
+// Calculates the set of tweaks that filter at least one bundle, these can become applicable once that bundle is loaded
+void choicy_index_bundle_filtered_tweaks(choicy_index_t *index, uint64_t *bitsOut);
+
+#endif
@@ -0,0 +1,50 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Shadow mode verifies the index based fast path of the Choicy dylib against the plist based path for a sample of all decisions
+// Every comparison is appended to the shadow log as one fixed size record, the preference bundle summarizes it
+
+#ifndef CHOICY_SHADOW_LOG_H
+#define CHOICY_SHADOW_LOG_H
+
+#include <stdint.h>
+
+#define CHOICY_SHADOW_RECORD_MAGIC 0x57444853 // 'SHDW'
+#define CHOICY_SHADOW_LOG_MAX_SIZE (sizeof(choicy_shadow_record_t) * 4096) // The log starts over once it gets bigger than this
+
+enum {
+	CHOICY_SHADOW_KIND_PREFERENCES = 1, // Process configuration loaded from the index vs. the preferences plist
+	CHOICY_SHADOW_KIND_TWEAK_DETECTION = 2, // Whether a dylib is a tweak according to the index vs. its filter plist
+};
+
+typedef struct {
+	uint32_t magic;
+	uint8_t kind;
+	uint8_t mismatch;
+	uint8_t fast_result;
+	uint8_t reference_result;
+	uint64_t timestamp; // seconds since 1970
+	uint64_t fast_ns;
+	uint64_t reference_ns;
+	char process[24]; // executable name, truncated
+	char subject[40]; // dylib name for tweak detection, truncated
+} choicy_shadow_record_t;
+
+#endif
@@ -0,0 +1,49 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "choicy_verdict.h"
+#include <string.h>
+
+bool choicy_tweak_is_crucial(const char *dylibName, const char *appBundleIdentifier)
+{
+	if (!appBundleIdentifier) return false;
+	if (!strcmp(appBundleIdentifier, "com.apple.Preferences")) {
+		return !strcmp(dylibName, "PreferenceLoader") || !strcmp(dylibName, "preferred");
+	}
+	if (!strcmp(appBundleIdentifier, "com.apple.springboard")) {
+		return !strcmp(dylibName, "ChoicySB");
+	}
+	return false;
+}
+
+int choicy_tweak_verdict(const choicy_verdict_process_t *process, const char *dylibName, const choicy_verdict_tweak_t *tweak)
+{
+	if (choicy_tweak_is_crucial(dylibName, process->app_bundle_identifier)) return CHOICY_VERDICT_CRUCIAL;
+	if (process->tweak_injection_disabled) return CHOICY_VERDICT_INJECTION_DISABLED;
+	if (tweak->globally_denied) return CHOICY_VERDICT_GLOBALLY_DENIED;
+	if (process->has_allow_list && !tweak->allowed) return CHOICY_VERDICT_NOT_ALLOWED;
+	if (process->has_deny_list && tweak->denied) return CHOICY_VERDICT_DENIED;
+	return CHOICY_VERDICT_ALLOWED;
+}
+
+bool choicy_verdict_allows_loading(int verdict)
+{
+	return verdict == CHOICY_VERDICT_ALLOWED || verdict == CHOICY_VERDICT_CRUCIAL;
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Whether a tweak may load into a process, shared by the Choicy dylib (tweak_verdict) and choicyctl so that both always agree
+
+#ifndef CHOICY_VERDICT_H
+#define CHOICY_VERDICT_H
+
+#include <stdbool.h>
+
+enum {
+	CHOICY_VERDICT_ALLOWED,
+	CHOICY_VERDICT_CRUCIAL, // Needed for Choicy itself to work, never blocked
+	CHOICY_VERDICT_INJECTION_DISABLED,
+	CHOICY_VERDICT_GLOBALLY_DENIED,
+	CHOICY_VERDICT_NOT_ALLOWED,
+	CHOICY_VERDICT_DENIED,
+};
+
+typedef struct {
+	const char *app_bundle_identifier; // Only set for apps, NULL for plugins and daemons
+	bool tweak_injection_disabled;
+	bool has_allow_list;
+	bool has_deny_list;
+} choicy_verdict_process_t;
+
+// Membership of one tweak in the lists that apply to the process
+typedef struct {
+	bool allowed;
+	bool denied;
+	bool globally_denied;
+} choicy_verdict_tweak_t;
+
+bool choicy_tweak_is_crucial(const char *dylibName, const char *appBundleIdentifier);
+int choicy_tweak_verdict(const choicy_verdict_process_t *process, const char *dylibName, const choicy_verdict_tweak_t *tweak);
+bool choicy_verdict_allows_loading(int verdict);
+
+#endif
@@ -0,0 +1,641 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "choicyctl_prefs.h"
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define kChoicyPrefsKeyGlobalDeniedTweaks "globalDeniedTweaks"
+#define kChoicyPrefsKeyAppSettings "appSettings"
+#define kChoicyPrefsKeyDaemonSettings "daemonSettings"
+#define kChoicyProcessPrefsKeyTweakInjectionDisabled "tweakInjectionDisabled"
+#define kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled "customTweakConfigurationEnabled"
+#define kChoicyProcessPrefsKeyAllowDenyMode "allowDenyMode"
+#define kChoicyProcessPrefsKeyDeniedTweaks "deniedTweaks"
+#define kChoicyProcessPrefsKeyAllowedTweaks "allowedTweaks"
+#define kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration "overwriteGlobalTweakConfiguration"
+
+static void *(*gOpaqueRetain)(void *opaque);
+static void (*gOpaqueRelease)(void *opaque);
+
+void choicyctl_set_opaque_callbacks(void *(*retain)(void *opaque), void (*release)(void *opaque))
+{
+	gOpaqueRetain = retain;
+	gOpaqueRelease = release;
+}
+
+static choicyctl_value_t *choicyctl_value_create(int type)
+{
+	choicyctl_value_t *value = calloc(1, sizeof(choicyctl_value_t));
+	value->type = type;
+	return value;
+}
+
+choicyctl_value_t *choicyctl_bool_create(bool boolean)
+{
+	choicyctl_value_t *value = choicyctl_value_create(CHOICYCTL_VALUE_BOOL);
+	value->boolean = boolean;
+	return value;
+}
+
+choicyctl_value_t *choicyctl_integer_create(int64_t integer)
+{
+	choicyctl_value_t *value = choicyctl_value_create(CHOICYCTL_VALUE_INTEGER);
+	value->integer = integer;
+	return value;
+}
+
+choicyctl_value_t *choicyctl_real_create(double real)
+{
+	choicyctl_value_t *value = choicyctl_value_create(CHOICYCTL_VALUE_REAL);
+	value->real = real;
+	return value;
+}
+
+choicyctl_value_t *choicyctl_string_create(const char *string)
+{
+	choicyctl_value_t *value = choicyctl_value_create(CHOICYCTL_VALUE_STRING);
+	value->string = strdup(string);
+	return value;
+}
+
+choicyctl_value_t *choicyctl_array_create(void)
+{
+	return choicyctl_value_create(CHOICYCTL_VALUE_ARRAY);
+}
+
+choicyctl_value_t *choicyctl_dictionary_create(void)
+{
+	return choicyctl_value_create(CHOICYCTL_VALUE_DICTIONARY);
+}
+
+choicyctl_value_t *choicyctl_opaque_create(void *opaque)
+{
+	choicyctl_value_t *value = choicyctl_value_create(CHOICYCTL_VALUE_OPAQUE);
+	value->opaque = opaque;
+	return value;
+}
+
+void choicyctl_value_free(choicyctl_value_t *value)
+{
+	if (!value) return;
+
+	if (value->type == CHOICYCTL_VALUE_STRING) {
+		free(value->string);
+	}
+	else if (value->type == CHOICYCTL_VALUE_OPAQUE) {
+		if (gOpaqueRelease) gOpaqueRelease(value->opaque);
+	}
+
+	for (size_t i = 0; i < value->count; i++) {
+		if (value->keys) free(value->keys[i]);
+		choicyctl_value_free(value->values[i]);
+	}
+	free(value->keys);
+	free(value->values);
+	free(value);
+}
+
+static void choicyctl_value_reserve(choicyctl_value_t *value)
+{
+	if (value->count < value->capacity) return;
+	value->capacity = value->capacity ? value->capacity * 2 : 8;
+	value->values = realloc(value->values, value->capacity * sizeof(choicyctl_value_t *));
+	if (value->type == CHOICYCTL_VALUE_DICTIONARY) {
+		value->keys = realloc(value->keys, value->capacity * sizeof(char *));
+	}
+}
+
+choicyctl_value_t *choicyctl_value_copy(const choicyctl_value_t *value)
+{
+	if (!value) return NULL;
+
+	switch (value->type) {
+		case CHOICYCTL_VALUE_BOOL:
+			return choicyctl_bool_create(value->boolean);
+		case CHOICYCTL_VALUE_INTEGER:
+			return choicyctl_integer_create(value->integer);
+		case CHOICYCTL_VALUE_REAL:
+			return choicyctl_real_create(value->real);
+		case CHOICYCTL_VALUE_STRING:
+			return choicyctl_string_create(value->string);
+		case CHOICYCTL_VALUE_OPAQUE:
+			return choicyctl_opaque_create(gOpaqueRetain ? gOpaqueRetain(value->opaque) : value->opaque);
+	}
+
+	choicyctl_value_t *copy = choicyctl_value_create(value->type);
+	for (size_t i = 0; i < value->count; i++) {
+		if (value->type == CHOICYCTL_VALUE_DICTIONARY) {
+			choicyctl_dictionary_set(copy, value->keys[i], choicyctl_value_copy(value->values[i]));
+		}
+		else {
+			choicyctl_array_append(copy, choicyctl_value_copy(value->values[i]));
+		}
+	}
+	return copy;
+}
+
+static size_t choicyctl_dictionary_index(const choicyctl_value_t *dictionary, const char *key)
+{
+	for (size_t i = 0; i < dictionary->count; i++) {
+		if (!strcmp(dictionary->keys[i], key)) return i;
+	}
+	return dictionary->count;
+}
+
+bool choicyctl_value_equal(const choicyctl_value_t *a, const choicyctl_value_t *b)
+{
+	if (!a || !b) return a == b;
+	if (a->type != b->type) return false;
+
+	switch (a->type) {
+		case CHOICYCTL_VALUE_BOOL:
+			return a->boolean == b->boolean;
+		case CHOICYCTL_VALUE_INTEGER:
+			return a->integer == b->integer;
+		case CHOICYCTL_VALUE_REAL:
+			return a->real == b->real;
+		case CHOICYCTL_VALUE_STRING:
+			return !strcmp(a->string, b->string);
+		case CHOICYCTL_VALUE_OPAQUE:
+			return a->opaque == b->opaque;
+	}
+
+	if (a->count != b->count) return false;
+	for (size_t i = 0; i < a->count; i++) {
+		if (a->type == CHOICYCTL_VALUE_DICTIONARY) {
+			// Dictionaries are equal regardless of the order of their keys
+			if (!choicyctl_value_equal(a->values[i], choicyctl_dictionary_get(b, a->keys[i]))) return false;
+		}
+		else {
+			if (!choicyctl_value_equal(a->values[i], b->values[i])) return false;
+		}
+	}
+	return true;
+}
+
+choicyctl_value_t *choicyctl_dictionary_get(const choicyctl_value_t *dictionary, const char *key)
+{
+	if (!dictionary || dictionary->type != CHOICYCTL_VALUE_DICTIONARY) return NULL;
+	size_t idx = choicyctl_dictionary_index(dictionary, key);
+	return idx < dictionary->count ? dictionary->values[idx] : NULL;
+}
+
+void choicyctl_dictionary_set(choicyctl_value_t *dictionary, const char *key, choicyctl_value_t *value)
+{
+	size_t idx = choicyctl_dictionary_index(dictionary, key);
+	if (idx < dictionary->count) {
+		choicyctl_value_free(dictionary->values[idx]);
+		if (value) {
+			dictionary->values[idx] = value;
+			return;
+		}
+
+		free(dictionary->keys[idx]);
+		dictionary->count--;
+		memmove(&dictionary->keys[idx], &dictionary->keys[idx + 1], (dictionary->count - idx) * sizeof(char *));
+		memmove(&dictionary->values[idx], &dictionary->values[idx + 1], (dictionary->count - idx) * sizeof(choicyctl_value_t *));
+		return;
+	}
+	if (!value) return;
+
+	choicyctl_value_reserve(dictionary);
+	dictionary->keys[dictionary->count] = strdup(key);
+	dictionary->values[dictionary->count] = value;
+	dictionary->count++;
+}
+
+void choicyctl_array_append(choicyctl_value_t *array, choicyctl_value_t *value)
+{
+	choicyctl_value_reserve(array);
+	array->values[array->count++] = value;
+}
+
+bool choicyctl_array_contains_string(const choicyctl_value_t *array, const char *string)
+{
+	if (!array || array->type != CHOICYCTL_VALUE_ARRAY) return false;
+	for (size_t i = 0; i < array->count; i++) {
+		if (array->values[i]->type == CHOICYCTL_VALUE_STRING && !strcmp(array->values[i]->string, string)) return true;
+	}
+	return false;
+}
+
+bool choicyctl_number_bool(const choicyctl_value_t *value, bool default_)
+{
+	if (!value) return default_;
+	switch (value->type) {
+		case CHOICYCTL_VALUE_BOOL:
+			return value->boolean;
+		case CHOICYCTL_VALUE_INTEGER:
+			return value->integer != 0;
+		case CHOICYCTL_VALUE_REAL:
+			return value->real != 0;
+	}
+	return default_;
+}
+
+int64_t choicyctl_number_integer(const choicyctl_value_t *value, int64_t default_)
+{
+	if (!value) return default_;
+	switch (value->type) {
+		case CHOICYCTL_VALUE_BOOL:
+			return value->boolean;
+		case CHOICYCTL_VALUE_INTEGER:
+			return value->integer;
+		case CHOICYCTL_VALUE_REAL:
+			return (int64_t)value->real;
+	}
+	return default_;
+}
+
+static const char *settings_key_for_kind(const char *kind)
+{
+	return !strcmp(kind, "app") ? kChoicyPrefsKeyAppSettings : kChoicyPrefsKeyDaemonSettings;
+}
+
+static bool string_is_glob(const char *string)
+{
+	return strpbrk(string, "*?[") != NULL;
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void choicyctl_string_list_free(char **list, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		free(list[i]);
+	}
+	free(list);
+}
+
+char **choicyctl_resolve_selector(choicyctl_context_t *context, const char *selector, bool allowCreation, size_t *countOut)
+{
+	static const char *allKinds[] = { "app", "daemon" };
+	const char **kinds = allKinds;
+	size_t kindCount = 2;
+	const char *pattern = selector;
+	bool explicitKind = false;
+
+	for (size_t i = 0; i < 2; i++) {
+		size_t prefixLength = strlen(allKinds[i]);
+		if (!strncmp(selector, allKinds[i], prefixLength) && selector[prefixLength] == ':') {
+			kinds = &allKinds[i];
+			kindCount = 1;
+			pattern = &selector[prefixLength + 1];
+			explicitKind = true;
+			break;
+		}
+	}
+
+	char **matches = NULL;
+	size_t count = 0;
+	for (size_t k = 0; k < kindCount; k++) {
+		const choicyctl_value_t *settings = choicyctl_dictionary_get(context->preferences, settings_key_for_kind(kinds[k]));
+		if (!settings || settings->type != CHOICYCTL_VALUE_DICTIONARY) continue;
+
+		char *names[settings->count ?: 1];
+		memcpy(names, settings->keys, settings->count * sizeof(char *));
+		qsort(names, settings->count, sizeof(char *), compare_strings);
+
+		for (size_t i = 0; i < settings->count; i++) {
+			if (fnmatch(pattern, names[i], 0) != 0) continue;
+			matches = realloc(matches, (count + 1) * sizeof(char *));
+			asprintf(&matches[count++], "%s:%s", kinds[k], names[i]);
+		}
+	}
+
+	if (!count && allowCreation && explicitKind && !string_is_glob(pattern)) {
+		matches = malloc(sizeof(char *));
+		matches[count++] = strdup(selector);
+	}
+
+	*countOut = count;
+	return matches;
+}
+
+// Processes are "<kind>:<name>"
+static const char *settings_key_for_process(const char *process)
+{
+	return !strncmp(process, "app:", 4) ? kChoicyPrefsKeyAppSettings : kChoicyPrefsKeyDaemonSettings;
+}
+
+const choicyctl_value_t *choicyctl_process_preferences(choicyctl_context_t *context, const char *process)
+{
+	const char *name = &strchr(process, ':')[1];
+	return choicyctl_dictionary_get(choicyctl_dictionary_get(context->preferences, settings_key_for_process(process)), name);
+}
+
+// Copy of the preferences of a process that can be modified and passed to set_process_preferences
+static choicyctl_value_t *copy_process_preferences(choicyctl_context_t *context, const char *process)
+{
+	const choicyctl_value_t *processPrefs = choicyctl_process_preferences(context, process);
+	if (processPrefs && processPrefs->type == CHOICYCTL_VALUE_DICTIONARY) return choicyctl_value_copy(processPrefs);
+	return choicyctl_dictionary_create();
+}
+
+// processPrefs = NULL removes the process
+static void set_process_preferences(choicyctl_context_t *context, const char *process, choicyctl_value_t *processPrefs)
+{
+	const char *name = &strchr(process, ':')[1];
+	const char *settingsKey = settings_key_for_process(process);
+
+	choicyctl_value_t *settings = choicyctl_dictionary_get(context->preferences, settingsKey);
+	if (!settings || settings->type != CHOICYCTL_VALUE_DICTIONARY) {
+		if (!processPrefs) return;
+		settings = choicyctl_dictionary_create();
+		choicyctl_dictionary_set(context->preferences, settingsKey, settings);
+	}
+	choicyctl_dictionary_set(settings, name, processPrefs);
+	context->preferences_changed = true;
+}
+
+// Returns a new array with the strings of array followed by the tweaks that are not in it yet
+static choicyctl_value_t *array_by_adding_tweaks(const choicyctl_value_t *array, int tweakCount, char *tweaks[])
+{
+	choicyctl_value_t *result = (array && array->type == CHOICYCTL_VALUE_ARRAY) ? choicyctl_value_copy(array) : choicyctl_array_create();
+	for (int i = 0; i < tweakCount; i++) {
+		if (!choicyctl_array_contains_string(result, tweaks[i])) choicyctl_array_append(result, choicyctl_string_create(tweaks[i]));
+	}
+	return result;
+}
+
+static choicyctl_value_t *array_by_removing_tweaks(const choicyctl_value_t *array, int tweakCount, char *tweaks[])
+{
+	choicyctl_value_t *result = choicyctl_array_create();
+	if (!array || array->type != CHOICYCTL_VALUE_ARRAY) return result;
+	for (size_t i = 0; i < array->count; i++) {
+		bool removed = false;
+		for (int t = 0; t < tweakCount && !removed; t++) {
+			removed = array->values[i]->type == CHOICYCTL_VALUE_STRING && !strcmp(array->values[i]->string, tweaks[t]);
+		}
+		if (!removed) choicyctl_array_append(result, choicyctl_value_copy(array->values[i]));
+	}
+	return result;
+}
+
+static int command_list(choicyctl_context_t *context, int argc, char *argv[])
+{
+	size_t count = 0;
+	char **processes = choicyctl_resolve_selector(context, "*", false, &count);
+	for (size_t i = 0; i < count; i++) {
+		const choicyctl_value_t *processPrefs = choicyctl_process_preferences(context, processes[i]);
+		const char *state;
+		if (choicyctl_number_bool(choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyTweakInjectionDisabled), false)) {
+			state = "tweak injection disabled";
+		}
+		else if (choicyctl_number_bool(choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled), false)) {
+			state = choicyctl_number_integer(choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyAllowDenyMode), 1) == 2 ? "custom (deny)" : "custom (allow)";
+		}
+		else {
+			state = "default";
+		}
+		fprintf(context->out, "%s\t%s\n", processes[i], state);
+	}
+	choicyctl_string_list_free(processes, count);
+	return 0;
+}
+
+static int command_set(choicyctl_context_t *context, int argc, char *argv[])
+{
+	if (argc < 2) return -1;
+
+	choicyctl_value_t *changes = choicyctl_dictionary_create();
+	for (int i = 1; i < argc; i++) {
+		const char *separator = strchr(argv[i], '=');
+		if (!separator || strchr(&separator[1], '=')) {
+			choicyctl_value_free(changes);
+			return -1;
+		}
+		char key[separator - argv[i] + 1];
+		memcpy(key, argv[i], separator - argv[i]);
+		key[separator - argv[i]] = '\0';
+		const char *value = &separator[1];
+
+		choicyctl_value_t *change = NULL;
+		if (!strcmp(key, kChoicyProcessPrefsKeyAllowDenyMode)) {
+			if (!strcmp(value, "allow") || !strcmp(value, "1")) change = choicyctl_integer_create(1);
+			else if (!strcmp(value, "deny") || !strcmp(value, "2")) change = choicyctl_integer_create(2);
+		}
+		else if (!strcmp(key, kChoicyProcessPrefsKeyTweakInjectionDisabled) || !strcmp(key, kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled) || !strcmp(key, kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration)) {
+			if (!strcmp(value, "true") || !strcmp(value, "1")) change = choicyctl_bool_create(true);
+			else if (!strcmp(value, "false") || !strcmp(value, "0")) change = choicyctl_bool_create(false);
+		}
+		else {
+			fprintf(context->err, "Unknown key: %s\n", key);
+			choicyctl_value_free(changes);
+			return 1;
+		}
+
+		if (!change) {
+			choicyctl_value_free(changes);
+			return -1;
+		}
+		choicyctl_dictionary_set(changes, key, change);
+	}
+
+	size_t count = 0;
+	char **processes = choicyctl_resolve_selector(context, argv[0], true, &count);
+	for (size_t i = 0; i < count; i++) {
+		choicyctl_value_t *processPrefs = copy_process_preferences(context, processes[i]);
+		for (size_t c = 0; c < changes->count; c++) {
+			choicyctl_dictionary_set(processPrefs, changes->keys[c], choicyctl_value_copy(changes->values[c]));
+		}
+		set_process_preferences(context, processes[i], processPrefs);
+	}
+	choicyctl_string_list_free(processes, count);
+	choicyctl_value_free(changes);
+
+	fprintf(context->err, "Updated %zu process(es)\n", count);
+	return 0;
+}
+
+static int command_deny_allow(choicyctl_context_t *context, int argc, char *argv[], bool deny)
+{
+	if (argc < 2) return -1;
+
+	int tweakCount = argc - 1;
+	char **tweaks = &argv[1];
+	size_t count = 0;
+	char **processes = choicyctl_resolve_selector(context, argv[0], deny, &count);
+
+	for (size_t i = 0; i < count; i++) {
+		choicyctl_value_t *processPrefs = copy_process_preferences(context, processes[i]);
+		bool customTweakConfigurationEnabled = choicyctl_number_bool(choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled), false);
+		int64_t allowDenyMode = choicyctl_number_integer(choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyAllowDenyMode), 1);
+		const choicyctl_value_t *allowedTweaks = choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyAllowedTweaks);
+		const choicyctl_value_t *deniedTweaks = choicyctl_dictionary_get(processPrefs, kChoicyProcessPrefsKeyDeniedTweaks);
+
+		if (deny) {
+			// On allow, denying means taking the tweaks off the allow list, everything else switches to a deny list
+			if (customTweakConfigurationEnabled && allowDenyMode == 1) {
+				choicyctl_dictionary_set(processPrefs, kChoicyProcessPrefsKeyAllowedTweaks, array_by_removing_tweaks(allowedTweaks, tweakCount, tweaks));
+			}
+			else {
+				choicyctl_dictionary_set(processPrefs, kChoicyProcessPrefsKeyDeniedTweaks, array_by_adding_tweaks(deniedTweaks, tweakCount, tweaks));
+				choicyctl_dictionary_set(processPrefs, kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled, choicyctl_bool_create(true));
+				choicyctl_dictionary_set(processPrefs, kChoicyProcessPrefsKeyAllowDenyMode, choicyctl_integer_create(2));
+			}
+		}
+		else {
+			// Without a custom configuration, everything is allowed already
+			if (!customTweakConfigurationEnabled) {
+				choicyctl_value_free(processPrefs);
+				continue;
+			}
+			if (allowDenyMode == 2) {
+				choicyctl_dictionary_set(processPrefs, kChoicyProcessPrefsKeyDeniedTweaks, array_by_removing_tweaks(deniedTweaks, tweakCount, tweaks));
+			}
+			else {
+				choicyctl_dictionary_set(processPrefs, kChoicyProcessPrefsKeyAllowedTweaks, array_by_adding_tweaks(allowedTweaks, tweakCount, tweaks));
+			}
+		}
+
+		set_process_preferences(context, processes[i], processPrefs);
+	}
+	choicyctl_string_list_free(processes, count);
+
+	fprintf(context->err, "Updated %zu process(es)\n", count);
+	return 0;
+}
+
+static int command_reset(choicyctl_context_t *context, int argc, char *argv[])
+{
+	if (argc != 1) return -1;
+
+	size_t count = 0;
+	char **processes = choicyctl_resolve_selector(context, argv[0], false, &count);
+	for (size_t i = 0; i < count; i++) {
+		set_process_preferences(context, processes[i], NULL);
+	}
+	choicyctl_string_list_free(processes, count);
+
+	fprintf(context->err, "Reset %zu process(es)\n", count);
+	return 0;
+}
+
+static int command_global(choicyctl_context_t *context, int argc, char *argv[], bool deny)
+{
+	if (!argc) return -1;
+
+	const choicyctl_value_t *globalDeniedTweaks = choicyctl_dictionary_get(context->preferences, kChoicyPrefsKeyGlobalDeniedTweaks);
+	choicyctl_dictionary_set(context->preferences, kChoicyPrefsKeyGlobalDeniedTweaks, deny ? array_by_adding_tweaks(globalDeniedTweaks, argc, argv) : array_by_removing_tweaks(globalDeniedTweaks, argc, argv));
+	context->preferences_changed = true;
+	return 0;
+}
+
+int choicyctl_run_command(choicyctl_context_t *context, int argc, char *argv[])
+{
+	if (argc < 1) return -1;
+	const char *command = argv[0];
+	argc--;
+	argv++;
+
+	if (!strcmp(command, "list")) return command_list(context, argc, argv);
+	if (!strcmp(command, "set")) return command_set(context, argc, argv);
+	if (!strcmp(command, "deny")) return command_deny_allow(context, argc, argv, true);
+	if (!strcmp(command, "allow")) return command_deny_allow(context, argc, argv, false);
+	if (!strcmp(command, "reset")) return command_reset(context, argc, argv);
+	if (!strcmp(command, "global-deny")) return command_global(context, argc, argv, true);
+	if (!strcmp(command, "global-allow")) return command_global(context, argc, argv, false);
+
+	return -1;
+}
+
+int choicyctl_import(choicyctl_context_t *context, choicyctl_value_t *imported, bool merge)
+{
+	if (!imported || imported->type != CHOICYCTL_VALUE_DICTIONARY) {
+		choicyctl_value_free(imported);
+		return 1;
+	}
+
+	if (merge) {
+		for (size_t i = 0; i < imported->count; i++) {
+			choicyctl_value_t *value = imported->values[i];
+			choicyctl_value_t *existing = choicyctl_dictionary_get(context->preferences, imported->keys[i]);
+			if (value->type == CHOICYCTL_VALUE_DICTIONARY && existing && existing->type == CHOICYCTL_VALUE_DICTIONARY) {
+				for (size_t j = 0; j < value->count; j++) {
+					choicyctl_dictionary_set(existing, value->keys[j], choicyctl_value_copy(value->values[j]));
+				}
+			}
+			else {
+				choicyctl_dictionary_set(context->preferences, imported->keys[i], choicyctl_value_copy(value));
+			}
+		}
+		choicyctl_value_free(imported);
+	}
+	else {
+		choicyctl_value_free(context->preferences);
+		context->preferences = imported;
+	}
+
+	context->preferences_changed = true;
+	return 0;
+}
+
+int choicyctl_run_batch(choicyctl_context_t *context, const char *script, int (*runLine)(int argc, char *argv[], void *userInfo), void *userInfo)
+{
+	choicyctl_value_t *previousPreferences = choicyctl_value_copy(context->preferences);
+	bool previousPreferencesChanged = context->preferences_changed;
+
+	int ret = 0;
+	size_t lineNumber = 0;
+	const char *cur = script;
+	while (*cur && ret == 0) {
+		size_t lineLength = strcspn(cur, "\r\n");
+		char line[lineLength + 1];
+		memcpy(line, cur, lineLength);
+		line[lineLength] = '\0';
+		cur += lineLength;
+		if (cur[0] == '\r' && cur[1] == '\n') cur += 2;
+		else if (*cur) cur++;
+		lineNumber++;
+
+		// Split at whitespace, lines that are empty or start with '#' are skipped
+		char tokens[lineLength + 1];
+		memcpy(tokens, line, lineLength + 1);
+		char *argv[lineLength / 2 + 2];
+		int argc = 0;
+		char *state = NULL;
+		for (char *token = strtok_r(tokens, " \t", &state); token; token = strtok_r(NULL, " \t", &state)) {
+			argv[argc++] = token;
+		}
+		argv[argc] = NULL;
+		if (!argc || argv[0][0] == '#') continue;
+
+		ret = !strcmp(argv[0], "batch") ? -1 : runLine(argc, argv, userInfo);
+		if (ret != 0) {
+			fprintf(context->err, "Line %zu failed: %s\n", lineNumber, &line[strspn(line, " \t")]);
+		}
+	}
+
+	if (ret != 0) {
+		choicyctl_value_free(context->preferences);
+		context->preferences = previousPreferences;
+		context->preferences_changed = previousPreferencesChanged;
+		return 1;
+	}
+
+	choicyctl_value_free(previousPreferences);
+	return 0;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Plain C core of choicyctl: a minimal property list value and the commands that edit the preferences with it
+// main.m converts between Foundation objects and these values, everything here also builds on hosts without Foundation (see tests/)
+
+#ifndef CHOICYCTL_PREFS_H
+#define CHOICYCTL_PREFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+	CHOICYCTL_VALUE_BOOL = 1,
+	CHOICYCTL_VALUE_INTEGER,
+	CHOICYCTL_VALUE_REAL,
+	CHOICYCTL_VALUE_STRING,
+	CHOICYCTL_VALUE_ARRAY,
+	CHOICYCTL_VALUE_DICTIONARY,
+	CHOICYCTL_VALUE_OPAQUE, // Any other object (e.g. data or dates), passed through unchanged
+};
+
+typedef struct choicyctl_value choicyctl_value_t;
+struct choicyctl_value {
+	int type;
+	union {
+		bool boolean;
+		int64_t integer;
+		double real;
+		char *string;
+		void *opaque;
+	};
+	size_t count;
+	size_t capacity;
+	char **keys; // dictionary, in insertion order
+	choicyctl_value_t **values; // array and dictionary
+};
+
+choicyctl_value_t *choicyctl_bool_create(bool boolean);
+choicyctl_value_t *choicyctl_integer_create(int64_t integer);
+choicyctl_value_t *choicyctl_real_create(double real);
+choicyctl_value_t *choicyctl_string_create(const char *string);
+choicyctl_value_t *choicyctl_array_create(void);
+choicyctl_value_t *choicyctl_dictionary_create(void);
+choicyctl_value_t *choicyctl_opaque_create(void *opaque); // takes over the reference
+void choicyctl_value_free(choicyctl_value_t *value);
+choicyctl_value_t *choicyctl_value_copy(const choicyctl_value_t *value);
+bool choicyctl_value_equal(const choicyctl_value_t *a, const choicyctl_value_t *b);
+
+// Opaque values are retained and released through these, they are never compared by content
+void choicyctl_set_opaque_callbacks(void *(*retain)(void *opaque), void (*release)(void *opaque));
+
+// Getters return NULL if the value is not a dictionary or doesn't contain the key, setters take over value (NULL removes the key)
+choicyctl_value_t *choicyctl_dictionary_get(const choicyctl_value_t *dictionary, const char *key);
+void choicyctl_dictionary_set(choicyctl_value_t *dictionary, const char *key, choicyctl_value_t *value);
+void choicyctl_array_append(choicyctl_value_t *array, choicyctl_value_t *value);
+bool choicyctl_array_contains_string(const choicyctl_value_t *array, const char *string);
+
+// Same as parseNumberBool / parseNumberInteger in Shared.m
+bool choicyctl_number_bool(const choicyctl_value_t *value, bool default_);
+int64_t choicyctl_number_integer(const choicyctl_value_t *value, int64_t default_);
+
+typedef struct {
+	choicyctl_value_t *preferences;
+	bool preferences_changed;
+	FILE *out; // results
+	FILE *err; // messages
+} choicyctl_context_t;
+
+// Returns "<kind>:<name>" for every process matched by the selector, free with choicyctl_string_list_free
+char **choicyctl_resolve_selector(choicyctl_context_t *context, const char *selector, bool allowCreation, size_t *countOut);
+void choicyctl_string_list_free(char **list, size_t count);
+const choicyctl_value_t *choicyctl_process_preferences(choicyctl_context_t *context, const char *process);
+
+// Commands return 0 on success, 1 on failure and -1 if the arguments are invalid
+// choicyctl_run_command handles list, set, deny, allow, reset, global-deny and global-allow, -1 for anything else
+int choicyctl_run_command(choicyctl_context_t *context, int argc, char *argv[]);
+// Replaces the preferences with imported or merges it into them key by key (dictionaries are merged one level deep), takes over imported
+int choicyctl_import(choicyctl_context_t *context, choicyctl_value_t *imported, bool merge);
+// Runs one command per line through runLine, stops at the first line that fails and puts the preferences back as they were before the batch
+int choicyctl_run_batch(choicyctl_context_t *context, const char *script, int (*runLine)(int argc, char *argv[], void *userInfo), void *userInfo);
+
+#endif
@@ -0,0 +1,562 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#import <Foundation/Foundation.h>
+#import <fnmatch.h>
+#import <errno.h>
+#import <unistd.h>
+#import "../Shared.h"
+#import "../ChoicyPrefsMigrator.h"
+#import "../ChoicyProfiles.h"
+#import "../ChoicyPrefs/CHPTweakList.h"
+#import "../ChoicyPrefs/CHPTweakInfo.h"
+#import "../choicy_verdict.h"
+#import "choicyctl_prefs.h"
+
+#define kChoicyPrefsRelativePath @"var/mobile/Library/Preferences/com.opa334.choicyprefs.plist"
+#define kChoicyProfilesRelativePath @"var/mobile/Library/Preferences/com.opa334.choicy.profiles.plist"
+
+static NSString *gRootPath;
+static BOOL gDryRun;
+static choicyctl_context_t gContext;
+static NSMutableDictionary *gProfileStore;
+static BOOL gProfileStoreChanged;
+
+static void printUsage(void)
+{
+	fprintf(stderr,
+		"Usage: choicyctl [--root <path>] [--dry-run] <command> [arguments]\n"
+		"\n"
+		"Selectors:\n"
+		"  app:<glob>            applications by bundle identifier\n"
+		"  daemon:<glob>         daemons by executable name\n"
+		"  <glob>                both of the above\n"
+		"  Globs only match processes that are already configured, use app:/daemon: with an exact name to configure a new one\n"
+		"\n"
+		"Commands:\n"
+		"  list                                  list all configured processes\n"
+		"  get <selector>...                     print the configuration of the matching processes as JSON\n"
+		"  set <selector> <key>=<value>...       set tweakInjectionDisabled, customTweakConfigurationEnabled,\n"
+		"                                        overwriteGlobalTweakConfiguration (true/false) or allowDenyMode (allow/deny)\n"
+		"  deny <selector> <tweak>...            prevent tweaks from injecting into the matching processes\n"
+		"  allow <selector> <tweak>...           undo deny / add tweaks to the allow list\n"
+		"  reset <selector>                      remove the configuration of the matching processes\n"
+		"  global-deny <tweak>...                add tweaks to the global deny list\n"
+		"  global-allow <tweak>...               remove tweaks from the global deny list\n"
+		"  tweaks <executable path>              show which tweaks inject into an executable and whether Choicy denies them\n"
+		"  export [<file>]                       export the preferences as JSON (stdout if no file is given)\n"
+		"  import [--merge] <file>               import preferences from JSON\n"
+		"  profile list                          list all profiles, the active one is marked with *\n"
+		"  profile save <name>                   save the current configuration as a profile\n"
+		"  profile activate <name>               activate a profile\n"
+		"  profile deactivate                    go back to the configuration without a profile\n"
+		"  profile delete <name>                 delete a profile\n"
+		"  batch <file>                          run one command per line from a file (- for stdin)\n"
+		"\n"
+		"All changes of one invocation are written once at the end, only if every command succeeded, followed by one reload notification.\n");
+}
+
+static NSString *preferencesPath(void)
+{
+	if (gRootPath) {
+		return [gRootPath stringByAppendingPathComponent:kChoicyPrefsRelativePath];
+	}
+	return kChoicyPrefsPlistPath;
+}
+
+static NSString *rootedPath(NSString *path)
+{
+	if (gRootPath && ![path hasPrefix:gRootPath]) {
+		return [gRootPath stringByAppendingPathComponent:path];
+	}
+	return path;
+}
+
+// Editing happens on choicyctl_value_t (see choicyctl_prefs.h), Foundation is only used to read and write the files
+static void *retainOpaque(void *opaque)
+{
+	return (void *)CFRetain(opaque);
+}
+
+static void releaseOpaque(void *opaque)
+{
+	CFRelease(opaque);
+}
+
+static choicyctl_value_t *valueForObject(id object)
+{
+	if ([object isKindOfClass:[NSNumber class]]) {
+		if (CFGetTypeID((__bridge CFTypeRef)object) == CFBooleanGetTypeID()) return choicyctl_bool_create([object boolValue]);
+		if (CFNumberIsFloatType((__bridge CFNumberRef)object)) return choicyctl_real_create([object doubleValue]);
+		return choicyctl_integer_create([object longLongValue]);
+	}
+	if ([object isKindOfClass:[NSString class]]) {
+		return choicyctl_string_create([object UTF8String]);
+	}
+	if ([object isKindOfClass:[NSArray class]]) {
+		choicyctl_value_t *array = choicyctl_array_create();
+		for (id item in object) {
+			choicyctl_array_append(array, valueForObject(item));
+		}
+		return array;
+	}
+	// Keys of property lists and JSON objects are always strings
+	if ([object isKindOfClass:[NSDictionary class]]) {
+		choicyctl_value_t *dictionary = choicyctl_dictionary_create();
+		[object enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+			choicyctl_dictionary_set(dictionary, key.UTF8String, valueForObject(value));
+		}];
+		return dictionary;
+	}
+	return choicyctl_opaque_create((void *)CFBridgingRetain(object));
+}
+
+static id objectForValue(const choicyctl_value_t *value)
+{
+	if (!value) return nil;
+
+	switch (value->type) {
+		case CHOICYCTL_VALUE_BOOL:
+			return @(value->boolean);
+		case CHOICYCTL_VALUE_INTEGER:
+			return @(value->integer);
+		case CHOICYCTL_VALUE_REAL:
+			return @(value->real);
+		case CHOICYCTL_VALUE_STRING:
+			return [NSString stringWithUTF8String:value->string];
+		case CHOICYCTL_VALUE_ARRAY: {
+			NSMutableArray *array = [NSMutableArray new];
+			for (size_t i = 0; i < value->count; i++) {
+				[array addObject:objectForValue(value->values[i])];
+			}
+			return array.copy;
+		}
+		case CHOICYCTL_VALUE_DICTIONARY: {
+			NSMutableDictionary *dictionary = [NSMutableDictionary new];
+			for (size_t i = 0; i < value->count; i++) {
+				dictionary[[NSString stringWithUTF8String:value->keys[i]]] = objectForValue(value->values[i]);
+			}
+			return dictionary.copy;
+		}
+		default:
+			return (__bridge id)value->opaque;
+	}
+}
+
+static NSMutableDictionary *preferencesObject(void)
+{
+	return [objectForValue(gContext.preferences) mutableCopy];
+}
+
+static void setPreferencesObject(NSDictionary *prefs)
+{
+	choicyctl_value_free(gContext.preferences);
+	gContext.preferences = valueForObject(prefs);
+	gContext.preferences_changed = YES;
+}
+
+static void loadPreferences(void)
+{
+	choicyctl_set_opaque_callbacks(retainOpaque, releaseOpaque);
+	gContext.out = stdout;
+	gContext.err = stderr;
+
+	NSDictionary *prefs = [NSDictionary dictionaryWithContentsOfFile:preferencesPath()];
+	NSMutableDictionary *prefsM = prefs ? [prefs mutableCopy] : [NSMutableDictionary new];
+
+	if ([ChoicyPrefsMigrator preferencesNeedMigration:prefsM]) {
+		[ChoicyPrefsMigrator migratePreferences:prefsM];
+		gContext.preferences_changed = YES;
+	}
+	gContext.preferences = valueForObject(prefsM);
+}
+
+static BOOL savePreferences(void)
+{
+	NSString *path = preferencesPath();
+
+	if (gDryRun) {
+		fprintf(stderr, "Dry run, not writing %s\n", path.fileSystemRepresentation);
+		return YES;
+	}
+
+	NSMutableDictionary *prefs = preferencesObject();
+	[ChoicyPrefsMigrator updatePreferenceVersion:prefs];
+
+	if (![prefs writeToFile:path atomically:YES]) {
+		fprintf(stderr, "Failed to write %s\n", path.fileSystemRepresentation);
+		return NO;
+	}
+
+	// The preference bundle runs as mobile and has to be able to write the file after us, even if we are the ones creating it
+	if (!gRootPath && geteuid() == 0) {
+		if (chown(path.fileSystemRepresentation, 501, 501) != 0) {
+			fprintf(stderr, "Failed to change the owner of %s to mobile: %s\n", path.fileSystemRepresentation, strerror(errno));
+		}
+	}
+
+	// Fixture roots are not read by anything running on the device
+	if (!gRootPath) {
+		CFNotificationCenterPostNotification(CFNotificationCenterGetDarwinNotifyCenter(), CFSTR("com.opa334.choicyprefs/ReloadPrefs"), NULL, NULL, YES);
+	}
+
+	return YES;
+}
+
+static NSString *jsonStringForObject(id object)
+{
+	NSJSONWritingOptions options = NSJSONWritingPrettyPrinted;
+	if (@available(iOS 11, *)) {
+		options |= NSJSONWritingSortedKeys;
+	}
+
+	NSData *data = [NSJSONSerialization dataWithJSONObject:object options:options error:nil];
+	return data ? [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] : nil;
+}
+
+static int commandGet(NSArray<NSString *> *args)
+{
+	if (!args.count) return -1;
+
+	NSMutableDictionary *result = [NSMutableDictionary new];
+	for (NSString *selector in args) {
+		size_t count = 0;
+		char **processes = choicyctl_resolve_selector(&gContext, selector.UTF8String, NO, &count);
+		for (size_t i = 0; i < count; i++) {
+			result[[NSString stringWithUTF8String:processes[i]]] = objectForValue(choicyctl_process_preferences(&gContext, processes[i]));
+		}
+		choicyctl_string_list_free(processes, count);
+	}
+
+	printf("%s\n", jsonStringForObject(result).UTF8String);
+	return 0;
+}
+
+static int commandTweaks(NSArray<NSString *> *args)
+{
+	if (args.count != 1) return -1;
+
+	NSString *executablePath = rootedPath(args[0]);
+	if (![[NSFileManager defaultManager] fileExistsAtPath:executablePath]) {
+		fprintf(stderr, "%s does not exist\n", executablePath.fileSystemRepresentation);
+		return 1;
+	}
+
+	// Same order of checks as should_load_dylib in the tweak
+	// Apps and plugins are configured by bundle identifier, everything else by executable name, both fall back to the rules
+	// Rules match the path on the device, not the one inside the root
+	NSString *devicePath = (gRootPath && [args[0] hasPrefix:gRootPath]) ? [args[0] substringFromIndex:gRootPath.length] : args[0];
+	NSString *bundlePath = executablePath.stringByDeletingLastPathComponent;
+	NSDictionary *prefs = preferencesObject();
+	NSDictionary *processPrefs;
+	NSString *processType = kChoicyRuleProcessTypeDaemon;
+	NSString *bundleIdentifier = nil;
+	if ([bundlePath.pathExtension isEqualToString:@"app"] || [bundlePath.pathExtension isEqualToString:@"appex"]) {
+		NSDictionary *bundleInfo = [NSDictionary dictionaryWithContentsOfFile:[bundlePath stringByAppendingPathComponent:@"Info.plist"]];
+		bundleIdentifier = bundleInfo[@"CFBundleIdentifier"];
+		processType = [bundlePath.pathExtension isEqualToString:@"app"] ? kChoicyRuleProcessTypeApp : kChoicyRuleProcessTypePlugin;
+		processPrefs = processPreferencesForApplication(prefs, bundleIdentifier) ?: processPreferencesForRules(prefs, devicePath, bundleIdentifier, processType);
+	}
+	else {
+		processPrefs = processPreferencesForDaemon(prefs, executablePath.lastPathComponent) ?: processPreferencesForRules(prefs, devicePath, nil, kChoicyRuleProcessTypeDaemon);
+	}
+	if (![processPrefs isKindOfClass:[NSDictionary class]]) processPrefs = nil;
+
+	BOOL customTweakConfigurationEnabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyCustomTweakConfigurationEnabled], NO);
+	BOOL overwriteGlobalTweakConfiguration = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyOverwriteGlobalTweakConfiguration], NO);
+	NSInteger allowDenyMode = parseNumberInteger(processPrefs[kChoicyProcessPrefsKeyAllowDenyMode], 1);
+	NSArray *globalDeniedTweaks = overwriteGlobalTweakConfiguration ? nil : prefs[kChoicyPrefsKeyGlobalDeniedTweaks];
+	NSArray *allowedTweaks = processPrefs[kChoicyProcessPrefsKeyAllowedTweaks];
+	NSArray *deniedTweaks = processPrefs[kChoicyProcessPrefsKeyDeniedTweaks];
+
+	choicy_verdict_process_t process = {
+		.app_bundle_identifier = [processType isEqualToString:kChoicyRuleProcessTypeApp] ? bundleIdentifier.UTF8String : NULL,
+		.tweak_injection_disabled = parseNumberBool(processPrefs[kChoicyProcessPrefsKeyTweakInjectionDisabled], NO),
+		.has_allow_list = customTweakConfigurationEnabled && allowDenyMode == 1 && [allowedTweaks isKindOfClass:[NSArray class]],
+		.has_deny_list = customTweakConfigurationEnabled && allowDenyMode == 2 && [deniedTweaks isKindOfClass:[NSArray class]],
+	};
+
+	for (CHPTweakInfo *tweakInfo in [[CHPTweakList sharedInstance] tweakListForExecutableAtPath:executablePath]) {
+		NSString *dylibName = tweakInfo.dylibName;
+
+		choicy_verdict_tweak_t tweak = {
+			.allowed = [allowedTweaks isKindOfClass:[NSArray class]] && [allowedTweaks containsObject:dylibName],
+			.denied = [deniedTweaks isKindOfClass:[NSArray class]] && [deniedTweaks containsObject:dylibName],
+			.globally_denied = [globalDeniedTweaks isKindOfClass:[NSArray class]] && [globalDeniedTweaks containsObject:dylibName],
+		};
+
+		NSString *state;
+		switch (choicy_tweak_verdict(&process, dylibName.UTF8String, &tweak)) {
+			case CHOICY_VERDICT_CRUCIAL:
+				state = @"loads (crucial for Choicy)";
+				break;
+			case CHOICY_VERDICT_INJECTION_DISABLED:
+				state = @"denied (tweak injection disabled)";
+				break;
+			case CHOICY_VERDICT_GLOBALLY_DENIED:
+				state = @"denied (global deny list)";
+				break;
+			case CHOICY_VERDICT_NOT_ALLOWED:
+				state = @"denied (not on allow list)";
+				break;
+			case CHOICY_VERDICT_DENIED:
+				state = @"denied (on deny list)";
+				break;
+			default:
+				state = @"loads";
+				break;
+		}
+
+		// Choicy itself and the Substrate safe mode are never routed through the hooks
+		if ([kAlwaysInjectGlobal containsObject:dylibName]) {
+			state = @"loads (always injected)";
+		}
+
+		printf("%s\t%s\n", dylibName.UTF8String, state.UTF8String);
+	}
+
+	return 0;
+}
+
+static int commandExport(NSArray<NSString *> *args)
+{
+	if (args.count > 1) return -1;
+
+	NSString *json = jsonStringForObject(objectForValue(gContext.preferences));
+	if (!json) {
+		fprintf(stderr, "Preferences contain values that can't be represented as JSON\n");
+		return 1;
+	}
+
+	if (args.count) {
+		if (![json writeToFile:args[0] atomically:YES encoding:NSUTF8StringEncoding error:nil]) {
+			fprintf(stderr, "Failed to write %s\n", [args[0] fileSystemRepresentation]);
+			return 1;
+		}
+	}
+	else {
+		printf("%s\n", json.UTF8String);
+	}
+
+	return 0;
+}
+
+static int commandImport(NSArray<NSString *> *args)
+{
+	BOOL merge = [args.firstObject isEqualToString:@"--merge"];
+	if (merge) args = [args subarrayWithRange:NSMakeRange(1, args.count - 1)];
+	if (args.count != 1) return -1;
+
+	NSData *data = [args[0] isEqualToString:@"-"] ? [[NSFileHandle fileHandleWithStandardInput] readDataToEndOfFile] : [NSData dataWithContentsOfFile:args[0]];
+	id imported = data ? [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:nil] : nil;
+	if (![imported isKindOfClass:[NSDictionary class]]) {
+		fprintf(stderr, "%s does not contain a JSON object\n", [args[0] fileSystemRepresentation]);
+		return 1;
+	}
+
+	if ([ChoicyPrefsMigrator preferencesNeedMigration:imported]) {
+		[ChoicyPrefsMigrator migratePreferences:imported];
+	}
+
+	return choicyctl_import(&gContext, valueForObject(imported), merge);
+}
+
+static NSString *profileStorePath(void)
+{
+	if (gRootPath) {
+		return [gRootPath stringByAppendingPathComponent:kChoicyProfilesRelativePath];
+	}
+	return kChoicyProfilesPlistPath;
+}
+
+static NSMutableDictionary *profileStore(void)
+{
+	if (!gProfileStore) gProfileStore = [ChoicyProfiles profileStoreAtPath:profileStorePath()];
+	return gProfileStore;
+}
+
+// Written right before the preferences that may name one of its profiles
+static BOOL saveProfileStore(void)
+{
+	NSString *path = profileStorePath();
+
+	if (gDryRun) {
+		fprintf(stderr, "Dry run, not writing %s\n", path.fileSystemRepresentation);
+		return YES;
+	}
+
+	if (![ChoicyProfiles writeProfileStore:gProfileStore toPath:path]) {
+		fprintf(stderr, "Failed to write %s\n", path.fileSystemRepresentation);
+		return NO;
+	}
+
+	if (!gRootPath && geteuid() == 0) {
+		if (chown(path.fileSystemRepresentation, 501, 501) != 0) {
+			fprintf(stderr, "Failed to change the owner of %s to mobile: %s\n", path.fileSystemRepresentation, strerror(errno));
+		}
+	}
+
+	return YES;
+}
+
+static int commandProfile(NSArray<NSString *> *args)
+{
+	NSString *subcommand = args.firstObject;
+	NSString *name = args.count == 2 ? args[1] : nil;
+	NSMutableDictionary *store = profileStore().mutableCopy;
+
+	if ([subcommand isEqualToString:@"list"] && args.count == 1) {
+		NSString *activeProfile = [ChoicyProfiles activeProfileInPreferences:preferencesObject() store:store];
+		for (NSString *profile in [ChoicyProfiles profileNamesInStore:store]) {
+			printf("%s %s\n", [profile isEqualToString:activeProfile] ? "*" : " ", profile.UTF8String);
+		}
+		return 0;
+	}
+
+	// Work on copies, so that a failure leaves both untouched
+	NSMutableDictionary *prefs = preferencesObject();
+	if ([subcommand isEqualToString:@"save"] && name) {
+		[ChoicyProfiles saveCurrentConfigurationAsProfile:name inPreferences:prefs store:store];
+	}
+	else if ([subcommand isEqualToString:@"activate"] && name) {
+		if (![ChoicyProfiles activateProfile:name inPreferences:prefs store:store]) {
+			fprintf(stderr, "No profile named %s\n", name.UTF8String);
+			return 1;
+		}
+	}
+	else if ([subcommand isEqualToString:@"deactivate"] && args.count == 1) {
+		[ChoicyProfiles activateProfile:nil inPreferences:prefs store:store];
+	}
+	else if ([subcommand isEqualToString:@"delete"] && name) {
+		[ChoicyProfiles deleteProfile:name inPreferences:prefs store:store];
+	}
+	else {
+		return -1;
+	}
+
+	gProfileStore = store;
+	gProfileStoreChanged = YES;
+	setPreferencesObject(prefs);
+	return 0;
+}
+
+static int runCommand(NSArray<NSString *> *arguments);
+
+static int runBatchLine(int argc, char *argv[], void *userInfo)
+{
+	NSMutableArray<NSString *> *arguments = [NSMutableArray new];
+	for (int i = 0; i < argc; i++) {
+		[arguments addObject:[NSString stringWithUTF8String:argv[i]]];
+	}
+	return runCommand(arguments);
+}
+
+static int commandBatch(NSArray<NSString *> *args)
+{
+	if (args.count != 1) return -1;
+
+	NSData *data = [args[0] isEqualToString:@"-"] ? [[NSFileHandle fileHandleWithStandardInput] readDataToEndOfFile] : [NSData dataWithContentsOfFile:args[0]];
+	NSString *script = data ? [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] : nil;
+	if (!script) {
+		fprintf(stderr, "Failed to read %s\n", [args[0] fileSystemRepresentation]);
+		return 1;
+	}
+
+	// The core puts the preferences back if a line fails, the profile store has to be put back here
+	NSMutableDictionary *profileStore = gProfileStore;
+	BOOL profileStoreChanged = gProfileStoreChanged;
+	int ret = choicyctl_run_batch(&gContext, script.UTF8String, runBatchLine, NULL);
+	if (ret != 0) {
+		gProfileStore = profileStore;
+		gProfileStoreChanged = profileStoreChanged;
+	}
+	return ret;
+}
+
+static int runCommand(NSArray<NSString *> *arguments)
+{
+	NSString *command = arguments.firstObject;
+	NSArray *args = arguments.count > 1 ? [arguments subarrayWithRange:NSMakeRange(1, arguments.count - 1)] : @[];
+
+	if ([command isEqualToString:@"get"]) return commandGet(args);
+	if ([command isEqualToString:@"tweaks"]) return commandTweaks(args);
+	if ([command isEqualToString:@"export"]) return commandExport(args);
+	if ([command isEqualToString:@"import"]) return commandImport(args);
+	if ([command isEqualToString:@"profile"]) return commandProfile(args);
+	if ([command isEqualToString:@"batch"]) return commandBatch(args);
+
+	// Everything that only edits the preferences lives in the core
+	char *argv[arguments.count + 1];
+	for (NSUInteger i = 0; i < arguments.count; i++) {
+		argv[i] = (char *)arguments[i].UTF8String;
+	}
+	argv[arguments.count] = NULL;
+	return choicyctl_run_command(&gContext, (int)arguments.count, argv);
+}
+
+int main(int argc, char *argv[], char *envp[])
+{
+	@autoreleasepool {
+		NSMutableArray<NSString *> *arguments = [NSMutableArray new];
+		for (int i = 1; i < argc; i++) {
+			[arguments addObject:[NSString stringWithUTF8String:argv[i]]];
+		}
+
+		while (arguments.count && [arguments.firstObject hasPrefix:@"--"]) {
+			NSString *option = arguments.firstObject;
+			[arguments removeObjectAtIndex:0];
+
+			if ([option isEqualToString:@"--root"] && arguments.count) {
+				gRootPath = arguments.firstObject.stringByStandardizingPath;
+				[arguments removeObjectAtIndex:0];
+				[CHPTweakList setRootPath:gRootPath];
+			}
+			else if ([option isEqualToString:@"--dry-run"]) {
+				gDryRun = YES;
+			}
+			else {
+				printUsage();
+				return 1;
+			}
+		}
+
+		if (!arguments.count) {
+			printUsage();
+			return 1;
+		}
+
+		loadPreferences();
+
+		int ret = runCommand(arguments);
+		if (ret == -1) {
+			printUsage();
+			return 1;
+		}
+		if (ret != 0) return ret;
+
+		// Nothing is written unless every command succeeded
+		if (gProfileStoreChanged && !saveProfileStore()) return 1;
+		if (gContext.preferences_changed) {
+			return savePreferences() ? 0 : 1;
+		}
+
+		return 0;
+	}
+}
@@ -3,30 +3,40 @@
 // So what we do instead is compile this C code into assembly with latest clang using gen_asm.sh
 // The right assembly file will then be included in Tweak.s
 
-#include <stdlib.h>
+#include <stddef.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
-extern void *(*dlopen_orig)(const char*, int);
-extern void *(*dyld_dlopen_orig)(const void *, const char*, int);
-
+extern _Atomic bool gHooksPassthrough;
 bool should_load_dylib(const char *dylibPath);
 
-void *dlopen_hook(const char *path, int mode)
+// Fast path, this gets inlined into every trampoline so that the common case never calls into C
+static inline __attribute__((always_inline)) bool path_needs_check(const char *path)
 {
-	if (path) {
-		if (!should_load_dylib(path)) {
-			return NULL;
-		}
-	}
-	__attribute__((musttail)) return dlopen_orig(path, mode);
+	if (!path || atomic_load_explicit(&gHooksPassthrough, memory_order_relaxed)) return false;
+
+	// Nothing on the system volume can be a tweak, this covers almost all framework and plugin loads
+	// Compared byte by byte so that we never read past the end of a short path
+	return !(path[0] == '/' && path[1] == 'S' && path[2] == 'y' && path[3] == 's' && path[4] == 't' && path[5] == 'e' && path[6] == 'm' && path[7] == '/');
 }
 
-void *dyld_dlopen_hook(const void *dyld, const char *path, int mode)
-{
-	if (path) {
-		if (!should_load_dylib(path)) {
-			return NULL;
-		}
+// Every hooked entry point: name, return type, parameters, arguments, return value if the dylib is blocked
+// For every entry, <name>_hook is generated and <name>_orig needs to be defined in Tweak.c
+#define HOOKED_ROUTINES(X) \
+	X(dlopen,           void *, (const char *path, int mode),                             (path, mode),           NULL) \
+	X(dlopen_from,      void *, (const char *path, int mode, void *lr),                   (path, mode, lr),       NULL) \
+	X(dlopen_preflight, bool,   (const char *path),                                       (path),                 false) \
+	X(dyld_dlopen,      void *, (const void *dyld, const char *path, int mode),           (dyld, path, mode),     NULL) \
+	X(dyld_dlopen_from, void *, (const void *dyld, const char *path, int mode, void *lr), (dyld, path, mode, lr), NULL)
+
+#define GENERATE_TRAMPOLINE(name, ret, params, args, blocked) \
+	extern ret (*name##_orig)params; \
+	ret name##_hook params \
+	{ \
+		if (path_needs_check(path) && !should_load_dylib(path)) { \
+			return blocked; \
+		} \
+		__attribute__((musttail)) return name##_orig args; \
 	}
-	__attribute__((musttail)) return dyld_dlopen_orig(dyld, path, mode);
-}
\ No newline at end of file
+
+HOOKED_ROUTINES(GENERATE_TRAMPOLINE)
@@ -1,5 +1,32 @@
-CFLAGS="-isysroot $(xcrun --sdk iphoneos --show-sdk-path) -miphoneos-version-min=8.0"
+# Generates gen.<arch>.s from gen.c, needs a clang recent enough to support __attribute__((musttail))
+# gen.c does not include anything from the SDK, so this also works with a plain clang on Linux
+# Pass --verify to assemble the output again and check that every trampoline from the table ended up in it
 
-clang $CFLAGS -S -arch armv7  gen.c -o gen.armv7.s
-clang $CFLAGS -S -arch arm64  gen.c -o gen.arm64.s
-clang $CFLAGS -S -arch arm64e gen.c -o gen.arm64e.s -fno-ptrauth-abi-version
\ No newline at end of file
+CLANG="${CLANG:-clang}"
+OBJDUMP="${OBJDUMP:-llvm-objdump}"
+NM="${NM:-llvm-nm}"
+
+CFLAGS="-O2"
+if command -v xcrun >/dev/null 2>&1; then
+	CFLAGS="$CFLAGS -isysroot $(xcrun --sdk iphoneos --show-sdk-path)"
+fi
+
+$CLANG $CFLAGS -S -target armv7-apple-ios8.0  gen.c -o gen.armv7.s || exit 1
+$CLANG $CFLAGS -S -target arm64-apple-ios8.0  gen.c -o gen.arm64.s || exit 1
+$CLANG $CFLAGS -S -target arm64e-apple-ios8.0 gen.c -o gen.arm64e.s -fno-ptrauth-abi-version || exit 1
+
+if [ "$1" = "--verify" ]; then
+	TMP_DIR="$(mktemp -d)"
+	HOOKS="$(sed -n 's/^	X(\([a-z_]*\),.*/\1_hook/p' gen.c)"
+	for ARCH in armv7 arm64 arm64e; do
+		$CLANG -c -target $ARCH-apple-ios8.0 gen.$ARCH.s -o "$TMP_DIR/gen.$ARCH.o" || exit 1
+		for HOOK in $HOOKS; do
+			if ! $NM "$TMP_DIR/gen.$ARCH.o" | grep -q " T _$HOOK$"; then
+				echo "gen.$ARCH.s: missing _$HOOK"
+				exit 1
+			fi
+		done
+		$OBJDUMP -d "$TMP_DIR/gen.$ARCH.o"
+	done
+	rm -rf "$TMP_DIR"
+fi
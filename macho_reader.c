@@ -0,0 +1,248 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "macho_reader.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Only the few constants and structures we need, so that this builds without <mach-o/loader.h>
+#define MACHO_MH_MAGIC 0xfeedface
+#define MACHO_MH_MAGIC_64 0xfeedfacf
+#define MACHO_MH_CIGAM 0xcefaedfe
+#define MACHO_MH_CIGAM_64 0xcffaedfe
+#define MACHO_FAT_MAGIC 0xcafebabe
+#define MACHO_FAT_MAGIC_64 0xcafebabf
+
+#define MACHO_LC_REQ_DYLD 0x80000000
+#define MACHO_LC_LOAD_DYLIB 0xc
+#define MACHO_LC_UUID 0x1b
+#define MACHO_LC_LAZY_LOAD_DYLIB 0x20
+#define MACHO_LC_LOAD_WEAK_DYLIB (0x18 | MACHO_LC_REQ_DYLD)
+#define MACHO_LC_RPATH (0x1c | MACHO_LC_REQ_DYLD)
+#define MACHO_LC_REEXPORT_DYLIB (0x1f | MACHO_LC_REQ_DYLD)
+#define MACHO_LC_LOAD_UPWARD_DYLIB (0x23 | MACHO_LC_REQ_DYLD)
+
+// Java class files share the fat magic, real fat binaries never have this many slices
+#define MACHO_FAT_MAX_ARCHS 32
+// Anything bigger is not a sane binary
+#define MACHO_MAX_SIZEOFCMDS (16 * 1024 * 1024)
+
+// Fat headers are big endian, slices are little endian
+static uint32_t read_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t read_be64(const uint8_t *p)
+{
+	return ((uint64_t)read_be32(p) << 32) | read_be32(&p[4]);
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static bool pread_exact(int fd, void *buf, size_t size, uint64_t offset)
+{
+	size_t done = 0;
+	while (done < size) {
+		ssize_t r = pread(fd, (uint8_t *)buf + done, size - done, (off_t)(offset + done));
+		if (r <= 0) return false;
+		done += r;
+	}
+	return true;
+}
+
+static int policy_rank(const macho_slice_policy_t *policy, int32_t cputype, int32_t cpusubtype)
+{
+	if (!policy) return 0;
+	for (size_t i = 0; i < policy->count; i++) {
+		if (policy->types[i].cputype == cputype && policy->types[i].cpusubtype == cpusubtype) return (int)i;
+	}
+	return -1;
+}
+
+bool macho_is_macho_at_path(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	uint8_t header[8];
+	bool isMacho = false;
+	if (pread_exact(fd, header, 4, 0)) {
+		uint32_t magic = read_le32(header);
+		uint32_t fatMagic = read_be32(header);
+		if (magic == MACHO_MH_MAGIC || magic == MACHO_MH_MAGIC_64 || magic == MACHO_MH_CIGAM || magic == MACHO_MH_CIGAM_64) {
+			isMacho = true;
+		}
+		else if ((fatMagic == MACHO_FAT_MAGIC || fatMagic == MACHO_FAT_MAGIC_64) && pread_exact(fd, &header[4], 4, 4)) {
+			uint32_t archCount = read_be32(&header[4]);
+			isMacho = archCount > 0 && archCount <= MACHO_FAT_MAX_ARCHS;
+		}
+	}
+	close(fd);
+	return isMacho;
+}
+
+// Finds the offset of the slice to use
+static int macho_find_slice(int fd, const macho_slice_policy_t *policy, uint64_t *offsetOut)
+{
+	uint8_t header[8];
+	if (!pread_exact(fd, header, sizeof(header), 0)) return -1;
+
+	uint32_t fatMagic = read_be32(header);
+	if (fatMagic != MACHO_FAT_MAGIC && fatMagic != MACHO_FAT_MAGIC_64) {
+		*offsetOut = 0;
+		return 0;
+	}
+
+	uint32_t archCount = read_be32(&header[4]);
+	if (archCount == 0 || archCount > MACHO_FAT_MAX_ARCHS) return -1;
+
+	// fat_arch is 20 bytes, fat_arch_64 is 32 bytes
+	size_t archSize = fatMagic == MACHO_FAT_MAGIC_64 ? 32 : 20;
+	uint8_t archs[MACHO_FAT_MAX_ARCHS * 32];
+	if (!pread_exact(fd, archs, archCount * archSize, sizeof(header))) return -1;
+
+	int bestRank = -1;
+	for (uint32_t i = 0; i < archCount; i++) {
+		const uint8_t *arch = &archs[i * archSize];
+		int rank = policy_rank(policy, (int32_t)read_be32(&arch[0]), (int32_t)read_be32(&arch[4]));
+		if (rank < 0 || (bestRank >= 0 && rank >= bestRank)) continue;
+		bestRank = rank;
+		*offsetOut = fatMagic == MACHO_FAT_MAGIC_64 ? read_be64(&arch[8]) : read_be32(&arch[8]);
+	}
+	return bestRank >= 0 ? 0 : -1;
+}
+
+// lc_str offsets are relative to the start of the load command, the string has to end inside of it
+static const char *load_command_string(const uint8_t *cmd, uint32_t cmdsize, uint32_t strOffsetPos)
+{
+	if (strOffsetPos + 4 > cmdsize) return NULL;
+	uint32_t strOffset = read_le32(&cmd[strOffsetPos]);
+	if (strOffset >= cmdsize) return NULL;
+	if (!memchr(&cmd[strOffset], '\0', cmdsize - strOffset)) return NULL;
+	return (const char *)&cmd[strOffset];
+}
+
+int macho_read_info_fd(int fd, const macho_slice_policy_t *policy, macho_info_t *infoOut)
+{
+	memset(infoOut, 0, sizeof(*infoOut));
+
+	uint64_t sliceOffset = 0;
+	if (macho_find_slice(fd, policy, &sliceOffset) != 0) return -1;
+
+	// mach_header is 28 bytes, mach_header_64 has 4 reserved bytes on top
+	uint8_t header[32];
+	if (!pread_exact(fd, header, 28, sliceOffset)) return -1;
+
+	uint32_t magic = read_le32(header);
+	if (magic != MACHO_MH_MAGIC && magic != MACHO_MH_MAGIC_64) return -1;
+	size_t headerSize = magic == MACHO_MH_MAGIC_64 ? 32 : 28;
+
+	int32_t cputype = (int32_t)read_le32(&header[4]);
+	int32_t cpusubtype = (int32_t)read_le32(&header[8]);
+	uint32_t ncmds = read_le32(&header[16]);
+	uint32_t sizeofcmds = read_le32(&header[20]);
+	if (sizeofcmds > MACHO_MAX_SIZEOFCMDS) return -1;
+
+	// Thin binaries have to match the policy too
+	if (policy_rank(policy, cputype, cpusubtype) < 0) return -1;
+
+	uint8_t *cmds = malloc(sizeofcmds ?: 1);
+	if (!cmds) return -1;
+	if (!pread_exact(fd, cmds, sizeofcmds, sliceOffset + headerSize)) {
+		free(cmds);
+		return -1;
+	}
+
+	// Every load command is at least 8 bytes, so this is an upper bound for both lists
+	uint32_t maxStrings = sizeofcmds / 8;
+	const char **strings = calloc(maxStrings ?: 1, sizeof(const char *) * 2);
+	if (!strings) {
+		free(cmds);
+		return -1;
+	}
+	const char **dylibs = strings;
+	const char **rpaths = &strings[maxStrings];
+
+	infoOut->cputype = cputype;
+	infoOut->cpusubtype = cpusubtype;
+	infoOut->dylibs = dylibs;
+	infoOut->rpaths = rpaths;
+	infoOut->load_commands = cmds;
+
+	uint32_t offset = 0;
+	for (uint32_t i = 0; i < ncmds; i++) {
+		if (offset + 8 > sizeofcmds) break;
+		const uint8_t *cmd = &cmds[offset];
+		uint32_t cmdType = read_le32(&cmd[0]);
+		uint32_t cmdsize = read_le32(&cmd[4]);
+		if (cmdsize < 8 || cmdsize > sizeofcmds - offset) break;
+
+		switch (cmdType) {
+			case MACHO_LC_LOAD_DYLIB:
+			case MACHO_LC_LOAD_WEAK_DYLIB:
+			case MACHO_LC_REEXPORT_DYLIB:
+			case MACHO_LC_LAZY_LOAD_DYLIB:
+			case MACHO_LC_LOAD_UPWARD_DYLIB: {
+				const char *name = load_command_string(cmd, cmdsize, 8);
+				if (name) dylibs[infoOut->dylib_count++] = name;
+				break;
+			}
+			case MACHO_LC_RPATH: {
+				const char *path = load_command_string(cmd, cmdsize, 8);
+				if (path) rpaths[infoOut->rpath_count++] = path;
+				break;
+			}
+			case MACHO_LC_UUID: {
+				if (cmdsize >= 8 + sizeof(infoOut->uuid)) {
+					memcpy(infoOut->uuid, &cmd[8], sizeof(infoOut->uuid));
+					infoOut->has_uuid = true;
+				}
+				break;
+			}
+		}
+
+		offset += cmdsize;
+	}
+
+	return 0;
+}
+
+int macho_read_info(const char *path, const macho_slice_policy_t *policy, macho_info_t *infoOut)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+	int ret = macho_read_info_fd(fd, policy, infoOut);
+	close(fd);
+	return ret;
+}
+
+void macho_info_free(macho_info_t *info)
+{
+	// dylibs is the start of the allocation that also holds rpaths
+	if (info->dylibs) free((void *)info->dylibs);
+	if (info->load_commands) free(info->load_commands);
+	memset(info, 0, sizeof(*info));
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Minimal Mach-O reader that only reads the headers and load commands of the slice it needs instead of the whole binary
+// Only depends on POSIX, so it also works on hosts without the Mach-O headers
+
+#ifndef MACHO_READER_H
+#define MACHO_READER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	int32_t cputype;
+	int32_t cpusubtype;
+} macho_slice_type_t;
+
+// Slice types in order of preference, a slice (including the only one of a thin binary) is only used if it matches one of them exactly
+typedef struct {
+	const macho_slice_type_t *types;
+	size_t count;
+} macho_slice_policy_t;
+
+typedef struct {
+	int32_t cputype;
+	int32_t cpusubtype;
+	bool has_uuid;
+	uint8_t uuid[16];
+
+	// Point into the load commands, which are owned by the info
+	const char **dylibs;
+	uint32_t dylib_count;
+	const char **rpaths;
+	uint32_t rpath_count;
+
+	void *load_commands;
+} macho_info_t;
+
+// Checks the magic, does not validate anything beyond it
+bool macho_is_macho_at_path(const char *path);
+
+// Extracts dependencies, rpaths and the UUID of the preferred slice in one pass, returns 0 on success
+// policy may be NULL to use the first slice
+int macho_read_info(const char *path, const macho_slice_policy_t *policy, macho_info_t *infoOut);
+int macho_read_info_fd(int fd, const macho_slice_policy_t *policy, macho_info_t *infoOut);
+void macho_info_free(macho_info_t *info);
+
+#endif
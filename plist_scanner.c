@@ -0,0 +1,290 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "plist_scanner.h"
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	uint8_t offsetIntSize;
+	uint8_t objectRefSize;
+	uint64_t objectCount;
+	uint64_t offsetTableOffset;
+} bplist_t;
+
+static bool bplist_read_int(const bplist_t *bplist, uint64_t offset, uint8_t intSize, uint64_t *valueOut)
+{
+	if (intSize == 0 || intSize > 8 || offset > bplist->size || intSize > bplist->size - offset) return false;
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < intSize; i++) {
+		value = (value << 8) | bplist->data[offset + i];
+	}
+	*valueOut = value;
+	return true;
+}
+
+static bool bplist_object_offset(const bplist_t *bplist, uint64_t ref, uint64_t *offsetOut)
+{
+	if (ref >= bplist->objectCount) return false;
+	if (!bplist_read_int(bplist, bplist->offsetTableOffset + ref * bplist->offsetIntSize, bplist->offsetIntSize, offsetOut)) return false;
+	return *offsetOut < bplist->size;
+}
+
+// Reads the marker of an object and its length, returns the offset of the object's payload
+static bool bplist_object_header(const bplist_t *bplist, uint64_t offset, uint8_t *typeOut, uint64_t *countOut, uint64_t *payloadOut)
+{
+	uint8_t marker = bplist->data[offset];
+	uint64_t count = marker & 0xF;
+	uint64_t payload = offset + 1;
+	if (count == 0xF) {
+		// Length is stored in a following int object
+		if (payload >= bplist->size || (bplist->data[payload] & 0xF0) != 0x10) return false;
+		uint8_t intSize = 1 << (bplist->data[payload] & 0xF);
+		if (!bplist_read_int(bplist, payload + 1, intSize, &count)) return false;
+		payload += 1 + intSize;
+	}
+	*typeOut = marker & 0xF0;
+	*countOut = count;
+	*payloadOut = payload;
+	return true;
+}
+
+// Returns the ASCII contents of a string object, UTF-16 strings are only accepted if they are ASCII aswell
+static char *bplist_copy_ascii_string(const bplist_t *bplist, uint64_t ref)
+{
+	uint64_t offset, count, payload;
+	uint8_t type;
+	if (!bplist_object_offset(bplist, ref, &offset)) return NULL;
+	if (!bplist_object_header(bplist, offset, &type, &count, &payload)) return NULL;
+
+	if (type == 0x50) {
+		if (payload > bplist->size || count > bplist->size - payload) return NULL;
+		char *string = malloc(count + 1);
+		memcpy(string, &bplist->data[payload], count);
+		string[count] = '\0';
+		return string;
+	}
+	else if (type == 0x60) {
+		if (payload > bplist->size || count > (bplist->size - payload) / 2) return NULL;
+		char *string = malloc(count + 1);
+		for (uint64_t i = 0; i < count; i++) {
+			uint16_t c = (bplist->data[payload + i * 2] << 8) | bplist->data[payload + i * 2 + 1];
+			if (c == 0 || c > 0x7F) {
+				free(string);
+				return NULL;
+			}
+			string[i] = (char)c;
+		}
+		string[count] = '\0';
+		return string;
+	}
+	return NULL;
+}
+
+static bool bplist_string_equals(const bplist_t *bplist, uint64_t ref, const char *string)
+{
+	uint64_t offset, count, payload;
+	uint8_t type;
+	if (!bplist_object_offset(bplist, ref, &offset)) return false;
+	if (!bplist_object_header(bplist, offset, &type, &count, &payload)) return false;
+	if (type != 0x50 || count != strlen(string)) return false;
+	if (payload > bplist->size || count > bplist->size - payload) return false;
+	return !memcmp(&bplist->data[payload], string, count);
+}
+
+static char *bplist_scan_copy_string(const uint8_t *data, size_t size, const char *key)
+{
+	if (size < 8 + 32) return NULL;
+
+	const uint8_t *trailer = &data[size - 32];
+	bplist_t bplist = { .data = data, .size = size, .offsetIntSize = trailer[6], .objectRefSize = trailer[7] };
+	uint64_t topObject;
+	bplist_read_int(&bplist, size - 24, 8, &bplist.objectCount);
+	bplist_read_int(&bplist, size - 16, 8, &topObject);
+	bplist_read_int(&bplist, size - 8, 8, &bplist.offsetTableOffset);
+	if (bplist.offsetTableOffset >= size || bplist.objectCount > size) return NULL;
+
+	uint64_t offset, count, payload;
+	uint8_t type;
+	if (!bplist_object_offset(&bplist, topObject, &offset)) return NULL;
+	if (!bplist_object_header(&bplist, offset, &type, &count, &payload)) return NULL;
+	if (type != 0xD0) return NULL;
+
+	// Dictionaries store all key references followed by all value references
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t keyRef, valueRef;
+		if (!bplist_read_int(&bplist, payload + i * bplist.objectRefSize, bplist.objectRefSize, &keyRef)) return NULL;
+		if (bplist_string_equals(&bplist, keyRef, key)) {
+			if (!bplist_read_int(&bplist, payload + (count + i) * bplist.objectRefSize, bplist.objectRefSize, &valueRef)) return NULL;
+			return bplist_copy_ascii_string(&bplist, valueRef);
+		}
+	}
+	return NULL;
+}
+
+static const char *xml_skip_past(const char *cur, const char *end, const char *terminator)
+{
+	const char *found = memmem(cur, end - cur, terminator, strlen(terminator));
+	return found ? found + strlen(terminator) : NULL;
+}
+
+static bool xml_tag_is(const char *name, size_t nameLength, const char *tag)
+{
+	return nameLength == strlen(tag) && !strncmp(name, tag, nameLength);
+}
+
+// Moves to the next element tag, skipping text, comments, processing instructions and the doctype
+// Returns false at the end of the data or if the scanner can't handle what comes next
+static bool xml_next_tag(const char **curInOut, const char *end, bool *closingOut, bool *selfClosingOut, const char **nameOut, size_t *nameLengthOut)
+{
+	const char *cur = *curInOut;
+	while (true) {
+		cur = memchr(cur, '<', end - cur);
+		if (!cur || end - cur < 2) return false;
+
+		if (cur[1] == '?') {
+			cur = xml_skip_past(cur, end, "?>");
+		}
+		else if (end - cur >= 4 && !strncmp(cur, "<!--", 4)) {
+			cur = xml_skip_past(cur, end, "-->");
+		}
+		else if (end - cur >= 9 && !strncmp(cur, "<![CDATA[", 9)) {
+			// Could hide anything, leave it to the real parser
+			return false;
+		}
+		else if (cur[1] == '!') {
+			cur = xml_skip_past(cur, end, ">");
+		}
+		else {
+			break;
+		}
+		if (!cur) return false;
+	}
+
+	const char *tagEnd = memchr(cur, '>', end - cur);
+	if (!tagEnd) return false;
+
+	bool closing = cur[1] == '/';
+	const char *name = cur + (closing ? 2 : 1);
+	const char *nameEnd = name;
+	while (nameEnd < tagEnd && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\n' && *nameEnd != '\r' && *nameEnd != '/') nameEnd++;
+
+	*closingOut = closing;
+	*selfClosingOut = tagEnd[-1] == '/';
+	*nameOut = name;
+	*nameLengthOut = nameEnd - name;
+	*curInOut = tagEnd + 1;
+	return true;
+}
+
+// Reads the text up to the closing tag, entities would need decoding so those are left to the real parser
+static const char *xml_text_end(const char *cur, const char *end, const char *closingTag)
+{
+	const char *textEnd = memmem(cur, end - cur, closingTag, strlen(closingTag));
+	if (!textEnd || memchr(cur, '&', textEnd - cur) || memchr(cur, '<', textEnd - cur)) return NULL;
+	return textEnd;
+}
+
+static char *xml_plist_scan_copy_string(const char *data, size_t size, const char *key)
+{
+	const char *cur = data;
+	const char *end = data + size;
+	size_t keyLength = strlen(key);
+
+	// Depth of nested dicts and arrays, only keys at depth 1 belong to the top level dictionary
+	int depth = 0;
+	bool closing, selfClosing;
+	const char *name;
+	size_t nameLength;
+	while (xml_next_tag(&cur, end, &closing, &selfClosing, &name, &nameLength)) {
+		bool isContainer = xml_tag_is(name, nameLength, "dict") || xml_tag_is(name, nameLength, "array");
+
+		if (closing) {
+			if (isContainer && --depth == 0) return NULL;
+			continue;
+		}
+
+		if (depth == 0) {
+			if (xml_tag_is(name, nameLength, "plist")) continue;
+			// The top level object has to be a dictionary
+			if (!xml_tag_is(name, nameLength, "dict") || selfClosing) return NULL;
+			depth = 1;
+			continue;
+		}
+
+		if (isContainer) {
+			if (!selfClosing) depth++;
+			continue;
+		}
+
+		if (depth != 1 || selfClosing || !xml_tag_is(name, nameLength, "key")) continue;
+
+		const char *keyEnd = xml_text_end(cur, end, "</key>");
+		if (!keyEnd) return NULL;
+		bool isKey = (size_t)(keyEnd - cur) == keyLength && !strncmp(cur, key, keyLength);
+		cur = keyEnd + strlen("</key>");
+		if (!isKey) continue;
+
+		// The value is the next element
+		if (!xml_next_tag(&cur, end, &closing, &selfClosing, &name, &nameLength)) return NULL;
+		if (closing || !xml_tag_is(name, nameLength, "string")) return NULL;
+		if (selfClosing) return strdup("");
+
+		const char *valueEnd = xml_text_end(cur, end, "</string>");
+		if (!valueEnd) return NULL;
+		return strndup(cur, valueEnd - cur);
+	}
+	return NULL;
+}
+
+char *plist_scan_copy_string(const char *path, const char *key)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	struct stat st = {0};
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return NULL;
+
+	char *value = NULL;
+	if (st.st_size >= 8 && !memcmp(data, "bplist00", 8)) {
+		value = bplist_scan_copy_string(data, st.st_size, key);
+	}
+	else if (memmem(data, st.st_size < 256 ? st.st_size : 256, "<plist", strlen("<plist")) || memmem(data, st.st_size < 256 ? st.st_size : 256, "<?xml", strlen("<?xml"))) {
+		value = xml_plist_scan_copy_string(data, st.st_size, key);
+	}
+
+	munmap(data, st.st_size);
+	return value;
+}
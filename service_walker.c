@@ -0,0 +1,91 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "service_walker.h"
+#include "macho_reader.h"
+#include <dirent.h>
+#include <fts.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool string_has_suffix(const char *str, const char *suffix)
+{
+	size_t strLen = strlen(str);
+	size_t suffixLen = strlen(suffix);
+	return strLen >= suffixLen && !strcmp(str + strLen - suffixLen, suffix);
+}
+
+static void report_xpc_service(FTSENT *entry, service_walker_callback_t callback, void *context)
+{
+	// The executable of Foo.xpc is Foo.xpc/Foo
+	char executablePath[PATH_MAX];
+	int nameLen = (int)(entry->fts_namelen - strlen(".xpc"));
+	if (snprintf(executablePath, sizeof(executablePath), "%s/%.*s", entry->fts_path, nameLen, entry->fts_name) >= (int)sizeof(executablePath)) return;
+	if (access(executablePath, F_OK) == 0) {
+		callback(executablePath, context);
+	}
+}
+
+int service_walker_find_xpc_services(const char *frameworksPath, service_walker_callback_t callback, void *context)
+{
+	char *const roots[] = { (char *)frameworksPath, NULL };
+	// FTS_NOSTAT takes the file type from the directory entry, so only directories are ever stat'ed
+	FTS *fts = fts_open(roots, FTS_PHYSICAL | FTS_NOCHDIR | FTS_NOSTAT, NULL);
+	if (!fts) return -1;
+
+	FTSENT *entry;
+	while ((entry = fts_read(fts)) != NULL) {
+		if (entry->fts_info != FTS_D) continue;
+		if (entry->fts_level == FTS_ROOTLEVEL) continue;
+
+		// Services can also contain services of their own, so keep descending
+		if (string_has_suffix(entry->fts_name, ".xpc")) {
+			report_xpc_service(entry, callback, context);
+		}
+	}
+
+	fts_close(fts);
+	return 0;
+}
+
+int service_walker_find_binaries(const char *directoryPath, const char *suffix, service_walker_callback_t callback, void *context)
+{
+	DIR *dir = opendir(directoryPath);
+	if (!dir) return -1;
+
+	struct dirent *dp;
+	while ((dp = readdir(dir)) != NULL) {
+		if (dp->d_name[0] == '.') continue;
+		if (!string_has_suffix(dp->d_name, suffix)) continue;
+		if (dp->d_type != DT_REG && dp->d_type != DT_LNK && dp->d_type != DT_UNKNOWN) continue;
+
+		char path[PATH_MAX];
+		if (snprintf(path, sizeof(path), "%s/%s", directoryPath, dp->d_name) >= (int)sizeof(path)) continue;
+		if (macho_is_macho_at_path(path)) {
+			callback(path, context);
+		}
+	}
+
+	closedir(dir);
+	return 0;
+}
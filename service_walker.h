@@ -0,0 +1,39 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Finds executables of XPC services and daemon binaries with fts and readdir instead of materializing an NSURL for every file
+// Only depends on POSIX (fts), so it also works on hosts without the Darwin headers
+
+#ifndef SERVICE_WALKER_H
+#define SERVICE_WALKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*service_walker_callback_t)(const char *executablePath, void *context);
+
+// Walks everything below frameworksPath without following symlinks and reports the executable of every .xpc bundle that has one
+// This is the same set the NSDirectoryEnumerator walk used to find, tests/service_walker_test.c compares the two
+int service_walker_find_xpc_services(const char *frameworksPath, service_walker_callback_t callback, void *context);
+
+// Reports every Mach-O file directly inside of directoryPath whose name ends in suffix
+int service_walker_find_binaries(const char *directoryPath, const char *suffix, service_walker_callback_t callback, void *context);
+
+#endif
@@ -0,0 +1,271 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for the plain C core of choicyctl: selector resolution, the commands that edit the preferences, import and batch
+
+#include "../choicyctl/choicyctl_prefs.h"
+#include "test.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static choicyctl_value_t *string_array(const char *first, ...)
+{
+	choicyctl_value_t *array = choicyctl_array_create();
+	va_list args;
+	va_start(args, first);
+	for (const char *string = first; string; string = va_arg(args, const char *)) {
+		choicyctl_array_append(array, choicyctl_string_create(string));
+	}
+	va_end(args);
+	return array;
+}
+
+// Two apps and three daemons, one of the apps is on an allow list and one of the daemons on a deny list
+static choicyctl_value_t *fixture_preferences(void)
+{
+	choicyctl_value_t *prefs = choicyctl_dictionary_create();
+
+	choicyctl_value_t *appSettings = choicyctl_dictionary_create();
+	choicyctl_value_t *safari = choicyctl_dictionary_create();
+	choicyctl_dictionary_set(safari, "customTweakConfigurationEnabled", choicyctl_bool_create(true));
+	choicyctl_dictionary_set(safari, "allowDenyMode", choicyctl_integer_create(1));
+	choicyctl_dictionary_set(safari, "allowedTweaks", string_array("A", "B", NULL));
+	choicyctl_dictionary_set(appSettings, "com.apple.mobilesafari", safari);
+	choicyctl_value_t *mail = choicyctl_dictionary_create();
+	choicyctl_dictionary_set(mail, "tweakInjectionDisabled", choicyctl_bool_create(true));
+	choicyctl_dictionary_set(appSettings, "com.apple.mobilemail", mail);
+	choicyctl_dictionary_set(prefs, "appSettings", appSettings);
+
+	choicyctl_value_t *daemonSettings = choicyctl_dictionary_create();
+	choicyctl_value_t *backboardd = choicyctl_dictionary_create();
+	choicyctl_dictionary_set(backboardd, "customTweakConfigurationEnabled", choicyctl_bool_create(true));
+	choicyctl_dictionary_set(backboardd, "allowDenyMode", choicyctl_integer_create(2));
+	choicyctl_dictionary_set(backboardd, "deniedTweaks", string_array("A", NULL));
+	choicyctl_dictionary_set(daemonSettings, "backboardd", backboardd);
+	choicyctl_dictionary_set(daemonSettings, "assertiond", choicyctl_dictionary_create());
+	choicyctl_dictionary_set(daemonSettings, "com.apple.mobilesafari", choicyctl_dictionary_create());
+	choicyctl_dictionary_set(prefs, "daemonSettings", daemonSettings);
+
+	choicyctl_dictionary_set(prefs, "globalDeniedTweaks", string_array("G", NULL));
+	return prefs;
+}
+
+static void context_reset(choicyctl_context_t *context)
+{
+	choicyctl_value_free(context->preferences);
+	context->preferences = fixture_preferences();
+	context->preferences_changed = false;
+}
+
+static int run(choicyctl_context_t *context, const char *line)
+{
+	char copy[strlen(line) + 1];
+	strcpy(copy, line);
+	char *argv[16];
+	int argc = 0;
+	for (char *token = strtok(copy, " "); token; token = strtok(NULL, " ")) {
+		argv[argc++] = token;
+	}
+	argv[argc] = NULL;
+	return choicyctl_run_command(context, argc, argv);
+}
+
+static bool resolves_to(choicyctl_context_t *context, const char *selector, bool allowCreation, const char *expected)
+{
+	size_t count = 0;
+	char **processes = choicyctl_resolve_selector(context, selector, allowCreation, &count);
+	char joined[1024] = "";
+	for (size_t i = 0; i < count; i++) {
+		if (i) strcat(joined, " ");
+		strcat(joined, processes[i]);
+	}
+	choicyctl_string_list_free(processes, count);
+	if (strcmp(joined, expected)) {
+		fprintf(stderr, "%s resolved to \"%s\", expected \"%s\"\n", selector, joined, expected);
+		return false;
+	}
+	return true;
+}
+
+static const choicyctl_value_t *process_value(choicyctl_context_t *context, const char *process, const char *key)
+{
+	return choicyctl_dictionary_get(choicyctl_process_preferences(context, process), key);
+}
+
+static int run_batch_line(int argc, char *argv[], void *userInfo)
+{
+	return choicyctl_run_command(userInfo, argc, argv);
+}
+
+int main(void)
+{
+	choicyctl_context_t context = { .out = tmpfile(), .err = tmpfile() };
+	context_reset(&context);
+
+	// Selectors, without a kind both kinds are searched, names are sorted
+	EXPECT(resolves_to(&context, "*", false, "app:com.apple.mobilemail app:com.apple.mobilesafari daemon:assertiond daemon:backboardd daemon:com.apple.mobilesafari"));
+	EXPECT(resolves_to(&context, "com.apple.mobilesafari", false, "app:com.apple.mobilesafari daemon:com.apple.mobilesafari"));
+	EXPECT(resolves_to(&context, "app:com.apple.*", false, "app:com.apple.mobilemail app:com.apple.mobilesafari"));
+	EXPECT(resolves_to(&context, "daemon:*d", false, "daemon:assertiond daemon:backboardd"));
+	EXPECT(resolves_to(&context, "daemon:[ab]*", false, "daemon:assertiond daemon:backboardd"));
+	EXPECT(resolves_to(&context, "app:backboardd", false, ""));
+
+	// Only exact names with an explicit kind create new processes
+	EXPECT(resolves_to(&context, "daemon:lsd", true, "daemon:lsd"));
+	EXPECT(resolves_to(&context, "daemon:lsd", false, ""));
+	EXPECT(resolves_to(&context, "lsd", true, ""));
+	EXPECT(resolves_to(&context, "daemon:ls?", true, ""));
+	EXPECT(resolves_to(&context, "daemon:backboardd", true, "daemon:backboardd"));
+
+	// set
+	EXPECT_INT(run(&context, "set daemon:*d tweakInjectionDisabled=true allowDenyMode=deny"), 0);
+	EXPECT(context.preferences_changed);
+	EXPECT(choicyctl_number_bool(process_value(&context, "daemon:assertiond", "tweakInjectionDisabled"), false));
+	EXPECT_INT(choicyctl_number_integer(process_value(&context, "daemon:assertiond", "allowDenyMode"), 0), 2);
+	EXPECT(choicyctl_number_bool(process_value(&context, "daemon:backboardd", "tweakInjectionDisabled"), false));
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "daemon:backboardd", "deniedTweaks"), "A"));
+	EXPECT_INT(run(&context, "set daemon:lsd overwriteGlobalTweakConfiguration=1"), 0);
+	EXPECT(choicyctl_number_bool(process_value(&context, "daemon:lsd", "overwriteGlobalTweakConfiguration"), false));
+	EXPECT_INT(run(&context, "set daemon:lsd allowDenyMode=maybe"), -1);
+	EXPECT_INT(run(&context, "set daemon:lsd tweakInjectionDisabled"), -1);
+	EXPECT_INT(run(&context, "set daemon:lsd a=b=c"), -1);
+	EXPECT_INT(run(&context, "set daemon:lsd"), -1);
+	EXPECT_INT(run(&context, "set daemon:lsd color=red"), 1);
+
+	// deny switches processes without a list to a deny list, on an allow list it takes the tweaks off it
+	context_reset(&context);
+	EXPECT_INT(run(&context, "deny * A C"), 0);
+	EXPECT(!choicyctl_array_contains_string(process_value(&context, "app:com.apple.mobilesafari", "allowedTweaks"), "A"));
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "app:com.apple.mobilesafari", "allowedTweaks"), "B"));
+	EXPECT_INT(choicyctl_number_integer(process_value(&context, "app:com.apple.mobilesafari", "allowDenyMode"), 0), 1);
+	EXPECT(!process_value(&context, "app:com.apple.mobilesafari", "deniedTweaks"));
+	EXPECT(choicyctl_number_bool(process_value(&context, "app:com.apple.mobilemail", "customTweakConfigurationEnabled"), false));
+	EXPECT_INT(choicyctl_number_integer(process_value(&context, "app:com.apple.mobilemail", "allowDenyMode"), 0), 2);
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "app:com.apple.mobilemail", "deniedTweaks"), "C"));
+	EXPECT_INT(process_value(&context, "daemon:backboardd", "deniedTweaks")->count, 2);
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "daemon:backboardd", "deniedTweaks"), "C"));
+	EXPECT_INT(run(&context, "deny daemon:lsd A"), 0);
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "daemon:lsd", "deniedTweaks"), "A"));
+	EXPECT_INT(run(&context, "deny daemon:lsd"), -1);
+
+	// allow undoes deny, adds to an allow list and leaves processes without a custom configuration alone
+	context_reset(&context);
+	EXPECT_INT(run(&context, "allow * A C"), 0);
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "app:com.apple.mobilesafari", "allowedTweaks"), "C"));
+	EXPECT_INT(process_value(&context, "app:com.apple.mobilesafari", "allowedTweaks")->count, 3);
+	EXPECT_INT(process_value(&context, "daemon:backboardd", "deniedTweaks")->count, 0);
+	EXPECT(!process_value(&context, "daemon:assertiond", "allowedTweaks"));
+	EXPECT(!process_value(&context, "app:com.apple.mobilemail", "customTweakConfigurationEnabled"));
+	EXPECT_INT(run(&context, "allow daemon:lsd A"), 0);
+	EXPECT(!choicyctl_process_preferences(&context, "daemon:lsd"));
+
+	// reset and the global deny list
+	context_reset(&context);
+	EXPECT_INT(run(&context, "reset daemon:*d"), 0);
+	EXPECT(resolves_to(&context, "daemon:*", false, "daemon:com.apple.mobilesafari"));
+	EXPECT_INT(run(&context, "reset"), -1);
+	EXPECT_INT(run(&context, "global-deny G H"), 0);
+	EXPECT_INT(choicyctl_dictionary_get(context.preferences, "globalDeniedTweaks")->count, 2);
+	EXPECT_INT(run(&context, "global-allow G"), 0);
+	EXPECT(!choicyctl_array_contains_string(choicyctl_dictionary_get(context.preferences, "globalDeniedTweaks"), "G"));
+	EXPECT(choicyctl_array_contains_string(choicyctl_dictionary_get(context.preferences, "globalDeniedTweaks"), "H"));
+	EXPECT_INT(run(&context, "global-deny"), -1);
+	EXPECT_INT(run(&context, "frobnicate"), -1);
+
+	// list
+	context_reset(&context);
+	FILE *out = context.out;
+	context.out = tmpfile();
+	EXPECT_INT(run(&context, "list"), 0);
+	char listed[1024] = "";
+	rewind(context.out);
+	listed[fread(listed, 1, sizeof(listed) - 1, context.out)] = '\0';
+	EXPECT(!strcmp(listed, "app:com.apple.mobilemail\ttweak injection disabled\napp:com.apple.mobilesafari\tcustom (allow)\ndaemon:assertiond\tdefault\ndaemon:backboardd\tcustom (deny)\ndaemon:com.apple.mobilesafari\tdefault\n"));
+	fclose(context.out);
+	context.out = out;
+
+	// Merging keeps the processes that are not imported, replacing doesn't
+	context_reset(&context);
+	choicyctl_value_t *imported = choicyctl_dictionary_create();
+	choicyctl_value_t *importedDaemons = choicyctl_dictionary_create();
+	choicyctl_value_t *importedLsd = choicyctl_dictionary_create();
+	choicyctl_dictionary_set(importedLsd, "tweakInjectionDisabled", choicyctl_bool_create(true));
+	choicyctl_dictionary_set(importedDaemons, "lsd", importedLsd);
+	choicyctl_dictionary_set(importedDaemons, "backboardd", choicyctl_dictionary_create());
+	choicyctl_dictionary_set(imported, "daemonSettings", importedDaemons);
+	choicyctl_dictionary_set(imported, "globalDeniedTweaks", string_array("I", NULL));
+	EXPECT_INT(choicyctl_import(&context, choicyctl_value_copy(imported), true), 0);
+	EXPECT(context.preferences_changed);
+	EXPECT(resolves_to(&context, "daemon:*", false, "daemon:assertiond daemon:backboardd daemon:com.apple.mobilesafari daemon:lsd"));
+	EXPECT(!process_value(&context, "daemon:backboardd", "deniedTweaks"));
+	EXPECT(choicyctl_number_bool(process_value(&context, "daemon:lsd", "tweakInjectionDisabled"), false));
+	EXPECT(resolves_to(&context, "app:*", false, "app:com.apple.mobilemail app:com.apple.mobilesafari"));
+	EXPECT_INT(choicyctl_dictionary_get(context.preferences, "globalDeniedTweaks")->count, 1);
+	EXPECT(choicyctl_array_contains_string(choicyctl_dictionary_get(context.preferences, "globalDeniedTweaks"), "I"));
+	EXPECT_INT(choicyctl_import(&context, choicyctl_value_copy(imported), false), 0);
+	EXPECT(choicyctl_value_equal(context.preferences, imported));
+	EXPECT_INT(choicyctl_import(&context, string_array("not a dictionary", NULL), false), 1);
+	EXPECT(choicyctl_value_equal(context.preferences, imported));
+	choicyctl_value_free(imported);
+
+	// A batch that fails on any line leaves the preferences as they were
+	context_reset(&context);
+	choicyctl_value_t *before = choicyctl_value_copy(context.preferences);
+	EXPECT_INT(choicyctl_run_batch(&context, "# comment\n\ndeny daemon:lsd A\r\n  global-deny X  \nset daemon:lsd color=red\nreset *\n", run_batch_line, &context), 1);
+	EXPECT(choicyctl_value_equal(context.preferences, before));
+	EXPECT(!context.preferences_changed);
+	EXPECT_INT(choicyctl_run_batch(&context, "reset *\nbatch other\n", run_batch_line, &context), 1);
+	EXPECT(choicyctl_value_equal(context.preferences, before));
+	EXPECT_INT(choicyctl_run_batch(&context, "reset *\nfrobnicate\n", run_batch_line, &context), 1);
+	EXPECT(choicyctl_value_equal(context.preferences, before));
+
+	// Otherwise every line is applied
+	EXPECT_INT(choicyctl_run_batch(&context, "# comment\n\ndeny daemon:lsd A\r\n\tglobal-deny X  \nreset app:*", run_batch_line, &context), 0);
+	EXPECT(context.preferences_changed);
+	EXPECT(choicyctl_array_contains_string(process_value(&context, "daemon:lsd", "deniedTweaks"), "A"));
+	EXPECT(choicyctl_array_contains_string(choicyctl_dictionary_get(context.preferences, "globalDeniedTweaks"), "X"));
+	EXPECT(resolves_to(&context, "app:*", false, ""));
+	choicyctl_value_free(before);
+
+	// Copies are deep and equality doesn't depend on the order of keys
+	choicyctl_value_t *a = choicyctl_dictionary_create();
+	choicyctl_dictionary_set(a, "x", choicyctl_integer_create(1));
+	choicyctl_dictionary_set(a, "y", string_array("z", NULL));
+	choicyctl_value_t *b = choicyctl_dictionary_create();
+	choicyctl_dictionary_set(b, "y", string_array("z", NULL));
+	choicyctl_dictionary_set(b, "x", choicyctl_integer_create(1));
+	EXPECT(choicyctl_value_equal(a, b));
+	choicyctl_value_t *c = choicyctl_value_copy(a);
+	choicyctl_array_append(choicyctl_dictionary_get(c, "y"), choicyctl_string_create("w"));
+	EXPECT(!choicyctl_value_equal(a, c));
+	choicyctl_dictionary_set(c, "y", NULL);
+	EXPECT_INT(c->count, 1);
+	choicyctl_value_t *one = choicyctl_integer_create(1), *yes = choicyctl_bool_create(true);
+	EXPECT(!choicyctl_value_equal(one, yes));
+	choicyctl_value_free(one);
+	choicyctl_value_free(yes);
+	choicyctl_value_free(a);
+	choicyctl_value_free(b);
+	choicyctl_value_free(c);
+
+	choicyctl_value_free(context.preferences);
+	return test_finish("choicyctl_test");
+}
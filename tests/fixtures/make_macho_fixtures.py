@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Regenerates the Mach-O fixtures used by macho_test, the output is checked in so the tests don't need this
+
+import os
+import struct
+
+CPU_TYPE_ARM64 = 0x0100000c
+CPU_SUBTYPE_ARM64_ALL = 0
+CPU_SUBTYPE_ARM64E = 2
+
+LC_REQ_DYLD = 0x80000000
+LC_LOAD_DYLIB = 0xc
+LC_UUID = 0x1b
+LC_LOAD_WEAK_DYLIB = 0x18 | LC_REQ_DYLD
+LC_RPATH = 0x1c | LC_REQ_DYLD
+
+def pad(data, alignment):
+	return data + b'\0' * (-len(data) % alignment)
+
+def dylib_command(cmd, name):
+	body = pad(name.encode() + b'\0', 8)
+	# dylib_command: cmd, cmdsize, name offset, timestamp, current version, compatibility version
+	return struct.pack('<IIIIII', cmd, 24 + len(body), 24, 2, 0x10000, 0x10000) + body
+
+def rpath_command(path):
+	body = pad(path.encode() + b'\0', 8)
+	return struct.pack('<III', LC_RPATH, 12 + len(body), 12) + body
+
+def uuid_command(uuid):
+	return struct.pack('<II', LC_UUID, 24) + uuid
+
+def thin(cpusubtype, commands, sizeofcmdsOverride=None):
+	cmds = b''.join(commands)
+	sizeofcmds = len(cmds) if sizeofcmdsOverride is None else sizeofcmdsOverride
+	# mach_header_64: magic, cputype, cpusubtype, filetype (MH_EXECUTE), ncmds, sizeofcmds, flags, reserved
+	return struct.pack('<IiiIIIII', 0xfeedfacf, CPU_TYPE_ARM64, cpusubtype, 2, len(commands), sizeofcmds, 0, 0) + cmds
+
+def fat(slices):
+	header = struct.pack('>II', 0xcafebabe, len(slices))
+	offset = pad(header + b'\0' * (20 * len(slices)), 64).__len__()
+	archs = b''
+	body = b''
+	for cpusubtype, data in slices:
+		archs += struct.pack('>iiIII', CPU_TYPE_ARM64, cpusubtype, offset + len(body), len(data), 6)
+		body += pad(data, 64)
+	return pad(header + archs, 64) + body
+
+def write(name, data):
+	with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), 'macho', name), 'wb') as f:
+		f.write(data)
+
+write('thin_arm64', thin(CPU_SUBTYPE_ARM64_ALL, [
+	uuid_command(bytes(range(16))),
+	dylib_command(LC_LOAD_DYLIB, '/usr/lib/libSystem.B.dylib'),
+	dylib_command(LC_LOAD_WEAK_DYLIB, '@rpath/Foo.framework/Foo'),
+	rpath_command('@executable_path/Frameworks'),
+]))
+
+write('fat_arm64_arm64e', fat([
+	(CPU_SUBTYPE_ARM64_ALL, thin(CPU_SUBTYPE_ARM64_ALL, [dylib_command(LC_LOAD_DYLIB, '/usr/lib/libarm64.dylib')])),
+	(CPU_SUBTYPE_ARM64E, thin(CPU_SUBTYPE_ARM64E, [dylib_command(LC_LOAD_DYLIB, '/usr/lib/libarm64e.dylib')])),
+]))
+
+# Load commands that claim to be bigger than the file
+write('truncated_arm64', thin(CPU_SUBTYPE_ARM64_ALL, [dylib_command(LC_LOAD_DYLIB, '/usr/lib/libSystem.B.dylib')], sizeofcmdsOverride=4096))
+
+# Java class files share the fat magic, the minor and major version end up where the slice count would be
+write('java.class', struct.pack('>IHH', 0xcafebabe, 0, 52) + b'\0' * 24)
+
+write('not_macho.txt', b'#!/bin/sh\necho "not a Mach-O"\n')
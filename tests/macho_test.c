@@ -0,0 +1,120 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for macho_reader against the fixtures in fixtures/macho (regenerate them with fixtures/make_macho_fixtures.py)
+
+#include "../macho_reader.h"
+#include "test.h"
+#include <string.h>
+
+#define FIXTURE(name) "fixtures/macho/" name
+
+#define CPU_TYPE_ARM64 0x0100000c
+#define CPU_SUBTYPE_ARM64_ALL 0
+#define CPU_SUBTYPE_ARM64E 2
+
+static const macho_slice_type_t kPreferArm64e[] = {
+	{ CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64E },
+	{ CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64_ALL },
+};
+
+static const macho_slice_type_t kArm64eOnly[] = {
+	{ CPU_TYPE_ARM64, CPU_SUBTYPE_ARM64E },
+};
+
+static void test_is_macho(void)
+{
+	EXPECT(macho_is_macho_at_path(FIXTURE("thin_arm64")));
+	EXPECT(macho_is_macho_at_path(FIXTURE("fat_arm64_arm64e")));
+	EXPECT(macho_is_macho_at_path(FIXTURE("truncated_arm64")));
+	EXPECT(!macho_is_macho_at_path(FIXTURE("java.class")));
+	EXPECT(!macho_is_macho_at_path(FIXTURE("not_macho.txt")));
+	EXPECT(!macho_is_macho_at_path(FIXTURE("does_not_exist")));
+}
+
+static void test_thin(void)
+{
+	macho_info_t info;
+	EXPECT_INT(macho_read_info(FIXTURE("thin_arm64"), NULL, &info), 0);
+	EXPECT_INT(info.cputype, CPU_TYPE_ARM64);
+	EXPECT_INT(info.cpusubtype, CPU_SUBTYPE_ARM64_ALL);
+	EXPECT(info.has_uuid);
+	EXPECT_INT(info.uuid[0], 0);
+	EXPECT_INT(info.uuid[15], 15);
+	EXPECT_INT(info.dylib_count, 2);
+	if (info.dylib_count == 2) {
+		EXPECT(!strcmp(info.dylibs[0], "/usr/lib/libSystem.B.dylib"));
+		EXPECT(!strcmp(info.dylibs[1], "@rpath/Foo.framework/Foo"));
+	}
+	EXPECT_INT(info.rpath_count, 1);
+	if (info.rpath_count == 1) {
+		EXPECT(!strcmp(info.rpaths[0], "@executable_path/Frameworks"));
+	}
+	macho_info_free(&info);
+
+	// Thin binaries have to match the policy like every slice of a fat one
+	macho_slice_policy_t policy = { kPreferArm64e, 2 };
+	EXPECT_INT(macho_read_info(FIXTURE("thin_arm64"), &policy, &info), 0);
+	macho_info_free(&info);
+	policy = (macho_slice_policy_t){ kArm64eOnly, 1 };
+	EXPECT_INT(macho_read_info(FIXTURE("thin_arm64"), &policy, &info), -1);
+	macho_info_free(&info);
+}
+
+static void test_fat(void)
+{
+	// Without a policy the first slice is used
+	macho_info_t info;
+	EXPECT_INT(macho_read_info(FIXTURE("fat_arm64_arm64e"), NULL, &info), 0);
+	EXPECT_INT(info.cpusubtype, CPU_SUBTYPE_ARM64_ALL);
+	EXPECT_INT(info.dylib_count, 1);
+	if (info.dylib_count == 1) EXPECT(!strcmp(info.dylibs[0], "/usr/lib/libarm64.dylib"));
+	EXPECT(!info.has_uuid);
+	macho_info_free(&info);
+
+	macho_slice_policy_t policy = { kPreferArm64e, 2 };
+	EXPECT_INT(macho_read_info(FIXTURE("fat_arm64_arm64e"), &policy, &info), 0);
+	EXPECT_INT(info.cpusubtype, CPU_SUBTYPE_ARM64E);
+	EXPECT_INT(info.dylib_count, 1);
+	if (info.dylib_count == 1) EXPECT(!strcmp(info.dylibs[0], "/usr/lib/libarm64e.dylib"));
+	macho_info_free(&info);
+}
+
+static void test_invalid(void)
+{
+	macho_info_t info;
+	EXPECT_INT(macho_read_info(FIXTURE("truncated_arm64"), NULL, &info), -1);
+	macho_info_free(&info);
+	EXPECT_INT(macho_read_info(FIXTURE("java.class"), NULL, &info), -1);
+	macho_info_free(&info);
+	EXPECT_INT(macho_read_info(FIXTURE("not_macho.txt"), NULL, &info), -1);
+	macho_info_free(&info);
+	EXPECT_INT(macho_read_info(FIXTURE("does_not_exist"), NULL, &info), -1);
+	macho_info_free(&info);
+}
+
+int main(void)
+{
+	test_is_macho();
+	test_thin();
+	test_fat();
+	test_invalid();
+	return test_finish("macho_test");
+}
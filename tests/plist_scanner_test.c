@@ -0,0 +1,58 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for plist_scanner against the plists in fixtures/plist, Info.bplist was written by Python's plistlib
+
+#include "../plist_scanner.h"
+#include "test.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FIXTURE(name) "fixtures/plist/" name
+
+static void expect_value(const char *path, const char *key, const char *expected)
+{
+	char *value = plist_scan_copy_string(path, key);
+	if (!value != !expected || (value && strcmp(value, expected))) {
+		fprintf(stderr, "%s: %s is %s, expected %s\n", path, key, value ?: "NULL", expected ?: "NULL");
+		gTestFailures++;
+	}
+	free(value);
+}
+
+int main(void)
+{
+	// Keys of nested dictionaries are never taken for the top level one, no matter where they are
+	expect_value(FIXTURE("nested_first.plist"), "CFBundleIdentifier", "com.example.foo");
+	expect_value(FIXTURE("nested_only.plist"), "CFBundleIdentifier", NULL);
+	expect_value(FIXTURE("nested_first.plist"), "NSExtension", NULL);
+	expect_value(FIXTURE("Info.bplist"), "CFBundleIdentifier", "com.example.foo");
+	expect_value(FIXTURE("Info.bplist"), "CFBundleExecutable", "Foo");
+
+	expect_value(FIXTURE("comments_and_empty_containers.plist"), "CFBundleIdentifier", "com.example.foo");
+
+	// Everything the scanner can't be sure about is left to the real parser
+	expect_value(FIXTURE("entity.plist"), "CFBundleIdentifier", NULL);
+	expect_value(FIXTURE("array_root.plist"), "CFBundleIdentifier", NULL);
+	expect_value(FIXTURE("not_a_string.plist"), "CFBundleIdentifier", NULL);
+	expect_value(FIXTURE("does_not_exist.plist"), "CFBundleIdentifier", NULL);
+
+	return test_finish("plist_scanner_test");
+}
@@ -0,0 +1,312 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for the rule matcher in the Choicy index
+// The rules are compiled the same way as in ChoicyIndexBuilder and every lookup is compared against a plain fnmatch walk over the rules,
+// which is what processPreferencesForRules (Shared.m) and matching_rule_preferences (Tweak.c) do on the plist
+
+#include "../choicy_index.h"
+#include "test.h"
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+	const char *executablePath;
+	const char *bundleIdentifier;
+	const char *processTypes[4]; // NULL terminated, empty = any
+} test_rule_t;
+
+static const test_rule_t kRules[] = {
+	{ "/usr/libexec/*d", NULL, { "daemon" } },
+	{ NULL, "com.apple.mobilesafari", {} },
+	{ "/Applications/*", NULL, { "app" } },
+	{ "/var/containers/Bundle/Application/*", "com.example.*", {} },
+	{ "/usr/sbin/notifyd", NULL, {} },
+	{ NULL, NULL, { "unknown" } }, // Never matches, left out of the index
+	{ "*", NULL, { "plugin" } },
+	{ NULL, "com.apple.[mM]ail", { "app", "plugin" } },
+	{ "/usr/libexec/installd", NULL, {} },
+	{ "/usr/libexec/install?", "", {} }, // An empty selector matches anything
+	{ "/System/Library/*/Frameworks/*.framework/*", NULL, { "daemon", "plugin" } },
+};
+#define RULE_COUNT (sizeof(kRules) / sizeof(kRules[0]))
+
+static const char *kProcessTypeNames[] = { "app", "plugin", "daemon" };
+static const uint32_t kProcessTypes[] = { CHOICY_RULE_PROCESS_TYPE_APP, CHOICY_RULE_PROCESS_TYPE_PLUGIN, CHOICY_RULE_PROCESS_TYPE_DAEMON };
+
+// Same as processPreferencesForRules, returns the position of the first matching rule in kRules
+static int reference_match(const char *executablePath, const char *bundleIdentifier, const char *processTypeName)
+{
+	for (int i = 0; i < (int)RULE_COUNT; i++) {
+		const test_rule_t *rule = &kRules[i];
+		if (rule->processTypes[0]) {
+			bool typeMatches = false;
+			for (int t = 0; rule->processTypes[t]; t++) {
+				if (!strcmp(rule->processTypes[t], processTypeName)) typeMatches = true;
+			}
+			if (!typeMatches) continue;
+		}
+		if (rule->executablePath && *rule->executablePath && !(executablePath && fnmatch(rule->executablePath, executablePath, 0) == 0)) continue;
+		if (rule->bundleIdentifier && *rule->bundleIdentifier && !(bundleIdentifier && fnmatch(rule->bundleIdentifier, bundleIdentifier, 0) == 0)) continue;
+		return i;
+	}
+	return -1;
+}
+
+#define MAX_NODES 256
+#define MAX_REFS 64
+
+static struct {
+	uint8_t data[65536];
+	size_t size;
+	char strings[4096];
+	uint32_t stringsSize;
+	int32_t next[MAX_NODES][256];
+	uint32_t nodeRules[MAX_NODES][MAX_REFS];
+	uint32_t nodeRuleCount[MAX_NODES];
+	uint32_t nodeCount;
+} gBuild;
+
+static uint32_t add_string(const char *str)
+{
+	uint32_t off = gBuild.stringsSize;
+	strcpy(&gBuild.strings[off], str);
+	gBuild.stringsSize += strlen(str) + 1;
+	return off;
+}
+
+static uint32_t add_node(void)
+{
+	memset(gBuild.next[gBuild.nodeCount], 0xff, sizeof(gBuild.next[0]));
+	return gBuild.nodeCount++;
+}
+
+// Same as addPattern in ChoicyIndexBuilder
+static choicy_index_pattern_t add_pattern(const char *pattern, uint32_t root, uint32_t ruleIdx)
+{
+	choicy_index_pattern_t entry = {0};
+	if (!pattern || !*pattern) return entry;
+
+	size_t prefixLength = strcspn(pattern, "*?[\\");
+	entry.pattern_off = add_string(pattern);
+	entry.prefix_length = (uint32_t)prefixLength;
+	if (!pattern[prefixLength]) entry.kind = CHOICY_RULE_PATTERN_LITERAL;
+	else if (!strcmp(&pattern[prefixLength], "*")) entry.kind = CHOICY_RULE_PATTERN_PREFIX;
+	else entry.kind = CHOICY_RULE_PATTERN_GLOB;
+
+	uint32_t node = root;
+	for (size_t i = 0; i < prefixLength; i++) {
+		uint8_t character = (uint8_t)pattern[i];
+		if (gBuild.next[node][character] < 0) gBuild.next[node][character] = add_node();
+		node = gBuild.next[node][character];
+	}
+	gBuild.nodeRules[node][gBuild.nodeRuleCount[node]++] = ruleIdx;
+	return entry;
+}
+
+static void append(const void *bytes, size_t length)
+{
+	memcpy(&gBuild.data[gBuild.size], bytes, length);
+	gBuild.size += length;
+}
+
+// Compiles kRules into an index file, indexRuleOut maps every index rule to its position in kRules
+static void write_index(const char *path, int *indexRuleOut)
+{
+	memset(&gBuild, 0, sizeof(gBuild));
+	add_string("");
+	add_node();
+	add_node();
+
+	choicy_index_rule_t rules[RULE_COUNT];
+	uint32_t ruleCount = 0;
+	for (int i = 0; i < (int)RULE_COUNT; i++) {
+		uint32_t processTypes = 0;
+		if (kRules[i].processTypes[0]) {
+			for (int t = 0; kRules[i].processTypes[t]; t++) {
+				for (int k = 0; k < 3; k++) {
+					if (!strcmp(kRules[i].processTypes[t], kProcessTypeNames[k])) processTypes |= kProcessTypes[k];
+				}
+			}
+			if (!processTypes) continue;
+		}
+		rules[ruleCount] = (choicy_index_rule_t){
+			.path = add_pattern(kRules[i].executablePath, CHOICY_MATCHER_ROOT_PATH, ruleCount),
+			.bundle = add_pattern(kRules[i].bundleIdentifier, CHOICY_MATCHER_ROOT_BUNDLE, ruleCount),
+			.process_types = processTypes,
+			.allow_deny_mode = 1,
+		};
+		indexRuleOut[ruleCount++] = i;
+	}
+
+	choicy_index_header_t header = {
+		.magic = CHOICY_INDEX_MAGIC,
+		.version = CHOICY_INDEX_VERSION,
+		.rule_count = ruleCount,
+		.matcher_node_count = gBuild.nodeCount,
+	};
+	gBuild.size = sizeof(header);
+
+	header.rules_off = (uint32_t)gBuild.size;
+	append(rules, ruleCount * sizeof(choicy_index_rule_t));
+
+	header.matcher_nodes_off = (uint32_t)gBuild.size;
+	uint32_t edgeCount = 0, refCount = 0;
+	for (uint32_t i = 0; i < gBuild.nodeCount; i++) {
+		choicy_index_matcher_node_t node = { .edges_first = edgeCount, .rules_first = refCount, .rule_count = gBuild.nodeRuleCount[i] };
+		for (int c = 0; c < 256; c++) {
+			if (gBuild.next[i][c] >= 0) node.edge_count++;
+		}
+		edgeCount += node.edge_count;
+		refCount += node.rule_count;
+		append(&node, sizeof(node));
+	}
+
+	// Edges of a node are sorted by character
+	header.matcher_edges_off = (uint32_t)gBuild.size;
+	header.matcher_edge_count = edgeCount;
+	for (uint32_t i = 0; i < gBuild.nodeCount; i++) {
+		for (int c = 0; c < 256; c++) {
+			if (gBuild.next[i][c] < 0) continue;
+			choicy_index_matcher_edge_t edge = { .character = (uint8_t)c, .node = (uint32_t)gBuild.next[i][c] };
+			append(&edge, sizeof(edge));
+		}
+	}
+
+	header.matcher_rules_off = (uint32_t)gBuild.size;
+	header.matcher_rule_ref_count = refCount;
+	for (uint32_t i = 0; i < gBuild.nodeCount; i++) {
+		append(gBuild.nodeRules[i], gBuild.nodeRuleCount[i] * sizeof(uint32_t));
+	}
+
+	header.strings_off = (uint32_t)gBuild.size;
+	header.strings_size = gBuild.stringsSize;
+	append(gBuild.strings, gBuild.stringsSize);
+
+	header.size = (uint32_t)gBuild.size;
+	memcpy(gBuild.data, &header, sizeof(header));
+
+	FILE *f = fopen(path, "wb");
+	fwrite(gBuild.data, 1, gBuild.size, f);
+	fclose(f);
+}
+
+static const char *kPaths[] = {
+	NULL,
+	"/usr/libexec/installd",
+	"/usr/libexec/installe",
+	"/usr/libexec/lsd",
+	"/usr/libexec/lsdx",
+	"/usr/sbin/notifyd",
+	"/usr/sbin/notifyd2",
+	"/Applications/MobileSafari.app/MobileSafari",
+	"/Applications",
+	"/var/containers/Bundle/Application/UUID/Example.app/Example",
+	"/var/containers/Bundle/Application",
+	"/System/Library/PrivateFrameworks/Frameworks/Foo.framework/XPCServices/foo",
+	"/System/Library/Frameworks/Foo.framework/foo",
+	"",
+};
+
+static const char *kBundleIdentifiers[] = {
+	NULL,
+	"com.apple.mobilesafari",
+	"com.apple.mobilesafari.extension",
+	"com.apple.mobilemail",
+	"com.apple.mail",
+	"com.apple.Mail",
+	"com.apple.xail",
+	"com.example.app",
+	"com.example",
+	"",
+};
+
+int main(void)
+{
+	char path[] = "/tmp/choicy_rule_matcher_test.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) return 1;
+	close(fd);
+
+	int indexRule[RULE_COUNT];
+	write_index(path, indexRule);
+	choicy_index_t index = {0};
+	EXPECT_INT(choicy_index_map(path, &index), 0);
+	unlink(path);
+	if (!index.header) return test_finish("rule_matcher_test");
+	EXPECT_INT(index.header->rule_count, RULE_COUNT - 1);
+
+	// Every combination of subjects has to pick the same rule as the plain walk
+	for (size_t p = 0; p < sizeof(kPaths) / sizeof(kPaths[0]); p++) {
+		for (size_t b = 0; b < sizeof(kBundleIdentifiers) / sizeof(kBundleIdentifiers[0]); b++) {
+			for (int t = 0; t < 3; t++) {
+				int expected = reference_match(kPaths[p], kBundleIdentifiers[b], kProcessTypeNames[t]);
+				int32_t idx = choicy_index_match_rule(&index, kPaths[p], kBundleIdentifiers[b], kProcessTypes[t]);
+				int actual = idx < 0 ? -1 : indexRule[idx];
+				if (actual != expected) {
+					fprintf(stderr, "%s %s %s: matched rule %d, expected %d\n", kPaths[p] ?: "(null)", kBundleIdentifiers[b] ?: "(null)", kProcessTypeNames[t], actual, expected);
+					gTestFailures++;
+				}
+
+				// The split version that Tweak.c uses has to agree
+				size_t words = choicy_bitset_words(index.header->rule_count);
+				uint64_t pathCandidates[words], bundleCandidates[words];
+				memset(pathCandidates, 0, sizeof(pathCandidates));
+				memset(bundleCandidates, 0, sizeof(bundleCandidates));
+				if (kPaths[p]) choicy_index_rule_candidates(&index, CHOICY_MATCHER_ROOT_PATH, kPaths[p], pathCandidates);
+				if (kBundleIdentifiers[b]) choicy_index_rule_candidates(&index, CHOICY_MATCHER_ROOT_BUNDLE, kBundleIdentifiers[b], bundleCandidates);
+				EXPECT_INT(choicy_index_match_rule_candidates(&index, kPaths[p], pathCandidates, kBundleIdentifiers[b], bundleCandidates, kProcessTypes[t]), idx);
+			}
+		}
+	}
+
+	#define MATCH(executablePath, bundleIdentifier, processType) ({ \
+		int32_t _idx = choicy_index_match_rule(&index, executablePath, bundleIdentifier, processType); \
+		_idx < 0 ? -1 : indexRule[_idx]; \
+	})
+
+	// Globs and exact patterns, the first matching rule wins
+	EXPECT_INT(MATCH("/usr/libexec/installd", NULL, CHOICY_RULE_PROCESS_TYPE_DAEMON), 0);
+	EXPECT_INT(MATCH("/usr/libexec/installd", NULL, CHOICY_RULE_PROCESS_TYPE_APP), 8);
+	EXPECT_INT(MATCH("/usr/libexec/installe", NULL, CHOICY_RULE_PROCESS_TYPE_APP), 9);
+	EXPECT_INT(MATCH("/usr/libexec/lsdx", NULL, CHOICY_RULE_PROCESS_TYPE_DAEMON), -1);
+	EXPECT_INT(MATCH("/usr/sbin/notifyd", NULL, CHOICY_RULE_PROCESS_TYPE_DAEMON), 4);
+	EXPECT_INT(MATCH("/usr/sbin/notifyd2", NULL, CHOICY_RULE_PROCESS_TYPE_DAEMON), -1);
+
+	// Bundle identifiers and paths
+	EXPECT_INT(MATCH("/Applications/MobileSafari.app/MobileSafari", "com.apple.mobilesafari", CHOICY_RULE_PROCESS_TYPE_APP), 1);
+	EXPECT_INT(MATCH("/Applications/MobileSafari.app/MobileSafari", NULL, CHOICY_RULE_PROCESS_TYPE_APP), 2);
+	EXPECT_INT(MATCH(NULL, "com.apple.mobilesafari.extension", CHOICY_RULE_PROCESS_TYPE_APP), -1);
+	EXPECT_INT(MATCH("/var/containers/Bundle/Application/UUID/Example.app/Example", "com.example.app", CHOICY_RULE_PROCESS_TYPE_APP), 3);
+	EXPECT_INT(MATCH("/var/containers/Bundle/Application/UUID/Example.app/Example", "com.example", CHOICY_RULE_PROCESS_TYPE_APP), -1);
+	EXPECT_INT(MATCH(NULL, "com.example.app", CHOICY_RULE_PROCESS_TYPE_APP), -1);
+	EXPECT_INT(MATCH(NULL, "com.apple.Mail", CHOICY_RULE_PROCESS_TYPE_APP), 7);
+
+	// Process type filters
+	EXPECT_INT(MATCH(NULL, "com.apple.mail", CHOICY_RULE_PROCESS_TYPE_DAEMON), -1);
+	EXPECT_INT(MATCH("/usr/libexec/lsd", NULL, CHOICY_RULE_PROCESS_TYPE_APP), -1);
+	EXPECT_INT(MATCH("/usr/libexec/lsd", NULL, CHOICY_RULE_PROCESS_TYPE_PLUGIN), 6);
+	EXPECT_INT(MATCH(NULL, "com.apple.mail", CHOICY_RULE_PROCESS_TYPE_PLUGIN), 7);
+
+	choicy_index_unmap(&index);
+	return test_finish("rule_matcher_test");
+}
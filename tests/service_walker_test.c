@@ -0,0 +1,171 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for service_walker, builds a fixture tree and compares the walker against a port of the NSDirectoryEnumerator walk it replaced
+
+#include "../service_walker.h"
+#include "test.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+	char *paths[64];
+	size_t count;
+} path_list_t;
+
+static void collect_path(const char *path, void *context)
+{
+	path_list_t *list = context;
+	if (list->count < sizeof(list->paths) / sizeof(list->paths[0])) list->paths[list->count++] = strdup(path);
+}
+
+static int compare_strings(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void path_list_free(path_list_t *list)
+{
+	for (size_t i = 0; i < list->count; i++) free(list->paths[i]);
+	list->count = 0;
+}
+
+// Every file and directory is enumerated without following symlinks, every entry ending in .xpc whose executable exists is reported
+static void reference_walk(const char *path, path_list_t *list)
+{
+	DIR *dir = opendir(path);
+	if (!dir) return;
+
+	struct dirent *dp;
+	while ((dp = readdir(dir)) != NULL) {
+		if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+
+		char childPath[PATH_MAX];
+		if (snprintf(childPath, sizeof(childPath), "%s/%s", path, dp->d_name) >= (int)sizeof(childPath)) continue;
+
+		size_t nameLen = strlen(dp->d_name);
+		if (nameLen >= 4 && !strcmp(&dp->d_name[nameLen - 4], ".xpc")) {
+			char executablePath[PATH_MAX];
+			if (snprintf(executablePath, sizeof(executablePath), "%s/%.*s", childPath, (int)(nameLen - 4), dp->d_name) < (int)sizeof(executablePath) &&
+				access(executablePath, F_OK) == 0) {
+				collect_path(executablePath, list);
+			}
+		}
+
+		struct stat st;
+		if (lstat(childPath, &st) == 0 && S_ISDIR(st.st_mode)) {
+			reference_walk(childPath, list);
+		}
+	}
+	closedir(dir);
+}
+
+static void make_dirs(const char *root, const char *relativePath)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", root, relativePath);
+	for (char *slash = &path[strlen(root) + 1]; (slash = strchr(slash, '/')); slash++) {
+		*slash = '\0';
+		mkdir(path, 0755);
+		*slash = '/';
+	}
+	mkdir(path, 0755);
+}
+
+static void make_file(const char *root, const char *relativePath)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", root, relativePath);
+	char *slash = strrchr(path, '/');
+	*slash = '\0';
+	make_dirs(root, &path[strlen(root) + 1]);
+	*slash = '/';
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+	if (fd >= 0) close(fd);
+}
+
+static void make_symlink(const char *root, const char *target, const char *relativePath)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", root, relativePath);
+	symlink(target, path);
+}
+
+static void build_fixture_tree(const char *root)
+{
+	// The usual places
+	make_file(root, "Foo.framework/XPCServices/FooService.xpc/FooService");
+	make_file(root, "Bar.framework/Versions/A/XPCServices/BarService.xpc/BarService");
+	make_symlink(root, "A", "Bar.framework/Versions/Current");
+	make_file(root, "Baz.framework/Frameworks/Nested.framework/XPCServices/NestedService.xpc/NestedService");
+
+	// Places a walk that only looks inside of frameworks would miss
+	make_file(root, "Foo.framework/Resources/ResourceService.xpc/ResourceService");
+	make_file(root, "Loose.xpc/Loose");
+	make_file(root, "Folder/Deep/DeepService.xpc/DeepService");
+	make_file(root, "Foo.framework/XPCServices/FooService.xpc/Contents/XPCServices/Inner.xpc/Inner");
+
+	// Not services
+	make_dirs(root, "Foo.framework/XPCServices/Empty.xpc");
+	make_file(root, "Foo.framework/NotADirectory.xpc");
+	make_symlink(root, "../Foo.framework", "Folder/Link.framework");
+}
+
+int main(void)
+{
+	char root[] = "/tmp/choicy_service_walker_XXXXXX";
+	if (!mkdtemp(root)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	build_fixture_tree(root);
+
+	path_list_t walked = { 0 }, reference = { 0 };
+	EXPECT_INT(service_walker_find_xpc_services(root, collect_path, &walked), 0);
+	reference_walk(root, &reference);
+
+	qsort(walked.paths, walked.count, sizeof(char *), compare_strings);
+	qsort(reference.paths, reference.count, sizeof(char *), compare_strings);
+
+	EXPECT_INT(reference.count, 7);
+	EXPECT_INT(walked.count, reference.count);
+	for (size_t i = 0; i < walked.count && i < reference.count; i++) {
+		if (strcmp(walked.paths[i], reference.paths[i])) {
+			fprintf(stderr, "walker found %s, reference found %s\n", walked.paths[i], reference.paths[i]);
+			gTestFailures++;
+		}
+	}
+
+	path_list_free(&walked);
+	path_list_free(&reference);
+	EXPECT_INT(service_walker_find_xpc_services("/does/not/exist", collect_path, &walked), 0);
+	EXPECT_INT(walked.count, 0);
+
+	char command[PATH_MAX + 16];
+	snprintf(command, sizeof(command), "rm -rf '%s'", root);
+	system(command);
+
+	return test_finish("service_walker_test");
+}
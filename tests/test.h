@@ -0,0 +1,51 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Minimal assertion helpers for the host tests, these only cover the plain C parts of Choicy
+
+#ifndef CHOICY_TEST_H
+#define CHOICY_TEST_H
+
+#include <stdio.h>
+
+static int gTestFailures = 0;
+
+#define EXPECT(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #cond); \
+		gTestFailures++; \
+	} \
+} while (0)
+
+#define EXPECT_INT(actual, expected) do { \
+	long long _actual = (long long)(actual), _expected = (long long)(expected); \
+	if (_actual != _expected) { \
+		fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _actual, _expected); \
+		gTestFailures++; \
+	} \
+} while (0)
+
+static inline int test_finish(const char *name)
+{
+	printf("%s: %s\n", name, gTestFailures ? "FAILED" : "passed");
+	return gTestFailures ? 1 : 0;
+}
+
+#endif
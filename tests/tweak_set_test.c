@@ -0,0 +1,102 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for encoding and decoding tweak sets, the allow / deny list overrides that SpringBoard passes through the environment
+
+#include "../choicy_index.h"
+#include "test.h"
+#include <string.h>
+
+// Encoding and decoding only look at the tweak table in the header
+static choicy_index_t index_with_tweaks(choicy_index_header_t *header, uint32_t tweakCount, uint64_t tweaksGeneration)
+{
+	memset(header, 0, sizeof(*header));
+	header->tweak_count = tweakCount;
+	header->bitset_words = choicy_bitset_words(tweakCount);
+	header->tweaks_generation = tweaksGeneration;
+	return (choicy_index_t){ .header = header, .size = sizeof(*header) };
+}
+
+int main(void)
+{
+	choicy_index_header_t header;
+	choicy_index_t index = index_with_tweaks(&header, 130, 0x2a);
+
+	// Round trip through all three words
+	uint64_t bits[3] = {0};
+	choicy_bitset_set(bits, 0);
+	choicy_bitset_set(bits, 5);
+	choicy_bitset_set(bits, 64);
+	choicy_bitset_set(bits, 129);
+	char encoded[19 + 3 * 16];
+	size_t len = choicy_tweak_set_encode(&index, bits, encoded, sizeof(encoded));
+	EXPECT_INT(len, strlen(encoded));
+	EXPECT(encoded[0] == CHOICY_TWEAK_SET_PREFIX);
+	EXPECT(!strncmp(encoded, "/2a:", 4));
+
+	uint64_t decoded[3] = { ~0ull, ~0ull, ~0ull };
+	EXPECT(choicy_tweak_set_decode(&index, encoded, decoded, 3));
+	EXPECT(!memcmp(bits, decoded, sizeof(bits)));
+
+	// Trailing zeros are omitted, so the empty set has no bits at all
+	uint64_t empty[3] = {0};
+	EXPECT_INT(choicy_tweak_set_encode(&index, empty, encoded, sizeof(encoded)), 4);
+	EXPECT(!strcmp(encoded, "/2a:"));
+	EXPECT(choicy_tweak_set_decode(&index, encoded, decoded, 3));
+	EXPECT(!memcmp(empty, decoded, sizeof(empty)));
+
+	// A set encoded for another tweak table is rejected
+	choicy_tweak_set_encode(&index, bits, encoded, sizeof(encoded));
+	choicy_index_header_t otherHeader;
+	choicy_index_t otherIndex = index_with_tweaks(&otherHeader, 130, 0x2b);
+	EXPECT(!choicy_tweak_set_decode(&otherIndex, encoded, decoded, 3));
+
+	// So is a set with bits beyond the tweak table, or one that doesn't fit into the output
+	choicy_index_t smallerIndex = index_with_tweaks(&otherHeader, 100, 0x2a);
+	EXPECT(!choicy_tweak_set_decode(&smallerIndex, encoded, decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, encoded, decoded, 2));
+
+	// Buffers that are too small fail instead of truncating
+	for (size_t size = 0; size <= len; size++) {
+		char small[sizeof(encoded)];
+		EXPECT_INT(choicy_tweak_set_encode(&index, bits, small, size), 0);
+	}
+	EXPECT_INT(choicy_tweak_set_encode(&index, bits, encoded, len + 1), len);
+
+	// Truncated strings
+	EXPECT(!choicy_tweak_set_decode(&index, "/", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/2a", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/:21", decoded, 3));
+
+	// Malformed strings
+	EXPECT(!choicy_tweak_set_decode(&index, "2a:21", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/2g:21", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/2a:2x", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/2a:21:", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/00000000000000002a:21", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, "/2a:21/Tweak", decoded, 3));
+	EXPECT(!choicy_tweak_set_decode(&index, NULL, decoded, 3));
+
+	// Upper case digits are accepted
+	EXPECT(choicy_tweak_set_decode(&index, "/2A:1F", decoded, 3));
+	EXPECT_INT(decoded[0], 0xf1);
+
+	return test_finish("tweak_set_test");
+}
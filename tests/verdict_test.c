@@ -0,0 +1,62 @@
+// Copyright (c) 2019-2021 Lars Fröder
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Host test for the tweak verdict shared by the Choicy dylib and choicyctl
+
+#include "../choicy_verdict.h"
+#include "test.h"
+
+static int verdict(const char *app, bool disabled, bool hasAllowList, bool hasDenyList, const char *dylibName, bool allowed, bool denied, bool globallyDenied)
+{
+	choicy_verdict_process_t process = { app, disabled, hasAllowList, hasDenyList };
+	choicy_verdict_tweak_t tweak = { allowed, denied, globallyDenied };
+	return choicy_tweak_verdict(&process, dylibName, &tweak);
+}
+
+int main(void)
+{
+	// Crucial tweaks win over everything, but only in the app that needs them
+	EXPECT_INT(verdict("com.apple.Preferences", true, true, false, "PreferenceLoader", false, false, true), CHOICY_VERDICT_CRUCIAL);
+	EXPECT_INT(verdict("com.apple.Preferences", false, true, false, "preferred", false, false, false), CHOICY_VERDICT_CRUCIAL);
+	EXPECT_INT(verdict("com.apple.springboard", true, false, false, "ChoicySB", false, false, false), CHOICY_VERDICT_CRUCIAL);
+	EXPECT_INT(verdict("com.apple.springboard", true, false, false, "PreferenceLoader", false, false, false), CHOICY_VERDICT_INJECTION_DISABLED);
+	EXPECT_INT(verdict(NULL, true, false, false, "ChoicySB", false, false, false), CHOICY_VERDICT_INJECTION_DISABLED);
+
+	// Order: injection disabled, global deny list, allow list, deny list
+	EXPECT_INT(verdict("com.example.app", true, false, false, "Tweak", false, false, true), CHOICY_VERDICT_INJECTION_DISABLED);
+	EXPECT_INT(verdict("com.example.app", false, true, false, "Tweak", true, false, true), CHOICY_VERDICT_GLOBALLY_DENIED);
+	EXPECT_INT(verdict("com.example.app", false, true, false, "Tweak", false, false, false), CHOICY_VERDICT_NOT_ALLOWED);
+	EXPECT_INT(verdict("com.example.app", false, true, false, "Tweak", true, false, false), CHOICY_VERDICT_ALLOWED);
+	EXPECT_INT(verdict("com.example.app", false, false, true, "Tweak", false, true, false), CHOICY_VERDICT_DENIED);
+	EXPECT_INT(verdict("com.example.app", false, false, true, "Tweak", false, false, false), CHOICY_VERDICT_ALLOWED);
+
+	// List membership only counts if the process uses that list
+	EXPECT_INT(verdict("com.example.app", false, false, false, "Tweak", false, true, false), CHOICY_VERDICT_ALLOWED);
+	EXPECT_INT(verdict(NULL, false, false, false, "Tweak", false, false, false), CHOICY_VERDICT_ALLOWED);
+
+	EXPECT(choicy_verdict_allows_loading(CHOICY_VERDICT_ALLOWED));
+	EXPECT(choicy_verdict_allows_loading(CHOICY_VERDICT_CRUCIAL));
+	EXPECT(!choicy_verdict_allows_loading(CHOICY_VERDICT_INJECTION_DISABLED));
+	EXPECT(!choicy_verdict_allows_loading(CHOICY_VERDICT_GLOBALLY_DENIED));
+	EXPECT(!choicy_verdict_allows_loading(CHOICY_VERDICT_NOT_ALLOWED));
+	EXPECT(!choicy_verdict_allows_loading(CHOICY_VERDICT_DENIED));
+
+	return test_finish("verdict_test");
+}